@@ -26,6 +26,8 @@ public class Bluelua : ModuleRules
 			new string[]
 			{
 				"Core",
+				// LuaBinder.h uses the lua api inline
+				"Liblua",
 				// ... add other public dependencies that you statically link with here ...
 			}
 		);
@@ -39,7 +41,6 @@ public class Bluelua : ModuleRules
 				"UMG",
 				"Slate",
 				// ... add private dependencies that you statically link with here ...	
-				"Liblua",
 				"LibLuasocket",
 				"LuaPanda",
 			}
@@ -2,28 +2,67 @@
 
 #include "Bluelua.h"
 
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+
 #include "LuaState.h"
+#include "LuaLog.h"
 #include "LuaObjectBase.h"
+#include "LuaWorkerPool.h"
 
 #define LOCTEXT_NAMESPACE "FBlueluaModule"
 
 DEFINE_LOG_CATEGORY(LogBluelua);
 
+DECLARE_CYCLE_STAT(TEXT("LuaStateCreate"), STAT_LuaStateCreate, STATGROUP_Bluelua);
+
+static TAutoConsoleVariable<int32> CVarLuaStatePoolSize(
+	TEXT("bluelua.StatePool.Size"),
+	1,
+	TEXT("Number of lua states prepared ahead of time so restarting PIE or a match gets one without waiting, 0 creates them on demand. Outside the editor the pool only fills once a state has been reset."));
+
+static TAutoConsoleVariable<float> CVarLuaStatePoolRefillDelay(
+	TEXT("bluelua.StatePool.RefillDelay"),
+	5.f,
+	TEXT("Seconds to wait after a lua state is taken before the pool builds a new one, so the first frames of PIE or a match don't pay for it."));
+
 void FBlueluaModule::StartupModule()
 {
 	FLuaObjectBase::Init();
+
+	// commandlets create their states on demand
+	if (!IsRunningCommandlet())
+	{
+		PrepareTickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FBlueluaModule::PrepareLuaStates));
+	}
 }
 
 void FBlueluaModule::ShutdownModule()
 {
+	if (PrepareTickerHandle.IsValid())
+	{
+		FTicker::GetCoreTicker().RemoveTicker(PrepareTickerHandle);
+		PrepareTickerHandle.Reset();
+	}
+
+	PreparedLuaStates.Reset();
+
 	ResetDefaultLuaState();
+
+	if (WorkerPool.IsValid())
+	{
+		WorkerPool->Shutdown();
+		WorkerPool.Reset();
+	}
+
+	FLuaLog::Shutdown();
 }
 
 TSharedPtr<FLuaState> FBlueluaModule::GetDefaultLuaState()
 {
 	if (!DefaultLuaState.IsValid())
 	{
-		DefaultLuaState = MakeShared<FLuaState>();
+		DefaultLuaState = CreateLuaState();
 	}
 
 	return DefaultLuaState;
@@ -31,9 +70,75 @@ TSharedPtr<FLuaState> FBlueluaModule::GetDefaultLuaState()
 
 void FBlueluaModule::ResetDefaultLuaState()
 {
+	if (DefaultLuaState.IsValid())
+	{
+		bLuaStateReset = true;
+	}
+
 	DefaultLuaState.Reset();
 }
 
+TSharedPtr<FLuaState> FBlueluaModule::CreateLuaState()
+{
+	LastStateTakenTime = FPlatformTime::Seconds();
+
+	if (PreparedLuaStates.Num() > 0)
+	{
+		return PreparedLuaStates.Pop(false);
+	}
+
+	return BuildLuaState(TEXT("on demand"));
+}
+
+bool FBlueluaModule::PrepareLuaStates(float DeltaTime)
+{
+	// games never restart without resetting a state first, so don't keep an idle one around for nothing
+	if (!GIsEditor && !bLuaStateReset)
+	{
+		return true;
+	}
+
+	if (PreparedLuaStates.Num() < CVarLuaStatePoolSize.GetValueOnGameThread())
+	{
+		// whoever took the last state is still starting up
+		if (FPlatformTime::Seconds() - LastStateTakenTime < CVarLuaStatePoolRefillDelay.GetValueOnGameThread())
+		{
+			return true;
+		}
+
+		PreparedLuaStates.Add(BuildLuaState(TEXT("prepared")));
+	}
+	else if (PreparedLuaStates.Num() > FMath::Max(CVarLuaStatePoolSize.GetValueOnGameThread(), 0))
+	{
+		PreparedLuaStates.Pop(false);
+	}
+
+	return true;
+}
+
+TSharedPtr<FLuaState> FBlueluaModule::BuildLuaState(const TCHAR* Reason)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaStateCreate);
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	TSharedPtr<FLuaState> LuaState = MakeShared<FLuaState>(IsRunningDedicatedServer() ? ELuaStateProfile::Server : ELuaStateProfile::Game);
+
+	UE_LOG(LogBluelua, Display, TEXT("Lua state %s in %.2f ms."), Reason, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+
+	return LuaState;
+}
+
+TSharedRef<FLuaWorkerPool, ESPMode::ThreadSafe> FBlueluaModule::GetWorkerPool()
+{
+	if (!WorkerPool.IsValid())
+	{
+		WorkerPool = MakeShared<FLuaWorkerPool, ESPMode::ThreadSafe>();
+	}
+
+	return WorkerPool.ToSharedRef();
+}
+
 #undef LOCTEXT_NAMESPACE
 	
 IMPLEMENT_MODULE(FBlueluaModule, Bluelua)
\ No newline at end of file
@@ -9,7 +9,38 @@
 #include "LatentActions.h"
 #include "Misc/Guid.h"
 
+#include "Bluelua.h"
+#include "LuaChunkCache.h"
+#include "LuaDelegateDispatcher.h"
 #include "LuaFunctionDelegate.h"
+#include "LuaState.h"
+
+// releases the lua binding it calls once the action is done or aborted
+class FBlueluaDelayAction : public FDelayAction
+{
+public:
+	FBlueluaDelayAction(float Duration, ULuaDelegateDispatcher* InDispatcher, int32 InSlot)
+		: FDelayAction(Duration, FLatentActionInfo())
+		, Dispatcher(InDispatcher)
+		, Slot(InSlot)
+		, Serial(InDispatcher->GetBindingSerial(InSlot))
+	{
+	}
+
+	virtual ~FBlueluaDelayAction()
+	{
+		ULuaDelegateDispatcher* DelegateDispatcher = Dispatcher.Get();
+		if (DelegateDispatcher && DelegateDispatcher->IsBindingValid(Slot) && DelegateDispatcher->GetBindingSerial(Slot) == Serial)
+		{
+			DelegateDispatcher->ReleaseBinding(Slot);
+		}
+	}
+
+private:
+	TWeakObjectPtr<ULuaDelegateDispatcher> Dispatcher;
+	int32 Slot;
+	uint32 Serial;
+};
 
 UObject* UBlueluaLibrary::GetWorldContext()
 {
@@ -23,6 +54,11 @@ UObject* UBlueluaLibrary::GetWorldContext()
 
 int32 UBlueluaLibrary::Delay(UObject* WorldContextObject, float Duration, int32 InDelegateId, class ULuaFunctionDelegate* InDelegate)
 {
+	if (!InDelegate)
+	{
+		return -1;
+	}
+
 	if (UWorld* World = GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull))
 	{
 		const int32 DelegateUUID = InDelegateId >= 0 ? InDelegateId : GetTypeHash(FGuid::NewGuid());
@@ -44,6 +80,59 @@ int32 UBlueluaLibrary::Delay(UObject* WorldContextObject, float Duration, int32
 	return -1;
 }
 
+int32 UBlueluaLibrary::DelayBinding(UObject* WorldContextObject, float Duration, FBlueluaDelayDelegate InDelegate)
+{
+	UObject* CallbackTarget = InDelegate.GetUObject();
+	if (!CallbackTarget)
+	{
+		return -1;
+	}
+
+	// the delay owns a lua binding passed to it
+	ULuaDelegateDispatcher* Dispatcher = Cast<ULuaDelegateDispatcher>(CallbackTarget);
+	const int32 Slot = Dispatcher ? ULuaDelegateDispatcher::GetBindingSlot(InDelegate.GetFunctionName()) : INDEX_NONE;
+
+	int32 DelegateUUID = -1;
+	bool bActionAdded = false;
+
+	if (UWorld* World = GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull))
+	{
+		// a binding slot is reused with a new serial, so slot and serial tell every lua delay on the same context apart
+		DelegateUUID = (Slot != INDEX_NONE)
+			? (int32)HashCombine(GetTypeHash(Slot), Dispatcher->GetBindingSerial(Slot))
+			: (int32)HashCombine(GetTypeHash(CallbackTarget), GetTypeHash(InDelegate.GetFunctionName()));
+
+		// lua bindings share one dispatcher object, actions are kept on the world context
+		FLatentActionManager& LatentActionManager = World->GetLatentActionManager();
+		if (LatentActionManager.FindExistingAction<FDelayAction>(WorldContextObject, DelegateUUID) == NULL)
+		{
+			FDelayAction* DelayAction = (Slot != INDEX_NONE) ? new FBlueluaDelayAction(Duration, Dispatcher, Slot) : new FDelayAction(Duration, FLatentActionInfo());
+			DelayAction->ExecutionFunction = InDelegate.GetFunctionName();
+			DelayAction->OutputLink = 0;
+			DelayAction->CallbackTarget = CallbackTarget;
+
+			LatentActionManager.AddNewAction(WorldContextObject, DelegateUUID, DelayAction);
+			bActionAdded = true;
+		}
+	}
+
+	if (Slot != INDEX_NONE && !bActionAdded)
+	{
+		Dispatcher->ReleaseBinding(Slot);
+	}
+
+	return DelegateUUID;
+}
+
+void UBlueluaLibrary::PreloadLuaModules(const TArray<FString>& ModuleNames)
+{
+	TSharedPtr<FLuaState> LuaState = FBlueluaModule::Get().GetDefaultLuaState();
+	if (LuaState.IsValid())
+	{
+		LuaState->PreloadModules(ModuleNames);
+	}
+}
+
 void UBlueluaLibrary::BindAction(AActor* TargetActor, FName ActionName, EInputEvent KeyEvent, bool InbConsumeInput, bool InbExecuteWhenPaused, FInputActionHandlerDynamicSignature Action)
 {
 	if (!TargetActor || !TargetActor->InputComponent)
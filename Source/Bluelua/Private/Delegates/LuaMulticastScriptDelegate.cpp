@@ -5,7 +5,6 @@
 
 #include "Bluelua.h"
 #include "lua.hpp"
-#include "LuaFunctionDelegate.h"
 #include "LuaState.h"
 
 FLuaMulticastScriptDelegate::FLuaMulticastScriptDelegate(void* InSource, UFunction* InFunction)
@@ -28,11 +27,8 @@ FLuaUDelegate* FLuaMulticastScriptDelegate::Create(lua_State* L, void* InSource,
 	return LuaMulticastScriptDelegate;
 }
 
-void FLuaMulticastScriptDelegate::OnAdd(ULuaFunctionDelegate* LuaFunctionDelegate)
+void FLuaMulticastScriptDelegate::OnAdd(const FScriptDelegate& Delegate)
 {
-	FScriptDelegate Delegate;
-	Delegate.BindUFunction(LuaFunctionDelegate, ULuaFunctionDelegate::DelegateFunctionName);
-
 	FMulticastScriptDelegate* MulticastScriptDelegate = reinterpret_cast<FMulticastScriptDelegate*>(Source);
 	if (MulticastScriptDelegate)
 	{
@@ -40,18 +36,20 @@ void FLuaMulticastScriptDelegate::OnAdd(ULuaFunctionDelegate* LuaFunctionDelegat
 	}
 }
 
-void FLuaMulticastScriptDelegate::OnRemove(ULuaFunctionDelegate* LuaFunctionDelegate)
+void FLuaMulticastScriptDelegate::Unbind(void* InSource, UFunction* InFunction, const FScriptDelegate& Delegate)
 {
-	FScriptDelegate Delegate;
-	Delegate.BindUFunction(LuaFunctionDelegate, ULuaFunctionDelegate::DelegateFunctionName);
-
-	FMulticastScriptDelegate* MulticastScriptDelegate = reinterpret_cast<FMulticastScriptDelegate*>(Source);
+	FMulticastScriptDelegate* MulticastScriptDelegate = reinterpret_cast<FMulticastScriptDelegate*>(InSource);
 	if (MulticastScriptDelegate)
 	{
 		MulticastScriptDelegate->Remove(Delegate);
 	}
 }
 
+void FLuaMulticastScriptDelegate::OnRemove(const FScriptDelegate& Delegate)
+{
+	Unbind(Source, Function, Delegate);
+}
+
 void FLuaMulticastScriptDelegate::OnClear()
 {
 	FMulticastScriptDelegate* MulticastScriptDelegate = reinterpret_cast<FMulticastScriptDelegate*>(Source);
@@ -78,3 +76,20 @@ FString FLuaMulticastScriptDelegate::OnGetName()
 {
 	return TEXT("MulticastScriptDelegate");
 }
+
+FUnbindDelegateFuncPtr FLuaMulticastScriptDelegate::GetUnbindFunc() const
+{
+	return &FLuaMulticastScriptDelegate::Unbind;
+}
+
+bool FLuaMulticastScriptDelegate::SupportsFanOut() const
+{
+	return true;
+}
+
+bool FLuaMulticastScriptDelegate::OnContains(const FScriptDelegate& Delegate) const
+{
+	FMulticastScriptDelegate* MulticastScriptDelegate = reinterpret_cast<FMulticastScriptDelegate*>(Source);
+
+	return MulticastScriptDelegate && MulticastScriptDelegate->Contains(Delegate);
+}
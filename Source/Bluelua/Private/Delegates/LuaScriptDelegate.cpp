@@ -5,7 +5,6 @@
 
 #include "Bluelua.h"
 #include "lua.hpp"
-#include "LuaFunctionDelegate.h"
 #include "LuaState.h"
 
 FLuaScriptDelegate::FLuaScriptDelegate(void* InSource, UFunction* InFunction)
@@ -28,16 +27,16 @@ FLuaUDelegate* FLuaScriptDelegate::Create(lua_State* L, void* InSource, UFunctio
 	return LuaScriptDelegate;
 }
 
-void FLuaScriptDelegate::OnAdd(ULuaFunctionDelegate* LuaFunctionDelegate)
+void FLuaScriptDelegate::OnAdd(const FScriptDelegate& Delegate)
 {
 	FScriptDelegate* ScriptDelegate = reinterpret_cast<FScriptDelegate*>(Source);
 	if (ScriptDelegate)
 	{
-		ScriptDelegate->BindUFunction(LuaFunctionDelegate, ULuaFunctionDelegate::DelegateFunctionName);
+		*ScriptDelegate = Delegate;
 	}
 }
 
-void FLuaScriptDelegate::OnRemove(ULuaFunctionDelegate* LuaFunctionDelegate)
+void FLuaScriptDelegate::OnRemove(const FScriptDelegate& Delegate)
 {
 	FScriptDelegate* ScriptDelegate = reinterpret_cast<FScriptDelegate*>(Source);
 	if (ScriptDelegate)
@@ -46,6 +45,16 @@ void FLuaScriptDelegate::OnRemove(ULuaFunctionDelegate* LuaFunctionDelegate)
 	}
 }
 
+void FLuaScriptDelegate::Unbind(void* InSource, UFunction* InFunction, const FScriptDelegate& Delegate)
+{
+	// the delegate may be bound to something else by now
+	FScriptDelegate* ScriptDelegate = reinterpret_cast<FScriptDelegate*>(InSource);
+	if (ScriptDelegate && *ScriptDelegate == Delegate)
+	{
+		ScriptDelegate->Clear();
+	}
+}
+
 void FLuaScriptDelegate::OnClear()
 {
 	FScriptDelegate* ScriptDelegate = reinterpret_cast<FScriptDelegate*>(Source);
@@ -73,3 +82,8 @@ FString FLuaScriptDelegate::OnGetName()
 	return TEXT("ScriptDelegate");
 }
 
+FUnbindDelegateFuncPtr FLuaScriptDelegate::GetUnbindFunc() const
+{
+	return &FLuaScriptDelegate::Unbind;
+}
+
@@ -10,7 +10,6 @@
 
 #include "Bluelua.h"
 #include "lua.hpp"
-#include "LuaFunctionDelegate.h"
 #include "LuaState.h"
 
 FLuaSparseDelegate::FLuaSparseDelegate(void* InSource, UFunction* InFunction)
@@ -33,12 +32,9 @@ FLuaUDelegate* FLuaSparseDelegate::Create(lua_State* L, void* InSource, UFunctio
 	return LuaSparseDelegate;
 }
 
-void FLuaSparseDelegate::OnAdd(ULuaFunctionDelegate* LuaFunctionDelegate)
+void FLuaSparseDelegate::OnAdd(const FScriptDelegate& Delegate)
 {
 #if ENGINE_MINOR_VERSION >= 23
-	FScriptDelegate Delegate;
-	Delegate.BindUFunction(LuaFunctionDelegate, ULuaFunctionDelegate::DelegateFunctionName);
-
 	FSparseDelegate* SparseDelegate = reinterpret_cast<FSparseDelegate*>(Source);
 	if (SparseDelegate)
 	{
@@ -46,29 +42,31 @@ void FLuaSparseDelegate::OnAdd(ULuaFunctionDelegate* LuaFunctionDelegate)
 
 		UObject* Parent = FSparseDelegateStorage::ResolveSparseOwner(*SparseDelegate, SparseDelegateFunc->OwningClassName, SparseDelegateFunc->DelegateName);
 
-		SparseDelegate->__Internal_AddUnique(Parent, SparseDelegateFunc->DelegateName, MoveTemp(Delegate));
+		SparseDelegate->__Internal_AddUnique(Parent, SparseDelegateFunc->DelegateName, FScriptDelegate(Delegate));
 	}
 #endif // ENGINE_MINOR_VERSION >= 23
 }
 
-void FLuaSparseDelegate::OnRemove(ULuaFunctionDelegate* LuaFunctionDelegate)
+void FLuaSparseDelegate::Unbind(void* InSource, UFunction* InFunction, const FScriptDelegate& Delegate)
 {
 #if ENGINE_MINOR_VERSION >= 23
-	FScriptDelegate Delegate;
-	Delegate.BindUFunction(LuaFunctionDelegate, ULuaFunctionDelegate::DelegateFunctionName);
-
-	FSparseDelegate* SparseDelegate = reinterpret_cast<FSparseDelegate*>(Source);
+	FSparseDelegate* SparseDelegate = reinterpret_cast<FSparseDelegate*>(InSource);
 	if (SparseDelegate)
 	{
-		USparseDelegateFunction* SparseDelegateFunc = CastChecked<USparseDelegateFunction>(Function);
+		USparseDelegateFunction* SparseDelegateFunc = CastChecked<USparseDelegateFunction>(InFunction);
 
 		UObject* Parent = FSparseDelegateStorage::ResolveSparseOwner(*SparseDelegate, SparseDelegateFunc->OwningClassName, SparseDelegateFunc->DelegateName);
 
-		SparseDelegate->__Internal_Remove(Parent, SparseDelegateFunc->DelegateName, MoveTemp(Delegate));
+		SparseDelegate->__Internal_Remove(Parent, SparseDelegateFunc->DelegateName, FScriptDelegate(Delegate));
 	}
 #endif // ENGINE_MINOR_VERSION >= 23
 }
 
+void FLuaSparseDelegate::OnRemove(const FScriptDelegate& Delegate)
+{
+	Unbind(Source, Function, Delegate);
+}
+
 void FLuaSparseDelegate::OnClear()
 {
 #if ENGINE_MINOR_VERSION >= 23
@@ -99,3 +97,8 @@ FString FLuaSparseDelegate::OnGetName()
 {
 	return TEXT("SparseDelegate");
 }
+
+FUnbindDelegateFuncPtr FLuaSparseDelegate::GetUnbindFunc() const
+{
+	return &FLuaSparseDelegate::Unbind;
+}
@@ -0,0 +1,403 @@
+#include "LuaAllocator.h"
+
+#include "HAL/PlatformMemory.h"
+#include "HAL/UnrealMemory.h"
+#include "Templates/Atomic.h"
+
+#include "Bluelua.h"
+
+DECLARE_MEMORY_STAT(TEXT("LuaSlabMemory"), STAT_LuaSlabMemory, STATGROUP_Bluelua);
+
+const uint32 FLuaAllocator::SlabHeaderSize = Align((uint32)sizeof(FLuaAllocator::FSlab), FLuaAllocator::Granularity);
+
+// set once the os returned a block not aligned to SlabSize, later slabs reserve twice the size right away
+static TAtomic<bool> bOSMisalignsSlabs(false);
+
+FLuaAllocator::FLuaAllocator()
+{
+	FMemory::Memzero(AvailableSlabs, sizeof(AvailableSlabs));
+}
+
+FLuaAllocator::~FLuaAllocator()
+{
+	// lua state is closed already, every slab left should be empty
+	for (const TPair<void*, size_t>& Kept : KeptLargeBlocks)
+	{
+		FMemory::Free(Kept.Key);
+	}
+
+	KeptLargeBlocks.Reset();
+
+	for (uint32 SizeClass = 0; SizeClass < NumSizeClasses; ++SizeClass)
+	{
+		FSlab* Slab = AvailableSlabs[SizeClass];
+		while (Slab)
+		{
+			FSlab* Next = Slab->Next;
+
+			DEC_MEMORY_STAT_BY(STAT_LuaSlabMemory, SlabSize);
+			FreeSlab(Slab);
+
+			Slab = Next;
+		}
+
+		AvailableSlabs[SizeClass] = nullptr;
+	}
+}
+
+void* FLuaAllocator::Realloc(void* Ptr, size_t OldSize, size_t NewSize)
+{
+	if (Ptr && KeptLargeBlocks.Num() > 0)
+	{
+		if (const size_t* KeptSize = KeptLargeBlocks.Find(Ptr))
+		{
+			return ReallocKept(Ptr, *KeptSize, NewSize);
+		}
+	}
+
+	if (NewSize == 0)
+	{
+		if (Ptr)
+		{
+			Free(Ptr, OldSize);
+		}
+
+		return nullptr;
+	}
+
+	// when Ptr is null, OldSize is the lua type of the new object
+	if (!Ptr)
+	{
+		return Malloc(NewSize);
+	}
+
+	const bool bOldSmall = OldSize <= MaxSmallSize;
+	const bool bNewSmall = NewSize <= MaxSmallSize;
+
+	// after a failed shrink the block is bigger than OldSize says, its slab knows the real class
+	if (bOldSmall && bNewSmall && GetSlab(Ptr)->SizeClass == GetSizeClass(NewSize))
+	{
+		Stats.SmallRequestedBytes += NewSize;
+		Stats.SmallRequestedBytes -= OldSize;
+		return Ptr;
+	}
+
+	if (!bOldSmall && !bNewSmall)
+	{
+		void* NewPtr = FMemory::Realloc(Ptr, NewSize);
+		if (NewPtr)
+		{
+			Stats.LargeBytes += NewSize;
+			Stats.LargeBytes -= OldSize;
+			UpdateHighWater();
+		}
+		else if (NewSize < OldSize)
+		{
+			Stats.LargeBytes -= OldSize - NewSize;
+			return Ptr;
+		}
+
+		return NewPtr;
+	}
+
+	void* NewPtr = Malloc(NewSize);
+	if (NewPtr)
+	{
+		FMemory::Memcpy(NewPtr, Ptr, FMath::Min(OldSize, NewSize));
+		Free(Ptr, OldSize);
+	}
+	else if (NewSize < OldSize)
+	{
+		// lua assumes a shrink never fails, keep the old block
+		if (bOldSmall)
+		{
+			Stats.SmallRequestedBytes -= OldSize - NewSize;
+		}
+		else
+		{
+			// lua frees it with a small size from now on, remember it is still a large block
+			KeptLargeBlocks.Add(Ptr, OldSize);
+		}
+
+		return Ptr;
+	}
+
+	return NewPtr;
+}
+
+void* FLuaAllocator::ReallocKept(void* Ptr, size_t KeptSize, size_t NewSize)
+{
+	if (NewSize > KeptSize)
+	{
+		void* NewPtr = FMemory::Realloc(Ptr, NewSize);
+		if (NewPtr)
+		{
+			KeptLargeBlocks.Remove(Ptr);
+
+			Stats.LargeBytes += NewSize;
+			Stats.LargeBytes -= KeptSize;
+			UpdateHighWater();
+		}
+
+		return NewPtr;
+	}
+
+	if (NewSize > MaxSmallSize)
+	{
+		KeptLargeBlocks.Remove(Ptr);
+
+		Stats.LargeBytes -= KeptSize - NewSize;
+		return Ptr;
+	}
+
+	void* NewPtr = NewSize > 0 ? Malloc(NewSize) : nullptr;
+	if (NewPtr || NewSize == 0)
+	{
+		if (NewPtr)
+		{
+			FMemory::Memcpy(NewPtr, Ptr, NewSize);
+		}
+
+		KeptLargeBlocks.Remove(Ptr);
+		FMemory::Free(Ptr);
+
+		Stats.LargeBytes -= KeptSize;
+		return NewPtr;
+	}
+
+	// still out of small blocks, keep it a little longer
+	return Ptr;
+}
+
+int64 FLuaAllocator::ReleaseEmptySlabs()
+{
+	int64 ReleasedBytes = 0;
+
+	for (uint32 SizeClass = 0; SizeClass < NumSizeClasses; ++SizeClass)
+	{
+		FSlab* Slab = AvailableSlabs[SizeClass];
+		while (Slab)
+		{
+			FSlab* Next = Slab->Next;
+
+			if (Slab->UsedBlocks == 0)
+			{
+				UnlinkSlab(Slab);
+				FreeSlab(Slab);
+
+				Stats.SlabBytes -= SlabSize;
+				--Stats.SlabCount;
+				--Stats.EmptySlabCount;
+				ReleasedBytes += SlabSize;
+			}
+
+			Slab = Next;
+		}
+	}
+
+	DEC_MEMORY_STAT_BY(STAT_LuaSlabMemory, ReleasedBytes);
+
+	return ReleasedBytes;
+}
+
+const FLuaAllocatorStats& FLuaAllocator::GetStats() const
+{
+	return Stats;
+}
+
+void* FLuaAllocator::Malloc(size_t Size)
+{
+	++Stats.AllocationCount;
+
+	if (Size <= MaxSmallSize)
+	{
+		const uint32 SizeClass = GetSizeClass(Size);
+
+		void* Ptr = MallocSmall(SizeClass);
+		if (Ptr)
+		{
+			Stats.SmallRequestedBytes += Size;
+			Stats.SmallBlockBytes += GetBlockSize(SizeClass);
+			UpdateHighWater();
+		}
+
+		return Ptr;
+	}
+
+	void* Ptr = FMemory::Malloc(Size);
+	if (Ptr)
+	{
+		Stats.LargeBytes += Size;
+		UpdateHighWater();
+	}
+
+	return Ptr;
+}
+
+void FLuaAllocator::Free(void* Ptr, size_t Size)
+{
+	if (Size <= MaxSmallSize)
+	{
+		// not GetSizeClass(Size), a block kept after a failed shrink lives in a bigger class
+		const uint32 SizeClass = GetSlab(Ptr)->SizeClass;
+
+		FreeSmall(Ptr, SizeClass);
+
+		Stats.SmallRequestedBytes -= Size;
+		Stats.SmallBlockBytes -= GetBlockSize(SizeClass);
+	}
+	else
+	{
+		FMemory::Free(Ptr);
+
+		Stats.LargeBytes -= Size;
+	}
+}
+
+void* FLuaAllocator::MallocSmall(uint32 SizeClass)
+{
+	FSlab* Slab = AvailableSlabs[SizeClass];
+	if (!Slab)
+	{
+		Slab = NewSlab(SizeClass);
+		if (!Slab)
+		{
+			return nullptr;
+		}
+	}
+
+	void* Ptr = nullptr;
+	if (Slab->FreeList)
+	{
+		Ptr = Slab->FreeList;
+		Slab->FreeList = *(void**)Ptr;
+	}
+	else
+	{
+		// carve blocks lazily so that a new slab does not touch all its pages
+		Ptr = Slab->UnusedStart;
+		Slab->UnusedStart += GetBlockSize(SizeClass);
+	}
+
+	if (Slab->UsedBlocks++ == 0)
+	{
+		--Stats.EmptySlabCount;
+	}
+
+	if (Slab->UsedBlocks == Slab->TotalBlocks)
+	{
+		// full slabs are not tracked, they come back when a block is freed
+		UnlinkSlab(Slab);
+	}
+
+	return Ptr;
+}
+
+void FLuaAllocator::FreeSmall(void* Ptr, uint32 SizeClass)
+{
+	FSlab* Slab = GetSlab(Ptr);
+	check(Slab->SizeClass == SizeClass);
+
+	if (Slab->UsedBlocks == Slab->TotalBlocks)
+	{
+		LinkSlab(Slab);
+	}
+
+	*(void**)Ptr = Slab->FreeList;
+	Slab->FreeList = Ptr;
+
+	if (--Slab->UsedBlocks == 0)
+	{
+		++Stats.EmptySlabCount;
+	}
+}
+
+FLuaAllocator::FSlab* FLuaAllocator::NewSlab(uint32 SizeClass)
+{
+	// slabs are aligned to their size so that a block can find its slab header by masking the address,
+	// os pages are aligned to 64 KB on windows only, elsewhere twice the size is reserved and the slab aligned inside
+	SIZE_T AllocationSize = bOSMisalignsSlabs ? SlabSize * 2 : SlabSize;
+	void* Allocation = FPlatformMemory::BinnedAllocFromOS(AllocationSize);
+	if (Allocation && !IsAligned(Allocation, SlabSize))
+	{
+		check(AllocationSize == SlabSize);
+		bOSMisalignsSlabs = true;
+
+		FPlatformMemory::BinnedFreeToOS(Allocation, AllocationSize);
+
+		AllocationSize = SlabSize * 2;
+		Allocation = FPlatformMemory::BinnedAllocFromOS(AllocationSize);
+	}
+
+	if (!Allocation)
+	{
+		return nullptr;
+	}
+
+	FSlab* Slab = (FSlab*)Align(Allocation, SlabSize);
+	check(GetSlab(Slab) == Slab);
+
+	Slab->Allocation = Allocation;
+	Slab->AllocationSize = AllocationSize;
+	Slab->Prev = nullptr;
+	Slab->Next = nullptr;
+	Slab->FreeList = nullptr;
+	Slab->UnusedStart = (uint8*)Slab + SlabHeaderSize;
+	Slab->SizeClass = SizeClass;
+	Slab->UsedBlocks = 0;
+	Slab->TotalBlocks = (SlabSize - SlabHeaderSize) / GetBlockSize(SizeClass);
+
+	LinkSlab(Slab);
+
+	Stats.SlabBytes += SlabSize;
+	++Stats.SlabCount;
+	++Stats.EmptySlabCount;
+
+	INC_MEMORY_STAT_BY(STAT_LuaSlabMemory, SlabSize);
+
+	return Slab;
+}
+
+void FLuaAllocator::FreeSlab(FSlab* Slab)
+{
+	FPlatformMemory::BinnedFreeToOS(Slab->Allocation, Slab->AllocationSize);
+}
+
+void FLuaAllocator::LinkSlab(FSlab* Slab)
+{
+	FSlab*& Head = AvailableSlabs[Slab->SizeClass];
+
+	Slab->Prev = nullptr;
+	Slab->Next = Head;
+	if (Head)
+	{
+		Head->Prev = Slab;
+	}
+
+	Head = Slab;
+}
+
+void FLuaAllocator::UnlinkSlab(FSlab* Slab)
+{
+	if (Slab->Prev)
+	{
+		Slab->Prev->Next = Slab->Next;
+	}
+	else
+	{
+		AvailableSlabs[Slab->SizeClass] = Slab->Next;
+	}
+
+	if (Slab->Next)
+	{
+		Slab->Next->Prev = Slab->Prev;
+	}
+
+	Slab->Prev = nullptr;
+	Slab->Next = nullptr;
+}
+
+void FLuaAllocator::UpdateHighWater()
+{
+	Stats.HighWaterBytes = FMath::Max(Stats.HighWaterBytes, Stats.GetBytesInUse());
+}
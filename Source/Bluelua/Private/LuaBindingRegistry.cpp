@@ -0,0 +1,195 @@
+#include "LuaBindingRegistry.h"
+
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectGlobals.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+
+static TAutoConsoleVariable<int32> CVarLuaStaticBindings(
+	TEXT("bluelua.StaticBindings"),
+	1,
+	TEXT("Call UFunctions with generated glue instead of reflection when there is one."));
+
+static TArray<FLuaBindingRegistry::FRegisterFunction>& GetPendingRegisterFunctions()
+{
+	// function local so generated files can add to it during static init
+	static TArray<FLuaBindingRegistry::FRegisterFunction> PendingRegisterFunctions;
+	return PendingRegisterFunctions;
+}
+
+static TMap<const UFunction*, FLuaBindingFunction> Bindings;
+static TMap<TPair<const UStruct*, FName>, FLuaBindingMember> Members;
+
+// members resolved through super structs, includes misses,
+// flushed after every garbage collection because a collected struct's address can be reused
+static TMap<TPair<const UStruct*, FName>, FLuaBindingMember> ResolvedMembers;
+static FDelegateHandle PostGarbageCollectHandle;
+
+void FLuaBindingRegistry::AddRegisterFunction(FRegisterFunction RegisterFunction)
+{
+	GetPendingRegisterFunctions().Add(RegisterFunction);
+}
+
+void FLuaBindingRegistry::Register(UFunction* Function, FLuaBindingFunction Binding)
+{
+	if (!Function || !Binding)
+	{
+		UE_LOG(LogBluelua, Warning, TEXT("Register lua binding failed! Function not found, the generated bindings may be out of date!"));
+		return;
+	}
+
+	Bindings.Add(Function, Binding);
+}
+
+void FLuaBindingRegistry::Unregister(UFunction* Function)
+{
+	Bindings.Remove(Function);
+}
+
+FLuaBindingFunction FLuaBindingRegistry::Find(UFunction* Function)
+{
+	RegisterPending();
+
+	if (Bindings.Num() == 0 || CVarLuaStaticBindings.GetValueOnGameThread() == 0)
+	{
+		return nullptr;
+	}
+
+	return Bindings.FindRef(Function);
+}
+
+bool FLuaBindingRegistry::PushBinding(lua_State* L, UFunction* Function)
+{
+	FLuaBindingFunction Binding = Find(Function);
+	if (!Binding)
+	{
+		return false;
+	}
+
+	lua_pushlightuserdata(L, Function);
+	lua_pushcclosure(L, Binding, 1);
+
+	return true;
+}
+
+void FLuaBindingRegistry::RegisterMember(UStruct* Struct, FName Name, const FLuaBindingMember& Member)
+{
+	if (!Struct || Name.IsNone())
+	{
+		UE_LOG(LogBluelua, Warning, TEXT("Register lua binding member failed! Invalid struct or name!"));
+		return;
+	}
+
+	Members.Add(TPair<const UStruct*, FName>(Struct, Name), Member);
+	ResolvedMembers.Reset();
+
+	if (!PostGarbageCollectHandle.IsValid())
+	{
+		PostGarbageCollectHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddStatic(&FLuaBindingRegistry::OnPostGarbageCollect);
+	}
+}
+
+bool FLuaBindingRegistry::FindMember(UStruct* Struct, FName Name, FLuaBindingMember& OutMember)
+{
+	RegisterPending();
+
+	if (Members.Num() == 0 || !Struct)
+	{
+		return false;
+	}
+
+	const TPair<const UStruct*, FName> Key(Struct, Name);
+	if (const FLuaBindingMember* Resolved = ResolvedMembers.Find(Key))
+	{
+		OutMember = *Resolved;
+		return OutMember.Function || OutMember.Getter;
+	}
+
+	FLuaBindingMember& Resolved = ResolvedMembers.Add(Key);
+	for (const UStruct* Super = Struct; Super; Super = Super->GetSuperStruct())
+	{
+		if (const FLuaBindingMember* Member = Members.Find(TPair<const UStruct*, FName>(Super, Name)))
+		{
+			Resolved = *Member;
+			break;
+		}
+	}
+
+	OutMember = Resolved;
+	return OutMember.Function || OutMember.Getter;
+}
+
+int32 FLuaBindingRegistry::PushMember(lua_State* L, UStruct* Struct, FName Name, void* Container)
+{
+	FLuaBindingMember Member;
+	if (!FindMember(Struct, Name, Member))
+	{
+		return -1;
+	}
+
+	if (Member.Function)
+	{
+		lua_pushcfunction(L, Member.Function);
+		return 1;
+	}
+
+	return Member.Getter(L, (uint8*)Container + Member.Offset);
+}
+
+bool FLuaBindingRegistry::SetMember(lua_State* L, UStruct* Struct, FName Name, void* Container, int32 Index)
+{
+	FLuaBindingMember Member;
+	if (!FindMember(Struct, Name, Member) || !Member.Getter)
+	{
+		return false;
+	}
+
+	if (!Member.Setter)
+	{
+		luaL_error(L, "Can't write to a readonly field[%s] in [%s]!", TCHAR_TO_UTF8(*Name.ToString()), TCHAR_TO_UTF8(*Struct->GetName()));
+		return true;
+	}
+
+	Member.Setter(L, (uint8*)Container + Member.Offset, Index);
+
+	return true;
+}
+
+int FLuaBindingRegistry::InvalidSelfError(lua_State* L, UStruct* Struct)
+{
+	lua_Debug Ar;
+	const char* MethodName = "?";
+	if (lua_getstack(L, 0, &Ar) && lua_getinfo(L, "n", &Ar) && Ar.name)
+	{
+		MethodName = Ar.name;
+	}
+
+	const FString StructName = Struct->GetName();
+	return luaL_error(L, "Call method[%s.%s] failed! Param 1 must be a %s, call it with ':' on a valid object!",
+		TCHAR_TO_UTF8(*StructName), MethodName, TCHAR_TO_UTF8(*StructName));
+}
+
+void FLuaBindingRegistry::OnPostGarbageCollect()
+{
+	ResolvedMembers.Empty();
+}
+
+void FLuaBindingRegistry::RegisterPending()
+{
+	TArray<FRegisterFunction>& PendingRegisterFunctions = GetPendingRegisterFunctions();
+	if (PendingRegisterFunctions.Num() == 0)
+	{
+		return;
+	}
+
+	const TArray<FRegisterFunction> RegisterFunctions = MoveTemp(PendingRegisterFunctions);
+	PendingRegisterFunctions.Reset();
+
+	for (FRegisterFunction RegisterFunction : RegisterFunctions)
+	{
+		RegisterFunction();
+	}
+
+	UE_LOG(LogBluelua, Log, TEXT("Registered %d generated lua binding(s) and %d member(s)."), Bindings.Num(), Members.Num());
+}
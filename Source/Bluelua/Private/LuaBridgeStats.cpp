@@ -0,0 +1,341 @@
+#include "LuaBridgeStats.h"
+
+#include "CoreGlobals.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/OutputDevice.h"
+#include "UObject/Class.h"
+#include "UObject/WeakObjectPtrTemplates.h"
+
+#include "Bluelua.h"
+
+static TAutoConsoleVariable<int32> CVarLuaBridgeStatsMaxFrames(
+	TEXT("bluelua.BridgeStats.MaxFrames"),
+	600,
+	TEXT("Number of frames of lua bridge counters kept for bluelua.BridgeStats Dump."));
+
+typedef TArray<TPair<int32, FLuaBridgeCounters>> FLuaBridgeFrameCounters;
+
+// bridge crossings only happen on the game thread,
+// a field pointer is only trusted while its owner is alive, rows are merged by path so a recompiled class keeps its row
+static TMap<TPair<TWeakObjectPtr<const UStruct>, const void*>, int32> KeyIndices;
+static TMap<FName, int32> PathIndices;
+static TArray<FString> KeyNames;
+
+static TMap<int32, FLuaBridgeCounters> FrameCounters;
+static uint64 CounterFrame = 0;
+
+// ring of finished frames, HistoryHead is the next to write
+static TArray<FLuaBridgeFrameCounters> FrameHistory;
+static int32 HistoryHead = 0;
+static int32 NumHistoryFrames = 0;
+
+bool FLuaBridgeStats::bEnabled = false;
+int64 FLuaBridgeStats::NumProxies = 0;
+int32 FLuaBridgeStats::MarshalDepth = 0;
+uint64 FLuaBridgeStats::MarshalFrame = 0;
+
+static void LuaBridgeStatsCommand(const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+{
+	if (Args.Num() == 0)
+	{
+		Ar.Log(TEXT("Usage: bluelua.BridgeStats Start|Stop|Reset|Dump [TopN] [Frames] [Cycles|Calls|Pushes|Fetches|Bytes|Proxies]"));
+		return;
+	}
+
+	const FString& Command = Args[0];
+	if (Command.Equals(TEXT("Start"), ESearchCase::IgnoreCase))
+	{
+		FLuaBridgeStats::Start();
+	}
+	else if (Command.Equals(TEXT("Stop"), ESearchCase::IgnoreCase))
+	{
+		FLuaBridgeStats::Stop();
+	}
+	else if (Command.Equals(TEXT("Reset"), ESearchCase::IgnoreCase))
+	{
+		FLuaBridgeStats::Reset();
+	}
+	else if (Command.Equals(TEXT("Dump"), ESearchCase::IgnoreCase))
+	{
+		ELuaBridgeStatsSort Sort = ELuaBridgeStatsSort::Cycles;
+		if (Args.Num() > 3)
+		{
+			static const TCHAR* SortNames[] = { TEXT("Cycles"), TEXT("Calls"), TEXT("Pushes"), TEXT("Fetches"), TEXT("Bytes"), TEXT("Proxies") };
+			for (int32 Index = 0; Index < UE_ARRAY_COUNT(SortNames); ++Index)
+			{
+				if (Args[3].Equals(SortNames[Index], ESearchCase::IgnoreCase))
+				{
+					Sort = (ELuaBridgeStatsSort)Index;
+				}
+			}
+		}
+
+		FLuaBridgeStats::Dump(Ar, Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 20, Args.Num() > 2 ? FCString::Atoi(*Args[2]) : 60, Sort);
+	}
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice LuaBridgeStatsConsoleCommand(
+	TEXT("bluelua.BridgeStats"),
+	TEXT("Count lua bridge calls and marshalling per UFunction and property. Usage: bluelua.BridgeStats Start|Stop|Reset|Dump [TopN] [Frames] [Cycles|Calls|Pushes|Fetches|Bytes|Proxies]"),
+	FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic(&LuaBridgeStatsCommand));
+
+FLuaBridgeCounters& FLuaBridgeCounters::operator+=(const FLuaBridgeCounters& Other)
+{
+	Calls += Other.Calls;
+	Cycles += Other.Cycles;
+	Pushes += Other.Pushes;
+	Fetches += Other.Fetches;
+	Bytes += Other.Bytes;
+	Proxies += Other.Proxies;
+
+	return *this;
+}
+
+FLuaBridgeStats::FCallScope::FCallScope(const UFunction* InFunction)
+	: Function(FLuaBridgeStats::IsEnabled() ? InFunction : nullptr)
+	, StartCycles(Function ? FPlatformTime::Cycles64() : 0)
+{
+
+}
+
+FLuaBridgeStats::FCallScope::~FCallScope()
+{
+	if (Function && FLuaBridgeStats::IsEnabled())
+	{
+		FLuaBridgeStats::RecordCall(Function, FPlatformTime::Cycles64() - StartCycles);
+	}
+}
+
+FLuaBridgeStats::FMarshalScope::FMarshalScope()
+{
+	// a lua error can skip the destructor, no marshalling spans two frames
+	if (FLuaBridgeStats::MarshalFrame != GFrameCounter)
+	{
+		FLuaBridgeStats::MarshalFrame = GFrameCounter;
+		FLuaBridgeStats::MarshalDepth = 0;
+	}
+
+	bOutermost = FLuaBridgeStats::MarshalDepth++ == 0;
+}
+
+FLuaBridgeStats::FMarshalScope::~FMarshalScope()
+{
+	--FLuaBridgeStats::MarshalDepth;
+}
+
+void FLuaBridgeStats::Start()
+{
+	if (bEnabled)
+	{
+		return;
+	}
+
+	Reset();
+
+	bEnabled = true;
+
+	UE_LOG(LogBluelua, Display, TEXT("Lua bridge stats started."));
+}
+
+void FLuaBridgeStats::Stop()
+{
+	if (!bEnabled)
+	{
+		return;
+	}
+
+	// counters are kept for dumping
+	AdvanceFrame();
+
+	bEnabled = false;
+
+	UE_LOG(LogBluelua, Display, TEXT("Lua bridge stats stopped."));
+}
+
+void FLuaBridgeStats::Reset()
+{
+	KeyIndices.Empty();
+	PathIndices.Empty();
+	KeyNames.Empty();
+
+	FrameCounters.Empty();
+	CounterFrame = GFrameCounter;
+
+	FrameHistory.Empty(FMath::Max(CVarLuaBridgeStatsMaxFrames.GetValueOnGameThread(), 1));
+	FrameHistory.SetNum(FMath::Max(CVarLuaBridgeStatsMaxFrames.GetValueOnGameThread(), 1));
+	HistoryHead = 0;
+	NumHistoryFrames = 0;
+}
+
+void FLuaBridgeStats::RecordCall(const UFunction* Function, uint64 Cycles)
+{
+	FLuaBridgeCounters& Counters = GetCounters(Function);
+	++Counters.Calls;
+	Counters.Cycles += Cycles;
+}
+
+void FLuaBridgeStats::RecordPush(const UProperty* Property, const void* Value, int64 Proxies)
+{
+	FLuaBridgeCounters& Counters = GetCounters(Property);
+	++Counters.Pushes;
+	Counters.Bytes += GetCopiedBytes(Property, Value);
+	Counters.Proxies += Proxies;
+}
+
+void FLuaBridgeStats::RecordFetch(const UProperty* Property, const void* Value)
+{
+	FLuaBridgeCounters& Counters = GetCounters(Property);
+	++Counters.Fetches;
+	Counters.Bytes += GetCopiedBytes(Property, Value);
+}
+
+void FLuaBridgeStats::Dump(FOutputDevice& Ar, int32 TopN, int32 NumFrames, ELuaBridgeStatsSort Sort)
+{
+	// dumping while stopped must not age the collected frames out of the history
+	if (bEnabled)
+	{
+		AdvanceFrame();
+	}
+
+	NumFrames = FMath::Clamp(NumFrames, 1, NumHistoryFrames > 0 ? NumHistoryFrames : 1);
+
+	TMap<int32, FLuaBridgeCounters> Totals;
+	for (int32 Frame = 0; Frame < NumFrames && Frame < NumHistoryFrames; ++Frame)
+	{
+		const int32 HistoryIndex = (HistoryHead - 1 - Frame + FrameHistory.Num()) % FrameHistory.Num();
+		for (const TPair<int32, FLuaBridgeCounters>& Entry : FrameHistory[HistoryIndex])
+		{
+			Totals.FindOrAdd(Entry.Key) += Entry.Value;
+		}
+	}
+
+	auto GetSortValue = [Sort](const FLuaBridgeCounters& Counters) -> int64
+	{
+		switch (Sort)
+		{
+		case ELuaBridgeStatsSort::Calls: return Counters.Calls;
+		case ELuaBridgeStatsSort::Pushes: return Counters.Pushes;
+		case ELuaBridgeStatsSort::Fetches: return Counters.Fetches;
+		case ELuaBridgeStatsSort::Bytes: return Counters.Bytes;
+		case ELuaBridgeStatsSort::Proxies: return Counters.Proxies;
+		default: return (int64)Counters.Cycles;
+		}
+	};
+
+	TArray<TPair<int32, FLuaBridgeCounters>> Sorted = Totals.Array();
+	Sorted.Sort([&GetSortValue](const TPair<int32, FLuaBridgeCounters>& A, const TPair<int32, FLuaBridgeCounters>& B)
+	{
+		return GetSortValue(A.Value) > GetSortValue(B.Value);
+	});
+
+	Ar.Logf(TEXT("Lua bridge stats, %s, last %d frame(s), %d UFunction(s) and propertie(s)."), bEnabled ? TEXT("running") : TEXT("stopped"), NumFrames, Sorted.Num());
+	Ar.Logf(TEXT("%10s %10s %10s %10s %14s %10s  %s"), TEXT("Calls"), TEXT("Ms"), TEXT("Pushes"), TEXT("Fetches"), TEXT("Bytes"), TEXT("Proxies"), TEXT("Name"));
+
+	for (int32 Index = 0; Index < Sorted.Num() && Index < TopN; ++Index)
+	{
+		const FLuaBridgeCounters& Counters = Sorted[Index].Value;
+		Ar.Logf(TEXT("%10lld %10.3f %10lld %10lld %14lld %10lld  %s"), Counters.Calls, FPlatformTime::ToMilliseconds64(Counters.Cycles), Counters.Pushes, Counters.Fetches, Counters.Bytes, Counters.Proxies, *KeyNames[Sorted[Index].Key]);
+	}
+}
+
+FLuaBridgeCounters& FLuaBridgeStats::GetCounters(const UFunction* Function)
+{
+	return GetCounters(Function, nullptr, [Function]() { return FString::Printf(TEXT("%s.%s"), *GetNameSafe(Function->GetOuter()), *Function->GetName()); });
+}
+
+FLuaBridgeCounters& FLuaBridgeStats::GetCounters(const UProperty* Property)
+{
+	return GetCounters(Property->GetOwnerStruct(), Property, [Property]() { return Property->GetPathName(); });
+}
+
+FLuaBridgeCounters& FLuaBridgeStats::GetCounters(const UStruct* Owner, const void* Field, TFunctionRef<FString()> GetName)
+{
+	AdvanceFrame();
+
+	const TPair<TWeakObjectPtr<const UStruct>, const void*> Key(Owner, Field);
+
+	int32 KeyIndex = INDEX_NONE;
+	if (const int32* FoundIndex = KeyIndices.Find(Key))
+	{
+		KeyIndex = *FoundIndex;
+	}
+	else
+	{
+		const FString Name = GetName();
+		if (const int32* PathIndex = PathIndices.Find(*Name))
+		{
+			KeyIndex = *PathIndex;
+		}
+		else
+		{
+			KeyIndex = KeyNames.Add(Name);
+			PathIndices.Add(*Name, KeyIndex);
+		}
+
+		KeyIndices.Add(Key, KeyIndex);
+	}
+
+	return FrameCounters.FindOrAdd(KeyIndex);
+}
+
+void FLuaBridgeStats::AdvanceFrame()
+{
+	if (CounterFrame == GFrameCounter || FrameHistory.Num() == 0)
+	{
+		return;
+	}
+
+	// frames without bridge crossings are kept as empty frames
+	const uint64 ElapsedFrames = FMath::Min<uint64>(GFrameCounter - CounterFrame, FrameHistory.Num());
+	for (uint64 Frame = 0; Frame < ElapsedFrames; ++Frame)
+	{
+		FLuaBridgeFrameCounters& History = FrameHistory[HistoryHead];
+		History.Reset();
+
+		if (Frame == 0)
+		{
+			History = FrameCounters.Array();
+			FrameCounters.Reset();
+		}
+
+		HistoryHead = (HistoryHead + 1) % FrameHistory.Num();
+		NumHistoryFrames = FMath::Min(NumHistoryFrames + 1, FrameHistory.Num());
+	}
+
+	CounterFrame = GFrameCounter;
+}
+
+int64 FLuaBridgeStats::GetCopiedBytes(const UProperty* Property, const void* Value)
+{
+	if (!Value)
+	{
+		return 0;
+	}
+
+	if (Property->IsA<UStructProperty>())
+	{
+		return Property->ElementSize;
+	}
+	else if (const UStrProperty* StrProperty = Cast<UStrProperty>(Property))
+	{
+		return StrProperty->GetPropertyValue(Value).Len() * sizeof(TCHAR);
+	}
+	else if (const UArrayProperty* ArrayProperty = Cast<UArrayProperty>(Property))
+	{
+		FScriptArrayHelper ArrayHelper(ArrayProperty, Value);
+		return (int64)ArrayHelper.Num() * ArrayProperty->Inner->ElementSize;
+	}
+	else if (const USetProperty* SetProperty = Cast<USetProperty>(Property))
+	{
+		FScriptSetHelper SetHelper(SetProperty, Value);
+		return (int64)SetHelper.Num() * SetProperty->ElementProp->ElementSize;
+	}
+	else if (const UMapProperty* MapProperty = Cast<UMapProperty>(Property))
+	{
+		FScriptMapHelper MapHelper(MapProperty, Value);
+		return (int64)MapHelper.Num() * (MapProperty->KeyProp->ElementSize + MapProperty->ValueProp->ElementSize);
+	}
+
+	return 0;
+}
@@ -0,0 +1,186 @@
+#include "LuaChunkCache.h"
+
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+#include "LuaState.h"
+
+DECLARE_CYCLE_STAT(TEXT("PreloadLuaChunks"), STAT_PreloadLuaChunks, STATGROUP_Bluelua);
+
+TFuture<FLuaPreloadResult> FLuaChunkCache::Preload(const TArray<FString>& ModuleNames)
+{
+	PendingPreloads.Increment();
+
+	TSharedRef<FLuaChunkCache, ESPMode::ThreadSafe> ChunkCache = AsShared();
+
+	return Async(EAsyncExecution::TaskGraph, [ChunkCache, ModuleNames]()
+	{
+		SCOPE_CYCLE_COUNTER(STAT_PreloadLuaChunks);
+
+		const double StartTime = FPlatformTime::Seconds();
+
+		TArray<FString> PendingModules;
+		{
+			FScopeLock Lock(&ChunkCache->ChunksLock);
+			for (const FString& ModuleName : ModuleNames)
+			{
+				if (!ChunkCache->Chunks.Contains(ModuleName))
+				{
+					PendingModules.AddUnique(ModuleName);
+				}
+			}
+		}
+
+		TArray<FLuaCompiledChunk> CompiledChunks;
+		TArray<bool> CompileResults;
+		CompiledChunks.SetNum(PendingModules.Num());
+		CompileResults.SetNumZeroed(PendingModules.Num());
+
+		// one throwaway lua state per batch, batches are spread over task graph workers
+		const int32 NumBatches = FMath::Min(PendingModules.Num(), FMath::Max(1, FTaskGraphInterface::Get().GetNumWorkerThreads()));
+		ParallelFor(NumBatches, [&](int32 BatchIndex)
+		{
+			lua_State* CompileState = luaL_newstate();
+			if (!CompileState)
+			{
+				return;
+			}
+
+			for (int32 Index = BatchIndex; Index < PendingModules.Num(); Index += NumBatches)
+			{
+				FString FilePath;
+				TArray<uint8> FileContent;
+				if (!ResolveModulePath(PendingModules[Index], FilePath) || !FFileHelper::LoadFileToArray(FileContent, *FilePath))
+				{
+					continue;
+				}
+
+				FLuaCompiledChunk& Chunk = CompiledChunks[Index];
+				Chunk.FilePath = FilePath;
+				Chunk.ChunkName = MakeChunkName(FilePath);
+
+				CompileResults[Index] = Compile(CompileState, FileContent, Chunk.ChunkName, Chunk.Bytecode);
+			}
+
+			lua_close(CompileState);
+		});
+
+		FLuaPreloadResult Result;
+		{
+			FScopeLock Lock(&ChunkCache->ChunksLock);
+			for (int32 Index = 0; Index < PendingModules.Num(); ++Index)
+			{
+				if (CompileResults[Index])
+				{
+					ChunkCache->Chunks.Emplace(PendingModules[Index], MoveTemp(CompiledChunks[Index]));
+					++Result.CompiledChunks;
+				}
+				else
+				{
+					++Result.FailedChunks;
+				}
+			}
+		}
+
+		Result.Seconds = FPlatformTime::Seconds() - StartTime;
+
+		UE_LOG(LogBluelua, Display, TEXT("Lua preload compiled %d chunk(s) in %.2fms, %d failed."), Result.CompiledChunks, Result.Seconds * 1000.0, Result.FailedChunks);
+
+		ChunkCache->PendingPreloads.Decrement();
+
+		return Result;
+	});
+}
+
+bool FLuaChunkCache::Take(const FString& ModuleName, FLuaCompiledChunk& OutChunk)
+{
+	FScopeLock Lock(&ChunksLock);
+
+	return Chunks.RemoveAndCopyValue(ModuleName, OutChunk);
+}
+
+bool FLuaChunkCache::IsPreloading() const
+{
+	return PendingPreloads.GetValue() > 0;
+}
+
+void FLuaChunkCache::Reset()
+{
+	FScopeLock Lock(&ChunksLock);
+
+	Chunks.Empty();
+}
+
+bool FLuaChunkCache::ResolveModulePath(const FString& ModuleName, FString& OutFilePath)
+{
+	const FString BaseFilePath = FPaths::Combine(FPaths::ProjectContentDir(), ModuleName.Replace(TEXT("."), TEXT("/")));
+
+	if (FPaths::FileExists(BaseFilePath + TEXT(".lua")))
+	{
+		OutFilePath = BaseFilePath + TEXT(".lua");
+	}
+	else if (FPaths::FileExists(BaseFilePath + TEXT(".luac")))
+	{
+		OutFilePath = BaseFilePath + TEXT(".luac");
+	}
+	else if (FPaths::FileExists(FPaths::Combine(BaseFilePath, TEXT("init.lua"))))
+	{
+		OutFilePath = FPaths::Combine(BaseFilePath, TEXT("init.lua"));
+	}
+	else if (FPaths::FileExists(FPaths::Combine(BaseFilePath, TEXT("init.luac"))))
+	{
+		OutFilePath = FPaths::Combine(BaseFilePath, TEXT("init.luac"));
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+FString FLuaChunkCache::MakeChunkName(const FString& FilePath)
+{
+	return FString::Printf(TEXT("@%s"), *FLuaState::MakeRelativePathToContent(FilePath));
+}
+
+bool FLuaChunkCache::Compile(lua_State* L, const TArray<uint8>& Source, const FString& ChunkName, TArray<uint8>& OutBytecode)
+{
+	OutBytecode.Reset();
+
+	// precompiled file, nothing to do
+	if (Source.Num() > 0 && Source[0] == LUA_SIGNATURE[0])
+	{
+		OutBytecode = Source;
+		return true;
+	}
+
+	if (LUA_OK != luaL_loadbuffer(L, (const char*)Source.GetData(), Source.Num(), TCHAR_TO_UTF8(*ChunkName)))
+	{
+		UE_LOG(LogBluelua, Error, TEXT("Lua preload compile failed! %s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+
+		lua_pop(L, 1);
+		return false;
+	}
+
+	// keep debug info so that tracebacks and LuaPanda still work
+	const int DumpResult = lua_dump(L, WriteBytecode, &OutBytecode, 0);
+	lua_pop(L, 1);
+
+	return (DumpResult == 0);
+}
+
+int FLuaChunkCache::WriteBytecode(lua_State* L, const void* Data, size_t Size, void* UserData)
+{
+	TArray<uint8>* Bytecode = (TArray<uint8>*)UserData;
+	Bytecode->Append((const uint8*)Data, Size);
+
+	return 0;
+}
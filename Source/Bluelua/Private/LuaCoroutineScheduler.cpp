@@ -0,0 +1,492 @@
+#include "LuaCoroutineScheduler.h"
+
+#include "Engine/StreamableManager.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/Package.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+#include "LuaDelegateDispatcher.h"
+#include "LuaState.h"
+#include "LuaUObject.h"
+
+DECLARE_CYCLE_STAT(TEXT("LuaCoroutineResume"), STAT_LuaCoroutineResume, STATGROUP_Bluelua);
+DECLARE_DWORD_COUNTER_STAT(TEXT("LuaCoroutinesWaiting"), STAT_LuaCoroutinesWaiting, STATGROUP_Bluelua);
+
+static TAutoConsoleVariable<int32> CVarLuaCoroutineEventsAsCoroutines(
+	TEXT("bluelua.Coroutine.EventsAsCoroutines"),
+	0,
+	TEXT("Run lua events and delegate callbacks without return value or out params as coroutines, so they can wait. Their struct params are copied instead of borrowed."));
+
+static TAutoConsoleVariable<int32> CVarLuaCoroutinePoolSize(
+	TEXT("bluelua.Coroutine.PoolSize"),
+	256,
+	TEXT("Max number of finished lua coroutines kept for reuse."));
+
+FLuaCoroutineScheduler::FLuaCoroutineScheduler()
+	: L(nullptr)
+	, LastId(0)
+	, FrameCounter(0)
+	, CurrentTime(0.0)
+{
+}
+
+FLuaCoroutineScheduler::~FLuaCoroutineScheduler()
+{
+	Shutdown();
+}
+
+void FLuaCoroutineScheduler::Init(lua_State* InL)
+{
+	L = InL;
+
+	StreamableManager = MakeUnique<FStreamableManager>();
+}
+
+void FLuaCoroutineScheduler::Shutdown()
+{
+	for (auto& Iter : LoadHandles)
+	{
+		if (Iter.Value.IsValid())
+		{
+			Iter.Value->CancelHandle();
+		}
+	}
+
+	LoadHandles.Empty();
+	StreamableManager.Reset();
+
+	// threads are owned by the registry, they are released with the state
+	Coroutines.Empty();
+	ThreadIds.Empty();
+	IdleThreads.Empty();
+	TimedWaits.Empty();
+	FrameWaits.Empty();
+	ReadyCoroutines.Empty();
+	ResumingCoroutines.Empty();
+
+	L = nullptr;
+}
+
+void FLuaCoroutineScheduler::Tick(float DeltaTime)
+{
+	if (!L)
+	{
+		return;
+	}
+
+	++FrameCounter;
+	CurrentTime += DeltaTime;
+
+	while (TimedWaits.Num() > 0 && TimedWaits.HeapTop().WakeTime <= CurrentTime)
+	{
+		FTimedWait TimedWait;
+		TimedWaits.HeapPop(TimedWait, false);
+		Wake(TimedWait.Id, TimedWait.Serial, LUA_NOREF);
+	}
+
+	while (FrameWaits.Num() > 0 && FrameWaits.HeapTop().WakeFrame <= FrameCounter)
+	{
+		FFrameWait FrameWait;
+		FrameWaits.HeapPop(FrameWait, false);
+		Wake(FrameWait.Id, FrameWait.Serial, LUA_NOREF);
+	}
+
+	// coroutines woken while resuming run next tick
+	Swap(ReadyCoroutines, ResumingCoroutines);
+
+	for (const FReadyCoroutine& Ready : ResumingCoroutines)
+	{
+		FCoroutine* Coroutine = Coroutines.Find(Ready.Id);
+		if (!Coroutine)
+		{
+			luaL_unref(L, LUA_REGISTRYINDEX, Ready.ArgsRef);
+			continue;
+		}
+
+		lua_State* Thread = Coroutine->Thread;
+		int32 NumArgs = 0;
+
+		if (Ready.ArgsRef != LUA_NOREF)
+		{
+			lua_rawgeti(Thread, LUA_REGISTRYINDEX, Ready.ArgsRef);
+			const int32 ArgsIndex = lua_gettop(Thread);
+
+			lua_getfield(Thread, ArgsIndex, "n");
+			NumArgs = (int32)lua_tointeger(Thread, -1);
+			lua_pop(Thread, 1);
+
+			if (!lua_checkstack(Thread, NumArgs + 1))
+			{
+				UE_LOG(LogBluelua, Warning, TEXT("Lua coroutine resume failed! too many wait results[%d]!"), NumArgs);
+				NumArgs = 0;
+			}
+
+			for (int32 Index = 1; Index <= NumArgs; ++Index)
+			{
+				lua_rawgeti(Thread, ArgsIndex, Index);
+			}
+
+			lua_remove(Thread, ArgsIndex);
+			luaL_unref(L, LUA_REGISTRYINDEX, Ready.ArgsRef);
+		}
+
+		Resume(Ready.Id, NumArgs, L);
+	}
+
+	ResumingCoroutines.Reset();
+
+	SET_DWORD_STAT(STAT_LuaCoroutinesWaiting, GetNumWaiting());
+}
+
+bool FLuaCoroutineScheduler::Spawn(lua_State* FromL, int32 NumArgs)
+{
+	if (!L)
+	{
+		lua_pop(FromL, NumArgs + 1);
+		return false;
+	}
+
+	FCoroutine Coroutine;
+	if (IdleThreads.Num() > 0)
+	{
+		Coroutine = IdleThreads.Pop(false);
+	}
+	else
+	{
+		Coroutine.Thread = lua_newthread(L);
+		Coroutine.ThreadRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+
+	Coroutine.bWaiting = false;
+	Coroutine.bWoken = false;
+	Coroutine.WaitSerial = 0;
+	Coroutine.BindingRef = LUA_NOREF;
+
+	lua_xmove(FromL, Coroutine.Thread, NumArgs + 1);
+
+	const int32 Id = ++LastId;
+	Coroutines.Add(Id, Coroutine);
+	ThreadIds.Add(Coroutine.Thread, Id);
+
+	return Resume(Id, NumArgs, FromL);
+}
+
+bool FLuaCoroutineScheduler::IsSchedulerThread(lua_State* InL) const
+{
+	return ThreadIds.Contains(InL);
+}
+
+int32 FLuaCoroutineScheduler::GetNumWaiting() const
+{
+	return Coroutines.Num();
+}
+
+bool FLuaCoroutineScheduler::ShouldSpawnEvents()
+{
+	return CVarLuaCoroutineEventsAsCoroutines.GetValueOnGameThread() != 0;
+}
+
+FLuaCoroutineScheduler* FLuaCoroutineScheduler::Get(lua_State* L)
+{
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+
+	return LuaStateWrapper ? &LuaStateWrapper->GetCoroutineScheduler() : nullptr;
+}
+
+int32 FLuaCoroutineScheduler::BeginWait(lua_State* InL, uint32& OutSerial)
+{
+	const int32* Id = ThreadIds.Find(InL);
+	if (!Id || !lua_isyieldable(InL))
+	{
+		luaL_error(InL, "Wait failed! must be called in a coroutine started by StartCoroutine or a lua event!");
+		return INDEX_NONE;
+	}
+
+	FCoroutine& Coroutine = Coroutines[*Id];
+	Coroutine.bWaiting = true;
+	Coroutine.bWoken = false;
+	OutSerial = ++Coroutine.WaitSerial;
+
+	return *Id;
+}
+
+void FLuaCoroutineScheduler::Wake(int32 Id, uint32 Serial, int ArgsRef)
+{
+	FCoroutine* Coroutine = Coroutines.Find(Id);
+	if (!Coroutine || !Coroutine->bWaiting || Coroutine->WaitSerial != Serial)
+	{
+		luaL_unref(L, LUA_REGISTRYINDEX, ArgsRef);
+		return;
+	}
+
+	// cleared here so a second wake before resuming is dropped
+	Coroutine->bWaiting = false;
+	Coroutine->bWoken = true;
+
+	ReadyCoroutines.Add({ Id, ArgsRef });
+}
+
+bool FLuaCoroutineScheduler::Resume(int32 Id, int32 NumArgs, lua_State* FromL)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaCoroutineResume);
+
+	lua_State* Thread = Coroutines[Id].Thread;
+	Coroutines[Id].bWaiting = false;
+	Coroutines[Id].bWoken = false;
+
+	// pooled threads miss hooks set after they were created, e.g. by the sample profiler or a debugger
+	if (lua_gethook(Thread) != lua_gethook(L))
+	{
+		lua_sethook(Thread, lua_gethook(L), lua_gethookmask(L), lua_gethookcount(L));
+	}
+
+#if LUA_VERSION_NUM >= 504
+	int NumResults = 0;
+	const int Status = lua_resume(Thread, FromL, NumArgs, &NumResults);
+#else
+	const int Status = lua_resume(Thread, FromL, NumArgs);
+#endif
+
+	// coroutine map may change while resuming
+	FCoroutine* Coroutine = Coroutines.Find(Id);
+	check(Coroutine);
+
+	if (Status == LUA_YIELD)
+	{
+		lua_settop(Thread, 0);
+
+		// plain coroutine.yield() waits one frame, a wait woken before it yielded is already ready
+		if (!Coroutine->bWaiting && !Coroutine->bWoken)
+		{
+			Coroutine->bWaiting = true;
+			FrameWaits.HeapPush({ FrameCounter + 1, Id, ++Coroutine->WaitSerial });
+		}
+
+		return true;
+	}
+
+	ReleaseWaitBinding(*Coroutine);
+
+	const FCoroutine Finished = *Coroutine;
+	Coroutines.Remove(Id);
+	ThreadIds.Remove(Thread);
+
+	if (Status == LUA_OK)
+	{
+		lua_settop(Thread, 0);
+		ReleaseThread(Finished, true);
+
+		return true;
+	}
+
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	if (!LuaStateWrapper || LuaStateWrapper->GetErrorThrottle().Report(Thread, lua_tostring(Thread, -1)))
+	{
+		luaL_traceback(L, Thread, lua_tostring(Thread, -1), 0);
+		UE_LOG(LogBluelua, Error, TEXT("Lua coroutine error! %s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+		lua_pop(L, 1);
+	}
+
+	// dead threads can't be resumed again
+	ReleaseThread(Finished, false);
+
+	return false;
+}
+
+void FLuaCoroutineScheduler::ReleaseThread(const FCoroutine& Coroutine, bool bReusable)
+{
+	if (bReusable && IdleThreads.Num() < CVarLuaCoroutinePoolSize.GetValueOnGameThread())
+	{
+		IdleThreads.Add(Coroutine);
+	}
+	else
+	{
+		luaL_unref(L, LUA_REGISTRYINDEX, Coroutine.ThreadRef);
+	}
+}
+
+void FLuaCoroutineScheduler::ReleaseWaitBinding(FCoroutine& Coroutine)
+{
+	if (Coroutine.BindingRef == LUA_NOREF)
+	{
+		return;
+	}
+
+	// a delegate that never fired keeps the binding and its closure until released here
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	ULuaDelegateDispatcher* Dispatcher = LuaStateWrapper ? LuaStateWrapper->GetDelegateDispatcher() : nullptr;
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, Coroutine.BindingRef);
+
+	int32 Slot = INDEX_NONE;
+	if (Dispatcher && ULuaDelegateDispatcher::FetchBinding(L, -1, Slot) && Slot != INDEX_NONE)
+	{
+		Dispatcher->ReleaseBinding(Slot);
+	}
+
+	lua_pop(L, 1);
+
+	luaL_unref(L, LUA_REGISTRYINDEX, Coroutine.BindingRef);
+	Coroutine.BindingRef = LUA_NOREF;
+}
+
+void FLuaCoroutineScheduler::OnObjectLoaded(int32 Id, uint32 Serial, FSoftObjectPath ObjectPath)
+{
+	LoadHandles.Remove(Id);
+
+	if (!L || !Coroutines.Contains(Id))
+	{
+		return;
+	}
+
+	lua_createtable(L, 1, 1);
+	FLuaUObject::Push(L, ObjectPath.ResolveObject());
+	lua_rawseti(L, -2, 1);
+	lua_pushinteger(L, 1);
+	lua_setfield(L, -2, "n");
+
+	Wake(Id, Serial, luaL_ref(L, LUA_REGISTRYINDEX));
+}
+
+int FLuaCoroutineScheduler::LuaStartCoroutine(lua_State* L)
+{
+	FLuaCoroutineScheduler* Scheduler = Get(L);
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+
+	if (!Scheduler)
+	{
+		return luaL_error(L, "Start coroutine failed! no lua state!");
+	}
+
+	lua_pushboolean(L, Scheduler->Spawn(L, lua_gettop(L) - 1));
+
+	return 1;
+}
+
+int FLuaCoroutineScheduler::LuaWaitSeconds(lua_State* L)
+{
+	FLuaCoroutineScheduler* Scheduler = Get(L);
+	const double Seconds = luaL_checknumber(L, 1);
+
+	uint32 Serial = 0;
+	const int32 Id = Scheduler->BeginWait(L, Serial);
+	Scheduler->TimedWaits.HeapPush({ Scheduler->CurrentTime + Seconds, Id, Serial });
+
+	return lua_yield(L, 0);
+}
+
+int FLuaCoroutineScheduler::LuaWaitFrames(lua_State* L)
+{
+	FLuaCoroutineScheduler* Scheduler = Get(L);
+	const lua_Integer Frames = luaL_optinteger(L, 1, 1);
+
+	uint32 Serial = 0;
+	const int32 Id = Scheduler->BeginWait(L, Serial);
+	Scheduler->FrameWaits.HeapPush({ Scheduler->FrameCounter + (uint64)FMath::Max<lua_Integer>(Frames, 1), Id, Serial });
+
+	return lua_yield(L, 0);
+}
+
+int FLuaCoroutineScheduler::LuaWaitDelegate(lua_State* L)
+{
+	FLuaCoroutineScheduler* Scheduler = Get(L);
+	luaL_checktype(L, 1, LUA_TUSERDATA);
+	lua_settop(L, 1);
+
+	uint32 Serial = 0;
+	const int32 Id = Scheduler->BeginWait(L, Serial);
+
+	// callback(Scheduler, Id, Serial, Delegate, Binding), removes itself on first call
+	lua_pushlightuserdata(L, Scheduler);
+	lua_pushinteger(L, Id);
+	lua_pushinteger(L, Serial);
+	lua_pushvalue(L, 1);
+	lua_pushnil(L);
+	lua_pushcclosure(L, OnDelegateFired, 5);
+	const int32 CallbackIndex = lua_gettop(L);
+
+	lua_pushcfunction(L, &ULuaDelegateDispatcher::CreateFunctionDelegate);
+	FLuaUObject::Push(L, GetTransientPackage());
+	lua_pushvalue(L, CallbackIndex);
+	lua_call(L, 2, 1);
+
+	lua_pushvalue(L, -1);
+	lua_setupvalue(L, CallbackIndex, 5);
+
+	// the binding is owned by the transient package, the coroutine releases it when it ends or waits for the next delegate
+	FCoroutine& Coroutine = Scheduler->Coroutines[Id];
+	Scheduler->ReleaseWaitBinding(Coroutine);
+	lua_pushvalue(L, -1);
+	Coroutine.BindingRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	lua_getfield(L, 1, "Add");
+	lua_pushvalue(L, 1);
+	lua_pushvalue(L, -3);
+	lua_call(L, 2, 0);
+
+	lua_settop(L, 0);
+
+	return lua_yield(L, 0);
+}
+
+int FLuaCoroutineScheduler::LuaWaitLoadObject(lua_State* L)
+{
+	FLuaCoroutineScheduler* Scheduler = Get(L);
+	const FSoftObjectPath ObjectPath(UTF8_TO_TCHAR(luaL_checkstring(L, 1)));
+
+	if (UObject* LoadedObject = ObjectPath.ResolveObject())
+	{
+		return FLuaUObject::Push(L, LoadedObject);
+	}
+
+	uint32 Serial = 0;
+	const int32 Id = Scheduler->BeginWait(L, Serial);
+
+	TSharedPtr<FStreamableHandle> Handle = Scheduler->StreamableManager->RequestAsyncLoad(ObjectPath,
+		FStreamableDelegate::CreateRaw(Scheduler, &FLuaCoroutineScheduler::OnObjectLoaded, Id, Serial, ObjectPath));
+
+	// a load that completed synchronously already woke the coroutine
+	const FCoroutine* Coroutine = Scheduler->Coroutines.Find(Id);
+	if (Handle.IsValid() && Coroutine && Coroutine->bWaiting)
+	{
+		Scheduler->LoadHandles.Add(Id, Handle);
+	}
+
+	return lua_yield(L, 0);
+}
+
+int FLuaCoroutineScheduler::OnDelegateFired(lua_State* L)
+{
+	FLuaCoroutineScheduler* Scheduler = (FLuaCoroutineScheduler*)lua_touserdata(L, lua_upvalueindex(1));
+	const int32 Id = (int32)lua_tointeger(L, lua_upvalueindex(2));
+	const uint32 Serial = (uint32)lua_tointeger(L, lua_upvalueindex(3));
+
+	if (lua_isnil(L, lua_upvalueindex(5)))
+	{
+		return 0;
+	}
+
+	const int32 NumArgs = lua_gettop(L);
+
+	lua_createtable(L, NumArgs, 1);
+	for (int32 Index = 1; Index <= NumArgs; ++Index)
+	{
+		lua_pushvalue(L, Index);
+		lua_rawseti(L, -2, Index);
+	}
+	lua_pushinteger(L, NumArgs);
+	lua_setfield(L, -2, "n");
+
+	Scheduler->Wake(Id, Serial, luaL_ref(L, LUA_REGISTRYINDEX));
+
+	lua_getfield(L, lua_upvalueindex(4), "Remove");
+	lua_pushvalue(L, lua_upvalueindex(4));
+	lua_pushvalue(L, lua_upvalueindex(5));
+	lua_call(L, 2, 0);
+
+	lua_pushnil(L);
+	lua_replace(L, lua_upvalueindex(5));
+
+	return 0;
+}
@@ -0,0 +1,630 @@
+#include "LuaDelegateDispatcher.h"
+
+#include "HAL/IConsoleManager.h"
+#include "UObject/Class.h"
+#include "UObject/UnrealType.h"
+#include "UObject/UObjectGlobals.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+#include "LuaFunctionDelegate.h"
+#include "LuaState.h"
+#include "LuaStackGuard.h"
+#include "LuaTrace.h"
+#include "LuaUObject.h"
+
+DECLARE_CYCLE_STAT(TEXT("HandleLuaBinding"), STAT_HandleLuaBinding, STATGROUP_Bluelua);
+
+static TAutoConsoleVariable<int32> CVarLuaDelegateSlotReuseDelay(
+	TEXT("bluelua.Delegate.SlotReuseDelay"),
+	1024,
+	TEXT("Number of released delegate binding slots kept before a slot is reused."));
+
+struct FLuaBindingHandle
+{
+	int32 Slot;
+	uint32 Serial;
+};
+
+const FName ULuaDelegateDispatcher::BindingFunctionName(TEXT("LuaBinding"));
+const char* ULuaDelegateDispatcher::BINDING_METATABLE = "LuaBinding_Metatable";
+TArray<UFunction*> ULuaDelegateDispatcher::BindingFunctions;
+
+void ULuaDelegateDispatcher::ProcessEvent(UFunction* Function, void* Parameters)
+{
+	const int32 Slot = Function ? GetBindingSlot(Function->GetFName()) : INDEX_NONE;
+	if (Slot != INDEX_NONE)
+	{
+		CallBinding(Slot, Parameters);
+	}
+	else
+	{
+		Super::ProcessEvent(Function, Parameters);
+	}
+}
+
+void ULuaDelegateDispatcher::BeginDestroy()
+{
+	Shutdown();
+
+	Super::BeginDestroy();
+}
+
+void ULuaDelegateDispatcher::BindLuaState(TSharedPtr<FLuaState> InLuaState)
+{
+	LuaState = InLuaState;
+}
+
+void ULuaDelegateDispatcher::Shutdown()
+{
+	// unbind from delegates that outlive the state, function refs are released with the state
+	LuaState.Reset();
+
+	for (int32 Slot = 0; Slot < Bindings.Num(); ++Slot)
+	{
+		ReleaseBinding(Slot);
+	}
+
+	Bindings.Empty();
+	NumBindings = 0;
+	FreeSlots.Empty();
+	NumFreeSlots = 0;
+	OwnerBindings.Empty();
+	SourceGroups.Empty();
+}
+
+int32 ULuaDelegateDispatcher::CreateBinding(lua_State* L, UObject* Owner, int32 FunctionIndex, int32 SelfIndex)
+{
+	const int32 Slot = AllocateSlot();
+
+	FBinding& Binding = Bindings[Slot];
+
+	lua_pushvalue(L, FunctionIndex);
+	Binding.FunctionRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	if (SelfIndex != 0)
+	{
+		lua_pushvalue(L, SelfIndex);
+		Binding.SelfRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+
+	Binding.bInUse = true;
+	Binding.Owner = Owner;
+	Binding.OwnerKey = Owner;
+	OwnerBindings.Add(Owner, Slot);
+
+	++NumBindings;
+
+	return Slot;
+}
+
+bool ULuaDelegateDispatcher::ReleaseBinding(int32 Slot)
+{
+	if (!IsBindingValid(Slot))
+	{
+		return false;
+	}
+
+	FBinding& Binding = Bindings[Slot];
+
+	// stale UE delegates must not call into the slot once it is reused
+	if (Binding.BoundDelegates.Num() > 0)
+	{
+		FScriptDelegate Delegate;
+		Delegate.BindUFunction(this, GetBindingFunctionName(Slot));
+
+		for (const FBoundDelegate& BoundDelegate : Binding.BoundDelegates)
+		{
+			if (BoundDelegate.Unbind && BoundDelegate.SourceOwner.IsValid())
+			{
+				BoundDelegate.Unbind(const_cast<void*>(BoundDelegate.Source), BoundDelegate.Function, Delegate);
+			}
+		}
+	}
+
+	if (Binding.bGroup)
+	{
+		for (int32 ListenerSlot : Binding.Listeners)
+		{
+			Bindings[ListenerSlot].GroupSlot = INDEX_NONE;
+		}
+
+		const int32* GroupSlot = SourceGroups.Find(Binding.Source);
+		if (GroupSlot && *GroupSlot == Slot)
+		{
+			SourceGroups.Remove(Binding.Source);
+		}
+	}
+	else
+	{
+		TSharedPtr<FLuaState> PinnedLuaState = LuaState.Pin();
+		if (PinnedLuaState.IsValid() && PinnedLuaState->GetState())
+		{
+			luaL_unref(PinnedLuaState->GetState(), LUA_REGISTRYINDEX, Binding.FunctionRef);
+			luaL_unref(PinnedLuaState->GetState(), LUA_REGISTRYINDEX, Binding.SelfRef);
+		}
+
+		if (Binding.GroupSlot != INDEX_NONE)
+		{
+			RemoveFromGroup(Binding.GroupSlot, Slot);
+		}
+	}
+
+	OwnerBindings.RemoveSingle(Binding.OwnerKey, Slot);
+
+	const uint32 Serial = Binding.Serial + 1;
+	Binding = FBinding();
+	Binding.Serial = Serial;
+
+	// copies that were never added to a tracked delegate may still fire, the reuse delay keeps them away from the next binding
+	FreeSlots.Enqueue(Slot);
+	++NumFreeSlots;
+
+	--NumBindings;
+
+	return true;
+}
+
+void ULuaDelegateDispatcher::ReleaseBindingsByOwner(UObject* Owner)
+{
+	TArray<int32> Slots;
+	OwnerBindings.MultiFind(Owner, Slots);
+
+	for (int32 Slot : Slots)
+	{
+		ReleaseBinding(Slot);
+	}
+}
+
+void ULuaDelegateDispatcher::ReleaseBindingsBySource(const void* Source)
+{
+	if (!Source)
+	{
+		return;
+	}
+
+	for (int32 Slot = 0; Slot < Bindings.Num(); ++Slot)
+	{
+		if (Bindings[Slot].Source == Source)
+		{
+			ReleaseBinding(Slot);
+		}
+	}
+}
+
+void ULuaDelegateDispatcher::ReleaseStaleBindings()
+{
+	for (int32 Slot = 0; Slot < Bindings.Num(); ++Slot)
+	{
+		if (IsBindingValid(Slot) && !Bindings[Slot].Owner.IsValid())
+		{
+			ReleaseBinding(Slot);
+		}
+	}
+}
+
+void ULuaDelegateDispatcher::TrackBoundDelegate(int32 Slot, const void* Source, UObject* SourceOwner, UFunction* Function, FUnbindDelegateFuncPtr Unbind)
+{
+	if (!IsBindingValid(Slot) || !Source)
+	{
+		return;
+	}
+
+	// without an owner the delegate memory can't be proven alive at release
+	if (!SourceOwner || !Unbind)
+	{
+		return;
+	}
+
+	FBinding& Binding = Bindings[Slot];
+
+	for (const FBoundDelegate& BoundDelegate : Binding.BoundDelegates)
+	{
+		if (BoundDelegate.Source == Source)
+		{
+			return;
+		}
+	}
+
+	FBoundDelegate& BoundDelegate = Binding.BoundDelegates.AddDefaulted_GetRef();
+	BoundDelegate.Source = Source;
+	BoundDelegate.SourceOwner = SourceOwner;
+	BoundDelegate.Function = Function;
+	BoundDelegate.Unbind = Unbind;
+}
+
+bool ULuaDelegateDispatcher::IsBindingValid(int32 Slot) const
+{
+	return Bindings.IsValidIndex(Slot) && Bindings[Slot].bInUse;
+}
+
+uint32 ULuaDelegateDispatcher::GetBindingSerial(int32 Slot) const
+{
+	return Bindings.IsValidIndex(Slot) ? Bindings[Slot].Serial : 0;
+}
+
+int32 ULuaDelegateDispatcher::GetNumBindings() const
+{
+	return NumBindings;
+}
+
+int32 ULuaDelegateDispatcher::GetNumSlots() const
+{
+	return Bindings.Num();
+}
+
+int32 ULuaDelegateDispatcher::FindOrCreateGroup(const void* Source, UObject* SourceOwner, UFunction* SignatureFunction)
+{
+	if (const int32* GroupSlot = SourceGroups.Find(Source))
+	{
+		// delegate memory may belong to a new object
+		const FBinding& Group = Bindings[*GroupSlot];
+		if (Group.Owner.IsValid() && Group.OwnerKey == SourceOwner && Group.SignatureFunction == SignatureFunction)
+		{
+			return *GroupSlot;
+		}
+
+		ReleaseBinding(*GroupSlot);
+	}
+
+	const int32 Slot = AllocateSlot();
+
+	FBinding& Group = Bindings[Slot];
+	Group.bInUse = true;
+	Group.bGroup = true;
+	Group.SignatureFunction = SignatureFunction;
+	Group.Source = Source;
+	// groups live as long as they have listeners, the source owner only detects reused delegate memory
+	Group.Owner = SourceOwner;
+	Group.OwnerKey = SourceOwner;
+
+	SourceGroups.Add(Source, Slot);
+
+	++NumBindings;
+
+	return Slot;
+}
+
+void ULuaDelegateDispatcher::AddToGroup(int32 GroupSlot, int32 Slot)
+{
+	if (!IsBindingValid(GroupSlot) || !IsBindingValid(Slot) || !Bindings[GroupSlot].bGroup || Bindings[Slot].bGroup)
+	{
+		return;
+	}
+
+	FBinding& Binding = Bindings[Slot];
+	if (Binding.GroupSlot == GroupSlot)
+	{
+		return;
+	}
+
+	if (Binding.GroupSlot != INDEX_NONE)
+	{
+		RemoveFromGroup(Binding.GroupSlot, Slot);
+	}
+
+	FBinding& Group = Bindings[GroupSlot];
+	Group.Listeners.Add(Slot);
+
+	Binding.GroupSlot = GroupSlot;
+	Binding.SignatureFunction = Group.SignatureFunction;
+	Binding.Source = Group.Source;
+}
+
+bool ULuaDelegateDispatcher::RemoveFromGroup(int32 GroupSlot, int32 Slot)
+{
+	if (!IsBindingValid(GroupSlot) || !Bindings[GroupSlot].bGroup)
+	{
+		return false;
+	}
+
+	FBinding& Group = Bindings[GroupSlot];
+	Group.Listeners.RemoveSingle(Slot);
+
+	if (Bindings.IsValidIndex(Slot) && Bindings[Slot].GroupSlot == GroupSlot)
+	{
+		Bindings[Slot].GroupSlot = INDEX_NONE;
+	}
+
+	// the last listener is gone, unbind the group from its delegate
+	if (Group.Listeners.Num() == 0)
+	{
+		ReleaseBinding(GroupSlot);
+		return true;
+	}
+
+	return false;
+}
+
+int32 ULuaDelegateDispatcher::GetGroupSlot(int32 Slot) const
+{
+	return IsBindingValid(Slot) ? Bindings[Slot].GroupSlot : INDEX_NONE;
+}
+
+bool ULuaDelegateDispatcher::CanFanOut(UFunction* SignatureFunction)
+{
+	if (!SignatureFunction)
+	{
+		return false;
+	}
+
+	for (TFieldIterator<UProperty> ParamIter(SignatureFunction); ParamIter && (ParamIter->PropertyFlags & CPF_Parm); ++ParamIter)
+	{
+		if ((ParamIter->PropertyFlags & CPF_ReturnParm) || (ParamIter->PropertyFlags & (CPF_ConstParm | CPF_OutParm)) == CPF_OutParm)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ULuaDelegateDispatcher::MakeDelegate(int32 Slot, UFunction* SignatureFunction, const void* Source, FScriptDelegate& OutDelegate)
+{
+	if (!IsBindingValid(Slot))
+	{
+		return false;
+	}
+
+	FBinding& Binding = Bindings[Slot];
+	if (!Binding.bGroup)
+	{
+		Binding.SignatureFunction = SignatureFunction;
+
+		if (Source)
+		{
+			Binding.Source = Source;
+		}
+	}
+
+	OutDelegate.BindUFunction(this, GetBindingFunctionName(Slot));
+
+	return true;
+}
+
+int ULuaDelegateDispatcher::PushBinding(lua_State* L, int32 Slot)
+{
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	ULuaDelegateDispatcher* Dispatcher = LuaStateWrapper ? LuaStateWrapper->GetDelegateDispatcher() : nullptr;
+	if (!Dispatcher || !Dispatcher->IsBindingValid(Slot))
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	FLuaBindingHandle* Handle = (FLuaBindingHandle*)lua_newuserdata(L, sizeof(FLuaBindingHandle));
+	Handle->Slot = Slot;
+	Handle->Serial = Dispatcher->Bindings[Slot].Serial;
+
+	if (luaL_newmetatable(L, BINDING_METATABLE))
+	{
+		static struct luaL_Reg Metamethods[] =
+		{
+			{ "__tostring", BindingToString },
+			{ NULL, NULL },
+		};
+
+		luaL_setfuncs(L, Metamethods, 0);
+
+		static struct luaL_Reg Methods[] =
+		{
+			{ "Release", LuaReleaseBinding },
+			{ NULL, NULL },
+		};
+
+		luaL_newlib(L, Methods);
+		lua_setfield(L, -2, "__index");
+	}
+
+	lua_setmetatable(L, -2);
+
+	return 1;
+}
+
+bool ULuaDelegateDispatcher::FetchBinding(lua_State* L, int32 Index, int32& OutSlot)
+{
+	OutSlot = INDEX_NONE;
+
+	FLuaBindingHandle* Handle = (FLuaBindingHandle*)luaL_testudata(L, Index, BINDING_METATABLE);
+	if (!Handle)
+	{
+		return false;
+	}
+
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	ULuaDelegateDispatcher* Dispatcher = LuaStateWrapper ? LuaStateWrapper->GetDelegateDispatcher() : nullptr;
+	if (Dispatcher && Dispatcher->IsBindingValid(Handle->Slot) && Dispatcher->Bindings[Handle->Slot].Serial == Handle->Serial)
+	{
+		OutSlot = Handle->Slot;
+	}
+
+	return true;
+}
+
+bool ULuaDelegateDispatcher::FetchDelegate(lua_State* L, int32 Index, UFunction* SignatureFunction, const void* Source, FScriptDelegate& OutDelegate)
+{
+	int32 Slot = INDEX_NONE;
+	if (FetchBinding(L, Index, Slot))
+	{
+		if (Slot == INDEX_NONE)
+		{
+			UE_LOG(LogBluelua, Warning, TEXT("Fetch lua delegate binding failed! Binding is released! SignatureFunction[%s]."), SignatureFunction ? *SignatureFunction->GetName() : TEXT("null"));
+			return false;
+		}
+
+		FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+		ULuaDelegateDispatcher* Dispatcher = LuaStateWrapper ? LuaStateWrapper->GetDelegateDispatcher() : nullptr;
+
+		return Dispatcher && Dispatcher->MakeDelegate(Slot, SignatureFunction, Source, OutDelegate);
+	}
+
+	// delegates created by ULuaFunctionDelegate::Create from C++
+	ULuaFunctionDelegate* FunctionDelegate = ULuaFunctionDelegate::Fetch(L, Index);
+	if (!FunctionDelegate)
+	{
+		return false;
+	}
+
+	FunctionDelegate->BindSignatureFunction(SignatureFunction);
+	OutDelegate.BindUFunction(FunctionDelegate, ULuaFunctionDelegate::DelegateFunctionName);
+
+	return true;
+}
+
+int ULuaDelegateDispatcher::CreateFunctionDelegate(lua_State* L)
+{
+	UObject* DelegateOwner = FLuaUObject::Fetch(L, 1);
+	if (!DelegateOwner)
+	{
+		luaL_error(L, "Create delegate failed! Param 1 must be a UObject as owner!");
+		return 0;
+	}
+
+	const int Param2Type = lua_type(L, 2);
+	if (Param2Type != LUA_TFUNCTION && lua_type(L, 3) != LUA_TFUNCTION)
+	{
+		luaL_error(L, "Create delegate failed! Param 2 or Param 3 must be a function!");
+	}
+
+	const int FunctionIndex = (Param2Type == LUA_TFUNCTION) ? 2 : 3;
+
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	ULuaDelegateDispatcher* Dispatcher = LuaStateWrapper ? LuaStateWrapper->GetDelegateDispatcher() : nullptr;
+	if (!Dispatcher)
+	{
+		return 0;
+	}
+
+	const int32 Slot = Dispatcher->CreateBinding(L, DelegateOwner, FunctionIndex, FunctionIndex == 3 ? 2 : 0);
+
+	return PushBinding(L, Slot);
+}
+
+int32 ULuaDelegateDispatcher::GetBindingSlot(FName FunctionName)
+{
+	// compares name index only, number is slot + 1
+	if (FunctionName.GetNumber() > 0 && FunctionName.IsEqual(BindingFunctionName, ENameCase::IgnoreCase, false))
+	{
+		return FunctionName.GetNumber() - 1;
+	}
+
+	return INDEX_NONE;
+}
+
+FName ULuaDelegateDispatcher::GetBindingFunctionName(int32 Slot)
+{
+	check(IsInGameThread());
+
+	UClass* DispatcherClass = ULuaDelegateDispatcher::StaticClass();
+
+	// thunks are only looked up by delegates, ProcessEvent never runs them
+	while (BindingFunctions.Num() <= Slot)
+	{
+		const FName FunctionName(BindingFunctionName, BindingFunctions.Num() + 1);
+
+		UFunction* Function = NewObject<UFunction>(DispatcherClass, FunctionName, RF_Public | RF_Transient);
+		Function->FunctionFlags |= FUNC_Public;
+		Function->Bind();
+		Function->StaticLink(true);
+		Function->AddToRoot();
+
+		DispatcherClass->AddFunctionToFunctionMap(Function, FunctionName);
+		BindingFunctions.Add(Function);
+	}
+
+	return BindingFunctions[Slot]->GetFName();
+}
+
+int32 ULuaDelegateDispatcher::AllocateSlot()
+{
+	int32 Slot = INDEX_NONE;
+	if (NumFreeSlots > CVarLuaDelegateSlotReuseDelay.GetValueOnGameThread() && FreeSlots.Dequeue(Slot))
+	{
+		--NumFreeSlots;
+	}
+	else
+	{
+		Slot = Bindings.AddDefaulted();
+
+		// make sure the thunk function exists before any delegate is bound to it
+		GetBindingFunctionName(Slot);
+	}
+
+	return Slot;
+}
+
+void ULuaDelegateDispatcher::CallBinding(int32 Slot, void* Parameters)
+{
+	TSharedPtr<FLuaState> PinnedLuaState = LuaState.Pin();
+	if (!PinnedLuaState.IsValid() || !IsBindingValid(Slot))
+	{
+		UE_LOG(LogBluelua, Warning, TEXT("Call lua delegate failed! Lua function is not bound! Binding[%d]."), Slot);
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_HandleLuaBinding);
+
+	lua_State* L = PinnedLuaState->GetState();
+	FLuaStackGuard Gurad(L);
+
+	const FBinding& Binding = Bindings[Slot];
+	UFunction* SignatureFunction = Binding.SignatureFunction;
+
+	FLuaTrace::FScope TraceScope(SignatureFunction);
+
+	if (Binding.bGroup)
+	{
+		TArray<FLuaFunctionRef, TInlineAllocator<16>> Functions;
+		for (int32 ListenerSlot : Binding.Listeners)
+		{
+			Functions.Add({ Bindings[ListenerSlot].FunctionRef, Bindings[ListenerSlot].SelfRef });
+		}
+
+		if (Functions.Num() > 0)
+		{
+			PinnedLuaState->CallLuaFunctions(SignatureFunction, Parameters, Functions);
+		}
+
+		return;
+	}
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, Binding.FunctionRef);
+	if (lua_type(L, -1) != LUA_TFUNCTION)
+	{
+		return;
+	}
+
+	bool bWithSelf = false;
+	if (Binding.SelfRef != LUA_NOREF)
+	{
+		lua_rawgeti(L, LUA_REGISTRYINDEX, Binding.SelfRef);
+		bWithSelf = true;
+	}
+
+	// stack = [BindingFunction]
+	PinnedLuaState->CallLuaFunction(SignatureFunction, Parameters, bWithSelf);
+}
+
+int ULuaDelegateDispatcher::BindingToString(lua_State* L)
+{
+	FLuaBindingHandle* Handle = (FLuaBindingHandle*)luaL_checkudata(L, 1, BINDING_METATABLE);
+
+	lua_pushfstring(L, "LuaBinding[%d][%d]", Handle->Slot, (int)Handle->Serial);
+
+	return 1;
+}
+
+int ULuaDelegateDispatcher::LuaReleaseBinding(lua_State* L)
+{
+	FLuaBindingHandle* Handle = (FLuaBindingHandle*)luaL_checkudata(L, 1, BINDING_METATABLE);
+
+	int32 Slot = INDEX_NONE;
+	FetchBinding(L, 1, Slot);
+
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	ULuaDelegateDispatcher* Dispatcher = LuaStateWrapper ? LuaStateWrapper->GetDelegateDispatcher() : nullptr;
+
+	lua_pushboolean(L, Dispatcher && Slot != INDEX_NONE && Dispatcher->ReleaseBinding(Handle->Slot));
+
+	return 1;
+}
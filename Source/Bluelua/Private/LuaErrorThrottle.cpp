@@ -0,0 +1,148 @@
+#include "LuaErrorThrottle.h"
+
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Crc.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+#include "LuaState.h"
+
+static TAutoConsoleVariable<int32> CVarLuaErrorThrottle(
+	TEXT("bluelua.Error.Throttle"),
+	1,
+	TEXT("Log the traceback of a lua error site once per window and count repeats, 0 logs every error."));
+
+static TAutoConsoleVariable<float> CVarLuaErrorWindowSeconds(
+	TEXT("bluelua.Error.WindowSeconds"),
+	10.f,
+	TEXT("Seconds a lua error site stays throttled after its traceback is logged, suppressed counts are summarized as often."));
+
+// frames searched for the lua function that raised the error
+static const int32 LuaErrorMaxSiteLevel = 8;
+
+FLuaErrorThrottle::FLuaErrorThrottle()
+	: TotalCount(0)
+	, PendingSuppressedCount(0)
+	, LastSummaryTime(FPlatformTime::Seconds())
+{
+}
+
+bool FLuaErrorThrottle::Report(lua_State* Thread, const char* Message)
+{
+	++TotalCount;
+
+	// innermost frame with a line, errors raised by C functions belong to their lua caller
+	lua_Debug Ar;
+	bool bFoundSite = false;
+	for (int32 Level = 0; Level < LuaErrorMaxSiteLevel && lua_getstack(Thread, Level, &Ar); ++Level)
+	{
+		if (lua_getinfo(Thread, "Sl", &Ar) && Ar.currentline > 0)
+		{
+			bFoundSite = true;
+			break;
+		}
+	}
+
+	const uint32 Key = bFoundSite
+		? HashCombine(FCrc::StrCrc32(Ar.short_src), (uint32)Ar.currentline)
+		: FCrc::StrCrc32(Message ? Message : "");
+
+	const double Now = FPlatformTime::Seconds();
+
+	FLuaErrorSite* Site = Sites.Find(Key);
+	if (!Site)
+	{
+		Site = &Sites.Add(Key);
+		Site->Location = bFoundSite ? FString::Printf(TEXT("%s:%d"), UTF8_TO_TCHAR(Ar.short_src), Ar.currentline) : TEXT("?");
+	}
+
+	++Site->TotalCount;
+
+	if (CVarLuaErrorThrottle.GetValueOnGameThread() != 0
+		&& Site->TotalCount > 1
+		&& Now - Site->WindowStartTime < CVarLuaErrorWindowSeconds.GetValueOnGameThread())
+	{
+		++Site->SuppressedCount;
+		++PendingSuppressedCount;
+		return false;
+	}
+
+	Site->WindowStartTime = Now;
+	Site->LastMessage = UTF8_TO_TCHAR(Message ? Message : "");
+
+	return true;
+}
+
+void FLuaErrorThrottle::Tick(float DeltaTime)
+{
+	if (PendingSuppressedCount <= 0)
+	{
+		return;
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	if (Now - LastSummaryTime >= CVarLuaErrorWindowSeconds.GetValueOnGameThread())
+	{
+		WriteSummary(Now);
+	}
+}
+
+int32 FLuaErrorThrottle::GetTotalCount() const
+{
+	return TotalCount;
+}
+
+const TMap<uint32, FLuaErrorSite>& FLuaErrorThrottle::GetSites() const
+{
+	return Sites;
+}
+
+void FLuaErrorThrottle::Reset()
+{
+	Sites.Reset();
+	TotalCount = 0;
+	PendingSuppressedCount = 0;
+}
+
+int FLuaErrorThrottle::LuaGetErrorCounts(lua_State* L)
+{
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	if (!LuaStateWrapper)
+	{
+		return 0;
+	}
+
+	const FLuaErrorThrottle& ErrorThrottle = LuaStateWrapper->GetErrorThrottle();
+
+	lua_createtable(L, 0, ErrorThrottle.Sites.Num());
+	for (const auto& Pair : ErrorThrottle.Sites)
+	{
+		lua_pushinteger(L, Pair.Value.TotalCount);
+		lua_setfield(L, -2, TCHAR_TO_UTF8(*Pair.Value.Location));
+	}
+
+	lua_pushinteger(L, ErrorThrottle.TotalCount);
+
+	return 2;
+}
+
+void FLuaErrorThrottle::WriteSummary(double Now)
+{
+	const double Window = Now - LastSummaryTime;
+	LastSummaryTime = Now;
+
+	UE_LOG(LogBluelua, Warning, TEXT("Lua errors suppressed! %d repeats in the last %.0f seconds:"), PendingSuppressedCount, Window);
+
+	for (auto& Pair : Sites)
+	{
+		FLuaErrorSite& Site = Pair.Value;
+		if (Site.SuppressedCount > 0)
+		{
+			UE_LOG(LogBluelua, Warning, TEXT("    %s suppressed %d times, %d in total, last logged: %s"), *Site.Location, Site.SuppressedCount, Site.TotalCount, *Site.LastMessage);
+			Site.SuppressedCount = 0;
+		}
+	}
+
+	PendingSuppressedCount = 0;
+}
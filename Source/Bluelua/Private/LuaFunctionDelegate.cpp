@@ -9,6 +9,7 @@
 #include "LuaObjectBase.h"
 #include "LuaState.h"
 #include "LuaStackGuard.h"
+#include "LuaTrace.h"
 #include "LuaUObject.h"
 
 DECLARE_CYCLE_STAT(TEXT("HandleLuaDelegate"), STAT_HandleLuaDelegate, STATGROUP_Bluelua);
@@ -26,6 +27,7 @@ void ULuaFunctionDelegate::ProcessEvent(UFunction* Function, void* Parameters)
 		}
 
 		SCOPE_CYCLE_COUNTER(STAT_HandleLuaDelegate);
+		FLuaTrace::FScope TraceScope(SignatureFunction);
 
 		lua_State* L = LuaState.Pin()->GetState();
 		FLuaStackGuard Gurad(L);
@@ -98,38 +100,6 @@ ULuaFunctionDelegate* ULuaFunctionDelegate::Fetch(lua_State* L, int32 Index)
 	return FunctionDelegate;
 }
 
-int ULuaFunctionDelegate::CreateFunctionDelegate(lua_State* L)
-{
-	UObject* DelegateOwner = FLuaUObject::Fetch(L, 1);
-	if (!DelegateOwner)
-	{
-		luaL_error(L, "Create delegate failed! Param 1 must be a UObject as owner!");
-		return 0;
-	}
-
-	const int Param2Type = lua_type(L, 2);
-	if (Param2Type != LUA_TFUNCTION && lua_type(L, 3) != LUA_TFUNCTION)
-	{
-		luaL_error(L, "Create delegate failed! Param 2 or Param 3 must be a function!");
-	}
-
-	const int FunctionIndex = (Param2Type == LUA_TFUNCTION) ? 2 : 3;
-
-	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
-	if (!LuaStateWrapper)
-	{
-		return 0;
-	}
-
-	ULuaFunctionDelegate* FunctionDelegate = ULuaFunctionDelegate::Create(DelegateOwner, LuaStateWrapper->AsShared(), nullptr, FunctionIndex);
-	if (!FunctionDelegate)
-	{
-		return 0;
-	}
-
-	return FLuaUObject::Push(L, FunctionDelegate, DelegateOwner);
-}
-
 void ULuaFunctionDelegate::BindLuaState(TSharedPtr<FLuaState> InLuaState)
 {
 	LuaState = InLuaState;
@@ -0,0 +1,248 @@
+#include "LuaGCScheduler.h"
+
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/App.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+
+DECLARE_CYCLE_STAT(TEXT("LuaGCSlice"), STAT_LuaGCSlice, STATGROUP_Bluelua);
+DECLARE_CYCLE_STAT(TEXT("LuaGCFullCollect"), STAT_LuaGCFullCollect, STATGROUP_Bluelua);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("LuaGCPauseMs"), STAT_LuaGCPauseMs, STATGROUP_Bluelua);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("LuaGCMaxPauseMs"), STAT_LuaGCMaxPauseMs, STATGROUP_Bluelua);
+
+static TAutoConsoleVariable<int32> CVarLuaGCScheduler(
+	TEXT("bluelua.GC.Scheduler"),
+	1,
+	TEXT("Drive lua garbage collector in per frame slices instead of lua's automatic collector."));
+
+static TAutoConsoleVariable<float> CVarLuaGCBudgetMs(
+	TEXT("bluelua.GC.BudgetMs"),
+	1.f,
+	TEXT("Time in milliseconds lua garbage collector may use every frame."));
+
+static TAutoConsoleVariable<float> CVarLuaGCSlackBudgetMs(
+	TEXT("bluelua.GC.SlackBudgetMs"),
+	4.f,
+	TEXT("Extra time in milliseconds lua garbage collector may use when last frame had slack, or when collection falls behind."));
+
+static TAutoConsoleVariable<float> CVarLuaGCTargetFrameMs(
+	TEXT("bluelua.GC.TargetFrameMs"),
+	0.f,
+	TEXT("Frames faster than this count as slack, 0 only uses engine idle time."));
+
+static TAutoConsoleVariable<int32> CVarLuaGCStepKB(
+	TEXT("bluelua.GC.StepKB"),
+	64,
+	TEXT("Work of one lua garbage collector step, in KB of allocation debt."));
+
+static TAutoConsoleVariable<int32> CVarLuaGCPause(
+	TEXT("bluelua.GC.Pause"),
+	200,
+	TEXT("Start a new cycle when heap grows to this percentage of its size after the last cycle, same as lua's gc pause."));
+
+static TAutoConsoleVariable<int32> CVarLuaGCHeapCeilingMB(
+	TEXT("bluelua.GC.HeapCeilingMB"),
+	64,
+	TEXT("Heap size in MB above which a state that hasn't ticked for a second, e.g. while loading, in a commandlet or a benchmark, restarts lua's automatic collector until it ticks again, 0 disables."));
+
+static TAutoConsoleVariable<int32> CVarLuaGCWithEngineGC(
+	TEXT("bluelua.GC.CollectWithEngineGC"),
+	1,
+	TEXT("Run a full lua collect after engine garbage collection and map load."));
+
+FLuaGCScheduler::FLuaGCScheduler()
+	: L(nullptr)
+	, bScheduling(false)
+	, bSchedulingAllowed(true)
+	, bCycleRunning(false)
+	, bCollectorRestarted(false)
+	, LastTickTime(0.0)
+	, NextCycleKB(0)
+{
+}
+
+void FLuaGCScheduler::Init(lua_State* InL)
+{
+	L = InL;
+	LastTickTime = FPlatformTime::Seconds();
+
+	SetScheduling(bSchedulingAllowed && CVarLuaGCScheduler.GetValueOnGameThread() != 0);
+}
+
+void FLuaGCScheduler::Tick(float DeltaTime)
+{
+	if (!L)
+	{
+		return;
+	}
+
+	const bool bWantScheduling = bSchedulingAllowed && CVarLuaGCScheduler.GetValueOnGameThread() != 0;
+	if (bWantScheduling != bScheduling)
+	{
+		SetScheduling(bWantScheduling);
+	}
+
+	if (!bScheduling)
+	{
+		return;
+	}
+
+	LastTickTime = FPlatformTime::Seconds();
+
+	if (bCollectorRestarted)
+	{
+		bCollectorRestarted = false;
+		lua_gc(L, LUA_GCSTOP, 0);
+	}
+
+	const int32 HeapKB = lua_gc(L, LUA_GCCOUNT, 0);
+	if (!bCycleRunning)
+	{
+		if (HeapKB < NextCycleKB)
+		{
+			return;
+		}
+
+		bCycleRunning = true;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_LuaGCSlice);
+
+	// heap keeps growing faster than slices collect, spend the slack budget regardless of frame time
+	const bool bBehind = (HeapKB >= NextCycleKB * 2);
+	const double BudgetMs = bBehind ? CVarLuaGCBudgetMs.GetValueOnGameThread() + CVarLuaGCSlackBudgetMs.GetValueOnGameThread() : GetSliceBudgetMs(DeltaTime);
+	const int32 StepKB = FMath::Max(1, CVarLuaGCStepKB.GetValueOnGameThread());
+
+	const double StartTime = FPlatformTime::Seconds();
+	const double EndTime = StartTime + BudgetMs / 1000.0;
+
+	do
+	{
+		++Stats.Steps;
+
+		if (lua_gc(L, LUA_GCSTEP, StepKB))
+		{
+			++Stats.Cycles;
+			ScheduleNextCycle();
+			break;
+		}
+	} while (FPlatformTime::Seconds() < EndTime);
+
+	Stats.LastSliceMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	Stats.MaxSliceMs = FMath::Max(Stats.MaxSliceMs, Stats.LastSliceMs);
+
+	INC_FLOAT_STAT_BY(STAT_LuaGCPauseMs, Stats.LastSliceMs);
+	SET_FLOAT_STAT(STAT_LuaGCMaxPauseMs, FMath::Max(Stats.MaxSliceMs, Stats.MaxFullCollectMs));
+}
+
+void FLuaGCScheduler::CheckHeapCeiling()
+{
+	if (!L || !bScheduling || bCollectorRestarted)
+	{
+		return;
+	}
+
+	const int32 CeilingMB = CVarLuaGCHeapCeilingMB.GetValueOnGameThread();
+	if (CeilingMB <= 0)
+	{
+		return;
+	}
+
+	const int32 HeapKB = lua_gc(L, LUA_GCCOUNT, 0);
+	if (HeapKB < CeilingMB * 1024 || FPlatformTime::Seconds() - LastTickTime < 1.0)
+	{
+		return;
+	}
+
+	// lua paces itself by allocation, Tick stops it again once the state ticks
+	bCollectorRestarted = true;
+	lua_gc(L, LUA_GCRESTART, 0);
+	++Stats.CeilingRestarts;
+
+	UE_LOG(LogBluelua, Log, TEXT("Lua heap %dKB is over bluelua.GC.HeapCeilingMB and the state isn't ticking, lua's collector runs until the next tick."), HeapKB);
+}
+
+void FLuaGCScheduler::FullCollect(const TCHAR* Reason)
+{
+	if (!L || CVarLuaGCWithEngineGC.GetValueOnGameThread() == 0)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_LuaGCFullCollect);
+
+	const int32 HeapKB = lua_gc(L, LUA_GCCOUNT, 0);
+	const double StartTime = FPlatformTime::Seconds();
+
+	lua_gc(L, LUA_GCCOLLECT, 0);
+
+	++Stats.FullCollects;
+	Stats.LastFullCollectMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	Stats.MaxFullCollectMs = FMath::Max(Stats.MaxFullCollectMs, Stats.LastFullCollectMs);
+
+	ScheduleNextCycle();
+
+	INC_FLOAT_STAT_BY(STAT_LuaGCPauseMs, Stats.LastFullCollectMs);
+	SET_FLOAT_STAT(STAT_LuaGCMaxPauseMs, FMath::Max(Stats.MaxSliceMs, Stats.MaxFullCollectMs));
+
+	UE_LOG(LogBluelua, Verbose, TEXT("Lua full collect after %s took %.2fms, heap %dKB -> %dKB."), Reason, Stats.LastFullCollectMs, HeapKB, lua_gc(L, LUA_GCCOUNT, 0));
+}
+
+bool FLuaGCScheduler::IsScheduling() const
+{
+	return bScheduling;
+}
+
+const FLuaGCStats& FLuaGCScheduler::GetStats() const
+{
+	return Stats;
+}
+
+void FLuaGCScheduler::SetSchedulingAllowed(bool bInSchedulingAllowed)
+{
+	bSchedulingAllowed = bInSchedulingAllowed;
+
+	const bool bWantScheduling = bSchedulingAllowed && CVarLuaGCScheduler.GetValueOnGameThread() != 0;
+	if (L && bWantScheduling != bScheduling)
+	{
+		SetScheduling(bWantScheduling);
+	}
+}
+
+void FLuaGCScheduler::SetScheduling(bool bInScheduling)
+{
+	bScheduling = bInScheduling;
+	bCollectorRestarted = false;
+
+	if (bScheduling)
+	{
+		// steps still run while stopped, lua only skips its own allocation triggered steps
+		lua_gc(L, LUA_GCSTOP, 0);
+		ScheduleNextCycle();
+	}
+	else
+	{
+		lua_gc(L, LUA_GCRESTART, 0);
+	}
+}
+
+void FLuaGCScheduler::ScheduleNextCycle()
+{
+	bCycleRunning = false;
+	NextCycleKB = lua_gc(L, LUA_GCCOUNT, 0) * FMath::Max(100, CVarLuaGCPause.GetValueOnGameThread()) / 100;
+}
+
+double FLuaGCScheduler::GetSliceBudgetMs(float DeltaTime) const
+{
+	double SlackMs = FApp::GetIdleTime() * 1000.0;
+
+	const float TargetFrameMs = CVarLuaGCTargetFrameMs.GetValueOnGameThread();
+	if (TargetFrameMs > 0.f)
+	{
+		SlackMs = FMath::Max(SlackMs, (double)TargetFrameMs - DeltaTime * 1000.0);
+	}
+
+	return CVarLuaGCBudgetMs.GetValueOnGameThread() + FMath::Clamp(SlackMs, 0.0, (double)CVarLuaGCSlackBudgetMs.GetValueOnGameThread());
+}
@@ -10,14 +10,16 @@
 #include "LuaObjectBase.h"
 #include "LuaState.h"
 #include "LuaStackGuard.h"
+#include "LuaTrace.h"
 #include "LuaUObject.h"
+#include "LuaUStruct.h"
 
 DECLARE_CYCLE_STAT(TEXT("InitLuaBinding"), STAT_InitLuaBinding, STATGROUP_Bluelua);
 DECLARE_CYCLE_STAT(TEXT("ReleaseLuaBinding"), STAT_ReleaseLuaBinding, STATGROUP_Bluelua);
 DECLARE_CYCLE_STAT(TEXT("CleanAllLuaObject"), STAT_CleanAllLuaObject, STATGROUP_Bluelua);
+DECLARE_CYCLE_STAT(TEXT("HotReloadLuaFile"), STAT_HotReloadLuaFile, STATGROUP_Bluelua);
 DECLARE_CYCLE_STAT(TEXT("ProcessLuaOverrideEvent"), STAT_ProcessLuaOverrideEvent, STATGROUP_Bluelua);
 DECLARE_CYCLE_STAT(TEXT("CallBPFunctionOverride"), STAT_CallBPFunctionOverride, STATGROUP_Bluelua);
-DECLARE_CYCLE_STAT(TEXT("FillBPFunctionOverrideOutProperty"), STAT_FillBPFunctionOverrideOutProperty, STATGROUP_Bluelua);
 
 struct FLuaAutoCleanGlobal
 {
@@ -109,6 +111,39 @@ void ILuaImplementableInterface::CleanAllLuaImplementableObject(FLuaState* InLua
 	}
 }
 
+void ILuaImplementableInterface::HotReloadLuaFile(const FString& FilePath)
+{
+	SCOPE_CYCLE_COUNTER(STAT_HotReloadLuaFile);
+
+	const FString NormalizedFilePath = FLuaState::NormalizeFilePath(FilePath);
+
+	TArray<FLuaState*> LuaStates;
+	LuaImplementableObjects.GetKeys(LuaStates);
+
+	for (FLuaState* InLuaState : LuaStates)
+	{
+		InLuaState->ReloadFile(NormalizedFilePath);
+
+		TArray<ILuaImplementableInterface*> PendingReloadObjects;
+		for (auto& Interface : LuaImplementableObjects.FindRef(InLuaState))
+		{
+			if (Interface->BoundLuaFilePath.Equals(NormalizedFilePath))
+			{
+				PendingReloadObjects.Emplace(Interface);
+			}
+		}
+
+		for (auto& Interface : PendingReloadObjects)
+		{
+			UObject* Object = Cast<UObject>(Interface);
+			if (Object && Object->IsValidLowLevel())
+			{
+				Interface->OnReloadLuaBinding();
+			}
+		}
+	}
+}
+
 bool ILuaImplementableInterface::OnInitLuaBinding()
 {
 	SCOPE_CYCLE_COUNTER(STAT_InitLuaBinding);
@@ -174,11 +209,56 @@ bool ILuaImplementableInterface::OnInitLuaBinding()
 
 	InitBPFunctionOverriding();
 
+	BoundLuaFilePath = FLuaState::NormalizeFilePath(OnInitBindingLuaPath_Parms.ReturnValue);
 	ModuleReferanceIndex = luaL_ref(L, LUA_REGISTRYINDEX);
 	
 	return true;
 }
 
+bool ILuaImplementableInterface::OnReloadLuaBinding()
+{
+	if (!IsLuaBound())
+	{
+		return false;
+	}
+
+	UObject* ThisObject = Cast<UObject>(this);
+
+	lua_State* L = LuaState->GetState();
+	FLuaStackGuard StackGuard(L);
+
+	FLuaAutoCleanGlobal AutoCleanGlobal(L, "Super");
+
+	FLuaUObject::Push(L, ThisObject);
+	lua_setglobal(L, "Super");
+
+	if (!LuaState->DoFile(BoundLuaFilePath))
+	{
+		UE_LOG(LogBluelua, Warning, TEXT("Reload lua binding in object[%s] failed! Do lua file[%s] failed!"), *ThisObject->GetName(), *BoundLuaFilePath);
+		return false;
+	}
+
+	if (lua_type(L, -1) != LUA_TTABLE)
+	{
+		UE_LOG(LogBluelua, Warning, TEXT("Reload lua binding in object[%s] failed! Lua file[%s] should return a table!"), *ThisObject->GetName(), *BoundLuaFilePath);
+		return false;
+	}
+
+	const int NewModuleIndex = lua_gettop(L);
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, ModuleReferanceIndex);
+	if (lua_type(L, -1) != LUA_TTABLE)
+	{
+		return false;
+	}
+
+	// swap function bodies into the bound module table, then re-resolve overrides against it
+	FLuaState::PatchTable(L, -1, NewModuleIndex);
+	InitBPFunctionOverriding();
+
+	return true;
+}
+
 void ILuaImplementableInterface::OnReleaseLuaBinding()
 {
 	SCOPE_CYCLE_COUNTER(STAT_ReleaseLuaBinding);
@@ -198,6 +278,7 @@ void ILuaImplementableInterface::OnReleaseLuaBinding()
 	}
 
 	ModuleReferanceIndex = LUA_NOREF;
+	BoundLuaFilePath.Empty();
 	LuaState.Reset();
 }
 
@@ -354,22 +435,6 @@ void ILuaImplementableInterface::RemoveFromLuaObjectList(FLuaState* InLuaState,
 	(*ValuePtr).Remove(Object);
 }
 
-int ILuaImplementableInterface::FillBPFunctionOverrideOutProperty(struct lua_State* L)
-{
-	SCOPE_CYCLE_COUNTER(STAT_FillBPFunctionOverrideOutProperty);
-
-	int32 OutParamsCount = lua_tointeger(L, lua_upvalueindex(1));
-	FOutParmRec* OutParamsList = (FOutParmRec*)lua_touserdata(L, lua_upvalueindex(2 + OutParamsCount));
-
-	int32 OutParamUpValueIndex = 2;
-	for (FOutParmRec* OutParam = OutParamsList; OutParam; OutParam = OutParam->NextOutParm)
-	{
-		FLuaObjectBase::FetchProperty(L, OutParam->Property, OutParam->PropAddr, lua_upvalueindex(OutParamUpValueIndex++));
-	}
-
-	return 0;
-}
-
 void ILuaImplementableInterface::ProcessBPFunctionOverride(UObject* Context, FFrame& Stack, void* const Z_Param__Result)
 {
 	UFunction* Function = Stack.CurrentNativeFunction;
@@ -423,6 +488,12 @@ bool ILuaImplementableInterface::CallBPFunctionOverride(UFunction* Function, FFr
 		return false;
 	}
 
+	// stack = [Module, Function, Module]
+	FLuaTrace::FScope TraceScope(L, -2, Function);
+
+	// the frame and out param addresses outlive the call
+	FLuaUStruct::FBorrowScope BorrowScope;
+
 	uint8* Frame = (uint8*)FMemory_Alloca(Function->PropertiesSize);
 	FMemory::Memzero(Frame, Function->PropertiesSize);
 
@@ -463,7 +534,7 @@ bool ILuaImplementableInterface::CallBPFunctionOverride(UFunction* Function, FFr
 			{
 				// also an in param
 				++InParamsCount;
-				FLuaObjectBase::PushProperty(L, Property, Out->PropAddr);
+				FLuaObjectBase::PushBorrowedProperty(L, Property, Out->PropAddr);
 			}
 
 			if (!(Property->PropertyFlags & CPF_ConstParm))
@@ -494,7 +565,7 @@ bool ILuaImplementableInterface::CallBPFunctionOverride(UFunction* Function, FFr
 			Stack.Step(Stack.Object, Param);
 
 			++InParamsCount;
-			FLuaObjectBase::PushProperty(L, Property, Param);
+			FLuaObjectBase::PushBorrowedProperty(L, Property, Param);
 		}
 	}
 
@@ -506,14 +577,17 @@ bool ILuaImplementableInterface::CallBPFunctionOverride(UFunction* Function, FFr
 		LocalProp->InitializeValue_InContainer(Frame);
 	}
 
-	if (LuaState->CallLuaFunction(InParamsCount + 1, OutParamsCount) && OutParamsCount > 0)
+	if (OutParamsCount > 0)
 	{
-		lua_pushinteger(L, OutParamsCount);
-		lua_insert(L, -(OutParamsCount + 1));
-		lua_pushlightuserdata(L, OutParamsList);
-		lua_pushcclosure(L, FillBPFunctionOverrideOutProperty, OutParamsCount + 2);
+		FLuaOutParams OutParams;
+		OutParams.OutParamsList = OutParamsList;
+		OutParams.OutParamsCount = OutParamsCount;
 
-		LuaState->CallLuaFunction(0, 0, false);
+		LuaState->CallLuaFunction(InParamsCount + 1, OutParams);
+	}
+	else
+	{
+		LuaState->CallLuaFunction(InParamsCount + 1, 0);
 	}
 
 	// destruct properties on the stack, except for out params since we know we didn't use that memory
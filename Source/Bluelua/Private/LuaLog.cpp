@@ -0,0 +1,706 @@
+#include "LuaLog.h"
+
+#include "HAL/Event.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformAtomics.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "Misc/DateTime.h"
+#include "Misc/OutputDeviceRedirector.h"
+#include "Misc/ScopeLock.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+#include "LuaState.h"
+
+DECLARE_CYCLE_STAT(TEXT("LuaLogWrite"), STAT_LuaLogWrite, STATGROUP_Bluelua);
+
+static TAutoConsoleVariable<int32> CVarLuaLogLevel(
+	TEXT("bluelua.Log.Level"),
+	3,
+	TEXT("Max level of lua log messages, 0 Error, 1 Warning, 2 Display, 3 Log, 4 Verbose. Messages above it are dropped before formatting."));
+
+static TAutoConsoleVariable<int32> CVarLuaLogAsync(
+	TEXT("bluelua.Log.Async"),
+	1,
+	TEXT("Write lua log messages on a background thread, 0 writes them synchronously."));
+
+static TAutoConsoleVariable<int32> CVarLuaLogStructured(
+	TEXT("bluelua.Log.Structured"),
+	0,
+	TEXT("Write lua log messages as json lines with time, level and category for log ingestion."));
+
+// longer messages are formatted on the heap and written synchronously, messages over the max size are truncated
+static const int32 LuaLogMessageSize = 480;
+static const int32 LuaLogMaxMessageSize = 64 * 1024;
+static const int32 LuaLogCategorySize = 32;
+
+// the writer also wakes up when this many messages are pending
+static const int64 LuaLogWakeThreshold = 256;
+static const uint32 LuaLogWriterIntervalMs = 10;
+
+static const TCHAR* const LuaLogLevelNames[] = { TEXT("Error"), TEXT("Warning"), TEXT("Display"), TEXT("Log"), TEXT("Verbose") };
+
+static ELogVerbosity::Type ToVerbosity(ELuaLogLevel Level)
+{
+	switch (Level)
+	{
+	case ELuaLogLevel::Error: return ELogVerbosity::Error;
+	case ELuaLogLevel::Warning: return ELogVerbosity::Warning;
+	case ELuaLogLevel::Display: return ELogVerbosity::Display;
+	case ELuaLogLevel::Log: return ELogVerbosity::Log;
+	default: return ELogVerbosity::Verbose;
+	}
+}
+
+struct FLuaLogMessage
+{
+	int64 Ticks;
+	int32 Length;
+	int32 PrefixLength;
+	ELuaLogLevel Level;
+	bool bJsonFields;
+	ANSICHAR Category[LuaLogCategorySize];
+	ANSICHAR Text[LuaLogMessageSize];
+
+	void Fill(ELuaLogLevel InLevel, const ANSICHAR* InCategory, const ANSICHAR* InText, int32 InLength, bool bInJsonFields, int32 InPrefixLength)
+	{
+		Ticks = FDateTime::UtcNow().GetTicks();
+		Level = InLevel;
+		bJsonFields = bInJsonFields;
+		Length = FMath::Min(InLength, LuaLogMessageSize);
+		PrefixLength = FMath::Min(InPrefixLength, Length);
+		FMemory::Memcpy(Text, InText, Length);
+		FCStringAnsi::Strncpy(Category, InCategory ? InCategory : "Lua", LuaLogCategorySize);
+	}
+
+	// copy the used part only
+	void CopyTo(FLuaLogMessage& OutMessage) const
+	{
+		FMemory::Memcpy(&OutMessage, this, STRUCT_OFFSET(FLuaLogMessage, Text) + Length);
+	}
+};
+
+// bounded multi producer single consumer ring buffer,
+// the sequence number of a slot tells producers and the consumer whose turn it is so no lock is taken
+class FLuaLogRing
+{
+public:
+	FLuaLogRing()
+		: EnqueuePos(0)
+		, DequeuePos(0)
+	{
+		for (int64 Index = 0; Index < NumSlots; ++Index)
+		{
+			Slots[Index].Sequence = Index;
+		}
+	}
+
+	// returns false if the ring is full
+	bool Enqueue(ELuaLogLevel Level, const ANSICHAR* Category, const ANSICHAR* Text, int32 Length, bool bJsonFields, int32 PrefixLength)
+	{
+		int64 Pos = FPlatformAtomics::AtomicRead(&EnqueuePos);
+		for (;;)
+		{
+			FSlot& Slot = Slots[Pos & (NumSlots - 1)];
+			const int64 Diff = FPlatformAtomics::AtomicRead(&Slot.Sequence) - Pos;
+			if (Diff == 0)
+			{
+				if (FPlatformAtomics::InterlockedCompareExchange(&EnqueuePos, Pos + 1, Pos) == Pos)
+				{
+					Slot.Message.Fill(Level, Category, Text, Length, bJsonFields, PrefixLength);
+					FPlatformAtomics::AtomicStore(&Slot.Sequence, Pos + 1);
+					return true;
+				}
+			}
+			else if (Diff < 0)
+			{
+				return false;
+			}
+
+			Pos = FPlatformAtomics::AtomicRead(&EnqueuePos);
+		}
+	}
+
+	// single consumer, callers hold the drain lock
+	bool Dequeue(FLuaLogMessage& OutMessage)
+	{
+		const int64 Pos = FPlatformAtomics::AtomicRead(&DequeuePos);
+		FSlot& Slot = Slots[Pos & (NumSlots - 1)];
+		if (FPlatformAtomics::AtomicRead(&Slot.Sequence) != Pos + 1)
+		{
+			return false;
+		}
+
+		Slot.Message.CopyTo(OutMessage);
+		FPlatformAtomics::AtomicStore(&Slot.Sequence, Pos + NumSlots);
+		FPlatformAtomics::AtomicStore(&DequeuePos, Pos + 1);
+
+		return true;
+	}
+
+	int64 NumPending() const
+	{
+		return FPlatformAtomics::AtomicRead(&EnqueuePos) - FPlatformAtomics::AtomicRead(&DequeuePos);
+	}
+
+protected:
+	enum { NumSlots = 2048 };
+
+	struct FSlot
+	{
+		volatile int64 Sequence;
+		FLuaLogMessage Message;
+	};
+
+	FSlot Slots[NumSlots];
+
+	alignas(PLATFORM_CACHE_LINE_SIZE) volatile int64 EnqueuePos;
+	alignas(PLATFORM_CACHE_LINE_SIZE) volatile int64 DequeuePos;
+};
+
+static FLuaLogRing& GetLogRing()
+{
+	static FLuaLogRing Ring;
+	return Ring;
+}
+
+// created with the first writer and never freed, producers may trigger it while the writer is deleted
+static FEvent* WriterWakeEvent = nullptr;
+
+class FLuaLogWriter : public FRunnable
+{
+public:
+	FLuaLogWriter(FEvent* InWakeEvent)
+		: WakeEvent(InWakeEvent)
+	{
+	}
+
+	virtual uint32 Run() override
+	{
+		while (!bStopping)
+		{
+			WakeEvent->Wait(LuaLogWriterIntervalMs);
+			FLuaLog::Flush();
+		}
+
+		return 0;
+	}
+
+	virtual void Stop() override
+	{
+		bStopping = true;
+		WakeEvent->Trigger();
+	}
+
+protected:
+	FEvent* WakeEvent;
+	FThreadSafeBool bStopping;
+};
+
+static FCriticalSection WriterLock;
+static FCriticalSection DrainLock;
+static FLuaLogWriter* Writer = nullptr;
+static FRunnableThread* WriterThread = nullptr;
+static FThreadSafeBool bWriterRunning;
+static bool bWriterShutdown = false;
+static FThreadSafeCounter DroppedMessages;
+
+// formats a message into a fixed buffer on the stack, only messages that don't fit a ring slot go to the heap
+struct FLuaLogFormatter
+{
+	ANSICHAR Buffer[LuaLogMessageSize];
+	TArray<ANSICHAR> HeapBuffer;
+	ANSICHAR* Data = Buffer;
+	int32 Capacity = LuaLogMessageSize;
+	int32 Length = 0;
+	bool bTruncated = false;
+
+	FLuaLogFormatter() = default;
+	FLuaLogFormatter(const FLuaLogFormatter&) = delete;
+	FLuaLogFormatter& operator=(const FLuaLogFormatter&) = delete;
+
+	void Append(const char* String, size_t StringLength)
+	{
+		const size_t Space = (size_t)(LuaLogMaxMessageSize - Length);
+		if (StringLength > Space)
+		{
+			StringLength = Space;
+			bTruncated = true;
+		}
+
+		const int32 NewLength = Length + (int32)StringLength;
+		if (NewLength > Capacity)
+		{
+			Grow(NewLength);
+		}
+
+		FMemory::Memcpy(Data + Length, String, StringLength);
+		Length = NewLength;
+	}
+
+	void Grow(int32 MinCapacity)
+	{
+		Capacity = FMath::Min(FMath::Max(Capacity * 2, MinCapacity), LuaLogMaxMessageSize);
+
+		const bool bOnStack = HeapBuffer.Num() == 0;
+		HeapBuffer.SetNumUninitialized(Capacity);
+		if (bOnStack)
+		{
+			FMemory::Memcpy(HeapBuffer.GetData(), Buffer, Length);
+		}
+
+		Data = HeapBuffer.GetData();
+	}
+
+	void AppendJsonString(const char* String, size_t StringLength)
+	{
+		Append("\"", 1);
+
+		size_t Start = 0;
+		for (size_t Index = 0; Index < StringLength; ++Index)
+		{
+			const uint8 Char = String[Index];
+			if (Char != '"' && Char != '\\' && Char >= 0x20)
+			{
+				continue;
+			}
+
+			Append(String + Start, Index - Start);
+			Start = Index + 1;
+
+			switch (Char)
+			{
+			case '"': Append("\\\"", 2); break;
+			case '\\': Append("\\\\", 2); break;
+			case '\n': Append("\\n", 2); break;
+			case '\r': Append("\\r", 2); break;
+			case '\t': Append("\\t", 2); break;
+			default:
+			{
+				ANSICHAR Escaped[8];
+				FCStringAnsi::Sprintf(Escaped, "\\u%04x", Char);
+				Append(Escaped, 6);
+			}
+			}
+		}
+
+		Append(String + Start, StringLength - Start);
+		Append("\"", 1);
+	}
+
+	// print style, values are converted with tostring and separated by tabs
+	void AppendArgs(lua_State* L)
+	{
+		const int32 ParamsCount = lua_gettop(L);
+		for (int32 Index = 1; Index <= ParamsCount && !bTruncated; ++Index)
+		{
+			if (Index > 1)
+			{
+				Append("\t", 1);
+			}
+
+			size_t StringLength = 0;
+			const char* String = luaL_tolstring(L, Index, &StringLength);
+			Append(String, StringLength);
+			lua_pop(L, 1);
+		}
+	}
+
+	// key=value pairs, or "key":value pairs in structured mode
+	void AppendFields(lua_State* L, int32 FieldsIndex, bool bStructured)
+	{
+		bool bFirst = true;
+
+		lua_pushnil(L);
+		while (lua_next(L, FieldsIndex))
+		{
+			if (!bFirst)
+			{
+				Append(bStructured ? "," : " ", 1);
+			}
+			bFirst = false;
+
+			size_t KeyLength = 0;
+			const char* Key = luaL_tolstring(L, -2, &KeyLength);
+			if (bStructured)
+			{
+				AppendJsonString(Key, KeyLength);
+			}
+			else
+			{
+				Append(Key, KeyLength);
+			}
+			lua_pop(L, 1);
+
+			Append(bStructured ? ":" : "=", 1);
+
+			const int32 ValueType = lua_type(L, -1);
+			size_t ValueLength = 0;
+			const char* Value = luaL_tolstring(L, -1, &ValueLength);
+			if (bStructured && ValueType != LUA_TNUMBER && ValueType != LUA_TBOOLEAN)
+			{
+				AppendJsonString(Value, ValueLength);
+			}
+			else
+			{
+				Append(Value, ValueLength);
+			}
+			lua_pop(L, 2);
+		}
+	}
+
+	int32 Finish()
+	{
+		if (bTruncated)
+		{
+			// do not cut an utf8 sequence
+			Length = Capacity - 3;
+			while (Length > 0 && ((uint8)Data[Length] & 0xC0) == 0x80)
+			{
+				--Length;
+			}
+
+			FMemory::Memcpy(Data + Length, "...", 3);
+			Length += 3;
+		}
+
+		return Length;
+	}
+};
+
+static void AppendJsonEscaped(FString& Out, const TCHAR* Text, int32 Length)
+{
+	Out += TEXT('"');
+
+	for (int32 Index = 0; Index < Length; ++Index)
+	{
+		const TCHAR Char = Text[Index];
+		switch (Char)
+		{
+		case TEXT('"'): Out += TEXT("\\\""); break;
+		case TEXT('\\'): Out += TEXT("\\\\"); break;
+		case TEXT('\n'): Out += TEXT("\\n"); break;
+		case TEXT('\r'): Out += TEXT("\\r"); break;
+		case TEXT('\t'): Out += TEXT("\\t"); break;
+		default:
+			if (Char < 0x20)
+			{
+				Out += FString::Printf(TEXT("\\u%04x"), (uint32)Char);
+			}
+			else
+			{
+				Out += Char;
+			}
+		}
+	}
+
+	Out += TEXT('"');
+}
+
+static void WriteText(int64 Ticks, ELuaLogLevel Level, const ANSICHAR* InCategory, const ANSICHAR* InText, int32 Length, bool bJsonFields, int32 PrefixLength, FString& Line)
+{
+	const FUTF8ToTCHAR Category(InCategory);
+
+	Line.Reset();
+
+	if (CVarLuaLogStructured.GetValueOnAnyThread() != 0)
+	{
+		const FUTF8ToTCHAR Text(InText, Length);
+
+		Line += TEXT("{\"time\":\"");
+		Line += FDateTime(Ticks).ToIso8601();
+		Line += TEXT("\",\"level\":\"");
+		Line += LuaLogLevelNames[(int32)Level];
+		Line += TEXT("\",\"category\":");
+		AppendJsonEscaped(Line, Category.Get(), Category.Length());
+		Line += TEXT(',');
+
+		if (bJsonFields)
+		{
+			Line.AppendChars(Text.Get(), Text.Length());
+		}
+		else
+		{
+			Line += TEXT("\"message\":");
+			AppendJsonEscaped(Line, Text.Get(), Text.Length());
+		}
+
+		Line += TEXT('}');
+	}
+	else
+	{
+		// the PIE prefix goes before "Lua log:" like it always did
+		const FUTF8ToTCHAR Prefix(InText, PrefixLength);
+		const FUTF8ToTCHAR Message(InText + PrefixLength, Length - PrefixLength);
+		Line.AppendChars(Prefix.Get(), Prefix.Length());
+
+		if (FCStringAnsi::Strcmp(InCategory, "Lua") == 0)
+		{
+			Line += TEXT("Lua log: ");
+		}
+		else
+		{
+			Line += TEXT("Lua log[");
+			Line.AppendChars(Category.Get(), Category.Length());
+			Line += TEXT("]: ");
+		}
+
+		Line.AppendChars(Message.Get(), Message.Length());
+	}
+
+	GLog->Serialize(*Line, ToVerbosity(Level), LogBluelua.GetCategoryName());
+}
+
+static void WriteMessage(const FLuaLogMessage& Message, FString& Line)
+{
+	WriteText(Message.Ticks, Message.Level, Message.Category, Message.Text, Message.Length, Message.bJsonFields, Message.PrefixLength, Line);
+}
+
+void FLuaLog::Register(lua_State* L, FLuaState* Owner)
+{
+	StartWriter();
+
+	if (Owner)
+	{
+		lua_pushlightuserdata(L, Owner);
+	}
+	else
+	{
+		lua_pushnil(L);
+	}
+	const int32 OwnerIndex = lua_gettop(L);
+
+	// print is Log.Info
+	lua_pushvalue(L, OwnerIndex);
+	lua_pushinteger(L, (lua_Integer)ELuaLogLevel::Display);
+	lua_pushstring(L, "Lua");
+	lua_pushcclosure(L, LuaWrite, 3);
+	lua_setglobal(L, "print");
+
+	PushLogTable(L, OwnerIndex, "Lua");
+	lua_setglobal(L, "Log");
+
+	lua_pop(L, 1);
+}
+
+bool FLuaLog::IsEnabled(ELuaLogLevel Level)
+{
+	return (int32)Level <= CVarLuaLogLevel.GetValueOnAnyThread() && !LogBluelua.IsSuppressed(ToVerbosity(Level));
+}
+
+void FLuaLog::Write(ELuaLogLevel Level, const ANSICHAR* Category, const ANSICHAR* Message, int32 Length, bool bJsonFields, int32 PrefixLength)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaLogWrite);
+
+	const bool bFitsRing = Length <= LuaLogMessageSize;
+
+	if (bWriterRunning && CVarLuaLogAsync.GetValueOnAnyThread() != 0)
+	{
+		FLuaLogRing& Ring = GetLogRing();
+
+		if (bFitsRing)
+		{
+			if (Ring.Enqueue(Level, Category, Message, Length, bJsonFields, PrefixLength))
+			{
+				if (Ring.NumPending() >= LuaLogWakeThreshold && WriterWakeEvent)
+				{
+					WriterWakeEvent->Trigger();
+				}
+
+				return;
+			}
+
+			// keep errors even if the writer can't keep up
+			if (Level != ELuaLogLevel::Error)
+			{
+				DroppedMessages.Increment();
+				return;
+			}
+		}
+		else
+		{
+			// a long message is written right away, pending messages go first to keep the order
+			Flush();
+		}
+	}
+
+	FString Line;
+	WriteText(FDateTime::UtcNow().GetTicks(), Level, Category ? Category : "Lua", Message, Length, bJsonFields, FMath::Min(PrefixLength, Length), Line);
+}
+
+void FLuaLog::Flush()
+{
+	FScopeLock Lock(&DrainLock);
+
+	// reused by every flush, only touched under the drain lock
+	static FLuaLogMessage Message;
+	static FString Line;
+
+	FLuaLogRing& Ring = GetLogRing();
+	while (Ring.Dequeue(Message))
+	{
+		WriteMessage(Message, Line);
+	}
+
+	const int32 Dropped = DroppedMessages.Reset();
+	if (Dropped > 0)
+	{
+		UE_LOG(LogBluelua, Warning, TEXT("Lua log dropped %d messages! ring buffer is full, raise bluelua.Log.Level or log less!"), Dropped);
+	}
+}
+
+void FLuaLog::Shutdown()
+{
+	{
+		FScopeLock Lock(&WriterLock);
+
+		bWriterShutdown = true;
+		bWriterRunning = false;
+
+		if (WriterThread)
+		{
+			WriterThread->Kill(true);
+			delete WriterThread;
+			WriterThread = nullptr;
+		}
+
+		if (Writer)
+		{
+			delete Writer;
+			Writer = nullptr;
+		}
+	}
+
+	Flush();
+}
+
+int FLuaLog::LuaWrite(lua_State* L)
+{
+	const ELuaLogLevel Level = (ELuaLogLevel)lua_tointeger(L, lua_upvalueindex(2));
+	if (!IsEnabled(Level))
+	{
+		return 0;
+	}
+
+	FLuaLogFormatter Formatter;
+
+	int32 PrefixLength = 0;
+	const FLuaState* Owner = (FLuaState*)lua_touserdata(L, lua_upvalueindex(1));
+	if (Owner)
+	{
+		const ANSICHAR* Prefix = Owner->GetLogPrefix();
+		PrefixLength = FCStringAnsi::Strlen(Prefix);
+		Formatter.Append(Prefix, PrefixLength);
+	}
+
+	Formatter.AppendArgs(L);
+
+	Write(Level, lua_tostring(L, lua_upvalueindex(3)), Formatter.Data, Formatter.Finish(), false, PrefixLength);
+
+	return 0;
+}
+
+int FLuaLog::LuaEvent(lua_State* L)
+{
+	const ELuaLogLevel Level = (ELuaLogLevel)lua_tointeger(L, lua_upvalueindex(2));
+	if (!IsEnabled(Level))
+	{
+		return 0;
+	}
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+
+	const bool bStructured = CVarLuaLogStructured.GetValueOnAnyThread() != 0;
+
+	FLuaLogFormatter Formatter;
+	Formatter.AppendFields(L, 1, bStructured);
+
+	const int32 Length = Formatter.Finish();
+
+	// a truncated field list is no valid json any more, write it as a message
+	Write(Level, lua_tostring(L, lua_upvalueindex(3)), Formatter.Data, Length, bStructured && !Formatter.bTruncated);
+
+	return 0;
+}
+
+int FLuaLog::LuaCategory(lua_State* L)
+{
+	const char* Category = luaL_checkstring(L, 1);
+
+	PushLogTable(L, lua_upvalueindex(1), Category);
+
+	return 1;
+}
+
+void FLuaLog::PushLogTable(lua_State* L, int32 OwnerIndex, const char* Category)
+{
+	static const struct
+	{
+		const char* Name;
+		ELuaLogLevel Level;
+	} Levels[] = {
+		{ "Error", ELuaLogLevel::Error },
+		{ "Warning", ELuaLogLevel::Warning },
+		{ "Info", ELuaLogLevel::Display },
+		{ "Debug", ELuaLogLevel::Log },
+		{ "Verbose", ELuaLogLevel::Verbose },
+	};
+
+	lua_createtable(L, 0, ARRAY_COUNT(Levels) + 2);
+
+	for (const auto& Level : Levels)
+	{
+		lua_pushvalue(L, OwnerIndex);
+		lua_pushinteger(L, (lua_Integer)Level.Level);
+		lua_pushstring(L, Category);
+		lua_pushcclosure(L, LuaWrite, 3);
+		lua_setfield(L, -2, Level.Name);
+	}
+
+	lua_pushvalue(L, OwnerIndex);
+	lua_pushinteger(L, (lua_Integer)ELuaLogLevel::Display);
+	lua_pushstring(L, Category);
+	lua_pushcclosure(L, LuaEvent, 3);
+	lua_setfield(L, -2, "Event");
+
+	lua_pushvalue(L, OwnerIndex);
+	lua_pushcclosure(L, LuaCategory, 1);
+	lua_setfield(L, -2, "Category");
+}
+
+void FLuaLog::StartWriter()
+{
+	if (bWriterRunning || !FPlatformProcess::SupportsMultithreading())
+	{
+		return;
+	}
+
+	FScopeLock Lock(&WriterLock);
+
+	if (bWriterRunning || bWriterShutdown)
+	{
+		return;
+	}
+
+	if (!WriterWakeEvent)
+	{
+		WriterWakeEvent = FPlatformProcess::GetSynchEventFromPool();
+	}
+
+	Writer = new FLuaLogWriter(WriterWakeEvent);
+	WriterThread = FRunnableThread::Create(Writer, TEXT("BlueluaLogWriter"), 0, TPri_BelowNormal);
+	if (!WriterThread)
+	{
+		delete Writer;
+		Writer = nullptr;
+
+		UE_LOG(LogBluelua, Warning, TEXT("Create lua log writer thread failed! lua log is written synchronously!"));
+		return;
+	}
+
+	bWriterRunning = true;
+}
@@ -0,0 +1,306 @@
+#include "LuaMemoryProfiler.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/Crc.h"
+#include "Misc/OutputDevice.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+#include "LuaState.h"
+
+DECLARE_MEMORY_STAT(TEXT("LuaStringMemory"), STAT_LuaStringMemory, STATGROUP_Bluelua);
+DECLARE_MEMORY_STAT(TEXT("LuaTableMemory"), STAT_LuaTableMemory, STATGROUP_Bluelua);
+DECLARE_MEMORY_STAT(TEXT("LuaFunctionMemory"), STAT_LuaFunctionMemory, STATGROUP_Bluelua);
+DECLARE_MEMORY_STAT(TEXT("LuaUserdataMemory"), STAT_LuaUserdataMemory, STATGROUP_Bluelua);
+DECLARE_MEMORY_STAT(TEXT("LuaThreadMemory"), STAT_LuaThreadMemory, STATGROUP_Bluelua);
+DECLARE_MEMORY_STAT(TEXT("LuaProtoMemory"), STAT_LuaProtoMemory, STATGROUP_Bluelua);
+DECLARE_MEMORY_STAT(TEXT("LuaOtherMemory"), STAT_LuaOtherMemory, STATGROUP_Bluelua);
+// sum of the above, live allocation counts are in bluelua.MemProfile Dump
+DECLARE_MEMORY_STAT(TEXT("LuaProfiledMemory"), STAT_LuaProfiledMemory, STATGROUP_Bluelua);
+
+// walking up further rarely finds a lua frame and costs on every allocation
+static const int32 MaxStackLevels = 8;
+static const int32 NativeModuleIndex = 0;
+
+static void LuaMemoryProfileCommand(const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+{
+	TSharedPtr<FLuaState> LuaState = FBlueluaModule::Get().GetDefaultLuaState();
+	if (!LuaState.IsValid() || Args.Num() == 0)
+	{
+		Ar.Log(TEXT("Usage: bluelua.MemProfile Start|Stop|Reset|Dump [MaxModules]"));
+		return;
+	}
+
+	const FString& Command = Args[0];
+	if (Command.Equals(TEXT("Start"), ESearchCase::IgnoreCase))
+	{
+		LuaState->StartMemoryProfiler();
+	}
+	else if (Command.Equals(TEXT("Stop"), ESearchCase::IgnoreCase))
+	{
+		LuaState->StopMemoryProfiler();
+	}
+	else if (Command.Equals(TEXT("Reset"), ESearchCase::IgnoreCase))
+	{
+		if (FLuaMemoryProfiler* Profiler = LuaState->GetMemoryProfiler())
+		{
+			Profiler->Reset();
+		}
+	}
+	else if (Command.Equals(TEXT("Dump"), ESearchCase::IgnoreCase))
+	{
+		if (FLuaMemoryProfiler* Profiler = LuaState->GetMemoryProfiler())
+		{
+			Profiler->Dump(Ar, Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 20);
+		}
+		else
+		{
+			Ar.Log(TEXT("Lua memory profiler is not started."));
+		}
+	}
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice LuaMemoryProfileConsoleCommand(
+	TEXT("bluelua.MemProfile"),
+	TEXT("Profile memory of the default lua state by type and module. Usage: bluelua.MemProfile Start|Stop|Reset|Dump [MaxModules]"),
+	FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic(&LuaMemoryProfileCommand));
+
+FLuaMemoryProfiler::FLuaMemoryProfiler(lua_State* InL)
+	: L(InL)
+	, bRunning(false)
+{
+	Reset();
+}
+
+FLuaMemoryProfiler::~FLuaMemoryProfiler()
+{
+	Stop();
+}
+
+void FLuaMemoryProfiler::Start()
+{
+	if (bRunning)
+	{
+		return;
+	}
+
+	Reset();
+
+	bRunning = true;
+}
+
+void FLuaMemoryProfiler::Stop()
+{
+	if (!bRunning)
+	{
+		return;
+	}
+
+	bRunning = false;
+
+	// usages are kept for dumping, frees can't be tracked from now on
+	ClearStats();
+	Records.Empty();
+}
+
+void FLuaMemoryProfiler::Reset()
+{
+	ClearStats();
+	Records.Empty();
+
+	for (FLuaMemoryUsage& TypeUsage : TypeUsages)
+	{
+		TypeUsage = FLuaMemoryUsage();
+	}
+
+	ModuleIndices.Empty();
+	ModuleNames.Reset();
+	ModuleUsages.Reset();
+
+	ModuleNames.Emplace(TEXT("[native]"));
+	ModuleUsages.AddDefaulted();
+}
+
+void FLuaMemoryProfiler::OnRealloc(void* Ptr, size_t OldSize, void* NewPtr, size_t NewSize)
+{
+	if (!Ptr)
+	{
+		// new object, OldSize is the lua type tag.
+		// lua stacks are not moved by new allocations so walking them here is safe
+		FRecord Record;
+		Record.Size = (SIZE_T)NewSize;
+		Record.Type = GetMemoryType(OldSize);
+		Record.ModuleIndex = GetCurrentModuleIndex();
+
+		Records.Emplace(NewPtr, Record);
+
+		AddUsage(Record, (int64)NewSize, 1);
+		++TypeUsages[(int32)Record.Type].TotalCount;
+		++ModuleUsages[Record.ModuleIndex].TotalCount;
+
+		return;
+	}
+
+	FRecord Record;
+	if (!Records.RemoveAndCopyValue(Ptr, Record))
+	{
+		// allocated before profiling started
+		return;
+	}
+
+	AddUsage(Record, -(int64)Record.Size, -1);
+
+	if (NewSize > 0)
+	{
+		Record.Size = (SIZE_T)NewSize;
+		Records.Emplace(NewPtr, Record);
+
+		AddUsage(Record, (int64)NewSize, 1);
+	}
+}
+
+const FLuaMemoryUsage& FLuaMemoryProfiler::GetTypeUsage(ELuaMemoryType Type) const
+{
+	return TypeUsages[(int32)Type];
+}
+
+void FLuaMemoryProfiler::GetModuleUsages(TArray<FLuaModuleMemoryUsage>& OutUsages) const
+{
+	OutUsages.Reset(ModuleNames.Num());
+
+	for (int32 Index = 0; Index < ModuleNames.Num(); ++Index)
+	{
+		FLuaModuleMemoryUsage& ModuleUsage = OutUsages.AddDefaulted_GetRef();
+		ModuleUsage.ModuleName = ModuleNames[Index];
+		ModuleUsage.Usage = ModuleUsages[Index];
+	}
+
+	OutUsages.Sort([](const FLuaModuleMemoryUsage& A, const FLuaModuleMemoryUsage& B)
+	{
+		return A.Usage.LiveBytes > B.Usage.LiveBytes;
+	});
+}
+
+void FLuaMemoryProfiler::Dump(FOutputDevice& Ar, int32 MaxModules/* = 20*/) const
+{
+	Ar.Logf(TEXT("Lua memory profile, %s, %d live allocation(s) tracked."), bRunning ? TEXT("running") : TEXT("stopped"), Records.Num());
+
+	Ar.Logf(TEXT("%-10s %14s %12s %12s"), TEXT("Type"), TEXT("LiveBytes"), TEXT("LiveCount"), TEXT("TotalCount"));
+	for (int32 Type = 0; Type < (int32)ELuaMemoryType::Num; ++Type)
+	{
+		const FLuaMemoryUsage& Usage = TypeUsages[Type];
+		Ar.Logf(TEXT("%-10s %14lld %12lld %12lld"), GetTypeName((ELuaMemoryType)Type), Usage.LiveBytes, Usage.LiveCount, Usage.TotalCount);
+	}
+
+	TArray<FLuaModuleMemoryUsage> Usages;
+	GetModuleUsages(Usages);
+
+	Ar.Logf(TEXT("%14s %12s %12s  %s"), TEXT("LiveBytes"), TEXT("LiveCount"), TEXT("TotalCount"), TEXT("Module"));
+	for (int32 Index = 0; Index < Usages.Num() && Index < MaxModules; ++Index)
+	{
+		const FLuaMemoryUsage& Usage = Usages[Index].Usage;
+		Ar.Logf(TEXT("%14lld %12lld %12lld  %s"), Usage.LiveBytes, Usage.LiveCount, Usage.TotalCount, *Usages[Index].ModuleName);
+	}
+}
+
+const TCHAR* FLuaMemoryProfiler::GetTypeName(ELuaMemoryType Type)
+{
+	switch (Type)
+	{
+	case ELuaMemoryType::String: return TEXT("string");
+	case ELuaMemoryType::Table: return TEXT("table");
+	case ELuaMemoryType::Function: return TEXT("function");
+	case ELuaMemoryType::Userdata: return TEXT("userdata");
+	case ELuaMemoryType::Thread: return TEXT("thread");
+	case ELuaMemoryType::Proto: return TEXT("proto");
+	default: return TEXT("other");
+	}
+}
+
+ELuaMemoryType FLuaMemoryProfiler::GetMemoryType(size_t LuaTypeTag)
+{
+	// lower bits are the basic type, upper bits are the variant, e.g. short and long strings
+	switch (LuaTypeTag & 0x0F)
+	{
+	case LUA_TSTRING: return ELuaMemoryType::String;
+	case LUA_TTABLE: return ELuaMemoryType::Table;
+	case LUA_TFUNCTION: return ELuaMemoryType::Function;
+	case LUA_TUSERDATA: return ELuaMemoryType::Userdata;
+	case LUA_TTHREAD: return ELuaMemoryType::Thread;
+#if LUA_VERSION_NUM >= 504
+	case LUA_NUMTYPES + 1: return ELuaMemoryType::Proto;
+#else
+	case LUA_NUMTAGS: return ELuaMemoryType::Proto;
+#endif
+	default: return ELuaMemoryType::Other;
+	}
+}
+
+int32 FLuaMemoryProfiler::GetCurrentModuleIndex()
+{
+	// attribute to the nearest lua function, coroutines are attributed to the function that resumed them
+	lua_Debug Ar;
+	for (int32 Level = 0; Level < MaxStackLevels && lua_getstack(L, Level, &Ar); ++Level)
+	{
+		if (lua_getinfo(L, "S", &Ar) && Ar.what && Ar.what[0] != 'C')
+		{
+			return FindOrAddModule(Ar.short_src);
+		}
+	}
+
+	return NativeModuleIndex;
+}
+
+int32 FLuaMemoryProfiler::FindOrAddModule(const char* Source)
+{
+	const uint32 SourceCrc = FCrc::StrCrc32(Source);
+
+	if (const int32* ModuleIndex = ModuleIndices.Find(SourceCrc))
+	{
+		return *ModuleIndex;
+	}
+
+	const int32 ModuleIndex = ModuleNames.Emplace(UTF8_TO_TCHAR(Source));
+	ModuleUsages.AddDefaulted();
+	ModuleIndices.Emplace(SourceCrc, ModuleIndex);
+
+	return ModuleIndex;
+}
+
+void FLuaMemoryProfiler::AddUsage(const FRecord& Record, int64 Bytes, int64 Count)
+{
+	FLuaMemoryUsage& TypeUsage = TypeUsages[(int32)Record.Type];
+	TypeUsage.LiveBytes += Bytes;
+	TypeUsage.LiveCount += Count;
+
+	FLuaMemoryUsage& ModuleUsage = ModuleUsages[Record.ModuleIndex];
+	ModuleUsage.LiveBytes += Bytes;
+	ModuleUsage.LiveCount += Count;
+
+	AddStats(Record.Type, Bytes);
+}
+
+void FLuaMemoryProfiler::AddStats(ELuaMemoryType Type, int64 Bytes)
+{
+	switch (Type)
+	{
+	case ELuaMemoryType::String: INC_MEMORY_STAT_BY(STAT_LuaStringMemory, Bytes); break;
+	case ELuaMemoryType::Table: INC_MEMORY_STAT_BY(STAT_LuaTableMemory, Bytes); break;
+	case ELuaMemoryType::Function: INC_MEMORY_STAT_BY(STAT_LuaFunctionMemory, Bytes); break;
+	case ELuaMemoryType::Userdata: INC_MEMORY_STAT_BY(STAT_LuaUserdataMemory, Bytes); break;
+	case ELuaMemoryType::Thread: INC_MEMORY_STAT_BY(STAT_LuaThreadMemory, Bytes); break;
+	case ELuaMemoryType::Proto: INC_MEMORY_STAT_BY(STAT_LuaProtoMemory, Bytes); break;
+	default: INC_MEMORY_STAT_BY(STAT_LuaOtherMemory, Bytes); break;
+	}
+
+	INC_MEMORY_STAT_BY(STAT_LuaProfiledMemory, Bytes);
+}
+
+void FLuaMemoryProfiler::ClearStats()
+{
+	// stats are shared by all states, only take back what this profiler added
+	for (const auto& Record : Records)
+	{
+		AddStats(Record.Value.Type, -(int64)Record.Value.Size);
+	}
+}
@@ -1,5 +1,6 @@
 #include "LuaObjectBase.h"
 
+#include "HAL/IConsoleManager.h"
 #include "Runtime/Launch/Resources/Version.h"
 #include "UObject/Class.h"
 #include "UObject/EnumProperty.h"
@@ -12,7 +13,10 @@
 #include "Delegates/LuaScriptDelegate.h"
 #include "Delegates/LuaSparseDelegate.h"
 #include "lua.hpp"
+#include "LuaBridgeStats.h"
 #include "LuaImplementableInterface.h"
+#include "LuaSampleProfiler.h"
+#include "LuaTrace.h"
 #include "LuaUClass.h"
 #include "LuaUDelegate.h"
 #include "LuaUObject.h"
@@ -21,6 +25,16 @@
 DECLARE_CYCLE_STAT(TEXT("PushPropertyToLua"), STAT_PushPropertyToLua, STATGROUP_Bluelua);
 DECLARE_CYCLE_STAT(TEXT("FetchPropertyFromLua"), STAT_FetchPropertyFromLua, STATGROUP_Bluelua);
 
+static TAutoConsoleVariable<int32> CVarLuaDirectNativeCall(
+	TEXT("bluelua.DirectNativeCall"),
+	1,
+	TEXT("Invoke final native UFunctions called from lua directly instead of through ProcessEvent, only on objects of bluelua.DirectNativeCall.Classes."));
+
+static TAutoConsoleVariable<FString> CVarLuaDirectNativeCallClasses(
+	TEXT("bluelua.DirectNativeCall.Classes"),
+	TEXT("BlueprintFunctionLibrary,ActorComponent"),
+	TEXT("Comma separated classes that don't override ProcessEvent, neither do their subclasses, objects of any other class are always called through ProcessEvent."));
+
 static TMap<FFieldClass*, FLuaObjectBase::PushPropertyFunction> GPusherMap;
 static TMap<FFieldClass*, FLuaObjectBase::FetchPropertyFunction> GFetcherMap;
 
@@ -152,6 +166,20 @@ int FLuaObjectBase::PushProperty(lua_State* L, UProperty* Property, void* Params
 	auto Pusher = GetPusher(PropertyClass);
 	if (Pusher)
 	{
+		if (FLuaBridgeStats::IsEnabled())
+		{
+			const FLuaBridgeStats::FMarshalScope MarshalScope;
+			const int64 NumProxies = FLuaBridgeStats::GetNumProxies();
+			const int Result = Pusher(L, Property, Params, Object, bCopyValue);
+
+			if (MarshalScope.IsOutermost())
+			{
+				FLuaBridgeStats::RecordPush(Property, Params, FLuaBridgeStats::GetNumProxies() - NumProxies);
+			}
+
+			return Result;
+		}
+
 		return Pusher(L, Property, Params, Object, bCopyValue);
 	}
 	else
@@ -164,6 +192,19 @@ int FLuaObjectBase::PushProperty(lua_State* L, UProperty* Property, void* Params
 	}
 }
 
+int FLuaObjectBase::PushBorrowedProperty(lua_State* L, UProperty* Property, void* Params)
+{
+	UStructProperty* StructProperty = Cast<UStructProperty>(Property);
+	if (!StructProperty)
+	{
+		return PushProperty(L, Property, Params);
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_PushPropertyToLua);
+
+	return FLuaUStruct::PushBorrowed(L, StructProperty->Struct, Params);
+}
+
 int FLuaObjectBase::PushStructProperty(lua_State* L, UProperty* Property, void* Params, UObject* Object, bool bCopyValue/* = true*/)
 {
 	UStructProperty* StructProperty = Cast<UStructProperty>(Property);
@@ -263,7 +304,7 @@ int FLuaObjectBase::PushMulticastDelegateProperty(lua_State* L, UProperty* Prope
 #else
 	UMulticastDelegateProperty* DelegateProperty = Cast<UMulticastDelegateProperty>(Property);
 
-	return FLuaUDelegate::Push(L, DelegateProperty->GetPropertyValuePtr(Params), DelegateProperty->SignatureFunction, FLuaMulticastScriptDelegate::Create);
+	return FLuaUDelegate::Push(L, DelegateProperty->GetPropertyValuePtr(Params), DelegateProperty->SignatureFunction, FLuaMulticastScriptDelegate::Create, nullptr, Object);
 #endif // ENGINE_MINOR_VERSION >= 23
 }
 
@@ -272,7 +313,7 @@ int FLuaObjectBase::PushMulticastInlineDelegateProperty(lua_State* L, UProperty*
 #if ENGINE_MINOR_VERSION >= 23
 	UMulticastInlineDelegateProperty* DelegateProperty = Cast<UMulticastInlineDelegateProperty>(Property);
 
-	return FLuaUDelegate::Push(L, DelegateProperty->GetPropertyValuePtr(Params), DelegateProperty->SignatureFunction, FLuaMulticastScriptDelegate::Create);
+	return FLuaUDelegate::Push(L, DelegateProperty->GetPropertyValuePtr(Params), DelegateProperty->SignatureFunction, FLuaMulticastScriptDelegate::Create, nullptr, Object);
 #else
 	return 0;
 #endif // ENGINE_MINOR_VERSION >= 23
@@ -283,7 +324,7 @@ int FLuaObjectBase::PushMulticastSparseDelegateProperty(lua_State* L, UProperty*
 #if ENGINE_MINOR_VERSION >= 23
 	UMulticastSparseDelegateProperty* DelegateProperty = Cast<UMulticastSparseDelegateProperty>(Property);
 
-	return FLuaUDelegate::Push(L, DelegateProperty->GetPropertyValuePtr(Params), DelegateProperty->SignatureFunction, FLuaSparseDelegate::Create);
+	return FLuaUDelegate::Push(L, DelegateProperty->GetPropertyValuePtr(Params), DelegateProperty->SignatureFunction, FLuaSparseDelegate::Create, nullptr, Object);
 #else
 	return 0;
 #endif // ENGINE_MINOR_VERSION >= 23
@@ -293,7 +334,7 @@ int FLuaObjectBase::PushDelegateProperty(lua_State* L, UProperty* Property, void
 {
 	auto DelegateProperty = Cast<UDelegateProperty>(Property);
 
-	return FLuaUDelegate::Push(L, DelegateProperty->GetPropertyValuePtr(Params), DelegateProperty->SignatureFunction, FLuaScriptDelegate::Create);
+	return FLuaUDelegate::Push(L, DelegateProperty->GetPropertyValuePtr(Params), DelegateProperty->SignatureFunction, FLuaScriptDelegate::Create, nullptr, Object);
 }
 
 int FLuaObjectBase::Push(lua_State* L, int8 Value)
@@ -387,6 +428,19 @@ bool FLuaObjectBase::FetchProperty(lua_State* L, UProperty* Property, void* Para
 	auto Fetcher = GetFetcher(Property->GetClass());
 	if (Fetcher)
 	{
+		if (FLuaBridgeStats::IsEnabled())
+		{
+			const FLuaBridgeStats::FMarshalScope MarshalScope;
+			const bool bResult = Fetcher(L, Property, Params, Index);
+
+			if (MarshalScope.IsOutermost())
+			{
+				FLuaBridgeStats::RecordFetch(Property, Params);
+			}
+
+			return bResult;
+		}
+
 		return Fetcher(L, Property, Params, Index);
 	}
 	else
@@ -728,8 +782,94 @@ bool FLuaObjectBase::Fetch(lua_State* L, int32 Index, FName& Value)
 	return true;
 }
 
+// a ProcessEvent override would be skipped by a direct call, so only allowed classes get one
+static bool IsDirectNativeCallClass(const UClass* Class)
+{
+	static FString ClassesValue;
+	static TArray<FName> ClassNames;
+	static TMap<TWeakObjectPtr<const UClass>, bool> AllowedClasses;
+
+	const FString& Value = CVarLuaDirectNativeCallClasses.GetValueOnGameThread();
+	if (Value != ClassesValue)
+	{
+		ClassesValue = Value;
+		AllowedClasses.Reset();
+
+		TArray<FString> Names;
+		Value.ParseIntoArray(Names, TEXT(","), true);
+
+		ClassNames.Reset();
+		for (const FString& Name : Names)
+		{
+			ClassNames.Add(*Name.TrimStartAndEnd());
+		}
+	}
+
+	if (const bool* bAllowed = AllowedClasses.Find(Class))
+	{
+		return *bAllowed;
+	}
+
+	// lua implementable objects override ProcessEvent to call LuaProcessEvent
+	bool bAllowed = false;
+	if (!Class->ImplementsInterface(ULuaImplementableInterface::StaticClass()))
+	{
+		for (const UStruct* Super = Class; Super && !bAllowed; Super = Super->GetSuperStruct())
+		{
+			bAllowed = ClassNames.Contains(Super->GetFName());
+		}
+	}
+
+	AllowedClasses.Add(Class, bAllowed);
+
+	return bAllowed;
+}
+
+static bool CanInvokeNative(UObject* Object, UFunction* Function, bool bIsParentDefaultFunction)
+{
+	// neither lua nor blueprint can override final functions, see ILuaImplementableInterface::OnProcessLuaOverrideEvent
+	return !bIsParentDefaultFunction
+		&& (Function->FunctionFlags & (FUNC_Native | FUNC_Final | FUNC_Net | FUNC_Event)) == (FUNC_Native | FUNC_Final)
+		&& Function->GetNativeFunc() != &ILuaImplementableInterface::ProcessBPFunctionOverride
+		&& CVarLuaDirectNativeCall.GetValueOnAnyThread() != 0
+		&& IsDirectNativeCallClass(Object->GetClass());
+}
+
+// the native part of UObject::ProcessEvent, without callspace and lua override checks
+static void InvokeNative(UObject* Object, UFunction* Function, uint8* Parms)
+{
+#if ENGINE_MINOR_VERSION >= 25
+	FFrame Stack(Object, Function, Parms, nullptr, Function->ChildProperties);
+#else
+	FFrame Stack(Object, Function, Parms, nullptr, Function->Children);
+#endif // ENGINE_MINOR_VERSION >= 25
+
+	// thunks read out params through the out list instead of locals
+	FOutParmRec** LastOut = &Stack.OutParms;
+	for (TFieldIterator<UProperty> ParamIter(Function); ParamIter && (ParamIter->PropertyFlags & CPF_Parm); ++ParamIter)
+	{
+		if (ParamIter->PropertyFlags & CPF_OutParm)
+		{
+			FOutParmRec* Out = (FOutParmRec*)FMemory_Alloca(sizeof(FOutParmRec));
+			Out->PropAddr = ParamIter->ContainerPtrToValuePtr<uint8>(Parms);
+			Out->Property = *ParamIter;
+			Out->NextOutParm = nullptr;
+
+			*LastOut = Out;
+			LastOut = &Out->NextOutParm;
+		}
+	}
+
+	uint8* ReturnValueAddress = Function->ReturnValueOffset != MAX_uint16 ? Parms + Function->ReturnValueOffset : nullptr;
+	Function->Invoke(Object, Stack, ReturnValueAddress);
+}
+
 int FLuaObjectBase::CallFunction(lua_State* L, UObject* Object, UFunction* Function, bool bIsParentDefaultFunction/* = false*/)
 {
+	FLuaSampleProfiler::FNativeScope ProfileScope(L, Function);
+	FLuaTrace::FScope TraceScope(Function);
+	FLuaBridgeStats::FCallScope StatsScope(Function);
+
 	uint8* Parms = (uint8*)FMemory_Alloca(Function->ParmsSize);
 	FMemory::Memzero(Parms, Function->ParmsSize);
 
@@ -753,32 +893,39 @@ int FLuaObjectBase::CallFunction(lua_State* L, UObject* Object, UFunction* Funct
 		}
 	}
 
-	const EFunctionFlags FunctionFlags = Function->FunctionFlags;
-	const FNativeFuncPtr NativeFucPtr = Function->GetNativeFunc();
-
-	if (NativeFucPtr == &ILuaImplementableInterface::ProcessBPFunctionOverride)
+	if (CanInvokeNative(Object, Function, bIsParentDefaultFunction))
+	{
+		InvokeNative(Object, Function, Parms);
+	}
+	else
 	{
-		ILuaImplementableInterface* LuaObject = Cast<ILuaImplementableInterface>(Object);
-		const bool bOverride = LuaObject ? LuaObject->HasBPFunctionOverrding(Function->GetName()) : false;
+		const EFunctionFlags FunctionFlags = Function->FunctionFlags;
+		const FNativeFuncPtr NativeFucPtr = Function->GetNativeFunc();
 
-		if (!bOverride || bIsParentDefaultFunction)
+		if (NativeFucPtr == &ILuaImplementableInterface::ProcessBPFunctionOverride)
 		{
-			Function->FunctionFlags &= ~FUNC_Native;
-			Function->SetNativeFunc(&UObject::ProcessInternal);
+			ILuaImplementableInterface* LuaObject = Cast<ILuaImplementableInterface>(Object);
+			const bool bOverride = LuaObject ? LuaObject->HasBPFunctionOverrding(Function->GetName()) : false;
+
+			if (!bOverride || bIsParentDefaultFunction)
+			{
+				Function->FunctionFlags &= ~FUNC_Native;
+				Function->SetNativeFunc(&UObject::ProcessInternal);
+			}
 		}
-	}
 
-	if (bIsParentDefaultFunction)
-	{
-		Object->UObject::ProcessEvent(Function, Parms);
-	}
-	else
-	{
-		Object->ProcessEvent(Function, Parms);
-	}
+		if (bIsParentDefaultFunction)
+		{
+			Object->UObject::ProcessEvent(Function, Parms);
+		}
+		else
+		{
+			Object->ProcessEvent(Function, Parms);
+		}
 
-	Function->FunctionFlags = FunctionFlags;
-	Function->SetNativeFunc(NativeFucPtr);
+		Function->FunctionFlags = FunctionFlags;
+		Function->SetNativeFunc(NativeFucPtr);
+	}
 
 	int32 ReturnNum = 0;
 	if (ReturnValue)
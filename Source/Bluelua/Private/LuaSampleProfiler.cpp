@@ -0,0 +1,535 @@
+#include "LuaSampleProfiler.h"
+
+#include "Algo/Reverse.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/OutputDevice.h"
+#include "Misc/Paths.h"
+#include "UObject/Class.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+#include "LuaState.h"
+
+DECLARE_CYCLE_STAT(TEXT("LuaProfileSample"), STAT_LuaProfileSample, STATGROUP_Bluelua);
+
+static TAutoConsoleVariable<int32> CVarLuaProfileSampleIntervalUs(
+	TEXT("bluelua.Profile.SampleIntervalUs"),
+	1000,
+	TEXT("Microseconds between two samples of the lua sample profiler."));
+
+static TAutoConsoleVariable<int32> CVarLuaProfileHookInstructions(
+	TEXT("bluelua.Profile.HookInstructions"),
+	1000,
+	TEXT("Lua instructions between two checks of the sample interval, lower is more accurate but costs more."));
+
+// deeper stacks are truncated at the root side
+static const int32 MaxSampleDepth = 128;
+static const int32 RootNodeIndex = 0;
+
+// a sample weighs at most this many intervals, lua entered without a native scope can't charge the idle time before it
+static const uint64 MaxSampleIntervals = 2;
+
+static void LuaProfileCommand(const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+{
+	TSharedPtr<FLuaState> LuaState = FBlueluaModule::Get().GetDefaultLuaState();
+	if (!LuaState.IsValid() || Args.Num() == 0)
+	{
+		Ar.Log(TEXT("Usage: bluelua.Profile Start|Stop|Reset|Export [Collapsed|Speedscope] [FileName]"));
+		return;
+	}
+
+	const FString& Command = Args[0];
+	if (Command.Equals(TEXT("Start"), ESearchCase::IgnoreCase))
+	{
+		LuaState->StartSampleProfiler();
+	}
+	else if (Command.Equals(TEXT("Stop"), ESearchCase::IgnoreCase))
+	{
+		LuaState->StopSampleProfiler();
+	}
+	else if (Command.Equals(TEXT("Reset"), ESearchCase::IgnoreCase))
+	{
+		if (FLuaSampleProfiler* Profiler = LuaState->GetSampleProfiler())
+		{
+			Profiler->Reset();
+		}
+	}
+	else if (Command.Equals(TEXT("Export"), ESearchCase::IgnoreCase))
+	{
+		FLuaSampleProfiler* Profiler = LuaState->GetSampleProfiler();
+		if (!Profiler)
+		{
+			Ar.Log(TEXT("Lua sample profiler is not started."));
+			return;
+		}
+
+		const ELuaProfileFormat Format = (Args.Num() > 1 && Args[1].Equals(TEXT("Speedscope"), ESearchCase::IgnoreCase)) ? ELuaProfileFormat::Speedscope : ELuaProfileFormat::Collapsed;
+		const FString FilePath = Profiler->Export(Format, Args.Num() > 2 ? Args[2] : FString());
+		if (FilePath.IsEmpty())
+		{
+			Ar.Log(TEXT("Export lua sample profile failed!"));
+		}
+		else
+		{
+			Ar.Logf(TEXT("Lua sample profile exported, %lld sample(s). File[%s]."), Profiler->GetNumSamples(), *FilePath);
+		}
+	}
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice LuaProfileConsoleCommand(
+	TEXT("bluelua.Profile"),
+	TEXT("Sample lua call stacks of the default lua state. Usage: bluelua.Profile Start|Stop|Reset|Export [Collapsed|Speedscope] [FileName]"),
+	FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic(&LuaProfileCommand));
+
+static void AppendJsonString(FString& Out, const FString& Value)
+{
+	Out += TEXT('"');
+
+	for (const TCHAR Char : Value)
+	{
+		switch (Char)
+		{
+		case TEXT('"'): Out += TEXT("\\\""); break;
+		case TEXT('\\'): Out += TEXT("\\\\"); break;
+		case TEXT('\n'): Out += TEXT("\\n"); break;
+		case TEXT('\r'): Out += TEXT("\\r"); break;
+		case TEXT('\t'): Out += TEXT("\\t"); break;
+		default:
+			if (Char < 0x20)
+			{
+				Out += FString::Printf(TEXT("\\u%04x"), (int32)Char);
+			}
+			else
+			{
+				Out += Char;
+			}
+		}
+	}
+
+	Out += TEXT('"');
+}
+
+FLuaSampleProfiler::FNativeScope::FNativeScope(lua_State* InL, UFunction* Function)
+	: Profiler(nullptr)
+{
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(InL);
+	FLuaSampleProfiler* SampleProfiler = LuaStateWrapper ? LuaStateWrapper->GetSampleProfiler() : nullptr;
+	if (SampleProfiler && SampleProfiler->IsRunning() && Function)
+	{
+		Profiler = SampleProfiler;
+		Profiler->PushNativeFrame(InL, Function);
+	}
+}
+
+FLuaSampleProfiler::FNativeScope::~FNativeScope()
+{
+	if (Profiler)
+	{
+		Profiler->PopNativeFrame();
+	}
+}
+
+FLuaSampleProfiler::FLuaSampleProfiler(lua_State* InL)
+	: L(InL)
+	, bRunning(false)
+	, SamplePeriodCycles(0)
+	, NextSampleCycles(0)
+	, LastSampleCycles(0)
+	, NumSamples(0)
+	, PreviousHook(nullptr)
+	, PreviousHookMask(0)
+	, PreviousHookCount(0)
+{
+	Reset();
+}
+
+FLuaSampleProfiler::~FLuaSampleProfiler()
+{
+	Stop();
+}
+
+void FLuaSampleProfiler::Start()
+{
+	if (bRunning || !L)
+	{
+		return;
+	}
+
+	bRunning = true;
+
+	SamplePeriodCycles = (uint64)(FMath::Max(CVarLuaProfileSampleIntervalUs.GetValueOnGameThread(), 1) / 1000000.0 / FPlatformTime::GetSecondsPerCycle64());
+	NextSampleCycles = FPlatformTime::Cycles64();
+	LastSampleCycles = NextSampleCycles;
+
+	PreviousHook = lua_gethook(L);
+	PreviousHookMask = lua_gethookmask(L);
+	PreviousHookCount = lua_gethookcount(L);
+
+	if (PreviousHook)
+	{
+		UE_LOG(LogBluelua, Warning, TEXT("Lua sample profiler replaces the current lua hook until stopped!"));
+	}
+
+	// coroutines created from now on inherit the hook, pooled ones get it when resumed
+	lua_sethook(L, &FLuaSampleProfiler::Hook, LUA_MASKCOUNT, FMath::Max(CVarLuaProfileHookInstructions.GetValueOnGameThread(), 1));
+}
+
+void FLuaSampleProfiler::Stop()
+{
+	if (!bRunning)
+	{
+		return;
+	}
+
+	bRunning = false;
+
+	// hooks left on coroutines remove themselves on the next call
+	lua_sethook(L, PreviousHook, PreviousHookMask, PreviousHookCount);
+
+	PreviousHook = nullptr;
+	PreviousHookMask = 0;
+	PreviousHookCount = 0;
+}
+
+void FLuaSampleProfiler::Reset()
+{
+	NumSamples = 0;
+
+	Frames.Reset();
+	LuaFrameIndices.Empty();
+	NativeFrameIndices.Empty();
+
+	StackNodes.Reset();
+	StackNodes.Add({ INDEX_NONE, INDEX_NONE, 0, 0 });
+}
+
+int64 FLuaSampleProfiler::GetNumSamples() const
+{
+	return NumSamples;
+}
+
+FString FLuaSampleProfiler::Export(ELuaProfileFormat Format, const FString& FileName/* = FString()*/) const
+{
+	const bool bSpeedscope = (Format == ELuaProfileFormat::Speedscope);
+
+	FString FilePath = FileName;
+	if (FilePath.IsEmpty())
+	{
+		FilePath = FString::Printf(TEXT("Lua-%s%s"), *FDateTime::Now().ToString(), bSpeedscope ? TEXT(".speedscope.json") : TEXT(".folded"));
+	}
+
+	if (FPaths::IsRelative(FilePath))
+	{
+		FilePath = FPaths::Combine(FPaths::ProfilingDir(), FilePath);
+	}
+
+	FString Content;
+	if (bSpeedscope)
+	{
+		BuildSpeedscope(Content);
+	}
+	else
+	{
+		BuildCollapsed(Content);
+	}
+
+	if (!FFileHelper::SaveStringToFile(Content, *FilePath, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM))
+	{
+		UE_LOG(LogBluelua, Error, TEXT("Export lua sample profile failed! Can't write file[%s]!"), *FilePath);
+		return FString();
+	}
+
+	return FPaths::ConvertRelativePathToFull(FilePath);
+}
+
+void FLuaSampleProfiler::PushNativeFrame(lua_State* InL, UFunction* Function)
+{
+	const int32 LuaDepth = GetStackDepth(InL);
+
+	// UE enters lua, the time since the last sample was spent outside of it
+	if (LuaDepth == 0)
+	{
+		LastSampleCycles = FMath::Max(LastSampleCycles, FPlatformTime::Cycles64());
+	}
+
+	NativeFrames.Add({ InL, LuaDepth, Function->GetFName() });
+}
+
+void FLuaSampleProfiler::PopNativeFrame()
+{
+	if (NativeFrames.Num() > 0)
+	{
+		NativeFrames.Pop(false);
+	}
+}
+
+void FLuaSampleProfiler::Hook(lua_State* InL, lua_Debug* Ar)
+{
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(InL);
+	FLuaSampleProfiler* Profiler = LuaStateWrapper ? LuaStateWrapper->GetSampleProfiler() : nullptr;
+	if (!Profiler || !Profiler->bRunning)
+	{
+		lua_sethook(InL, nullptr, 0, 0);
+		return;
+	}
+
+	const uint64 Cycles = FPlatformTime::Cycles64();
+	if (Cycles < Profiler->NextSampleCycles)
+	{
+		return;
+	}
+
+	// the count hook fires late by up to HookInstructions, weight by the time actually elapsed
+	const uint64 ElapsedCycles = FMath::Min(Cycles - Profiler->LastSampleCycles, Profiler->SamplePeriodCycles * MaxSampleIntervals);
+
+	Profiler->NextSampleCycles = Cycles + Profiler->SamplePeriodCycles;
+	Profiler->LastSampleCycles = Cycles;
+	Profiler->Sample(InL, ElapsedCycles);
+}
+
+int32 FLuaSampleProfiler::GetStackDepth(lua_State* InL)
+{
+	// lua_getstack walks from the top, find the depth by doubling then bisecting
+	lua_Debug Ar;
+
+	int32 Low = 0;
+	int32 High = 1;
+	while (lua_getstack(InL, High - 1, &Ar))
+	{
+		Low = High;
+		High *= 2;
+	}
+
+	// levels [0, Low) exist, level High - 1 doesn't
+	while (Low + 1 < High)
+	{
+		const int32 Mid = (Low + High) / 2;
+		if (lua_getstack(InL, Mid - 1, &Ar))
+		{
+			Low = Mid;
+		}
+		else
+		{
+			High = Mid;
+		}
+	}
+
+	return Low;
+}
+
+void FLuaSampleProfiler::Sample(lua_State* InL, uint64 ElapsedCycles)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaProfileSample);
+
+	// innermost first
+	TArray<int32, TInlineAllocator<MaxSampleDepth>> LuaFrames;
+
+	lua_Debug Ar;
+	for (int32 Level = 0; Level < MaxSampleDepth && lua_getstack(InL, Level, &Ar); ++Level)
+	{
+		LuaFrames.Add(FindOrAddLuaFrame(InL, Ar));
+	}
+
+	const int32 Depth = LuaFrames.Num();
+
+	int32 NodeIndex = RootNodeIndex;
+	int32 NativeIndex = 0;
+
+	// walk from the outermost lua frame, native frames go right above the lua frames active when they were pushed
+	for (int32 OuterIndex = 0; OuterIndex < Depth; ++OuterIndex)
+	{
+		for (; NativeIndex < NativeFrames.Num(); ++NativeIndex)
+		{
+			const FNativeFrame& NativeFrame = NativeFrames[NativeIndex];
+			if (NativeFrame.L != InL)
+			{
+				continue;
+			}
+
+			if (NativeFrame.LuaDepth > OuterIndex)
+			{
+				break;
+			}
+
+			NodeIndex = FindOrAddChild(NodeIndex, FindOrAddNativeFrame(NativeFrame.Name));
+		}
+
+		NodeIndex = FindOrAddChild(NodeIndex, LuaFrames[Depth - 1 - OuterIndex]);
+	}
+
+	++StackNodes[NodeIndex].Samples;
+	StackNodes[NodeIndex].Cycles += ElapsedCycles;
+	++NumSamples;
+}
+
+int32 FLuaSampleProfiler::FindOrAddLuaFrame(lua_State* InL, lua_Debug& Ar)
+{
+	lua_getinfo(InL, "Sn", &Ar);
+
+	// short_src is bounded by LUA_IDSIZE, source can be a whole chunk loaded from a string
+	const FLuaFrameKey Key{ FName(Ar.short_src), Ar.name ? FName(Ar.name) : NAME_None, Ar.linedefined };
+	if (const int32* FrameIndex = LuaFrameIndices.Find(Key))
+	{
+		return *FrameIndex;
+	}
+
+	FFrame Frame;
+	Frame.File = UTF8_TO_TCHAR(Ar.short_src);
+	Frame.Line = Ar.linedefined;
+
+	if (Ar.what && Ar.what[0] == 'm')
+	{
+		Frame.Name = FString::Printf(TEXT("main (%s)"), *Frame.File);
+	}
+	else if (Ar.what && Ar.what[0] == 'C')
+	{
+		Frame.Name = FString::Printf(TEXT("%s [C]"), Ar.name ? UTF8_TO_TCHAR(Ar.name) : TEXT("?"));
+	}
+	else
+	{
+		Frame.Name = FString::Printf(TEXT("%s (%s:%d)"), Ar.name ? UTF8_TO_TCHAR(Ar.name) : TEXT("?"), *Frame.File, Frame.Line);
+	}
+
+	const int32 FrameIndex = Frames.Add(MoveTemp(Frame));
+	LuaFrameIndices.Add(Key, FrameIndex);
+
+	return FrameIndex;
+}
+
+int32 FLuaSampleProfiler::FindOrAddNativeFrame(FName Name)
+{
+	if (const int32* FrameIndex = NativeFrameIndices.Find(Name))
+	{
+		return *FrameIndex;
+	}
+
+	FFrame Frame;
+	Frame.Name = FString::Printf(TEXT("%s [UE]"), *Name.ToString());
+	Frame.Line = 0;
+
+	const int32 FrameIndex = Frames.Add(MoveTemp(Frame));
+	NativeFrameIndices.Add(Name, FrameIndex);
+
+	return FrameIndex;
+}
+
+int32 FLuaSampleProfiler::FindOrAddChild(int32 NodeIndex, int32 FrameIndex)
+{
+	if (const int32* ChildIndex = StackNodes[NodeIndex].Children.Find(FrameIndex))
+	{
+		return *ChildIndex;
+	}
+
+	const int32 ChildIndex = StackNodes.Add({ NodeIndex, FrameIndex, 0, 0 });
+	StackNodes[NodeIndex].Children.Add(FrameIndex, ChildIndex);
+
+	return ChildIndex;
+}
+
+void FLuaSampleProfiler::GetStackFrames(int32 NodeIndex, TArray<int32>& OutFrames) const
+{
+	OutFrames.Reset();
+
+	for (int32 Index = NodeIndex; Index != RootNodeIndex; Index = StackNodes[Index].Parent)
+	{
+		OutFrames.Add(StackNodes[Index].FrameIndex);
+	}
+
+	Algo::Reverse(OutFrames);
+}
+
+int64 FLuaSampleProfiler::GetWeightUs(int32 NodeIndex) const
+{
+	return FMath::Max((int64)(StackNodes[NodeIndex].Cycles * FPlatformTime::GetSecondsPerCycle64() * 1000000.0), (int64)1);
+}
+
+void FLuaSampleProfiler::BuildCollapsed(FString& Out) const
+{
+	TArray<int32> StackFrames;
+
+	for (int32 NodeIndex = 0; NodeIndex < StackNodes.Num(); ++NodeIndex)
+	{
+		if (StackNodes[NodeIndex].Samples <= 0)
+		{
+			continue;
+		}
+
+		GetStackFrames(NodeIndex, StackFrames);
+
+		for (int32 Index = 0; Index < StackFrames.Num(); ++Index)
+		{
+			if (Index > 0)
+			{
+				Out += TEXT(';');
+			}
+
+			// ';' separates frames and the last space separates the count
+			Out += Frames[StackFrames[Index]].Name.Replace(TEXT(";"), TEXT(":")).Replace(TEXT(" "), TEXT("_"));
+		}
+
+		// weighted in microseconds like the speedscope export
+		Out += FString::Printf(TEXT(" %lld\n"), GetWeightUs(NodeIndex));
+	}
+}
+
+void FLuaSampleProfiler::BuildSpeedscope(FString& Out) const
+{
+	Out += TEXT("{\"$schema\":\"https://www.speedscope.app/file-format-schema.json\",\"exporter\":\"Bluelua\",\"name\":\"Lua\",\"activeProfileIndex\":0,");
+
+	Out += TEXT("\"shared\":{\"frames\":[");
+	for (int32 Index = 0; Index < Frames.Num(); ++Index)
+	{
+		const FFrame& Frame = Frames[Index];
+
+		Out += (Index > 0) ? TEXT(",{\"name\":") : TEXT("{\"name\":");
+		AppendJsonString(Out, Frame.Name);
+
+		if (!Frame.File.IsEmpty())
+		{
+			Out += TEXT(",\"file\":");
+			AppendJsonString(Out, Frame.File);
+			Out += FString::Printf(TEXT(",\"line\":%d"), Frame.Line);
+		}
+
+		Out += TEXT('}');
+	}
+	Out += TEXT("]},");
+
+	FString Samples;
+	FString Weights;
+	TArray<int32> StackFrames;
+	int64 TotalWeight = 0;
+
+	for (int32 NodeIndex = 0; NodeIndex < StackNodes.Num(); ++NodeIndex)
+	{
+		if (StackNodes[NodeIndex].Samples <= 0)
+		{
+			continue;
+		}
+
+		GetStackFrames(NodeIndex, StackFrames);
+
+		if (!Samples.IsEmpty())
+		{
+			Samples += TEXT(',');
+			Weights += TEXT(',');
+		}
+
+		Samples += TEXT('[');
+		for (int32 Index = 0; Index < StackFrames.Num(); ++Index)
+		{
+			Samples += (Index > 0) ? FString::Printf(TEXT(",%d"), StackFrames[Index]) : FString::Printf(TEXT("%d"), StackFrames[Index]);
+		}
+		Samples += TEXT(']');
+
+		const int64 Weight = GetWeightUs(NodeIndex);
+		Weights += FString::Printf(TEXT("%lld"), Weight);
+		TotalWeight += Weight;
+	}
+
+	Out += FString::Printf(TEXT("\"profiles\":[{\"type\":\"sampled\",\"name\":\"Lua\",\"unit\":\"microseconds\",\"startValue\":0,\"endValue\":%lld,"), TotalWeight);
+	Out += TEXT("\"samples\":[") + Samples + TEXT("],\"weights\":[") + Weights + TEXT("]}]}");
+}
@@ -0,0 +1,576 @@
+#include "LuaSerializer.h"
+
+#include "Serialization/BufferReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/ObjectAndNameAsStringProxyArchive.h"
+#include "UObject/Class.h"
+#include "UObject/UObjectGlobals.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+#include "LuaState.h"
+#include "LuaUStruct.h"
+
+DECLARE_CYCLE_STAT(TEXT("LuaSerialize"), STAT_LuaSerialize, STATGROUP_Bluelua);
+DECLARE_CYCLE_STAT(TEXT("LuaDeserialize"), STAT_LuaDeserialize, STATGROUP_Bluelua);
+
+static const uint8 SerializerVersion = 1;
+
+// guards native stack, shared tables and cycles are written as references and don't count
+static const int32 MaxDepth = 200;
+
+enum class ELuaValueTag : uint8
+{
+	Nil,
+	False,
+	True,
+	Integer,
+	Float,
+	Double,
+	String,
+	Table,
+	TableRef,
+	Struct,
+};
+
+FLuaSerializer::FLuaSerializer(bool bInAllowStructs/* = true*/)
+	: bAllowStructs(bInAllowStructs)
+	, ReadData(nullptr)
+	, ReadSize(0)
+	, ReadOffset(0)
+	, NumReadTables(0)
+{
+}
+
+bool FLuaSerializer::Serialize(lua_State* L, int32 FirstIndex, int32 Count, TArray<uint8>& OutBuffer)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaSerialize);
+
+	OutBuffer.Reset();
+	TableRefs.Reset();
+	Error.Reset();
+
+	FirstIndex = lua_absindex(L, FirstIndex);
+
+	OutBuffer.Add(SerializerVersion);
+	WriteVarUInt(OutBuffer, Count);
+
+	for (int32 Index = FirstIndex; Index < FirstIndex + Count; ++Index)
+	{
+		if (!WriteValue(L, Index, 0, OutBuffer))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool FLuaSerializer::Serialize(lua_State* L, int32 FirstIndex, int32 Count)
+{
+	return Serialize(L, FirstIndex, Count, ScratchBuffer);
+}
+
+const TArray<uint8>& FLuaSerializer::GetScratchBuffer() const
+{
+	return ScratchBuffer;
+}
+
+int32 FLuaSerializer::Deserialize(lua_State* L, const uint8* Data, int32 Size)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaDeserialize);
+
+	Error.Reset();
+
+	ReadData = Data;
+	ReadSize = Size;
+	ReadOffset = 0;
+	NumReadTables = 0;
+
+	const int32 Top = lua_gettop(L);
+
+	uint8 Version = 0;
+	uint64 Count = 0;
+	if (!ReadBytes(&Version, sizeof(Version)) || !ReadVarUInt(Count))
+	{
+		return INDEX_NONE;
+	}
+
+	if (Version != SerializerVersion)
+	{
+		SetError(FString::Printf(TEXT("unsupported version[%d]"), Version));
+		return INDEX_NONE;
+	}
+
+	if (Count > (uint64)ReadSize || !lua_checkstack(L, (int)Count + 1))
+	{
+		SetError(TEXT("too many values"));
+		return INDEX_NONE;
+	}
+
+	// reference id -> decoded table
+	lua_newtable(L);
+	const int32 RefsIndex = lua_gettop(L);
+
+	for (uint64 Index = 0; Index < Count; ++Index)
+	{
+		if (!ReadValue(L, RefsIndex, 0))
+		{
+			lua_settop(L, Top);
+			return INDEX_NONE;
+		}
+	}
+
+	lua_remove(L, RefsIndex);
+
+	ReadData = nullptr;
+
+	return (int32)Count;
+}
+
+int32 FLuaSerializer::Deserialize(lua_State* L, const TArray<uint8>& Buffer)
+{
+	return Deserialize(L, Buffer.GetData(), Buffer.Num());
+}
+
+const FString& FLuaSerializer::GetError() const
+{
+	return Error;
+}
+
+int FLuaSerializer::LuaSerialize(lua_State* L)
+{
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	if (!LuaStateWrapper)
+	{
+		return 0;
+	}
+
+	FLuaSerializer& Serializer = LuaStateWrapper->GetSerializer();
+	if (!Serializer.Serialize(L, 1, lua_gettop(L)))
+	{
+		return luaL_error(L, "Serialize failed! %s!", TCHAR_TO_UTF8(*Serializer.GetError()));
+	}
+
+	const TArray<uint8>& Buffer = Serializer.GetScratchBuffer();
+	lua_pushlstring(L, (const char*)Buffer.GetData(), Buffer.Num());
+
+	return 1;
+}
+
+int FLuaSerializer::LuaDeserialize(lua_State* L)
+{
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	if (!LuaStateWrapper)
+	{
+		return 0;
+	}
+
+	size_t Size = 0;
+	const char* Data = luaL_checklstring(L, 1, &Size);
+
+	FLuaSerializer& Serializer = LuaStateWrapper->GetSerializer();
+
+	const int32 Count = Serializer.Deserialize(L, (const uint8*)Data, (int32)Size);
+	if (Count == INDEX_NONE)
+	{
+		return luaL_error(L, "Deserialize failed! %s!", TCHAR_TO_UTF8(*Serializer.GetError()));
+	}
+
+	return Count;
+}
+
+bool FLuaSerializer::WriteValue(lua_State* L, int32 Index, int32 Depth, TArray<uint8>& Buffer)
+{
+	switch (lua_type(L, Index))
+	{
+	case LUA_TNIL:
+		Buffer.Add((uint8)ELuaValueTag::Nil);
+		return true;
+	case LUA_TBOOLEAN:
+		Buffer.Add((uint8)(lua_toboolean(L, Index) ? ELuaValueTag::True : ELuaValueTag::False));
+		return true;
+	case LUA_TNUMBER:
+		if (lua_isinteger(L, Index))
+		{
+			// zigzag so that small negative numbers stay short
+			const int64 Value = lua_tointeger(L, Index);
+			Buffer.Add((uint8)ELuaValueTag::Integer);
+			WriteVarUInt(Buffer, ((uint64)Value << 1) ^ (uint64)(Value >> 63));
+		}
+		else
+		{
+			const double Value = lua_tonumber(L, Index);
+			const float FloatValue = (float)Value;
+			if ((double)FloatValue == Value)
+			{
+				Buffer.Add((uint8)ELuaValueTag::Float);
+				Buffer.Append((const uint8*)&FloatValue, sizeof(FloatValue));
+			}
+			else
+			{
+				Buffer.Add((uint8)ELuaValueTag::Double);
+				Buffer.Append((const uint8*)&Value, sizeof(Value));
+			}
+		}
+		return true;
+	case LUA_TSTRING:
+	{
+		size_t Length = 0;
+		const char* Value = lua_tolstring(L, Index, &Length);
+		Buffer.Add((uint8)ELuaValueTag::String);
+		WriteVarUInt(Buffer, Length);
+		Buffer.Append((const uint8*)Value, Length);
+		return true;
+	}
+	case LUA_TTABLE:
+		return WriteTable(L, Index, Depth, Buffer);
+	case LUA_TUSERDATA:
+		if (bAllowStructs && FLuaUStruct::ToLuaUStruct(L, Index))
+		{
+			return WriteStruct(L, Index, Buffer);
+		}
+		// fall through
+	default:
+		return SetError(FString::Printf(TEXT("can't serialize %s"), UTF8_TO_TCHAR(luaL_typename(L, Index))));
+	}
+}
+
+bool FLuaSerializer::WriteTable(lua_State* L, int32 Index, int32 Depth, TArray<uint8>& Buffer)
+{
+	Index = lua_absindex(L, Index);
+
+	const void* TablePointer = lua_topointer(L, Index);
+	if (const int32* RefId = TableRefs.Find(TablePointer))
+	{
+		Buffer.Add((uint8)ELuaValueTag::TableRef);
+		WriteVarUInt(Buffer, *RefId);
+		return true;
+	}
+
+	if (Depth >= MaxDepth || !lua_checkstack(L, 3))
+	{
+		return SetError(TEXT("table nested too deep"));
+	}
+
+	TableRefs.Emplace(TablePointer, TableRefs.Num());
+
+	// array part first, then other pairs terminated by nil
+	const lua_Integer ArrayCount = (lua_Integer)lua_rawlen(L, Index);
+
+	Buffer.Add((uint8)ELuaValueTag::Table);
+	WriteVarUInt(Buffer, ArrayCount);
+
+	for (lua_Integer ArrayIndex = 1; ArrayIndex <= ArrayCount; ++ArrayIndex)
+	{
+		lua_rawgeti(L, Index, ArrayIndex);
+		const bool bSuccess = WriteValue(L, -1, Depth + 1, Buffer);
+		lua_pop(L, 1);
+
+		if (!bSuccess)
+		{
+			return false;
+		}
+	}
+
+	lua_pushnil(L);
+	while (lua_next(L, Index))
+	{
+		if (lua_isinteger(L, -2))
+		{
+			const lua_Integer Key = lua_tointeger(L, -2);
+			if (Key >= 1 && Key <= ArrayCount)
+			{
+				lua_pop(L, 1);
+				continue;
+			}
+		}
+
+		if (!WriteValue(L, -2, Depth + 1, Buffer) || !WriteValue(L, -1, Depth + 1, Buffer))
+		{
+			lua_pop(L, 2);
+			return false;
+		}
+
+		lua_pop(L, 1);
+	}
+
+	Buffer.Add((uint8)ELuaValueTag::Nil);
+
+	return true;
+}
+
+bool FLuaSerializer::WriteStruct(lua_State* L, int32 Index, TArray<uint8>& Buffer)
+{
+	FLuaUStruct* LuaUStruct = FLuaUStruct::ToLuaUStruct(L, Index);
+	UScriptStruct* ScriptStruct = LuaUStruct->GetSource();
+	if (!ScriptStruct || !LuaUStruct->GetScriptBuffer())
+	{
+		return SetError(TEXT("can't serialize invalid struct"));
+	}
+
+	const FTCHARToUTF8 StructPath(*ScriptStruct->GetPathName());
+
+	Buffer.Add((uint8)ELuaValueTag::Struct);
+	WriteVarUInt(Buffer, StructPath.Length());
+	Buffer.Append((const uint8*)StructPath.Get(), StructPath.Length());
+
+	const int32 SizeOffset = Buffer.AddZeroed(sizeof(uint32));
+
+	// tagged properties, names and objects as strings, so data survives struct layout changes
+	FMemoryWriter Writer(Buffer, false, true);
+	FObjectAndNameAsStringProxyArchive Ar(Writer, false);
+	ScriptStruct->SerializeItem(Ar, LuaUStruct->GetScriptBuffer(), nullptr);
+
+	const uint32 StructSize = Buffer.Num() - SizeOffset - sizeof(uint32);
+	FMemory::Memcpy(Buffer.GetData() + SizeOffset, &StructSize, sizeof(StructSize));
+
+	return true;
+}
+
+bool FLuaSerializer::ReadValue(lua_State* L, int32 RefsIndex, int32 Depth)
+{
+	uint8 Tag = 0;
+	if (!ReadBytes(&Tag, sizeof(Tag)))
+	{
+		return false;
+	}
+
+	switch ((ELuaValueTag)Tag)
+	{
+	case ELuaValueTag::Nil:
+		lua_pushnil(L);
+		return true;
+	case ELuaValueTag::False:
+		lua_pushboolean(L, false);
+		return true;
+	case ELuaValueTag::True:
+		lua_pushboolean(L, true);
+		return true;
+	case ELuaValueTag::Integer:
+	{
+		uint64 Value = 0;
+		if (!ReadVarUInt(Value))
+		{
+			return false;
+		}
+
+		lua_pushinteger(L, (lua_Integer)((Value >> 1) ^ (~(Value & 1) + 1)));
+		return true;
+	}
+	case ELuaValueTag::Float:
+	{
+		float Value = 0.f;
+		if (!ReadBytes(&Value, sizeof(Value)))
+		{
+			return false;
+		}
+
+		lua_pushnumber(L, Value);
+		return true;
+	}
+	case ELuaValueTag::Double:
+	{
+		double Value = 0.0;
+		if (!ReadBytes(&Value, sizeof(Value)))
+		{
+			return false;
+		}
+
+		lua_pushnumber(L, Value);
+		return true;
+	}
+	case ELuaValueTag::String:
+	{
+		uint64 Length = 0;
+		if (!ReadVarUInt(Length) || Length > (uint64)(ReadSize - ReadOffset))
+		{
+			return SetError(TEXT("truncated string"));
+		}
+
+		lua_pushlstring(L, (const char*)ReadData + ReadOffset, (size_t)Length);
+		ReadOffset += (int32)Length;
+		return true;
+	}
+	case ELuaValueTag::Table:
+		return ReadTable(L, RefsIndex, Depth);
+	case ELuaValueTag::TableRef:
+	{
+		uint64 RefId = 0;
+		if (!ReadVarUInt(RefId) || RefId >= (uint64)NumReadTables)
+		{
+			return SetError(TEXT("invalid table reference"));
+		}
+
+		lua_rawgeti(L, RefsIndex, (lua_Integer)RefId + 1);
+		return true;
+	}
+	case ELuaValueTag::Struct:
+		if (!bAllowStructs)
+		{
+			return SetError(TEXT("structs are not allowed here"));
+		}
+
+		return ReadStruct(L);
+	default:
+		return SetError(FString::Printf(TEXT("unknown tag[%d]"), Tag));
+	}
+}
+
+bool FLuaSerializer::ReadTable(lua_State* L, int32 RefsIndex, int32 Depth)
+{
+	uint64 ArrayCount = 0;
+	if (!ReadVarUInt(ArrayCount) || ArrayCount > (uint64)(ReadSize - ReadOffset))
+	{
+		return SetError(TEXT("truncated table"));
+	}
+
+	if (Depth >= MaxDepth || !lua_checkstack(L, 3))
+	{
+		return SetError(TEXT("table nested too deep"));
+	}
+
+	lua_createtable(L, (int)ArrayCount, 0);
+	const int32 TableIndex = lua_gettop(L);
+
+	// register before reading children so that cycles resolve to this table
+	lua_pushvalue(L, TableIndex);
+	lua_rawseti(L, RefsIndex, ++NumReadTables);
+
+	for (uint64 ArrayIndex = 1; ArrayIndex <= ArrayCount; ++ArrayIndex)
+	{
+		if (!ReadValue(L, RefsIndex, Depth + 1))
+		{
+			return false;
+		}
+
+		lua_rawseti(L, TableIndex, (lua_Integer)ArrayIndex);
+	}
+
+	while (true)
+	{
+		if (!ReadValue(L, RefsIndex, Depth + 1))
+		{
+			return false;
+		}
+
+		if (lua_isnil(L, -1))
+		{
+			lua_pop(L, 1);
+			break;
+		}
+
+		if (lua_type(L, -1) == LUA_TNUMBER && lua_tonumber(L, -1) != lua_tonumber(L, -1))
+		{
+			return SetError(TEXT("nan table key"));
+		}
+
+		if (!ReadValue(L, RefsIndex, Depth + 1))
+		{
+			return false;
+		}
+
+		lua_rawset(L, TableIndex);
+	}
+
+	return true;
+}
+
+bool FLuaSerializer::ReadStruct(lua_State* L)
+{
+	uint64 PathLength = 0;
+	if (!ReadVarUInt(PathLength) || PathLength > (uint64)(ReadSize - ReadOffset))
+	{
+		return SetError(TEXT("truncated struct"));
+	}
+
+	const FUTF8ToTCHAR PathConverter((const ANSICHAR*)ReadData + ReadOffset, (int32)PathLength);
+	const FString StructPath(PathConverter.Length(), PathConverter.Get());
+	ReadOffset += (int32)PathLength;
+
+	uint32 StructSize = 0;
+	if (!ReadBytes(&StructSize, sizeof(StructSize)) || StructSize > (uint32)(ReadSize - ReadOffset))
+	{
+		return SetError(TEXT("truncated struct"));
+	}
+
+	// payloads can come from scripts, never load a package named by one
+	UScriptStruct* ScriptStruct = FindObject<UScriptStruct>(nullptr, *StructPath);
+	if (!ScriptStruct)
+	{
+		return SetError(FString::Printf(TEXT("can't find struct[%s], it must be loaded before deserializing"), *StructPath));
+	}
+
+	FLuaUStruct::Push(L, ScriptStruct);
+	FLuaUStruct* LuaUStruct = FLuaUStruct::ToLuaUStruct(L, -1);
+
+	FBufferReader Reader((void*)(ReadData + ReadOffset), StructSize, false);
+	FObjectAndNameAsStringProxyArchive Ar(Reader, false);
+	ScriptStruct->SerializeItem(Ar, LuaUStruct->GetScriptBuffer(), nullptr);
+
+	ReadOffset += StructSize;
+
+	if (Reader.IsError() || Ar.IsError())
+	{
+		return SetError(FString::Printf(TEXT("struct[%s] data is malformed"), *StructPath));
+	}
+
+	return true;
+}
+
+void FLuaSerializer::WriteVarUInt(TArray<uint8>& Buffer, uint64 Value)
+{
+	while (Value >= 0x80)
+	{
+		Buffer.Add((uint8)(Value | 0x80));
+		Value >>= 7;
+	}
+
+	Buffer.Add((uint8)Value);
+}
+
+bool FLuaSerializer::ReadVarUInt(uint64& OutValue)
+{
+	OutValue = 0;
+
+	for (int32 Shift = 0; Shift < 64; Shift += 7)
+	{
+		if (ReadOffset >= ReadSize)
+		{
+			return SetError(TEXT("truncated data"));
+		}
+
+		const uint8 Byte = ReadData[ReadOffset++];
+		OutValue |= (uint64)(Byte & 0x7F) << Shift;
+
+		if (!(Byte & 0x80))
+		{
+			return true;
+		}
+	}
+
+	return SetError(TEXT("malformed varint"));
+}
+
+bool FLuaSerializer::ReadBytes(void* Dest, int32 Size)
+{
+	if (ReadOffset + Size > ReadSize)
+	{
+		return SetError(TEXT("truncated data"));
+	}
+
+	FMemory::Memcpy(Dest, ReadData + ReadOffset, Size);
+	ReadOffset += Size;
+
+	return true;
+}
+
+bool FLuaSerializer::SetError(const FString& InError)
+{
+	if (Error.IsEmpty())
+	{
+		Error = InError;
+	}
+
+	return false;
+}
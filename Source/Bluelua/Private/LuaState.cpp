@@ -1,13 +1,17 @@
 #include "LuaState.h"
 
+#include "Containers/Ticker.h"
 #include "Engine/Engine.h"
 #include "Engine/GameInstance.h"
 #include "Engine/World.h"
 #include "GenericPlatform/GenericPlatformMemory.h"
+#include "HAL/PlatformTime.h"
 #include "HAL/UnrealMemory.h"
+#include "Misc/CoreDelegates.h"
 #include "Misc/FileHelper.h"
 #include "Misc/Paths.h"
 #include "UObject/Class.h"
+#include "UObject/Package.h"
 #include "UObject/UnrealType.h"
 #include "UObject/UObjectGlobals.h"
 
@@ -15,75 +19,96 @@
 #include "LibLuasocket.h"
 #include "LuaPanda.h"
 #include "lua.hpp"
+#include "LuaChunkCache.h"
+#include "LuaDelegateDispatcher.h"
 #include "LuaFunctionDelegate.h"
+#include "LuaLog.h"
+#include "LuaMemoryProfiler.h"
 #include "LuaObjectBase.h"
+#include "LuaSampleProfiler.h"
 #include "LuaStackGuard.h"
+#include "LuaTrace.h"
 #include "LuaUClass.h"
 #include "LuaUDelegate.h"
 #include "LuaUObject.h"
 #include "LuaUScriptStruct.h"
+#include "LuaUStruct.h"
 
-DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("LuaMemory"), STAT_LuaMemory, STATGROUP_Bluelua);
+DECLARE_MEMORY_STAT(TEXT("LuaMemory"), STAT_LuaMemory, STATGROUP_Bluelua);
 DECLARE_CYCLE_STAT(TEXT("CallLuaFunction"), STAT_CallLuaFunction, STATGROUP_Bluelua);
+DECLARE_CYCLE_STAT(TEXT("CallLuaFunctions"), STAT_CallLuaFunctions, STATGROUP_Bluelua);
 DECLARE_CYCLE_STAT(TEXT("FillOutProperty"), STAT_FillOutProperty, STATGROUP_Bluelua);
 DECLARE_CYCLE_STAT(TEXT("LuaLoadClass"), STAT_LuaLoadClass, STATGROUP_Bluelua);
 DECLARE_CYCLE_STAT(TEXT("LuaLoadStruct"), STAT_LuaLoadStruct, STATGROUP_Bluelua);
 DECLARE_CYCLE_STAT(TEXT("LuaGetEnum"), STAT_LuaGetEnum, STATGROUP_Bluelua);
 
-FLuaState::FLuaState()
+FLuaState::FLuaState(ELuaStateProfile InProfile)
 	: L(nullptr)
+	, Profile(InProfile)
 	, CacheObjectRefIndex(LUA_NOREF)
+	, DelegateDispatcher(nullptr)
+	, ChunkCache(MakeShared<FLuaChunkCache, ESPMode::ThreadSafe>())
 {
-	L = lua_newstate(LuaAlloc, nullptr);
+	L = lua_newstate(LuaAlloc, this);
 	if (L)
 	{
 		FLuaStackGuard Guard(L);
 
 		lua_atpanic(L, LuaPanic);
 
-		static const luaL_Reg LoadedLibs[] = {
-			{ "_G", luaopen_base },
-			{ LUA_LOADLIBNAME, luaopen_package },
-			{ LUA_COLIBNAME, luaopen_coroutine },
-			{ LUA_TABLIBNAME, luaopen_table },
-			{ LUA_OSLIBNAME, luaopen_os },
-			{ LUA_STRLIBNAME, luaopen_string },
-			{ LUA_MATHLIBNAME, luaopen_math },
-			{ LUA_UTF8LIBNAME, luaopen_utf8 },
-			{ LUA_DBLIBNAME, luaopen_debug },
-			{ NULL, NULL }
-		};
-		
-		for (const luaL_Reg* Lib = LoadedLibs; Lib->func; ++Lib)
-		{
-			luaL_requiref(L, Lib->name, Lib->func, 1);
-			lua_pop(L, 1);
-		}
+		OpenLibraries(L, Profile);
+
+		const bool bSandbox = Profile == ELuaStateProfile::Sandbox;
 
 		// add custom searcher to the beginning of package.searchers: preload, custom, lua, c
-		lua_pushcfunction(L, LuaSearcher);
-		const int CustomSearcherIndex = lua_gettop(L);
+		if (!bSandbox)
+		{
+			lua_pushcfunction(L, LuaSearcher);
+			const int CustomSearcherIndex = lua_gettop(L);
 
-		lua_getglobal(L, "package");
-		lua_getfield(L, -1, "searchers");
+			lua_getglobal(L, "package");
+			lua_getfield(L, -1, "searchers");
 
-		const int SearchersIndex = lua_gettop(L);
+			const int SearchersIndex = lua_gettop(L);
 
-		for (int i = lua_rawlen(L, SearchersIndex) + 1; i > 2; --i)
-		{
-			lua_rawgeti(L, SearchersIndex, i - 1);
-			lua_rawseti(L, SearchersIndex, i);
+			for (int i = lua_rawlen(L, SearchersIndex) + 1; i > 2; --i)
+			{
+				lua_rawgeti(L, SearchersIndex, i - 1);
+				lua_rawseti(L, SearchersIndex, i);
+			}
+			lua_pushvalue(L, CustomSearcherIndex);
+			lua_rawseti(L, SearchersIndex, 2);
 		}
-		lua_pushvalue(L, CustomSearcherIndex);
-		lua_rawseti(L, SearchersIndex, 2);
 
-		lua_register(L, "print", LuaPrint);
-		lua_register(L, "LoadObject", &FLuaUObject::LuaLoadObject);
-		lua_register(L, "DestroyObject", &FLuaUObject::LuaDestroyObject);
-		lua_register(L, "LoadClass", LuaLoadClass);
-		lua_register(L, "LoadStruct", LuaLoadStruct);
+		FLuaLog::Register(L, this);
+		if (!bSandbox)
+		{
+			lua_register(L, "LoadObject", &FLuaUObject::LuaLoadObject);
+			lua_register(L, "DestroyObject", &FLuaUObject::LuaDestroyObject);
+			lua_register(L, "LoadClass", LuaLoadClass);
+			lua_register(L, "LoadStruct", LuaLoadStruct);
+			lua_register(L, "PreloadModules", LuaPreloadModules);
+		}
 		lua_register(L, "GetEnum", GetEnumValue);
-		lua_register(L, "CreateFunctionDelegate", &ULuaFunctionDelegate::CreateFunctionDelegate);
+
+		// delegates, worker jobs, serialized structs and object loads reach past the state
+		const bool bGameplay = Profile == ELuaStateProfile::Game || Profile == ELuaStateProfile::Server;
+		if (bGameplay)
+		{
+			lua_register(L, "CreateFunctionDelegate", &ULuaDelegateDispatcher::CreateFunctionDelegate);
+			lua_register(L, "RunWorkerJob", LuaRunWorkerJob);
+			lua_register(L, "Serialize", &FLuaSerializer::LuaSerialize);
+			lua_register(L, "Deserialize", &FLuaSerializer::LuaDeserialize);
+			lua_register(L, "WaitDelegate", &FLuaCoroutineScheduler::LuaWaitDelegate);
+			lua_register(L, "WaitLoadObject", &FLuaCoroutineScheduler::LuaWaitLoadObject);
+		}
+		lua_register(L, "StartCoroutine", &FLuaCoroutineScheduler::LuaStartCoroutine);
+		lua_register(L, "WaitSeconds", &FLuaCoroutineScheduler::LuaWaitSeconds);
+		lua_register(L, "WaitFrames", &FLuaCoroutineScheduler::LuaWaitFrames);
+		lua_register(L, "SetTimer", &FLuaTimerWheel::LuaSetTimer);
+		lua_register(L, "SetInterval", &FLuaTimerWheel::LuaSetInterval);
+		lua_register(L, "ClearTimer", &FLuaTimerWheel::LuaClearTimer);
+		lua_register(L, "GetErrorCounts", &FLuaErrorThrottle::LuaGetErrorCounts);
 
 		// bind this to L
 		*((void**)lua_getextraspace(L)) = this;
@@ -96,20 +121,25 @@ FLuaState::FLuaState()
 		lua_setmetatable(L, -2);
 		CacheObjectRefIndex = luaL_ref(L, LUA_REGISTRYINDEX);
 
-		if (FLibLuasocketModule::IsAvailable())
+		const bool bWithLuasocket = Profile == ELuaStateProfile::Game || Profile == ELuaStateProfile::Server;
+		if (bWithLuasocket && FLibLuasocketModule::IsAvailable())
 		{
+			uint64 StartCycles = FPlatformTime::Cycles64();
+
 			FLibLuasocketModule::Get().SetupLuasocket(L);
 			lua_pushboolean(L, true);
 			lua_setglobal(L, "SupportLuasocket");
 
-			UE_LOG(LogBluelua, Display, TEXT("Lua state setup with Luasocket."));
+			UE_LOG(LogBluelua, Display, TEXT("Lua state setup with Luasocket in %.3f ms."), FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
 
-			if (UE_BUILD_SHIPPING == 0 && FLuaPanda::IsAvailable())
+			if (UE_BUILD_SHIPPING == 0 && Profile == ELuaStateProfile::Game && FLuaPanda::IsAvailable())
 			{
+				StartCycles = FPlatformTime::Cycles64();
+
 				FLuaPanda::Get().SetupLuaPanda(L);
 				lua_pushboolean(L, true);
 				lua_setglobal(L, "SupportLuaPanda");
-				UE_LOG(LogBluelua, Display, TEXT("Lua state setup with LuaPanda."));
+				UE_LOG(LogBluelua, Display, TEXT("Lua state setup with LuaPanda in %.3f ms."), FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
 			}
 		}
 
@@ -125,15 +155,36 @@ FLuaState::FLuaState()
 		lua_pushboolean(L, !!UE_BUILD_DEBUG);
 		lua_setglobal(L, "BuildDebug");
 
+		GCScheduler.Init(L);
+		CoroutineScheduler.Init(L);
+		TimerWheel.Init(L);
+
 		UE_LOG(LogBluelua, Display, TEXT("Lua state created. LuaState[0x%x], L[0x%x]."), this, L);
 	}
 
 	PostGarbageCollectDelegate = FCoreUObjectDelegates::GetPostGarbageCollect().AddRaw(this, &FLuaState::OnPostGarbageCollect);
+	MemoryTrimDelegate = FCoreDelegates::GetMemoryTrimDelegate().AddRaw(this, &FLuaState::OnMemoryTrim);
+	PostLoadMapDelegate = FCoreUObjectDelegates::PostLoadMapWithWorld.AddRaw(this, &FLuaState::OnPostLoadMap);
+	TickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FLuaState::Tick));
 }
 
 FLuaState::~FLuaState()
 {
 	FCoreUObjectDelegates::GetPostGarbageCollect().Remove(PostGarbageCollectDelegate);
+	FCoreDelegates::GetMemoryTrimDelegate().Remove(MemoryTrimDelegate);
+	FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(PostLoadMapDelegate);
+	FTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+
+	MemoryProfiler.Reset();
+	SampleProfiler.Reset();
+	CoroutineScheduler.Shutdown();
+	TimerWheel.Shutdown();
+
+	if (DelegateDispatcher)
+	{
+		DelegateDispatcher->Shutdown();
+		DelegateDispatcher = nullptr;
+	}
 
 	if (L)
 	{
@@ -157,6 +208,126 @@ lua_State* FLuaState::GetState() const
 	return L;
 }
 
+ELuaStateProfile FLuaState::GetProfile() const
+{
+	return Profile;
+}
+
+void FLuaState::OpenLibraries(lua_State* L, ELuaStateProfile Profile)
+{
+	static const luaL_Reg Libs[] = {
+		{ "_G", luaopen_base },
+		{ LUA_LOADLIBNAME, luaopen_package },
+		{ LUA_COLIBNAME, luaopen_coroutine },
+		{ LUA_TABLIBNAME, luaopen_table },
+		{ LUA_STRLIBNAME, luaopen_string },
+		{ LUA_MATHLIBNAME, luaopen_math },
+		{ NULL, NULL }
+	};
+
+	static const luaL_Reg GameLazyLibs[] = {
+		{ LUA_OSLIBNAME, luaopen_os },
+		{ LUA_UTF8LIBNAME, luaopen_utf8 },
+		{ LUA_DBLIBNAME, luaopen_debug },
+		{ NULL, NULL }
+	};
+
+	// no os and debug, isolated code only transforms data
+	static const luaL_Reg IsolatedLazyLibs[] = {
+		{ LUA_UTF8LIBNAME, luaopen_utf8 },
+		{ NULL, NULL }
+	};
+
+	static const TCHAR* const ProfileNames[] = { TEXT("Game"), TEXT("Server"), TEXT("Worker"), TEXT("Sandbox") };
+
+	const bool bIsolated = Profile == ELuaStateProfile::Worker || Profile == ELuaStateProfile::Sandbox;
+
+	FString Timings;
+	for (const luaL_Reg* Lib = Libs; Lib->func; ++Lib)
+	{
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+
+		luaL_requiref(L, Lib->name, Lib->func, 1);
+		lua_pop(L, 1);
+
+		Timings += FString::Printf(TEXT("%s %.3f ms, "), UTF8_TO_TCHAR(Lib->name), FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+	}
+
+	// name -> open function, shared by the _G index and package.preload entries
+	lua_newtable(L);
+	const int32 LazyLibsIndex = lua_gettop(L);
+
+	luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+
+	FString LazyNames;
+	for (const luaL_Reg* Lib = bIsolated ? IsolatedLazyLibs : GameLazyLibs; Lib->func; ++Lib)
+	{
+		lua_pushcfunction(L, Lib->func);
+		lua_setfield(L, LazyLibsIndex, Lib->name);
+
+		lua_pushvalue(L, LazyLibsIndex);
+		lua_pushcclosure(L, LuaOpenLazyLibrary, 1);
+		lua_setfield(L, -2, Lib->name);
+
+		LazyNames += FString::Printf(TEXT("%s "), UTF8_TO_TCHAR(Lib->name));
+	}
+	lua_pop(L, 1);
+
+	lua_pushglobaltable(L);
+	lua_createtable(L, 0, 1);
+	lua_pushvalue(L, LazyLibsIndex);
+	lua_pushcclosure(L, LuaOpenLazyLibrary, 1);
+	lua_setfield(L, -2, "__index");
+	lua_setmetatable(L, -2);
+
+	// the lazy index is the metatable of _G until a script sets its own
+	lua_getglobal(L, "setmetatable");
+	lua_pushvalue(L, LazyLibsIndex);
+	lua_pushcclosure(L, LuaSetMetatable, 2);
+	lua_setglobal(L, "setmetatable");
+	lua_pop(L, 2);
+
+	if (bIsolated)
+	{
+		lua_pushnil(L);
+		lua_setglobal(L, "dofile");
+		lua_pushnil(L);
+		lua_setglobal(L, "loadfile");
+	}
+
+	if (Profile == ELuaStateProfile::Sandbox)
+	{
+		// no native code and no bytecode, crafted bytecode can break out of the vm
+		lua_getglobal(L, LUA_LOADLIBNAME);
+		lua_pushnil(L);
+		lua_setfield(L, -2, "loadlib");
+		lua_pushliteral(L, "");
+		lua_setfield(L, -2, "cpath");
+		lua_pushliteral(L, "");
+		lua_setfield(L, -2, "path");
+
+		// searchers: preload only
+		lua_createtable(L, 1, 0);
+		lua_getfield(L, -2, "searchers");
+		lua_rawgeti(L, -1, 1);
+		lua_rawseti(L, -3, 1);
+		lua_pop(L, 1);
+		lua_setfield(L, -2, "searchers");
+		lua_pop(L, 1);
+
+		lua_getglobal(L, LUA_STRLIBNAME);
+		lua_pushnil(L);
+		lua_setfield(L, -2, "dump");
+		lua_pop(L, 1);
+
+		lua_getglobal(L, "load");
+		lua_pushcclosure(L, LuaSandboxLoad, 1);
+		lua_setglobal(L, "load");
+	}
+
+	UE_LOG(LogBluelua, Log, TEXT("Lua libraries opened for %s profile: %slazy: %s"), ProfileNames[(int32)Profile], *Timings, *LazyNames);
+}
+
 bool FLuaState::DoBuffer(const uint8* Buffer, uint32 BufferSize, const char* Name/* = nullptr*/)
 {
 	if (!L)
@@ -164,6 +335,8 @@ bool FLuaState::DoBuffer(const uint8* Buffer, uint32 BufferSize, const char* Nam
 		return false;
 	}
 
+	GCScheduler.CheckHeapCeiling();
+
 	lua_pushcfunction(L, LuaError);
 	const int32 LuaErrorFunctionIndex = lua_gettop(L);
 
@@ -220,54 +393,167 @@ bool FLuaState::CallLuaFunction(UFunction* SignatureFunction, void* Parameters,
 {
 	SCOPE_CYCLE_COUNTER(STAT_CallLuaFunction);
 
+	GCScheduler.CheckHeapCeiling();
+
 	FLuaStackGuard Gurad(L);
-	
-	lua_pushcfunction(L, FLuaState::LuaError);
-	const int32 LuaErrorFunctionIndex = bWithSelf ? lua_absindex(L, -3) : lua_absindex(L, -2);
-	lua_insert(L, LuaErrorFunctionIndex);
+	FLuaSampleProfiler::FNativeScope ProfileScope(L, SignatureFunction);
+	FLuaTrace::FScope TraceScope(L, bWithSelf ? -2 : -1, SignatureFunction);
+
+	const int32 FunctionIndex = lua_absindex(L, bWithSelf ? -2 : -1);
+
+	const bool bHasOutParams = SignatureFunction && (SignatureFunction->ReturnValueOffset != MAX_uint16 || SignatureFunction->HasAnyFunctionFlags(FUNC_HasOutParms));
+
+	// nothing to return, run as coroutine so the function can wait
+	const bool bSpawnEvent = !bHasOutParams && FLuaCoroutineScheduler::ShouldSpawnEvents();
+
+	// parameters outlive the call but not a coroutine, which may resume later
+	FLuaUStruct::FBorrowScope BorrowScope;
 
 	int32 InParamsCount = bWithSelf ? 1 : 0;
-	int32 OutParamsCount = 0;
+	FLuaOutParams OutParams;
+	OutParams.Function = SignatureFunction;
+	OutParams.Parameters = Parameters;
 
-	UProperty* ReturnValue = nullptr;
 	for (TFieldIterator<UProperty> ParamIter(SignatureFunction); ParamIter && (ParamIter->PropertyFlags & CPF_Parm); ++ParamIter)
 	{
 		UProperty* ParamProperty = *ParamIter;
 
-		OutParamsCount += ((ParamIter->PropertyFlags & (CPF_ConstParm | CPF_OutParm)) == CPF_OutParm) ? 1 : 0;
+		OutParams.OutParamsCount += ((ParamIter->PropertyFlags & (CPF_ConstParm | CPF_OutParm)) == CPF_OutParm) ? 1 : 0;
 
 		if (ParamIter->PropertyFlags & CPF_ReturnParm)
 		{
-			ReturnValue = ParamProperty;
+			OutParams.ReturnValue = ParamProperty;
 		}
-		else
+		else if (bSpawnEvent)
 		{
 			++InParamsCount;
 			FLuaObjectBase::PushProperty(L, ParamProperty, ParamProperty->ContainerPtrToValuePtr<uint8>(Parameters));
 		}
+		else
+		{
+			++InParamsCount;
+			FLuaObjectBase::PushBorrowedProperty(L, ParamProperty, ParamProperty->ContainerPtrToValuePtr<uint8>(Parameters));
+		}
 	}
 
-	if (LUA_OK != lua_pcall(L, InParamsCount, OutParamsCount, LuaErrorFunctionIndex))
+	if (bHasOutParams)
+	{
+		return CallLuaFunction(InParamsCount, OutParams);
+	}
+
+	if (bSpawnEvent)
+	{
+		return CoroutineScheduler.Spawn(L, InParamsCount);
+	}
+
+	lua_pushcfunction(L, FLuaState::LuaError);
+	lua_insert(L, FunctionIndex);
+
+	return LUA_OK == lua_pcall(L, InParamsCount, 0, FunctionIndex);
+}
+
+bool FLuaState::CallLuaFunction(int32 InParamsCount, const FLuaOutParams& OutParams)
+{
+	const int32 FunctionIndex = lua_absindex(L, -(InParamsCount + 1));
+
+	// stack = [LuaError, CallAndFillOutParams, Function, Params..., OutParams], light functions and userdata allocate nothing
+	lua_pushcfunction(L, FLuaState::LuaError);
+	lua_pushcfunction(L, FLuaState::CallAndFillOutParams);
+	lua_rotate(L, FunctionIndex, 2);
+	lua_pushlightuserdata(L, (void*)&OutParams);
+
+	if (LUA_OK != lua_pcall(L, InParamsCount + 2, 0, FunctionIndex))
 	{
+		lua_pop(L, 1);
+		lua_remove(L, FunctionIndex);
 		return false;
 	}
 
-	if (ReturnValue || (SignatureFunction && SignatureFunction->HasAnyFunctionFlags(FUNC_HasOutParms)))
+	lua_remove(L, FunctionIndex);
+	return true;
+}
+
+void FLuaState::CallLuaFunctions(UFunction* SignatureFunction, void* Parameters, TArrayView<const FLuaFunctionRef> Functions)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CallLuaFunctions);
+
+	GCScheduler.CheckHeapCeiling();
+
+	FLuaStackGuard Gurad(L);
+	FLuaSampleProfiler::FNativeScope ProfileScope(L, SignatureFunction);
+
+	if (!lua_checkstack(L, Functions.Num() * 2 + 1))
 	{
-		lua_pushinteger(L, OutParamsCount);
-		lua_insert(L, -(OutParamsCount + 1));
-		lua_pushlightuserdata(L, ReturnValue);
-		lua_pushlightuserdata(L, SignatureFunction);
-		lua_pushlightuserdata(L, Parameters);
-		lua_pushcclosure(L, FillOutProperty, OutParamsCount + 4);
+		UE_LOG(LogBluelua, Error, TEXT("Call lua functions failed! Too many functions[%d]!"), Functions.Num());
+		return;
+	}
+
+	lua_pushcfunction(L, FLuaState::LuaError);
+	const int32 LuaErrorFunctionIndex = lua_gettop(L);
+
+	// functions are taken before calling, removing one while calling doesn't affect this call
+	const int32 FirstFunctionIndex = LuaErrorFunctionIndex + 1;
+	for (const FLuaFunctionRef& Function : Functions)
+	{
+		lua_rawgeti(L, LUA_REGISTRYINDEX, Function.FunctionRef);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, Function.SelfRef);
+	}
+
+	const int32 FirstParamIndex = lua_gettop(L) + 1;
+	int32 ParamsCount = 0;
 
-		if (LUA_OK != lua_pcall(L, 0, 0, LuaErrorFunctionIndex))
+	const bool bSpawnEvents = FLuaCoroutineScheduler::ShouldSpawnEvents();
+	FLuaUStruct::FBorrowScope BorrowScope;
+
+	for (TFieldIterator<UProperty> ParamIter(SignatureFunction); ParamIter && (ParamIter->PropertyFlags & CPF_Parm); ++ParamIter)
+	{
+		if ((ParamIter->PropertyFlags & CPF_ReturnParm) == 0)
 		{
-			return false;
+			++ParamsCount;
+			if (bSpawnEvents)
+			{
+				FLuaObjectBase::PushProperty(L, *ParamIter, ParamIter->ContainerPtrToValuePtr<uint8>(Parameters));
+			}
+			else
+			{
+				FLuaObjectBase::PushBorrowedProperty(L, *ParamIter, ParamIter->ContainerPtrToValuePtr<uint8>(Parameters));
+			}
 		}
 	}
 
-	return true;
+	for (int32 Index = 0; Index < Functions.Num(); ++Index)
+	{
+		const int32 FunctionIndex = FirstFunctionIndex + Index * 2;
+		if (lua_type(L, FunctionIndex) != LUA_TFUNCTION || !lua_checkstack(L, ParamsCount + 2))
+		{
+			continue;
+		}
+
+		const bool bWithSelf = Functions[Index].SelfRef != LUA_NOREF;
+
+		FLuaTrace::FScope TraceScope(L, FunctionIndex, SignatureFunction);
+
+		lua_pushvalue(L, FunctionIndex);
+		if (bWithSelf)
+		{
+			lua_pushvalue(L, FunctionIndex + 1);
+		}
+
+		for (int32 ParamIndex = 0; ParamIndex < ParamsCount; ++ParamIndex)
+		{
+			lua_pushvalue(L, FirstParamIndex + ParamIndex);
+		}
+
+		const int32 ArgsCount = ParamsCount + (bWithSelf ? 1 : 0);
+		if (bSpawnEvents)
+		{
+			CoroutineScheduler.Spawn(L, ArgsCount);
+		}
+		else if (LUA_OK != lua_pcall(L, ArgsCount, 0, LuaErrorFunctionIndex))
+		{
+			lua_pop(L, 1);
+		}
+	}
 }
 
 bool FLuaState::CallLuaFunction(int32 InParamsCount, int32 OutParamsCount, bool bWithSelf/* = true*/)
@@ -288,6 +574,106 @@ bool FLuaState::CallLuaFunction(int32 InParamsCount, int32 OutParamsCount, bool
 	return true;
 }
 
+TFuture<FLuaPreloadResult> FLuaState::PreloadModules(const TArray<FString>& ModuleNames)
+{
+	return ChunkCache->Preload(ModuleNames);
+}
+
+bool FLuaState::ReloadFile(const FString& FilePath)
+{
+	const FString NormalizedFilePath = NormalizeFilePath(FilePath);
+
+	TArray<FString> ModuleNames;
+	for (const auto& ModuleFile : LoadedModuleFiles)
+	{
+		if (ModuleFile.Value.Equals(NormalizedFilePath))
+		{
+			ModuleNames.Emplace(ModuleFile.Key);
+		}
+	}
+
+	bool bSuccess = true;
+	for (const FString& ModuleName : ModuleNames)
+	{
+		bSuccess &= ReloadModule(ModuleName);
+	}
+
+	return bSuccess;
+}
+
+bool FLuaState::ReloadModule(const FString& ModuleName)
+{
+	const FString* FilePath = LoadedModuleFiles.Find(ModuleName);
+	if (!L || !FilePath)
+	{
+		return false;
+	}
+
+	TArray<uint8> FileContent;
+	if (!FFileHelper::LoadFileToArray(FileContent, **FilePath))
+	{
+		UE_LOG(LogBluelua, Warning, TEXT("Lua reload module[%s] failed! File[%s] load failed!"), *ModuleName, **FilePath);
+		return false;
+	}
+
+	FLuaStackGuard Guard(L);
+
+	lua_pushcfunction(L, LuaError);
+	const int32 LuaErrorFunctionIndex = lua_gettop(L);
+
+	const FTCHARToUTF8 ModuleNameConverter(*ModuleName);
+	if (LUA_OK != luaL_loadbuffer(L, (const char*)FileContent.GetData(), FileContent.Num(), TCHAR_TO_UTF8(*FLuaChunkCache::MakeChunkName(*FilePath))))
+	{
+		UE_LOG(LogBluelua, Error, TEXT("Lua reload module[%s] failed! %s"), *ModuleName, UTF8_TO_TCHAR(lua_tostring(L, -1)));
+		return false;
+	}
+
+	// same arguments as require passes to the loader
+	lua_pushstring(L, ModuleNameConverter.Get());
+	lua_pushstring(L, TCHAR_TO_UTF8(**FilePath));
+	if (LUA_OK != lua_pcall(L, 2, 1, LuaErrorFunctionIndex))
+	{
+		return false;
+	}
+
+	const int32 NewModuleIndex = lua_gettop(L);
+
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "loaded");
+	const int32 LoadedIndex = lua_gettop(L);
+
+	lua_getfield(L, LoadedIndex, ModuleNameConverter.Get());
+	if (lua_istable(L, -1) && lua_istable(L, NewModuleIndex))
+	{
+		// keep the old table so that everyone holding it sees the new functions
+		PatchTable(L, -1, NewModuleIndex);
+	}
+	else if (!lua_isnil(L, NewModuleIndex))
+	{
+		lua_pushvalue(L, NewModuleIndex);
+		lua_setfield(L, LoadedIndex, ModuleNameConverter.Get());
+	}
+
+	UE_LOG(LogBluelua, Display, TEXT("Lua module[%s] reloaded."), *ModuleName);
+
+	return true;
+}
+
+bool FLuaState::IsModuleFile(const FString& FilePath) const
+{
+	const FString NormalizedFilePath = NormalizeFilePath(FilePath);
+
+	for (const auto& ModuleFile : LoadedModuleFiles)
+	{
+		if (ModuleFile.Value.Equals(NormalizedFilePath))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool FLuaState::GetFromCache(void* InObject)
 {
 	if (!InObject || !L || CacheObjectRefIndex == LUA_NOREF)
@@ -351,6 +737,11 @@ void FLuaState::RemoveReferenceByOwner(UObject* Owner)
 	{
 		RemoveReference(Object, Owner);
 	}
+
+	if (DelegateDispatcher)
+	{
+		DelegateDispatcher->ReleaseBindingsByOwner(Owner);
+	}
 }
 
 void FLuaState::GetObjectsByOwner(UObject* Owner, TSet<UObject*>& Objects)
@@ -364,126 +755,332 @@ void FLuaState::GetObjectsByOwner(UObject* Owner, TSet<UObject*>& Objects)
 	}
 }
 
-void FLuaState::SetOwnerGameInstane(class UGameInstance* InOwnerGameInstane)
+const FLuaAllocatorStats& FLuaState::GetAllocatorStats() const
 {
-	OwnerGameInstane = InOwnerGameInstane;
+	return Allocator.GetStats();
 }
 
-class UGameInstance* FLuaState::GetOwnerGameInstance()
+int64 FLuaState::TrimMemory()
 {
-	return OwnerGameInstane.Get();
-}
+	const int64 ReleasedBytes = Allocator.ReleaseEmptySlabs();
 
-void FLuaState::AddReferencedObjects(FReferenceCollector& Collector)
-{
-	Collector.AddReferencedObjects(ReferencedObjectsWithOwner);
-}
+	UE_LOG(LogBluelua, Log, TEXT("Lua state trim memory, %lld bytes released. LuaState[0x%x]."), ReleasedBytes, this);
 
-FString FLuaState::GetReferencerName() const
-{
-	return TEXT("FLuaState Referencer");
+	return ReleasedBytes;
 }
 
-FLuaState* FLuaState::GetStateWrapper(lua_State* InL)
+void FLuaState::StartMemoryProfiler()
 {
-	return InL ? (FLuaState*)*((void**)lua_getextraspace(InL)) : nullptr;
-}
+	if (!L)
+	{
+		return;
+	}
 
-int FLuaState::LuaError(lua_State* L)
-{
-	luaL_traceback(L, L, lua_tostring(L, -1), 1);
+	if (!MemoryProfiler.IsValid())
+	{
+		MemoryProfiler = MakeUnique<FLuaMemoryProfiler>(L);
+	}
 
-	const char* ErrorInfoWithStack = lua_tostring(L, -1);
-	UE_LOG(LogBluelua, Error, TEXT("%s"), UTF8_TO_TCHAR(ErrorInfoWithStack));
+	MemoryProfiler->Start();
 
-	return 1;
+	UE_LOG(LogBluelua, Display, TEXT("Lua memory profiler started. LuaState[0x%x]."), this);
 }
 
-int FLuaState::LuaPanic(lua_State* L)
+void FLuaState::StopMemoryProfiler()
 {
-	UE_LOG(LogBluelua, Error, TEXT("PANIC: unprotected error in call to Lua API(%s)"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
-	return 0;
+	if (MemoryProfiler.IsValid() && MemoryProfiler->IsRunning())
+	{
+		MemoryProfiler->Stop();
+
+		UE_LOG(LogBluelua, Display, TEXT("Lua memory profiler stopped. LuaState[0x%x]."), this);
+	}
 }
 
-int FLuaState::LuaPrint(lua_State * L)
+FLuaMemoryProfiler* FLuaState::GetMemoryProfiler() const
 {
-	FString Message;
+	return MemoryProfiler.Get();
+}
 
-	const int32 ParamsCount = lua_gettop(L);
-	for (int32 Index = 1; Index <= ParamsCount; ++Index)
+void FLuaState::StartSampleProfiler()
+{
+	if (!L)
 	{
-		const char* StackMessage = lua_tostring(L, Index);
-		if (!StackMessage)
-		{
-			if (lua_isboolean(L, Index))
-			{
-				StackMessage = lua_toboolean(L, Index) ? "true" : "false";
-			}
-			else
-			{
-				luaL_callmeta(L, Index, "__tostring");
-				StackMessage = lua_tostring(L, -1);
-			}
-		}
+		return;
+	}
 
-		Message = FString::Printf(TEXT("%s%s%s"), *Message, Message.IsEmpty() ? TEXT("") : TEXT("\t"), UTF8_TO_TCHAR(StackMessage));
+	if (!SampleProfiler.IsValid())
+	{
+		SampleProfiler = MakeUnique<FLuaSampleProfiler>(L);
 	}
 
-	FString Prefix;
+	SampleProfiler->Start();
 
-#if WITH_EDITOR
-	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
-	UGameInstance* OwnerGameInstane = LuaStateWrapper ? LuaStateWrapper->GetOwnerGameInstance() : nullptr;
+	UE_LOG(LogBluelua, Display, TEXT("Lua sample profiler started. LuaState[0x%x]."), this);
+}
 
-	UWorld* World = OwnerGameInstane ? OwnerGameInstane->GetWorldContext()->World() : nullptr;
-	if (World)
+void FLuaState::StopSampleProfiler()
+{
+	if (SampleProfiler.IsValid() && SampleProfiler->IsRunning())
 	{
-		if (World->WorldType == EWorldType::PIE)
-		{
-			switch (World->GetNetMode())
-			{
-			case NM_Client:
-				Prefix = FString::Printf(TEXT("Client %d: "), GPlayInEditorID - 1);
-				break;
-			case NM_DedicatedServer:
-			case NM_ListenServer:
-				Prefix = FString::Printf(TEXT("Server: "));
-				break;
-			case NM_Standalone:
-				break;
-			}
-		}
-	}
-#endif
+		SampleProfiler->Stop();
 
-	UE_LOG(LogBluelua, Display, TEXT("%sLua log: %s"), *Prefix, *Message);
+		UE_LOG(LogBluelua, Display, TEXT("Lua sample profiler stopped, %lld sample(s). LuaState[0x%x]."), SampleProfiler->GetNumSamples(), this);
+	}
+}
 
-	return 0;
+FLuaSampleProfiler* FLuaState::GetSampleProfiler() const
+{
+	return SampleProfiler.Get();
 }
 
-int FLuaState::LuaSearcher(lua_State* L)
+FLuaGCScheduler& FLuaState::GetGCScheduler()
 {
-	const FString FileName = UTF8_TO_TCHAR(lua_tostring(L, 1));
-	const FString BaseFilePath = FPaths::Combine(FPaths::ProjectContentDir(), FileName.Replace(TEXT("."), TEXT("/")));
+	return GCScheduler;
+}
 
-	FString FullFilePath;
-	if (FPaths::FileExists(BaseFilePath + TEXT(".lua")))
-	{
-		FullFilePath = BaseFilePath + TEXT(".lua");
-	}
-	else if (FPaths::FileExists(BaseFilePath + TEXT(".luac")))
+bool FLuaState::Serialize(int32 FirstIndex, int32 Count, TArray<uint8>& OutBuffer)
+{
+	if (!L)
 	{
-		FullFilePath = BaseFilePath + TEXT(".luac");
+		return false;
 	}
-	else if (FPaths::FileExists(FPaths::Combine(BaseFilePath, TEXT("init.lua"))))
+
+	if (!Serializer.Serialize(L, FirstIndex, Count, OutBuffer))
 	{
-		FullFilePath = FPaths::Combine(BaseFilePath, TEXT("init.lua"));
+		UE_LOG(LogBluelua, Warning, TEXT("Lua serialize failed! %s!"), *Serializer.GetError());
+		return false;
 	}
-	else if (FPaths::FileExists(FPaths::Combine(BaseFilePath, TEXT("init.luac"))))
+
+	return true;
+}
+
+int32 FLuaState::Deserialize(const TArray<uint8>& Buffer)
+{
+	if (!L)
+	{
+		return INDEX_NONE;
+	}
+
+	const int32 Count = Serializer.Deserialize(L, Buffer);
+	if (Count == INDEX_NONE)
+	{
+		UE_LOG(LogBluelua, Warning, TEXT("Lua deserialize failed! %s!"), *Serializer.GetError());
+	}
+
+	return Count;
+}
+
+FLuaCoroutineScheduler& FLuaState::GetCoroutineScheduler()
+{
+	return CoroutineScheduler;
+}
+
+FLuaTimerWheel& FLuaState::GetTimerWheel()
+{
+	return TimerWheel;
+}
+
+FLuaErrorThrottle& FLuaState::GetErrorThrottle()
+{
+	return ErrorThrottle;
+}
+
+ULuaDelegateDispatcher* FLuaState::GetDelegateDispatcher()
+{
+	if (!DelegateDispatcher && L)
 	{
-		FullFilePath = FPaths::Combine(BaseFilePath, TEXT("init.luac"));
+		DelegateDispatcher = NewObject<ULuaDelegateDispatcher>(GetTransientPackage());
+		DelegateDispatcher->BindLuaState(AsShared());
+	}
+
+	return DelegateDispatcher;
+}
+
+FLuaSerializer& FLuaState::GetSerializer()
+{
+	return Serializer;
+}
+
+void FLuaState::SetOwnerGameInstane(class UGameInstance* InOwnerGameInstane)
+{
+	OwnerGameInstane = InOwnerGameInstane;
+
+	UpdateLogPrefix();
+}
+
+class UGameInstance* FLuaState::GetOwnerGameInstance()
+{
+	return OwnerGameInstane.Get();
+}
+
+const ANSICHAR* FLuaState::GetLogPrefix() const
+{
+	return LogPrefix.Num() > 0 ? LogPrefix.GetData() : "";
+}
+
+void FLuaState::AddReferencedObjects(FReferenceCollector& Collector)
+{
+	Collector.AddReferencedObjects(ReferencedObjectsWithOwner);
+	Collector.AddReferencedObject(DelegateDispatcher);
+}
+
+FString FLuaState::GetReferencerName() const
+{
+	return TEXT("FLuaState Referencer");
+}
+
+FLuaState* FLuaState::GetStateWrapper(lua_State* InL)
+{
+	return InL ? (FLuaState*)*((void**)lua_getextraspace(InL)) : nullptr;
+}
+
+int FLuaState::LuaError(lua_State* L)
+{
+	// repeats of an error site only count, the message is returned without traceback
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	if (LuaStateWrapper && !LuaStateWrapper->ErrorThrottle.Report(L, lua_tostring(L, -1)))
+	{
+		return 1;
+	}
+
+	luaL_traceback(L, L, lua_tostring(L, -1), 1);
+
+	const char* ErrorInfoWithStack = lua_tostring(L, -1);
+	UE_LOG(LogBluelua, Error, TEXT("%s"), UTF8_TO_TCHAR(ErrorInfoWithStack));
+
+	return 1;
+}
+
+int FLuaState::LuaPanic(lua_State* L)
+{
+	UE_LOG(LogBluelua, Error, TEXT("PANIC: unprotected error in call to Lua API(%s)"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+	return 0;
+}
+
+int FLuaState::LuaOpenLazyLibrary(lua_State* L)
+{
+	// called as _G.__index(_G, Name) or as package.preload loader(Name)
+	const int32 NameIndex = lua_istable(L, 1) ? 2 : 1;
+	if (lua_type(L, NameIndex) != LUA_TSTRING)
+	{
+		return 0;
+	}
+
+	const char* Name = lua_tostring(L, NameIndex);
+
+	const int32 LazyLibsIndex = lua_upvalueindex(1);
+	if (lua_getfield(L, LazyLibsIndex, Name) != LUA_TFUNCTION)
+	{
+		return 0;
+	}
+
+	const lua_CFunction OpenFunction = lua_tocfunction(L, -1);
+	lua_pop(L, 1);
+
+	// opened once
+	lua_pushnil(L);
+	lua_setfield(L, LazyLibsIndex, Name);
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	luaL_requiref(L, Name, OpenFunction, 1);
+	UE_LOG(LogBluelua, Log, TEXT("Lua library %s opened on first access in %.3f ms."), UTF8_TO_TCHAR(Name), FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+
+	// undefined globals stop paying for the index once every library is open, unless scripts replaced the metatable
+	lua_pushnil(L);
+	if (lua_next(L, LazyLibsIndex))
+	{
+		lua_pop(L, 2);
 	}
 	else
+	{
+		lua_pushglobaltable(L);
+		if (lua_getmetatable(L, -1))
+		{
+			lua_getfield(L, -1, "__index");
+			if (lua_tocfunction(L, -1) == LuaOpenLazyLibrary)
+			{
+				lua_pushnil(L);
+				lua_setmetatable(L, -4);
+			}
+			lua_pop(L, 2);
+		}
+		lua_pop(L, 1);
+	}
+
+	return 1;
+}
+
+int FLuaState::LuaSetMetatable(lua_State* L)
+{
+	// strict mode and undefined global detectors replace the metatable of _G, open the lazy libraries as plain globals first
+	lua_pushglobaltable(L);
+	const bool bGlobalTable = lua_rawequal(L, 1, -1) != 0;
+	lua_pop(L, 1);
+
+	if (bGlobalTable)
+	{
+		const int32 LazyLibsIndex = lua_upvalueindex(2);
+
+		lua_pushnil(L);
+		while (lua_next(L, LazyLibsIndex))
+		{
+			const lua_CFunction OpenFunction = lua_tocfunction(L, -1);
+			lua_pop(L, 1);
+
+			luaL_requiref(L, lua_tostring(L, -1), OpenFunction, 1);
+			lua_pop(L, 1);
+
+			// clearing an existing field while traversing is allowed
+			lua_pushvalue(L, -1);
+			lua_pushnil(L);
+			lua_rawset(L, LazyLibsIndex);
+		}
+	}
+
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_insert(L, 1);
+	lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+
+	return lua_gettop(L);
+}
+
+int FLuaState::LuaSandboxLoad(lua_State* L)
+{
+	// load(chunk [, chunkname [, mode [, env]]]) with mode forced to text, an absent env must stay absent
+	const int NumArgs = FMath::Min(lua_gettop(L), 4);
+	lua_settop(L, FMath::Max(NumArgs, 3));
+
+	lua_pushliteral(L, "t");
+	lua_replace(L, 3);
+
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_insert(L, 1);
+	lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+
+	return lua_gettop(L);
+}
+
+int FLuaState::LuaSearcher(lua_State* L)
+{
+	const FString FileName = UTF8_TO_TCHAR(lua_tostring(L, 1));
+
+	// use bytecode compiled by PreloadModules if there is one
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	FLuaCompiledChunk PreloadedChunk;
+	if (LuaStateWrapper && LuaStateWrapper->ChunkCache->Take(FileName, PreloadedChunk))
+	{
+		if (LUA_OK == luaL_loadbufferx(L, (const char*)PreloadedChunk.Bytecode.GetData(), PreloadedChunk.Bytecode.Num(), TCHAR_TO_UTF8(*PreloadedChunk.ChunkName), "b"))
+		{
+			LuaStateWrapper->LoadedModuleFiles.Emplace(FileName, NormalizeFilePath(PreloadedChunk.FilePath));
+			return 1;
+		}
+
+		UE_LOG(LogBluelua, Warning, TEXT("Lua require load preloaded chunk failed, fallback to source! %s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+		lua_pop(L, 1);
+	}
+
+	FString FullFilePath;
+	if (!FLuaChunkCache::ResolveModulePath(FileName, FullFilePath))
 	{
 		//UE_LOG(LogBluelua, Warning, TEXT("Lua require failed! File[%s] not exists!"), *FileName);
 		return 0;
@@ -496,7 +1093,7 @@ int FLuaState::LuaSearcher(lua_State* L)
 		return 0;
 	}
 	
-	if (LUA_OK != luaL_loadbuffer(L, (const char *)FileContent.GetData(), FileContent.Num(), TCHAR_TO_UTF8(*FString::Printf(TEXT("@%s"), *MakeRelativePathToContent(FullFilePath)))))
+	if (LUA_OK != luaL_loadbuffer(L, (const char *)FileContent.GetData(), FileContent.Num(), TCHAR_TO_UTF8(*FLuaChunkCache::MakeChunkName(FullFilePath))))
 	{
 		const char* ErrorInfo = lua_tostring(L, -1);
 		UE_LOG(LogBluelua, Error, TEXT("Lua require failed! Lua load buffer failed! %s"), UTF8_TO_TCHAR(ErrorInfo));
@@ -504,25 +1101,34 @@ int FLuaState::LuaSearcher(lua_State* L)
 		return 0;
 	}
 
+	if (LuaStateWrapper)
+	{
+		LuaStateWrapper->LoadedModuleFiles.Emplace(FileName, NormalizeFilePath(FullFilePath));
+	}
+
 	return 1;
 }
 
 void* FLuaState::LuaAlloc(void* UserData, void* Ptr, size_t OldSize, size_t NewSize)
 {
-	(void)UserData; /* not used */
-	const size_t NewBytes = NewSize - (Ptr ? OldSize : 0);
-
-	INC_DWORD_STAT_BY(STAT_LuaMemory, NewBytes);
+	FLuaState* LuaStateWrapper = (FLuaState*)UserData;
 
-	if (NewSize == 0)
+	void* NewPtr = LuaStateWrapper->Allocator.Realloc(Ptr, OldSize, NewSize);
+	if (!NewPtr && NewSize > 0)
 	{
-		FMemory::Free(Ptr);
 		return nullptr;
 	}
-	else
+
+	// when Ptr is null, OldSize is the lua type of the new object
+	INC_MEMORY_STAT_BY(STAT_LuaMemory, (int64)NewSize - (int64)(Ptr ? OldSize : 0));
+
+	FLuaMemoryProfiler* MemoryProfiler = LuaStateWrapper->MemoryProfiler.Get();
+	if (MemoryProfiler && MemoryProfiler->IsRunning())
 	{
-		return FMemory::Realloc(Ptr, NewSize);
+		MemoryProfiler->OnRealloc(Ptr, OldSize, NewPtr, NewSize);
 	}
+
+	return NewPtr;
 }
 
 int FLuaState::LuaLoadClass(lua_State* L)
@@ -620,29 +1226,102 @@ int FLuaState::GetEnumValue(lua_State* L)
 	return 1;
 }
 
-int FLuaState::FillOutProperty(lua_State* L)
+int FLuaState::LuaPreloadModules(lua_State* L)
+{
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	if (!LuaStateWrapper)
+	{
+		return 0;
+	}
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+
+	TArray<FString> ModuleNames;
+	const int32 Num = lua_rawlen(L, 1);
+	for (int32 Index = 1; Index <= Num; ++Index)
+	{
+		lua_rawgeti(L, 1, Index);
+		if (const char* ModuleName = lua_tostring(L, -1))
+		{
+			ModuleNames.Emplace(UTF8_TO_TCHAR(ModuleName));
+		}
+		lua_pop(L, 1);
+	}
+
+	LuaStateWrapper->PreloadModules(ModuleNames);
+
+	return 0;
+}
+
+int FLuaState::LuaRunWorkerJob(lua_State* L)
+{
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	if (!LuaStateWrapper)
+	{
+		return 0;
+	}
+
+	const char* ModuleName = luaL_checkstring(L, 1);
+	const char* FunctionName = luaL_checkstring(L, 2);
+	if (!lua_isnoneornil(L, 3))
+	{
+		luaL_checktype(L, 3, LUA_TFUNCTION);
+	}
+
+	TArray<uint8> Arguments;
+	if (!LuaStateWrapper->Serializer.Serialize(L, 4, FMath::Max(0, lua_gettop(L) - 3), Arguments))
+	{
+		return luaL_error(L, "Run worker job failed! %s!", TCHAR_TO_UTF8(*LuaStateWrapper->Serializer.GetError()));
+	}
+
+	TFuture<FLuaWorkerResult> Result = FBlueluaModule::Get().GetWorkerPool()->Submit(UTF8_TO_TCHAR(ModuleName), UTF8_TO_TCHAR(FunctionName), MoveTemp(Arguments));
+
+	if (lua_isfunction(L, 3))
+	{
+		lua_pushvalue(L, 3);
+
+		FPendingWorkerJob& PendingJob = LuaStateWrapper->PendingWorkerJobs.AddDefaulted_GetRef();
+		PendingJob.Result = MoveTemp(Result);
+		PendingJob.CallbackRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+
+	return 0;
+}
+
+int FLuaState::CallAndFillOutParams(lua_State* L)
 {
+	// stack = [Function, Params..., OutParams]
+	const FLuaOutParams* OutParams = (const FLuaOutParams*)lua_touserdata(L, -1);
+	lua_pop(L, 1);
+
+	lua_call(L, lua_gettop(L) - 1, OutParams->OutParamsCount);
+
 	SCOPE_CYCLE_COUNTER(STAT_FillOutProperty);
 
-	int32 OutParamsCount = lua_tointeger(L, lua_upvalueindex(1));
-	UProperty* ReturnValue = (UProperty*)lua_touserdata(L, lua_upvalueindex(2 + OutParamsCount));
-	UFunction* Function = (UFunction*)lua_touserdata(L, lua_upvalueindex(3 + OutParamsCount));
-	void* Parameters = lua_touserdata(L, lua_upvalueindex(4 + OutParamsCount));
+	// stack = [Results...]
+	int32 ResultIndex = 1;
+	if (OutParams->OutParamsList)
+	{
+		for (FOutParmRec* OutParam = OutParams->OutParamsList; OutParam; OutParam = OutParam->NextOutParm)
+		{
+			FLuaObjectBase::FetchProperty(L, OutParam->Property, OutParam->PropAddr, ResultIndex++);
+		}
+
+		return 0;
+	}
 
-	int32 OutParamUpValueIndex = 2;
-	if (ReturnValue)
+	if (OutParams->ReturnValue)
 	{
-		FLuaObjectBase::FetchProperty(L, ReturnValue, ReturnValue->ContainerPtrToValuePtr<uint8>(Parameters), lua_upvalueindex(OutParamUpValueIndex));
-		++OutParamUpValueIndex;
+		FLuaObjectBase::FetchProperty(L, OutParams->ReturnValue, OutParams->ReturnValue->ContainerPtrToValuePtr<uint8>(OutParams->Parameters), ResultIndex++);
 	}
 
-	if (Function->HasAnyFunctionFlags(FUNC_HasOutParms))
+	if (OutParams->Function && OutParams->Function->HasAnyFunctionFlags(FUNC_HasOutParms))
 	{
-		for (TFieldIterator<UProperty> ParamIter(Function); ParamIter && ((ParamIter->PropertyFlags & (CPF_Parm | CPF_ReturnParm)) == CPF_Parm); ++ParamIter)
+		for (TFieldIterator<UProperty> ParamIter(OutParams->Function); ParamIter && ((ParamIter->PropertyFlags & (CPF_Parm | CPF_ReturnParm)) == CPF_Parm); ++ParamIter)
 		{
 			if ((ParamIter->PropertyFlags & (CPF_ConstParm | CPF_OutParm)) == CPF_OutParm)
 			{
-				FLuaObjectBase::FetchProperty(L, *ParamIter, (*ParamIter)->ContainerPtrToValuePtr<uint8>(Parameters), lua_upvalueindex(OutParamUpValueIndex++));
+				FLuaObjectBase::FetchProperty(L, *ParamIter, (*ParamIter)->ContainerPtrToValuePtr<uint8>(OutParams->Parameters), ResultIndex++);
 			}
 		}
 	}
@@ -650,6 +1329,112 @@ int FLuaState::FillOutProperty(lua_State* L)
 	return 0;
 }
 
+bool FLuaState::Tick(float DeltaTime)
+{
+	FLuaTrace::UpdateLuaCallHook(L);
+
+	DispatchWorkerResults();
+
+	TimerWheel.Tick(DeltaTime);
+
+	CoroutineScheduler.Tick(DeltaTime);
+
+	GCScheduler.Tick(DeltaTime);
+
+	ErrorThrottle.Tick(DeltaTime);
+
+	UpdateLogPrefix();
+
+	return true;
+}
+
+void FLuaState::UpdateLogPrefix()
+{
+#if WITH_EDITOR
+	FString Prefix;
+
+	UGameInstance* GameInstance = OwnerGameInstane.Get();
+	const FWorldContext* WorldContext = GameInstance ? GameInstance->GetWorldContext() : nullptr;
+	UWorld* World = WorldContext ? WorldContext->World() : nullptr;
+	if (World && World->WorldType == EWorldType::PIE)
+	{
+		switch (World->GetNetMode())
+		{
+		case NM_Client:
+			Prefix = FString::Printf(TEXT("Client %d: "), GPlayInEditorID - 1);
+			break;
+		case NM_DedicatedServer:
+		case NM_ListenServer:
+			Prefix = TEXT("Server: ");
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (Prefix.IsEmpty())
+	{
+		LogPrefix.Reset();
+		return;
+	}
+
+	const FTCHARToUTF8 Converted(*Prefix);
+	if (LogPrefix.Num() != Converted.Length() + 1 || FMemory::Memcmp(LogPrefix.GetData(), Converted.Get(), Converted.Length()) != 0)
+	{
+		LogPrefix.SetNumUninitialized(Converted.Length() + 1);
+		FMemory::Memcpy(LogPrefix.GetData(), Converted.Get(), Converted.Length());
+		LogPrefix[Converted.Length()] = 0;
+	}
+#endif
+}
+
+void FLuaState::DispatchWorkerResults()
+{
+	if (!L || PendingWorkerJobs.Num() == 0)
+	{
+		return;
+	}
+
+	// callbacks may submit new jobs, take finished ones out first
+	TArray<FPendingWorkerJob> FinishedJobs;
+	for (int32 Index = PendingWorkerJobs.Num() - 1; Index >= 0; --Index)
+	{
+		if (PendingWorkerJobs[Index].Result.IsReady())
+		{
+			FinishedJobs.Insert(MoveTemp(PendingWorkerJobs[Index]), 0);
+			PendingWorkerJobs.RemoveAt(Index, 1, false);
+		}
+	}
+
+	for (FPendingWorkerJob& FinishedJob : FinishedJobs)
+	{
+		FLuaStackGuard Guard(L);
+
+		const FLuaWorkerResult& Result = FinishedJob.Result.Get();
+
+		lua_pushcfunction(L, LuaError);
+		const int32 LuaErrorFunctionIndex = lua_gettop(L);
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, FinishedJob.CallbackRef);
+		luaL_unref(L, LUA_REGISTRYINDEX, FinishedJob.CallbackRef);
+
+		int32 ResultsCount = Result.bSuccess ? Serializer.Deserialize(L, Result.Payload) : INDEX_NONE;
+		if (ResultsCount == INDEX_NONE)
+		{
+			lua_pushboolean(L, false);
+			lua_pushstring(L, TCHAR_TO_UTF8(*(Result.bSuccess ? Serializer.GetError() : Result.Error)));
+			ResultsCount = 1;
+		}
+		else
+		{
+			lua_pushboolean(L, true);
+			lua_insert(L, -(ResultsCount + 1));
+		}
+
+		lua_pcall(L, ResultsCount + 1, 0, LuaErrorFunctionIndex);
+	}
+}
+
 void FLuaState::OnPostGarbageCollect()
 {
 	TSet<UObject*> ObjectsNeedGC;
@@ -666,6 +1451,126 @@ void FLuaState::OnPostGarbageCollect()
 	{
 		RemoveReference(Object, nullptr);
 	}
+
+	if (DelegateDispatcher)
+	{
+		DelegateDispatcher->ReleaseStaleBindings();
+	}
+
+	GCScheduler.FullCollect(TEXT("engine garbage collection"));
+}
+
+void FLuaState::OnPostLoadMap(UWorld* World)
+{
+	GCScheduler.FullCollect(TEXT("map load"));
+}
+
+void FLuaState::OnMemoryTrim()
+{
+	TrimMemory();
+}
+
+FString FLuaState::NormalizeFilePath(const FString& InPath)
+{
+	FString FullPath = FPaths::ConvertRelativePathToFull(InPath);
+	FPaths::NormalizeFilename(FullPath);
+
+	return FullPath;
+}
+
+void FLuaState::PatchTable(lua_State* L, int32 TargetIndex, int32 SourceIndex)
+{
+	TargetIndex = lua_absindex(L, TargetIndex);
+	SourceIndex = lua_absindex(L, SourceIndex);
+
+	lua_newtable(L);
+	const int32 VisitedIndex = lua_gettop(L);
+
+	PatchTableRecursive(L, TargetIndex, SourceIndex, VisitedIndex);
+
+	lua_pop(L, 1);
+}
+
+void FLuaState::PatchTableRecursive(lua_State* L, int32 TargetIndex, int32 SourceIndex, int32 VisitedIndex)
+{
+	lua_pushvalue(L, SourceIndex);
+	lua_pushboolean(L, true);
+	lua_rawset(L, VisitedIndex);
+
+	lua_pushnil(L); // stack = [..., nil]
+	while (lua_next(L, SourceIndex)) // stack = [..., key, value]
+	{
+		lua_pushvalue(L, -2);
+		lua_rawget(L, TargetIndex); // stack = [..., key, value, oldvalue]
+
+		if (lua_isfunction(L, -2) || lua_isnil(L, -1))
+		{
+			// the new function keeps the module locals of the old one
+			if (lua_isfunction(L, -1))
+			{
+				JoinUpvalues(L, lua_absindex(L, -2), lua_absindex(L, -1));
+			}
+
+			// replace function bodies and add new fields, state in the target table is kept
+			lua_pushvalue(L, -3);
+			lua_pushvalue(L, -3);
+			lua_rawset(L, TargetIndex);
+		}
+		else if (lua_istable(L, -1) && lua_istable(L, -2))
+		{
+			lua_pushvalue(L, -2);
+			lua_rawget(L, VisitedIndex);
+			const bool bVisited = !!lua_toboolean(L, -1);
+			lua_pop(L, 1);
+
+			if (!bVisited)
+			{
+				PatchTableRecursive(L, lua_absindex(L, -1), lua_absindex(L, -2), VisitedIndex);
+			}
+		}
+
+		lua_pop(L, 2); // stack = [..., key]
+	}
+}
+
+void FLuaState::JoinUpvalues(lua_State* L, int32 NewFunctionIndex, int32 OldFunctionIndex)
+{
+	if (lua_iscfunction(L, NewFunctionIndex) || lua_iscfunction(L, OldFunctionIndex))
+	{
+		return;
+	}
+
+	for (int32 NewUpvalue = 1; ; ++NewUpvalue)
+	{
+		const char* NewName = lua_getupvalue(L, NewFunctionIndex, NewUpvalue);
+		if (!NewName)
+		{
+			break;
+		}
+		lua_pop(L, 1);
+
+		// names are empty in stripped bytecode
+		if (!*NewName)
+		{
+			continue;
+		}
+
+		for (int32 OldUpvalue = 1; ; ++OldUpvalue)
+		{
+			const char* OldName = lua_getupvalue(L, OldFunctionIndex, OldUpvalue);
+			if (!OldName)
+			{
+				break;
+			}
+			lua_pop(L, 1);
+
+			if (FCStringAnsi::Strcmp(NewName, OldName) == 0)
+			{
+				lua_upvaluejoin(L, NewFunctionIndex, NewUpvalue, OldFunctionIndex, OldUpvalue);
+				break;
+			}
+		}
+	}
 }
 
 FString FLuaState::MakeRelativePathToContent(const FString& InPath)
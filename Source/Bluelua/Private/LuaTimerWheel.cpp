@@ -0,0 +1,447 @@
+#include "LuaTimerWheel.h"
+
+#include "HAL/IConsoleManager.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+#include "LuaState.h"
+
+DECLARE_CYCLE_STAT(TEXT("LuaTimerTick"), STAT_LuaTimerTick, STATGROUP_Bluelua);
+DECLARE_DWORD_COUNTER_STAT(TEXT("LuaTimersFired"), STAT_LuaTimersFired, STATGROUP_Bluelua);
+DECLARE_DWORD_COUNTER_STAT(TEXT("LuaTimers"), STAT_LuaTimers, STATGROUP_Bluelua);
+
+static TAutoConsoleVariable<int32> CVarLuaTimerTickMs(
+	TEXT("bluelua.Timer.TickMs"),
+	10,
+	TEXT("Resolution of lua timers in milliseconds, read when lua state is created."));
+
+FLuaTimerWheel::FLuaTimerWheel()
+	: L(nullptr)
+	, TickSeconds(0.01)
+	, Accumulator(0.0)
+	, NextTick(0)
+	, FreeHead(INDEX_NONE)
+	, NumTimers(0)
+{
+	for (int32& Head : Heads)
+	{
+		Head = INDEX_NONE;
+	}
+}
+
+FLuaTimerWheel::~FLuaTimerWheel()
+{
+	Shutdown();
+}
+
+void FLuaTimerWheel::Init(lua_State* InL)
+{
+	L = InL;
+
+	TickSeconds = FMath::Max(1, CVarLuaTimerTickMs.GetValueOnGameThread()) / 1000.0;
+}
+
+void FLuaTimerWheel::Shutdown()
+{
+	// function refs are released with the state
+	for (int32& Head : Heads)
+	{
+		Head = INDEX_NONE;
+	}
+
+	Nodes.Empty();
+	ExpiredTimers.Empty();
+	FreeHead = INDEX_NONE;
+	NumTimers = 0;
+
+	L = nullptr;
+}
+
+void FLuaTimerWheel::Tick(float DeltaTime)
+{
+	if (!L)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_LuaTimerTick);
+
+	Accumulator += DeltaTime;
+
+	const uint64 ElapsedTicks = (uint64)(Accumulator / TickSeconds);
+	Accumulator -= ElapsedTicks * TickSeconds;
+
+	if (NumTimers == 0)
+	{
+		// empty wheel, nothing to cascade
+		NextTick += ElapsedTicks;
+	}
+	else
+	{
+		for (const uint64 LastTick = NextTick + ElapsedTicks; NextTick < LastTick; ++NextTick)
+		{
+			const int32 Index = (int32)(NextTick & (RootSlots - 1));
+
+			// root wheel wrapped, move timers of the next upper slot down
+			if (Index == 0)
+			{
+				for (int32 Level = 1; Level < NumLevels; ++Level)
+				{
+					const int32 LevelIndex = (int32)((NextTick >> (RootBits + (Level - 1) * LevelBits)) & (LevelSlots - 1));
+					Cascade(Level, LevelIndex);
+
+					if (LevelIndex != 0)
+					{
+						break;
+					}
+				}
+			}
+
+			Expire(Index);
+		}
+	}
+
+	FireExpired();
+
+	SET_DWORD_STAT(STAT_LuaTimers, NumTimers);
+}
+
+int64 FLuaTimerWheel::SetTimer(lua_State* InL, int32 FunctionIndex, float Delay, float Interval/* = 0.f*/)
+{
+	if (!L)
+	{
+		return 0;
+	}
+
+	lua_pushvalue(InL, FunctionIndex);
+	const int FunctionRef = luaL_ref(InL, LUA_REGISTRYINDEX);
+
+	const int32 NodeIndex = AllocNode();
+	FTimerNode& Node = Nodes[NodeIndex];
+	Node.FunctionRef = FunctionRef;
+	// tick NextTick fires after one tick
+	Node.ExpireTick = NextTick + FMath::Max<uint64>(SecondsToTicks(Delay), 1) - 1;
+	Node.IntervalTicks = Interval > 0.f ? (uint32)FMath::Clamp<uint64>(SecondsToTicks(Interval), 1, MAX_uint32) : 0;
+
+	Schedule(NodeIndex);
+
+	return MakeHandle(NodeIndex);
+}
+
+bool FLuaTimerWheel::ClearTimer(int64 Handle)
+{
+	const int32 NodeIndex = FindNode(Handle);
+	if (NodeIndex == INDEX_NONE)
+	{
+		return false;
+	}
+
+	FreeNode(NodeIndex);
+
+	return true;
+}
+
+bool FLuaTimerWheel::IsTimerActive(int64 Handle) const
+{
+	return FindNode(Handle) != INDEX_NONE;
+}
+
+int32 FLuaTimerWheel::GetNumTimers() const
+{
+	return NumTimers;
+}
+
+int32 FLuaTimerWheel::AllocNode()
+{
+	int32 NodeIndex = FreeHead;
+	if (NodeIndex != INDEX_NONE)
+	{
+		FreeHead = Nodes[NodeIndex].Next;
+	}
+	else
+	{
+		NodeIndex = Nodes.AddUninitialized();
+		Nodes[NodeIndex].Generation = 1;
+	}
+
+	FTimerNode& Node = Nodes[NodeIndex];
+	Node.Prev = INDEX_NONE;
+	Node.Next = INDEX_NONE;
+	Node.Slot = INDEX_NONE;
+
+	++NumTimers;
+
+	return NodeIndex;
+}
+
+void FLuaTimerWheel::FreeNode(int32 NodeIndex)
+{
+	Unlink(NodeIndex);
+
+	FTimerNode& Node = Nodes[NodeIndex];
+	luaL_unref(L, LUA_REGISTRYINDEX, Node.FunctionRef);
+	Node.FunctionRef = LUA_NOREF;
+
+	// handles keep generation in 31 bits so they stay positive
+	Node.Generation = (Node.Generation + 1) & 0x7fffffff;
+	if (Node.Generation == 0)
+	{
+		Node.Generation = 1;
+	}
+
+	Node.Next = FreeHead;
+	FreeHead = NodeIndex;
+
+	--NumTimers;
+}
+
+void FLuaTimerWheel::Schedule(int32 NodeIndex)
+{
+	FTimerNode& Node = Nodes[NodeIndex];
+
+	// late timers fire on the next tick
+	Node.ExpireTick = FMath::Max(Node.ExpireTick, NextTick);
+
+	const uint64 Delta = Node.ExpireTick - NextTick;
+	if (Delta < RootSlots)
+	{
+		Link(NodeIndex, (int32)(Node.ExpireTick & (RootSlots - 1)));
+		return;
+	}
+
+	int32 Level = 1;
+	while (Level < NumLevels - 1 && Delta >= (1ull << (RootBits + Level * LevelBits)))
+	{
+		++Level;
+	}
+
+	// too far for the wheel, parked in the last slot and cascaded again until in range
+	const uint64 MaxDelta = (1ull << (RootBits + (NumLevels - 1) * LevelBits)) - 1;
+	const uint64 SlotTick = Delta > MaxDelta ? NextTick + MaxDelta : Node.ExpireTick;
+
+	const int32 LevelIndex = (int32)((SlotTick >> (RootBits + (Level - 1) * LevelBits)) & (LevelSlots - 1));
+	Link(NodeIndex, RootSlots + (Level - 1) * LevelSlots + LevelIndex);
+}
+
+void FLuaTimerWheel::Link(int32 NodeIndex, int32 Slot)
+{
+	FTimerNode& Node = Nodes[NodeIndex];
+	Node.Slot = Slot;
+	Node.Prev = INDEX_NONE;
+	Node.Next = Heads[Slot];
+
+	if (Node.Next != INDEX_NONE)
+	{
+		Nodes[Node.Next].Prev = NodeIndex;
+	}
+
+	Heads[Slot] = NodeIndex;
+}
+
+void FLuaTimerWheel::Unlink(int32 NodeIndex)
+{
+	FTimerNode& Node = Nodes[NodeIndex];
+	if (Node.Slot == INDEX_NONE)
+	{
+		return;
+	}
+
+	if (Node.Prev != INDEX_NONE)
+	{
+		Nodes[Node.Prev].Next = Node.Next;
+	}
+	else
+	{
+		Heads[Node.Slot] = Node.Next;
+	}
+
+	if (Node.Next != INDEX_NONE)
+	{
+		Nodes[Node.Next].Prev = Node.Prev;
+	}
+
+	Node.Prev = INDEX_NONE;
+	Node.Next = INDEX_NONE;
+	Node.Slot = INDEX_NONE;
+}
+
+void FLuaTimerWheel::Cascade(int32 Level, int32 Index)
+{
+	const int32 Slot = RootSlots + (Level - 1) * LevelSlots + Index;
+
+	int32 NodeIndex = Heads[Slot];
+	Heads[Slot] = INDEX_NONE;
+
+	while (NodeIndex != INDEX_NONE)
+	{
+		const int32 NextIndex = Nodes[NodeIndex].Next;
+		Nodes[NodeIndex].Slot = INDEX_NONE;
+
+		Schedule(NodeIndex);
+
+		NodeIndex = NextIndex;
+	}
+}
+
+void FLuaTimerWheel::Expire(int32 Slot)
+{
+	int32 NodeIndex = Heads[Slot];
+	Heads[Slot] = INDEX_NONE;
+
+	while (NodeIndex != INDEX_NONE)
+	{
+		FTimerNode& Node = Nodes[NodeIndex];
+		const int32 NextIndex = Node.Next;
+
+		Node.Prev = INDEX_NONE;
+		Node.Next = INDEX_NONE;
+		Node.Slot = INDEX_NONE;
+
+		ExpiredTimers.Add(MakeHandle(NodeIndex));
+
+		NodeIndex = NextIndex;
+	}
+}
+
+void FLuaTimerWheel::FireExpired()
+{
+	if (ExpiredTimers.Num() == 0)
+	{
+		return;
+	}
+
+	INC_DWORD_STAT_BY(STAT_LuaTimersFired, ExpiredTimers.Num());
+
+	const int32 Top = lua_gettop(L);
+
+	lua_pushcfunction(L, TimerTraceback);
+	const int32 TracebackIndex = lua_gettop(L);
+
+	for (int32 Index = 0; Index < ExpiredTimers.Num(); ++Index)
+	{
+		const int64 Handle = ExpiredTimers[Index];
+
+		// cleared by a callback fired before it
+		const int32 NodeIndex = FindNode(Handle);
+		if (NodeIndex == INDEX_NONE)
+		{
+			continue;
+		}
+
+		FTimerNode& Node = Nodes[NodeIndex];
+		lua_rawgeti(L, LUA_REGISTRYINDEX, Node.FunctionRef);
+
+		// rescheduled before calling so the callback can clear it
+		if (Node.IntervalTicks > 0)
+		{
+			Node.ExpireTick += Node.IntervalTicks;
+			Schedule(NodeIndex);
+		}
+		else
+		{
+			FreeNode(NodeIndex);
+		}
+
+		lua_pushinteger(L, Handle);
+		if (LUA_OK != lua_pcall(L, 1, 0, TracebackIndex))
+		{
+			// false if the error site is throttled
+			if (lua_type(L, -1) == LUA_TSTRING)
+			{
+				UE_LOG(LogBluelua, Error, TEXT("Lua timer callback failed! %s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+			}
+			lua_pop(L, 1);
+		}
+	}
+
+	ExpiredTimers.Reset();
+
+	lua_settop(L, Top);
+}
+
+uint64 FLuaTimerWheel::SecondsToTicks(float Seconds) const
+{
+	return Seconds > 0.f ? (uint64)FMath::CeilToDouble(Seconds / TickSeconds) : 0;
+}
+
+int64 FLuaTimerWheel::MakeHandle(int32 NodeIndex) const
+{
+	return ((int64)Nodes[NodeIndex].Generation << 32) | (uint32)NodeIndex;
+}
+
+int32 FLuaTimerWheel::FindNode(int64 Handle) const
+{
+	const int32 NodeIndex = (int32)(Handle & 0xffffffff);
+	const uint32 Generation = (uint32)(Handle >> 32);
+
+	if (Handle <= 0 || !Nodes.IsValidIndex(NodeIndex))
+	{
+		return INDEX_NONE;
+	}
+
+	const FTimerNode& Node = Nodes[NodeIndex];
+	if (Node.Generation != Generation || Node.FunctionRef == LUA_NOREF)
+	{
+		return INDEX_NONE;
+	}
+
+	return NodeIndex;
+}
+
+int FLuaTimerWheel::LuaSetTimer(lua_State* L)
+{
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	const float Delay = (float)luaL_optnumber(L, 2, 0.0);
+
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	if (!LuaStateWrapper)
+	{
+		return luaL_error(L, "Set timer failed! no lua state!");
+	}
+
+	lua_pushinteger(L, LuaStateWrapper->GetTimerWheel().SetTimer(L, 1, Delay));
+
+	return 1;
+}
+
+int FLuaTimerWheel::LuaSetInterval(lua_State* L)
+{
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+	const float Interval = (float)luaL_checknumber(L, 2);
+	luaL_argcheck(L, Interval > 0.f, 2, "interval must be greater than 0");
+	const float Delay = (float)luaL_optnumber(L, 3, Interval);
+
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	if (!LuaStateWrapper)
+	{
+		return luaL_error(L, "Set interval failed! no lua state!");
+	}
+
+	lua_pushinteger(L, LuaStateWrapper->GetTimerWheel().SetTimer(L, 1, Delay, Interval));
+
+	return 1;
+}
+
+int FLuaTimerWheel::LuaClearTimer(lua_State* L)
+{
+	const int64 Handle = (int64)luaL_optinteger(L, 1, 0);
+
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	lua_pushboolean(L, LuaStateWrapper && LuaStateWrapper->GetTimerWheel().ClearTimer(Handle));
+
+	return 1;
+}
+
+int FLuaTimerWheel::TimerTraceback(lua_State* L)
+{
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+	if (LuaStateWrapper && !LuaStateWrapper->GetErrorThrottle().Report(L, lua_tostring(L, 1)))
+	{
+		lua_pushboolean(L, false);
+		return 1;
+	}
+
+	luaL_traceback(L, L, lua_tostring(L, 1), 1);
+
+	return 1;
+}
@@ -0,0 +1,227 @@
+#include "LuaTrace.h"
+
+#include "HAL/IConsoleManager.h"
+#include "UObject/Class.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+
+#if BLUELUA_TRACE_ENABLED
+UE_TRACE_CHANNEL_DEFINE(BlueluaChannel)
+#endif // BLUELUA_TRACE_ENABLED
+
+static TAutoConsoleVariable<int32> CVarLuaTraceCallDepth(
+	TEXT("bluelua.Trace.LuaCallDepth"),
+	0,
+	TEXT("Trace lua to lua calls up to this call depth on the Bluelua trace channel, 0 disables it, at most 64."));
+
+// one bit per traced depth in OpenLuaEvents
+static const int32 MaxTracedLuaCallDepth = 64;
+
+// interned names, lua_Debug pointers can be reused once a chunk or function is collected
+struct FLuaTraceEventKey
+{
+	FName Function;
+	FName Source;
+	int32 Line;
+
+	bool operator==(const FLuaTraceEventKey& Other) const
+	{
+		return Function == Other.Function && Source == Other.Source && Line == Other.Line;
+	}
+
+	friend uint32 GetTypeHash(const FLuaTraceEventKey& Key)
+	{
+		return HashCombine(HashCombine(GetTypeHash(Key.Function), GetTypeHash(Key.Source)), ::GetTypeHash(Key.Line));
+	}
+};
+
+// lua states are only traced on the game thread
+static TMap<const UFunction*, uint32> FunctionEventIds;
+static TMap<FLuaTraceEventKey, uint32> LuaEventIds;
+
+static int32 TracedLuaCallDepth = 0;
+static int32 LuaCallDepth = 0;
+static uint64 OpenLuaEvents = 0;
+
+bool FLuaTrace::IsEnabled()
+{
+#if BLUELUA_TRACE_ENABLED
+	return UE_TRACE_CHANNELEXPR_IS_ENABLED(BlueluaChannel) && UE_TRACE_CHANNELEXPR_IS_ENABLED(CpuChannel);
+#else
+	return false;
+#endif // BLUELUA_TRACE_ENABLED
+}
+
+void FLuaTrace::UpdateLuaCallHook(lua_State* L)
+{
+	if (!L)
+	{
+		return;
+	}
+
+	const int32 CallDepth = FMath::Min(CVarLuaTraceCallDepth.GetValueOnGameThread(), MaxTracedLuaCallDepth);
+	const bool bTraceLuaCalls = CallDepth > 0 && IsEnabled();
+
+	lua_Hook CurrentHook = lua_gethook(L);
+	if (bTraceLuaCalls && !CurrentHook)
+	{
+		TracedLuaCallDepth = CallDepth;
+		LuaCallDepth = 0;
+		OpenLuaEvents = 0;
+
+		lua_sethook(L, &FLuaTrace::LuaCallHook, LUA_MASKCALL | LUA_MASKRET, 0);
+	}
+	else if (CurrentHook == &FLuaTrace::LuaCallHook)
+	{
+		if (!bTraceLuaCalls)
+		{
+			lua_sethook(L, nullptr, 0, 0);
+		}
+		else
+		{
+			TracedLuaCallDepth = CallDepth;
+		}
+	}
+}
+
+FLuaTrace::FScope::FScope(const UFunction* Function)
+	: bActive(false)
+	, SavedLuaCallDepth(0)
+{
+	if (Function && IsEnabled())
+	{
+		Begin(GetEventId(Function));
+	}
+}
+
+FLuaTrace::FScope::FScope(lua_State* L, int32 FunctionIndex, const UFunction* SignatureFunction)
+	: bActive(false)
+	, SavedLuaCallDepth(0)
+{
+	if (IsEnabled() && lua_type(L, FunctionIndex) == LUA_TFUNCTION)
+	{
+		// ">S" doesn't fill the name, which is read when there is no SignatureFunction
+		lua_Debug Ar = {};
+		lua_pushvalue(L, FunctionIndex);
+		if (lua_getinfo(L, ">S", &Ar))
+		{
+			Begin(GetEventId(Ar, SignatureFunction));
+		}
+	}
+}
+
+FLuaTrace::FScope::~FScope()
+{
+#if BLUELUA_TRACE_ENABLED
+	if (bActive)
+	{
+		EndLuaEvents(SavedLuaCallDepth);
+		FCpuProfilerTrace::OutputEndEvent();
+	}
+#endif // BLUELUA_TRACE_ENABLED
+}
+
+void FLuaTrace::FScope::Begin(uint32 EventId)
+{
+#if BLUELUA_TRACE_ENABLED
+	bActive = true;
+	SavedLuaCallDepth = LuaCallDepth;
+
+	FCpuProfilerTrace::OutputBeginEvent(EventId);
+#endif // BLUELUA_TRACE_ENABLED
+}
+
+uint32 FLuaTrace::GetEventId(const UFunction* Function)
+{
+#if BLUELUA_TRACE_ENABLED
+	if (const uint32* EventId = FunctionEventIds.Find(Function))
+	{
+		return *EventId;
+	}
+
+	const FString EventName = FString::Printf(TEXT("%s.%s"), *GetNameSafe(Function->GetOuter()), *Function->GetName());
+	const uint32 EventId = FCpuProfilerTrace::OutputEventType(*EventName);
+	FunctionEventIds.Add(Function, EventId);
+
+	return EventId;
+#else
+	return 0;
+#endif // BLUELUA_TRACE_ENABLED
+}
+
+uint32 FLuaTrace::GetEventId(const lua_Debug& Ar, const UFunction* SignatureFunction)
+{
+#if BLUELUA_TRACE_ENABLED
+	// lua functions called from UE are named by the UE function, the lua name depends on the call site
+	const FName FunctionName = SignatureFunction ? SignatureFunction->GetFName() : FName(Ar.name ? Ar.name : "?");
+
+	// short_src is bounded by LUA_IDSIZE, source can be a whole chunk loaded from a string
+	const FLuaTraceEventKey Key{ FunctionName, FName(Ar.short_src), Ar.linedefined };
+	if (const uint32* EventId = LuaEventIds.Find(Key))
+	{
+		return *EventId;
+	}
+
+	const FString EventName = FString::Printf(TEXT("%s (%s:%d)"), *FunctionName.ToString(), *Key.Source.ToString(), Ar.linedefined);
+	const uint32 EventId = FCpuProfilerTrace::OutputEventType(*EventName);
+	LuaEventIds.Add(Key, EventId);
+
+	return EventId;
+#else
+	return 0;
+#endif // BLUELUA_TRACE_ENABLED
+}
+
+void FLuaTrace::LuaCallHook(lua_State* L, lua_Debug* Ar)
+{
+#if BLUELUA_TRACE_ENABLED
+	// coroutines may yield with their events open, only the main thread is traced
+	const bool bMainThread = lua_pushthread(L) == 1;
+	lua_pop(L, 1);
+
+	if (!bMainThread)
+	{
+		return;
+	}
+
+	if (Ar->event == LUA_HOOKRET)
+	{
+		EndLuaEvents(LuaCallDepth - 1);
+		return;
+	}
+
+	if (Ar->event == LUA_HOOKTAILCALL)
+	{
+		// the called function replaces the current frame
+		EndLuaEvents(LuaCallDepth - 1);
+	}
+
+	++LuaCallDepth;
+
+	if (LuaCallDepth > TracedLuaCallDepth || !lua_getinfo(L, "Sn", Ar) || Ar->what[0] == 'C')
+	{
+		return;
+	}
+
+	OpenLuaEvents |= (1ull << (LuaCallDepth - 1));
+	FCpuProfilerTrace::OutputBeginEvent(GetEventId(*Ar, nullptr));
+#endif // BLUELUA_TRACE_ENABLED
+}
+
+void FLuaTrace::EndLuaEvents(int32 ToDepth)
+{
+#if BLUELUA_TRACE_ENABLED
+	ToDepth = FMath::Max(ToDepth, 0);
+
+	for (; LuaCallDepth > ToDepth; --LuaCallDepth)
+	{
+		const uint64 EventBit = (LuaCallDepth <= MaxTracedLuaCallDepth) ? (1ull << (LuaCallDepth - 1)) : 0;
+		if (OpenLuaEvents & EventBit)
+		{
+			OpenLuaEvents &= ~EventBit;
+			FCpuProfilerTrace::OutputEndEvent();
+		}
+	}
+#endif // BLUELUA_TRACE_ENABLED
+}
@@ -6,6 +6,8 @@
 
 #include "Bluelua.h"
 #include "lua.hpp"
+#include "LuaBindingRegistry.h"
+#include "LuaBridgeStats.h"
 #include "LuaObjectBase.h"
 #include "LuaState.h"
 #include "LuaUObject.h"
@@ -46,6 +48,7 @@ int FLuaUClass::Push(lua_State* L, UClass* InSource)
 	}
 
 	void* Buffer = lua_newuserdata(L, sizeof(FLuaUClass));
+	FLuaBridgeStats::OnProxyCreated();
 	FLuaUClass* LuaUClass = new(Buffer) FLuaUClass(InSource);
 
 	if (luaL_newmetatable(L, UCLASS_METATABLE))
@@ -122,6 +125,12 @@ int FLuaUClass::Index(lua_State* L)
 	}
 
 	const char* PropertyName = lua_tostring(L, 2);
+	const int32 MemberNum = FLuaBindingRegistry::PushMember(L, LuaUClass->Source.Get(), PropertyName, LuaUClass->Source->GetDefaultObject());
+	if (MemberNum >= 0)
+	{
+		return MemberNum;
+	}
+
 	if (UFunction* Function = LuaUClass->Source->FindFunctionByName(PropertyName))
 	{
 		if (!Function->HasAnyFunctionFlags(FUNC_BlueprintCallable | FUNC_BlueprintPure))
@@ -129,6 +138,12 @@ int FLuaUClass::Index(lua_State* L)
 			luaL_error(L, "Function[%s] is not blueprint callable!", TCHAR_TO_UTF8(*Function->GetName()));
 		}
 
+		// glue of member functions needs an object as self, the class proxy calls them on the default object
+		if (Function->HasAnyFunctionFlags(FUNC_Static) && FLuaBindingRegistry::PushBinding(L, Function))
+		{
+			return 1;
+		}
+
 		lua_pushlightuserdata(L, Function);
 		lua_pushcclosure(L, CallStaticUFunction, 1);
 
@@ -156,6 +171,12 @@ int FLuaUClass::NewIndex(lua_State* L)
 	UObject* ClassDefaultObject = LuaUClass->Source->GetDefaultObject();
 	const char* PropertyName = lua_tostring(L, 2);
 
+	// hand-written fields, on the default object like Index
+	if (FLuaBindingRegistry::SetMember(L, LuaUClass->Source.Get(), PropertyName, ClassDefaultObject, 3))
+	{
+		return 0;
+	}
+
 	UProperty* Property = LuaUClass->Source->FindPropertyByName(PropertyName);
 	if (Property)
 	{
@@ -7,6 +7,8 @@
 
 #include "Bluelua.h"
 #include "lua.hpp"
+#include "LuaBridgeStats.h"
+#include "LuaDelegateDispatcher.h"
 #include "LuaFunctionDelegate.h"
 #include "LuaState.h"
 
@@ -26,7 +28,7 @@ FLuaUDelegate::~FLuaUDelegate()
 
 }
 
-int FLuaUDelegate::Push(lua_State* L, void* InSource, UFunction* InFunction, FCreateDelegateFuncPtr CreateDelegateFuncPtr, void* InBuffer /*= nullptr*/)
+int FLuaUDelegate::Push(lua_State* L, void* InSource, UFunction* InFunction, FCreateDelegateFuncPtr CreateDelegateFuncPtr, void* InBuffer /*= nullptr*/, UObject* InOwner /*= nullptr*/)
 {
 	SCOPE_CYCLE_COUNTER(STAT_DelegatePush);
 
@@ -43,6 +45,8 @@ int FLuaUDelegate::Push(lua_State* L, void* InSource, UFunction* InFunction, FCr
 	}
 
 	FLuaUDelegate* LuaUDelegate = CreateDelegateFuncPtr(L, InSource, InFunction);
+	FLuaBridgeStats::OnProxyCreated();
+	LuaUDelegate->Owner = InOwner;
 
 	if (luaL_newmetatable(L, UDELEGATE_METATABLE))
 	{
@@ -73,12 +77,7 @@ bool FLuaUDelegate::Fetch(lua_State* L, int32 Index, UFunction* InFunction, FScr
 		return false;
 	}
 
-	ULuaFunctionDelegate* FunctionDelegate = ULuaFunctionDelegate::Fetch(L, Index);
-
-	FunctionDelegate->BindSignatureFunction(InFunction);
-	InScriptDelegate->BindUFunction(FunctionDelegate, ULuaFunctionDelegate::DelegateFunctionName);
-
-	return true;
+	return ULuaDelegateDispatcher::FetchDelegate(L, Index, InFunction, nullptr, *InScriptDelegate);
 }
 
 int FLuaUDelegate::Index(lua_State* L)
@@ -118,15 +117,45 @@ int FLuaUDelegate::Add(lua_State* L)
 	}
 
 	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
-	if (!LuaStateWrapper)
+	ULuaDelegateDispatcher* Dispatcher = LuaStateWrapper ? LuaStateWrapper->GetDelegateDispatcher() : nullptr;
+
+	// all lua listeners of a multicast delegate share one UE binding, params are pushed once per broadcast
+	int32 Slot = INDEX_NONE;
+	if (Dispatcher && LuaUDelegate->SupportsFanOut() && LuaUDelegate->Owner.IsValid()
+		&& ULuaDelegateDispatcher::FetchBinding(L, 2, Slot) && Slot != INDEX_NONE
+		&& ULuaDelegateDispatcher::CanFanOut(LuaUDelegate->Function))
+	{
+		const int32 GroupSlot = Dispatcher->FindOrCreateGroup(LuaUDelegate->Source, LuaUDelegate->Owner.Get(), LuaUDelegate->Function);
+
+		FScriptDelegate GroupDelegate;
+		if (Dispatcher->MakeDelegate(GroupSlot, LuaUDelegate->Function, LuaUDelegate->Source, GroupDelegate))
+		{
+			if (!LuaUDelegate->OnContains(GroupDelegate))
+			{
+				LuaUDelegate->OnAdd(GroupDelegate);
+				Dispatcher->TrackBoundDelegate(GroupSlot, LuaUDelegate->Source, LuaUDelegate->Owner.Get(), LuaUDelegate->Function, LuaUDelegate->GetUnbindFunc());
+			}
+
+			Dispatcher->AddToGroup(GroupSlot, Slot);
+
+			lua_pushboolean(L, 1);
+			return 1;
+		}
+	}
+
+	FScriptDelegate Delegate;
+	if (!ULuaDelegateDispatcher::FetchDelegate(L, 2, LuaUDelegate->Function, LuaUDelegate->Source, Delegate))
 	{
 		return 0;
 	}
 
-	ULuaFunctionDelegate* FunctionDelegate = ULuaFunctionDelegate::Fetch(L, 2);
-	FunctionDelegate->BindSignatureFunction(LuaUDelegate->Function);
+	LuaUDelegate->OnAdd(Delegate);
 
-	LuaUDelegate->OnAdd(FunctionDelegate);
+	// release unbinds the slot from this delegate
+	if (Dispatcher && ULuaDelegateDispatcher::FetchBinding(L, 2, Slot) && Slot != INDEX_NONE)
+	{
+		Dispatcher->TrackBoundDelegate(Slot, LuaUDelegate->Source, LuaUDelegate->Owner.Get(), LuaUDelegate->Function, LuaUDelegate->GetUnbindFunc());
+	}
 
 	lua_pushboolean(L, 1);
 	return 1;
@@ -135,15 +164,36 @@ int FLuaUDelegate::Add(lua_State* L)
 int FLuaUDelegate::Remove(lua_State* L)
 {
 	FLuaUDelegate* LuaUDelegate = (FLuaUDelegate*)luaL_checkudata(L, 1, UDELEGATE_METATABLE);
+	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
+
+	int32 Slot = INDEX_NONE;
+	if (ULuaDelegateDispatcher::FetchBinding(L, 2, Slot))
+	{
+		ULuaDelegateDispatcher* Dispatcher = LuaStateWrapper ? LuaStateWrapper->GetDelegateDispatcher() : nullptr;
+		if (Dispatcher && Slot != INDEX_NONE)
+		{
+			// releasing the last listener of a group unbinds the group too
+			FScriptDelegate Delegate;
+			Delegate.BindUFunction(Dispatcher, ULuaDelegateDispatcher::GetBindingFunctionName(Slot));
+
+			LuaUDelegate->OnRemove(Delegate);
+			Dispatcher->ReleaseBinding(Slot);
+		}
+
+		return 0;
+	}
+
 	ULuaFunctionDelegate* FunctionDelegate = ULuaFunctionDelegate::Fetch(L, 2);
 
-	FLuaState* LuaStateWrapper = FLuaState::GetStateWrapper(L);
 	if (LuaStateWrapper)
 	{
 		LuaStateWrapper->RemoveReference(FunctionDelegate, FunctionDelegate->GetOuter());
 	}
 
-	LuaUDelegate->OnRemove(FunctionDelegate);
+	FScriptDelegate Delegate;
+	Delegate.BindUFunction(FunctionDelegate, ULuaFunctionDelegate::DelegateFunctionName);
+
+	LuaUDelegate->OnRemove(Delegate);
 
 	return 0;
 }
@@ -163,6 +213,13 @@ int FLuaUDelegate::Clear(lua_State* L)
 		}
 	}
 
+	// bindings added through this delegate
+	ULuaDelegateDispatcher* Dispatcher = LuaStateWrapper ? LuaStateWrapper->GetDelegateDispatcher() : nullptr;
+	if (Dispatcher)
+	{
+		Dispatcher->ReleaseBindingsBySource(LuaUDelegate->Source);
+	}
+
 	LuaUDelegate->OnClear();
 
 	return 0;
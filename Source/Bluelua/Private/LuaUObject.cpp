@@ -8,6 +8,8 @@
 
 #include "Bluelua.h"
 #include "lua.hpp"
+#include "LuaBindingRegistry.h"
+#include "LuaBridgeStats.h"
 #include "LuaState.h"
 #include "LuaImplementableInterface.h"
 
@@ -55,6 +57,7 @@ int FLuaUObject::Push(lua_State* L, UObject* InSource, UObject* InParent/* = nul
 	}
 
 	void* Buffer = lua_newuserdata(L, sizeof(FLuaUObject));
+	FLuaBridgeStats::OnProxyCreated();
 	FLuaUObject* LuaUObject = new(Buffer) FLuaUObject(InSource, InParent);
 
 	if (luaL_newmetatable(L, UOBJECT_METATABLE))
@@ -145,8 +148,22 @@ int FLuaUObject::Index(lua_State* L)
 
 	UClass* Class = LuaUObject->Source->GetClass();
 
+	if (!bIsParentDefaultFunction)
+	{
+		const int32 MemberNum = FLuaBindingRegistry::PushMember(L, Class, *PropertyName, LuaUObject->Source.Get());
+		if (MemberNum >= 0)
+		{
+			return MemberNum;
+		}
+	}
+
 	if (UFunction* Function = Class->FindFunctionByName(*PropertyName))
 	{
+		if (!bIsParentDefaultFunction && FLuaBindingRegistry::PushBinding(L, Function))
+		{
+			return 1;
+		}
+
 		lua_pushboolean(L, bIsParentDefaultFunction);
 		lua_pushlightuserdata(L, Function);
 		lua_pushcclosure(L, CallUFunction, 2);
@@ -183,6 +200,11 @@ int FLuaUObject::NewIndex(lua_State* L)
 
 	const char* PropertyName = lua_tostring(L, 2);
 	UClass* Class = LuaUObject->Source->GetClass();
+	if (FLuaBindingRegistry::SetMember(L, Class, PropertyName, LuaUObject->Source.Get(), 3))
+	{
+		return 0;
+	}
+
 	UProperty* Property = Class->FindPropertyByName(PropertyName);
 	if (Property)
 	{
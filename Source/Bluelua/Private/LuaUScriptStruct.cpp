@@ -5,6 +5,7 @@
 
 #include "Bluelua.h"
 #include "lua.hpp"
+#include "LuaBridgeStats.h"
 #include "LuaState.h"
 #include "LuaUStruct.h"
 
@@ -41,6 +42,7 @@ int FLuaUScriptStruct::Push(lua_State* L, UScriptStruct* InSource)
 	}
 
 	void* Buffer = lua_newuserdata(L, sizeof(FLuaUScriptStruct));
+	FLuaBridgeStats::OnProxyCreated();
 	FLuaUScriptStruct* LuaUScriptStruct = new(Buffer) FLuaUScriptStruct(InSource);
 
 	if (luaL_newmetatable(L, USCRIPTSTRUCT_METATABLE))
@@ -6,6 +6,8 @@
 
 #include "Bluelua.h"
 #include "lua.hpp"
+#include "LuaBindingRegistry.h"
+#include "LuaBridgeStats.h"
 
 DECLARE_CYCLE_STAT(TEXT("StructPush"), STAT_StructPush, STATGROUP_Bluelua);
 DECLARE_CYCLE_STAT(TEXT("StructIndex"), STAT_StructIndex, STATGROUP_Bluelua);
@@ -13,10 +15,15 @@ DECLARE_CYCLE_STAT(TEXT("StructNewIndex"), STAT_StructNewIndex, STATGROUP_Bluelu
 
 const char* FLuaUStruct::USTRUCT_METATABLE = "UStruct_Metatable";
 
+// views pushed by PushBorrowed that are still valid, innermost scope last, collected views are nulled
+static TArray<FLuaUStruct*> BorrowedStructs;
+static int32 BorrowScopeDepth = 0;
+
 FLuaUStruct::FLuaUStruct(UScriptStruct* InSource, uint8* InScriptBuffer, bool InbCopyValue)
 	: Source(InSource)
 	, ScriptBuffer(InScriptBuffer)
 	, bCopyValue(InbCopyValue)
+	, bBorrowed(false)
 {
 
 }
@@ -31,6 +38,16 @@ int32 FLuaUStruct::GetStructureSize() const
 	return Source.IsValid() ? Source->GetStructureSize() : 0;
 }
 
+UScriptStruct* FLuaUStruct::GetSource() const
+{
+	return Source.Get();
+}
+
+uint8* FLuaUStruct::GetScriptBuffer() const
+{
+	return ScriptBuffer;
+}
+
 int FLuaUStruct::Push(lua_State* L, UScriptStruct* InSource, void* InBuffer /*= nullptr*/, bool InbCopyValue/* = true*/)
 {
 	SCOPE_CYCLE_COUNTER(STAT_StructPush);
@@ -42,6 +59,7 @@ int FLuaUStruct::Push(lua_State* L, UScriptStruct* InSource, void* InBuffer /*=
 	}
 
 	uint8* UserData = (uint8*)lua_newuserdata(L, sizeof(FLuaUStruct));
+	FLuaBridgeStats::OnProxyCreated();
 
 	uint8* ScriptBuffer = (uint8*)InBuffer;
 	if (InbCopyValue)
@@ -76,6 +94,66 @@ int FLuaUStruct::Push(lua_State* L, UScriptStruct* InSource, void* InBuffer /*=
 	return 1;
 }
 
+int FLuaUStruct::PushBorrowed(lua_State* L, UScriptStruct* InSource, void* InBuffer)
+{
+	if (BorrowScopeDepth == 0 || !InBuffer || !IsInGameThread())
+	{
+		return Push(L, InSource, InBuffer, true);
+	}
+
+	Push(L, InSource, InBuffer, false);
+
+	if (FLuaUStruct* LuaUStruct = ToLuaUStruct(L, -1))
+	{
+		LuaUStruct->bBorrowed = true;
+		BorrowedStructs.Add(LuaUStruct);
+	}
+
+	return 1;
+}
+
+FLuaUStruct::FBorrowScope::FBorrowScope()
+	: FirstBorrowed(INDEX_NONE)
+{
+	// other threads keep copying
+	if (IsInGameThread())
+	{
+		FirstBorrowed = BorrowedStructs.Num();
+		++BorrowScopeDepth;
+	}
+}
+
+FLuaUStruct::FBorrowScope::~FBorrowScope()
+{
+	if (FirstBorrowed == INDEX_NONE)
+	{
+		return;
+	}
+
+	for (int32 Index = FirstBorrowed; Index < BorrowedStructs.Num(); ++Index)
+	{
+		if (BorrowedStructs[Index])
+		{
+			BorrowedStructs[Index]->ScriptBuffer = nullptr;
+		}
+	}
+
+	BorrowedStructs.SetNum(FirstBorrowed, false);
+	--BorrowScopeDepth;
+}
+
+FLuaUStruct* FLuaUStruct::CheckLuaUStruct(lua_State* L, int32 Index)
+{
+	FLuaUStruct* LuaUStruct = (FLuaUStruct*)luaL_checkudata(L, Index, USTRUCT_METATABLE);
+	if (LuaUStruct->bBorrowed && !LuaUStruct->ScriptBuffer)
+	{
+		luaL_error(L, "Struct[%s] was borrowed for a call that has returned! Call Copy() on it during the call to keep it!",
+			LuaUStruct->Source.IsValid() ? TCHAR_TO_UTF8(*LuaUStruct->Source->GetName()) : "null");
+	}
+
+	return LuaUStruct;
+}
+
 bool FLuaUStruct::Fetch(lua_State* L, int32 Index, UScriptStruct* OutStruct, uint8* OutBuffer)
 {
 	if (!OutStruct || lua_isnil(L, Index))
@@ -106,7 +184,7 @@ bool FLuaUStruct::Fetch(lua_State* L, int32 Index, UScriptStruct* OutStruct, uin
 		return true;
 	}
 
-	FLuaUStruct* LuaUStruct = (FLuaUStruct*)luaL_checkudata(L, Index, FLuaUStruct::USTRUCT_METATABLE);
+	FLuaUStruct* LuaUStruct = CheckLuaUStruct(L, Index);
 
 	//const int32 TargetSize = StructProperty->Struct->GetStructureSize();
 	//const int32 SourceSize = LuaUStruct->GetStructureSize();
@@ -126,20 +204,45 @@ bool FLuaUStruct::Fetch(lua_State* L, int32 Index, UScriptStruct* OutStruct, uin
 	//}
 }
 
+FLuaUStruct* FLuaUStruct::ToLuaUStruct(lua_State* L, int32 Index)
+{
+	return (FLuaUStruct*)luaL_testudata(L, Index, USTRUCT_METATABLE);
+}
+
 int FLuaUStruct::Index(lua_State* L)
 {
 	SCOPE_CYCLE_COUNTER(STAT_StructIndex);
 
-	FLuaUStruct* LuaUStruct = (FLuaUStruct*)luaL_checkudata(L, 1, USTRUCT_METATABLE);
+	FLuaUStruct* LuaUStruct = CheckLuaUStruct(L, 1);
 	if (!LuaUStruct->Source.IsValid())
 	{
 		return 0;
 	}
 
 	const char* PropertyName = lua_tostring(L, 2);
+	const int32 MemberNum = FLuaBindingRegistry::PushMember(L, LuaUStruct->Source.Get(), PropertyName, LuaUStruct->ScriptBuffer);
+	if (MemberNum >= 0)
+	{
+		return MemberNum;
+	}
+
 	if (UProperty* Property = FindStructPropertyByName(LuaUStruct->Source.Get(), PropertyName))
 	{
-		return FLuaObjectBase::PushProperty(L, Property, Property->ContainerPtrToValuePtr<uint8>(LuaUStruct->ScriptBuffer), nullptr, false);
+		uint8* ValuePtr = Property->ContainerPtrToValuePtr<uint8>(LuaUStruct->ScriptBuffer);
+
+		// members of a borrowed struct are only valid as long as it is
+		UStructProperty* StructProperty = LuaUStruct->bBorrowed ? Cast<UStructProperty>(Property) : nullptr;
+		if (StructProperty)
+		{
+			return PushBorrowed(L, StructProperty->Struct, ValuePtr);
+		}
+
+		return FLuaObjectBase::PushProperty(L, Property, ValuePtr, nullptr, false);
+	}
+	else if (FCStringAnsi::Strcmp(PropertyName, "Copy") == 0)
+	{
+		lua_pushcfunction(L, Copy);
+		return 1;
 	}
 
 	return 0;
@@ -149,13 +252,25 @@ int FLuaUStruct::NewIndex(lua_State* L)
 {
 	SCOPE_CYCLE_COUNTER(STAT_StructNewIndex);
 
-	FLuaUStruct* LuaUStruct = (FLuaUStruct*)luaL_checkudata(L, 1, USTRUCT_METATABLE);
+	FLuaUStruct* LuaUStruct = CheckLuaUStruct(L, 1);
 	if (!LuaUStruct->Source.IsValid())
 	{
 		return 0;
 	}
 
 	const char* PropertyName = lua_tostring(L, 2);
+
+	// writes would go to the caller's memory
+	if (LuaUStruct->bBorrowed)
+	{
+		luaL_error(L, "Can't write property[%s] to a borrowed struct[%s]! Call Copy() on it to get a writable value!", PropertyName, TCHAR_TO_UTF8(*(LuaUStruct->Source->GetName())));
+	}
+
+	if (FLuaBindingRegistry::SetMember(L, LuaUStruct->Source.Get(), PropertyName, LuaUStruct->ScriptBuffer, 3))
+	{
+		return 0;
+	}
+
 	UProperty* Property = FindStructPropertyByName(LuaUStruct->Source.Get(), PropertyName);
 	if (Property)
 	{
@@ -178,6 +293,16 @@ int FLuaUStruct::GC(lua_State* L)
 {
 	FLuaUStruct* LuaUStruct = (FLuaUStruct*)luaL_checkudata(L, 1, USTRUCT_METATABLE);
 
+	// open scopes keep indices into BorrowedStructs
+	if (LuaUStruct->bBorrowed && LuaUStruct->ScriptBuffer)
+	{
+		const int32 BorrowedIndex = BorrowedStructs.FindLast(LuaUStruct);
+		if (BorrowedIndex != INDEX_NONE)
+		{
+			BorrowedStructs[BorrowedIndex] = nullptr;
+		}
+	}
+
 	if (LuaUStruct->bCopyValue)
 	{
 		if (LuaUStruct->Source.IsValid() && LuaUStruct->ScriptBuffer)
@@ -204,6 +329,13 @@ int FLuaUStruct::ToString(lua_State* L)
 	return 1;
 }
 
+int FLuaUStruct::Copy(lua_State* L)
+{
+	FLuaUStruct* LuaUStruct = CheckLuaUStruct(L, 1);
+
+	return Push(L, LuaUStruct->Source.Get(), LuaUStruct->ScriptBuffer, true);
+}
+
 class UProperty* FLuaUStruct::FindStructPropertyByName(UScriptStruct* Source, FName Name)
 {
 	UProperty* Property = Source->FindPropertyByName(Name);
@@ -0,0 +1,413 @@
+#include "LuaWorkerPool.h"
+
+#include "Async/Async.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+
+#include "Bluelua.h"
+#include "lua.hpp"
+#include "LuaChunkCache.h"
+#include "LuaLog.h"
+#include "LuaSerializer.h"
+#include "LuaState.h"
+
+DECLARE_CYCLE_STAT(TEXT("LuaWorkerJob"), STAT_LuaWorkerJob, STATGROUP_Bluelua);
+
+static TAutoConsoleVariable<int32> CVarLuaWorkerMaxStates(
+	TEXT("bluelua.Worker.MaxStates"),
+	0,
+	TEXT("Max number of lua worker states, 0 uses the number of task graph worker threads."));
+
+static TAutoConsoleVariable<float> CVarLuaWorkerJobTimeBudget(
+	TEXT("bluelua.Worker.JobTimeBudget"),
+	0.f,
+	TEXT("Seconds a lua worker job may run before it is stopped with an error, 0 means no limit. Jobs are always stopped on shutdown."));
+
+static TAutoConsoleVariable<FString> CVarLuaWorkerAllowedModules(
+	TEXT("bluelua.Worker.AllowedModules"),
+	TEXT(""),
+	TEXT("Comma separated module names or wildcards like \"ai.scoring.*\" that worker states may require, usually set in the [ConsoleVariables] section of DefaultEngine.ini."));
+
+// instructions between two checks of the worker hook
+static const int32 LuaWorkerHookCount = 10000;
+
+// registry keys of worker states, compared by address, not const so they can't be merged
+static char WorkerPoolKey = 0;
+static char WorkerDeadlineKey = 0;
+
+FLuaWorkerPool::FLuaWorkerPool()
+	: NumStates(0)
+	, bShuttingDown(false)
+{
+}
+
+FLuaWorkerPool::~FLuaWorkerPool()
+{
+	Shutdown();
+}
+
+TFuture<FLuaWorkerResult> FLuaWorkerPool::Submit(const FString& ModuleName, const FString& FunctionName, TArray<uint8>&& Arguments)
+{
+	TSharedPtr<FLuaWorkerJob, ESPMode::ThreadSafe> Job = MakeShared<FLuaWorkerJob, ESPMode::ThreadSafe>();
+	Job->ModuleName = ModuleName;
+	Job->FunctionName = FunctionName;
+	Job->Arguments = MoveTemp(Arguments);
+
+	RefreshConfiguredModules();
+
+	TFuture<FLuaWorkerResult> Future = Job->Promise.GetFuture();
+
+	{
+		FScopeLock Lock(&JobsLock);
+		if (bShuttingDown)
+		{
+			FLuaWorkerResult Result;
+			Result.Error = TEXT("lua worker pool is shut down");
+			Job->Promise.SetValue(MoveTemp(Result));
+
+			return Future;
+		}
+
+		PendingJobs.Add(Job);
+	}
+
+	TryDispatch();
+
+	return Future;
+}
+
+void FLuaWorkerPool::AddAllowedModules(const TArray<FString>& ModuleNames)
+{
+	FScopeLock Lock(&AllowedModulesLock);
+
+	for (const FString& ModuleName : ModuleNames)
+	{
+		AllowedModules.AddUnique(ModuleName);
+	}
+}
+
+bool FLuaWorkerPool::IsModuleAllowed(const FString& ModuleName) const
+{
+	FScopeLock Lock(&AllowedModulesLock);
+
+	for (const FString& AllowedModule : AllowedModules)
+	{
+		if (ModuleName.MatchesWildcard(AllowedModule, ESearchCase::CaseSensitive))
+		{
+			return true;
+		}
+	}
+
+	for (const FString& AllowedModule : ConfiguredModules)
+	{
+		if (ModuleName.MatchesWildcard(AllowedModule, ESearchCase::CaseSensitive))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void FLuaWorkerPool::RefreshConfiguredModules()
+{
+	const FString& Value = CVarLuaWorkerAllowedModules.GetValueOnGameThread();
+
+	FScopeLock Lock(&AllowedModulesLock);
+
+	if (Value == ConfiguredModulesValue)
+	{
+		return;
+	}
+
+	ConfiguredModulesValue = Value;
+	ConfiguredModules.Reset();
+	Value.ParseIntoArray(ConfiguredModules, TEXT(","), true);
+
+	for (FString& ModuleName : ConfiguredModules)
+	{
+		ModuleName.TrimStartAndEndInline();
+	}
+}
+
+void FLuaWorkerPool::Shutdown()
+{
+	TArray<TSharedPtr<FLuaWorkerJob, ESPMode::ThreadSafe>> CanceledJobs;
+	{
+		FScopeLock Lock(&JobsLock);
+
+		bShuttingDown = true;
+		CanceledJobs = MoveTemp(PendingJobs);
+	}
+
+	for (auto& Job : CanceledJobs)
+	{
+		FLuaWorkerResult Result;
+		Result.Error = TEXT("lua worker pool is shut down");
+		Job->Promise.SetValue(MoveTemp(Result));
+	}
+
+	while (RunningWorkers.GetValue() > 0)
+	{
+		FPlatformProcess::Sleep(0.001f);
+	}
+
+	FScopeLock Lock(&JobsLock);
+
+	for (lua_State* WorkerL : IdleStates)
+	{
+		lua_close(WorkerL);
+	}
+
+	IdleStates.Empty();
+	NumStates = 0;
+}
+
+void FLuaWorkerPool::TryDispatch()
+{
+	lua_State* WorkerL = nullptr;
+	{
+		FScopeLock Lock(&JobsLock);
+
+		if (bShuttingDown || PendingJobs.Num() == 0)
+		{
+			return;
+		}
+
+		int32 MaxStates = CVarLuaWorkerMaxStates.GetValueOnAnyThread();
+		if (MaxStates <= 0)
+		{
+			MaxStates = FMath::Max(1, FTaskGraphInterface::Get().GetNumWorkerThreads());
+		}
+
+		if (IdleStates.Num() > 0)
+		{
+			WorkerL = IdleStates.Pop(false);
+		}
+		else if (NumStates < MaxStates)
+		{
+			// state is created on the worker thread
+			++NumStates;
+		}
+		else
+		{
+			// running workers pick up the job when they finish
+			return;
+		}
+
+		RunningWorkers.Increment();
+	}
+
+	TSharedRef<FLuaWorkerPool, ESPMode::ThreadSafe> WorkerPool = AsShared();
+
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [WorkerPool, WorkerL]()
+	{
+		WorkerPool->RunWorker(WorkerL);
+	});
+}
+
+void FLuaWorkerPool::RunWorker(lua_State* WorkerL)
+{
+	if (!WorkerL)
+	{
+		WorkerL = CreateWorkerState();
+	}
+
+	if (!WorkerL)
+	{
+		UE_LOG(LogBluelua, Error, TEXT("Lua worker state create failed!"));
+
+		FScopeLock Lock(&JobsLock);
+		--NumStates;
+		RunningWorkers.Decrement();
+		return;
+	}
+
+	while (true)
+	{
+		TSharedPtr<FLuaWorkerJob, ESPMode::ThreadSafe> Job;
+		{
+			FScopeLock Lock(&JobsLock);
+
+			if (bShuttingDown || PendingJobs.Num() == 0)
+			{
+				IdleStates.Add(WorkerL);
+				break;
+			}
+
+			Job = PendingJobs[0];
+			PendingJobs.RemoveAt(0, 1, false);
+		}
+
+		RunJob(WorkerL, *Job);
+	}
+
+	RunningWorkers.Decrement();
+}
+
+void FLuaWorkerPool::RunJob(lua_State* WorkerL, FLuaWorkerJob& Job)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuaWorkerJob);
+
+	FLuaWorkerResult Result;
+
+	const int32 Top = lua_gettop(WorkerL);
+
+	const float TimeBudget = CVarLuaWorkerJobTimeBudget.GetValueOnAnyThread();
+	lua_pushnumber(WorkerL, TimeBudget > 0.f ? FPlatformTime::Seconds() + TimeBudget : 0.0);
+	lua_rawsetp(WorkerL, LUA_REGISTRYINDEX, &WorkerDeadlineKey);
+
+	lua_pushcfunction(WorkerL, WorkerTraceback);
+	const int32 TracebackIndex = lua_gettop(WorkerL);
+
+	lua_getglobal(WorkerL, "require");
+	lua_pushstring(WorkerL, TCHAR_TO_UTF8(*Job.ModuleName));
+	if (LUA_OK != lua_pcall(WorkerL, 1, 1, TracebackIndex))
+	{
+		Result.Error = UTF8_TO_TCHAR(lua_tostring(WorkerL, -1));
+	}
+	else if (!lua_istable(WorkerL, -1) || LUA_TFUNCTION != lua_getfield(WorkerL, -1, TCHAR_TO_UTF8(*Job.FunctionName)))
+	{
+		Result.Error = FString::Printf(TEXT("can't find function[%s] in module[%s]"), *Job.FunctionName, *Job.ModuleName);
+	}
+	else
+	{
+		const int32 FunctionIndex = lua_gettop(WorkerL);
+
+		// worker states can't touch reflection, structs are rejected
+		FLuaSerializer Serializer(false);
+
+		const int32 ArgumentsCount = Serializer.Deserialize(WorkerL, Job.Arguments);
+		if (ArgumentsCount == INDEX_NONE)
+		{
+			Result.Error = FString::Printf(TEXT("malformed job arguments, %s"), *Serializer.GetError());
+		}
+		else if (LUA_OK != lua_pcall(WorkerL, ArgumentsCount, LUA_MULTRET, TracebackIndex))
+		{
+			Result.Error = UTF8_TO_TCHAR(lua_tostring(WorkerL, -1));
+		}
+		else if (Serializer.Serialize(WorkerL, FunctionIndex, lua_gettop(WorkerL) - FunctionIndex + 1, Result.Payload))
+		{
+			Result.bSuccess = true;
+		}
+		else
+		{
+			Result.Error = Serializer.GetError();
+		}
+	}
+
+	lua_settop(WorkerL, Top);
+
+	if (!Result.bSuccess)
+	{
+		UE_LOG(LogBluelua, Warning, TEXT("Lua worker job[%s.%s] failed! %s"), *Job.ModuleName, *Job.FunctionName, *Result.Error);
+	}
+
+	Job.Promise.SetValue(MoveTemp(Result));
+}
+
+lua_State* FLuaWorkerPool::CreateWorkerState()
+{
+	lua_State* WorkerL = luaL_newstate();
+	if (!WorkerL)
+	{
+		return nullptr;
+	}
+
+	// no io, os, debug and file loading, worker code only transforms data
+	FLuaState::OpenLibraries(WorkerL, ELuaStateProfile::Worker);
+
+	// print and Log write to the lock-free log ring, safe off the game thread
+	FLuaLog::Register(WorkerL, nullptr);
+
+	// package.searchers = { preload, allowed modules }
+	lua_getglobal(WorkerL, "package");
+	lua_getfield(WorkerL, -1, "searchers");
+	const int32 SearchersIndex = lua_gettop(WorkerL);
+
+	for (int32 Index = lua_rawlen(WorkerL, SearchersIndex); Index > 1; --Index)
+	{
+		lua_pushnil(WorkerL);
+		lua_rawseti(WorkerL, SearchersIndex, Index);
+	}
+
+	lua_pushlightuserdata(WorkerL, this);
+	lua_pushcclosure(WorkerL, WorkerSearcher, 1);
+	lua_rawseti(WorkerL, SearchersIndex, 2);
+
+	lua_pushnil(WorkerL);
+	lua_setfield(WorkerL, -3, "loadlib");
+
+	lua_pop(WorkerL, 2);
+
+	lua_pushboolean(WorkerL, true);
+	lua_setglobal(WorkerL, "IsLuaWorker");
+
+	// a looping job would keep Shutdown waiting forever
+	lua_pushlightuserdata(WorkerL, this);
+	lua_rawsetp(WorkerL, LUA_REGISTRYINDEX, &WorkerPoolKey);
+	lua_sethook(WorkerL, WorkerHook, LUA_MASKCOUNT, LuaWorkerHookCount);
+
+	return WorkerL;
+}
+
+int FLuaWorkerPool::WorkerSearcher(lua_State* L)
+{
+	FLuaWorkerPool* WorkerPool = (FLuaWorkerPool*)lua_touserdata(L, lua_upvalueindex(1));
+
+	const char* ModuleName = luaL_checkstring(L, 1);
+	const FString ModuleNameString = UTF8_TO_TCHAR(ModuleName);
+
+	if (!WorkerPool || !WorkerPool->IsModuleAllowed(ModuleNameString))
+	{
+		lua_pushfstring(L, "\n\tmodule '%s' is not allowed in lua worker", ModuleName);
+		return 1;
+	}
+
+	FString FilePath;
+	TArray<uint8> FileContent;
+	if (!FLuaChunkCache::ResolveModulePath(ModuleNameString, FilePath) || !FFileHelper::LoadFileToArray(FileContent, *FilePath))
+	{
+		lua_pushfstring(L, "\n\tno lua worker module '%s'", ModuleName);
+		return 1;
+	}
+
+	if (LUA_OK != luaL_loadbuffer(L, (const char*)FileContent.GetData(), FileContent.Num(), TCHAR_TO_UTF8(*FLuaChunkCache::MakeChunkName(FilePath))))
+	{
+		return luaL_error(L, "error loading module '%s': %s", ModuleName, lua_tostring(L, -1));
+	}
+
+	lua_pushstring(L, TCHAR_TO_UTF8(*FilePath));
+
+	return 2;
+}
+
+int FLuaWorkerPool::WorkerTraceback(lua_State* L)
+{
+	luaL_traceback(L, L, lua_tostring(L, 1), 1);
+
+	return 1;
+}
+
+void FLuaWorkerPool::WorkerHook(lua_State* L, lua_Debug* Ar)
+{
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &WorkerPoolKey);
+	const FLuaWorkerPool* WorkerPool = (const FLuaWorkerPool*)lua_touserdata(L, -1);
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &WorkerDeadlineKey);
+	const double Deadline = lua_tonumber(L, -1);
+	lua_pop(L, 2);
+
+	if (WorkerPool && WorkerPool->bShuttingDown)
+	{
+		luaL_error(L, "lua worker pool is shutting down");
+	}
+
+	if (Deadline > 0.0 && FPlatformTime::Seconds() > Deadline)
+	{
+		luaL_error(L, "lua worker job ran out of its time budget, see bluelua.Worker.JobTimeBudget");
+	}
+}
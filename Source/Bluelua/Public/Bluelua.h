@@ -3,6 +3,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Containers/Ticker.h"
 #include "Modules/ModuleManager.h"
 #include "Stats/Stats.h"
 
@@ -11,6 +12,7 @@ DECLARE_LOG_CATEGORY_EXTERN(LogBluelua, Log, All);
 DECLARE_STATS_GROUP(TEXT("Bluelua"), STATGROUP_Bluelua, STATCAT_Advanced);
 
 class FLuaState;
+class FLuaWorkerPool;
 
 class BLUELUA_API FBlueluaModule : public IModuleInterface
 {
@@ -22,8 +24,14 @@ public:
 
 	TSharedPtr<FLuaState> GetDefaultLuaState();
 
+	// the next GetDefaultLuaState takes a prepared state from the pool
 	void ResetDefaultLuaState();
 
+	// a fresh lua state with the game or dedicated server profile, prepared ahead of time if the pool has one
+	TSharedPtr<FLuaState> CreateLuaState();
+
+	TSharedRef<FLuaWorkerPool, ESPMode::ThreadSafe> GetWorkerPool();
+
 	static inline FBlueluaModule& Get()
 	{
 		return FModuleManager::LoadModuleChecked<FBlueluaModule>("Bluelua");
@@ -34,6 +42,22 @@ public:
 		return FModuleManager::Get().IsModuleLoaded("Bluelua");
 	}
 
+protected:
+	// build at most one state per frame until the pool is full, refilling waits for bluelua.StatePool.RefillDelay,
+	// outside the editor the pool stays empty until a default state has been reset once
+	bool PrepareLuaStates(float DeltaTime);
+
+	TSharedPtr<FLuaState> BuildLuaState(const TCHAR* Reason);
+
 protected:
 	TSharedPtr<FLuaState> DefaultLuaState;
+
+	// idle states built while nothing waits for them
+	TArray<TSharedPtr<FLuaState>> PreparedLuaStates;
+
+	FDelegateHandle PrepareTickerHandle;
+	double LastStateTakenTime = 0.0;
+	bool bLuaStateReset = false;
+
+	TSharedPtr<FLuaWorkerPool, ESPMode::ThreadSafe> WorkerPool;
 };
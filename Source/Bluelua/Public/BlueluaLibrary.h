@@ -6,6 +6,8 @@
 #include "Kismet/BlueprintFunctionLibrary.h"
 #include "BlueluaLibrary.generated.h"
 
+DECLARE_DYNAMIC_DELEGATE(FBlueluaDelayDelegate);
+
 UCLASS()
 class BLUELUA_API UBlueluaLibrary : public UBlueprintFunctionLibrary
 {
@@ -26,6 +28,25 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Utilities|BlueluaLibrary", meta = (WorldContext = "WorldContextObject", Duration = "0.2"))
 	static int32 Delay(UObject* WorldContextObject, float Duration, int32 InDelegateId, class ULuaFunctionDelegate* InDelegate);
 
+	/**
+	* Perform a delegate with a delay (specified in seconds).  Calling again with the same delegate while it is counting down will be ignored.
+	* A lua binding passed in is released once the delay is done or aborted.
+	*
+	* @param WorldContext	World context.
+	* @param Duration 		length of delay (in seconds).
+	* @param InDelegate 	The delegate, e.g. a lua binding created by CreateFunctionDelegate.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "Utilities|BlueluaLibrary", meta = (WorldContext = "WorldContextObject", Duration = "0.2"))
+	static int32 DelayBinding(UObject* WorldContextObject, float Duration, FBlueluaDelayDelegate InDelegate);
+
+	/**
+	* Compile lua modules to bytecode on worker threads, later require of these modules only load the bytecode.
+	*
+	* @param ModuleNames	Module names used by require, e.g. "Lua.Blueprints.Character".
+	*/
+	UFUNCTION(BlueprintCallable, Category = "Utilities|BlueluaLibrary")
+	static void PreloadLuaModules(const TArray<FString>& ModuleNames);
+
 	UFUNCTION(BlueprintCallable, Category = "Utilities|BlueluaLibrary")
 	static void BindAction(AActor* TargetActor, FName ActionName, EInputEvent KeyEvent, bool InbConsumeInput, bool InbExecuteWhenPaused, FInputActionHandlerDynamicSignature Action);
 
@@ -11,11 +11,13 @@ public:
 	virtual ~FLuaScriptDelegate();
 
 	static FLuaUDelegate* Create(lua_State* L, void* InSource, UFunction* InFunction);
+	static void Unbind(void* InSource, UFunction* InFunction, const FScriptDelegate& Delegate);
 
 protected:
-	virtual void OnAdd(ULuaFunctionDelegate* LuaFunctionDelegate) override;
-	virtual void OnRemove(ULuaFunctionDelegate* LuaFunctionDelegate) override;
+	virtual void OnAdd(const FScriptDelegate& Delegate) override;
+	virtual void OnRemove(const FScriptDelegate& Delegate) override;
 	virtual void OnClear() override;
 	virtual TArray<UObject*> OnGetAllObjects() const override;
 	virtual FString OnGetName() override;
+	virtual FUnbindDelegateFuncPtr GetUnbindFunc() const override;
 };
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct BLUELUA_API FLuaAllocatorStats
+{
+	// bytes asked by lua for blocks served from slabs
+	uint64 SmallRequestedBytes = 0;
+	// bytes of size class blocks in use, includes rounding waste
+	uint64 SmallBlockBytes = 0;
+	// bytes of blocks forwarded to FMemory
+	uint64 LargeBytes = 0;
+	// bytes of all slabs currently owned
+	uint64 SlabBytes = 0;
+	uint64 HighWaterBytes = 0;
+	uint64 AllocationCount = 0;
+	int32 SlabCount = 0;
+	int32 EmptySlabCount = 0;
+
+	uint64 GetBytesInUse() const
+	{
+		return SmallBlockBytes + LargeBytes;
+	}
+
+	// share of slab memory not used by live blocks, [0, 1]
+	float GetFragmentation() const
+	{
+		return SlabBytes > 0 ? 1.f - (float)((double)SmallRequestedBytes / (double)SlabBytes) : 0.f;
+	}
+};
+
+class BLUELUA_API FLuaAllocator
+{
+public:
+	FLuaAllocator();
+	~FLuaAllocator();
+
+	void* Realloc(void* Ptr, size_t OldSize, size_t NewSize);
+
+	// free slabs that have no live block, returns released bytes
+	int64 ReleaseEmptySlabs();
+
+	const FLuaAllocatorStats& GetStats() const;
+
+	static const uint32 Granularity = 16;
+	static const uint32 MaxSmallSize = 512;
+	static const uint32 NumSizeClasses = MaxSmallSize / Granularity;
+	static const uint32 SlabSize = 64 * 1024;
+
+protected:
+	struct FSlab
+	{
+		FSlab* Prev;
+		FSlab* Next;
+		void* FreeList;
+		uint8* UnusedStart;
+		uint32 SizeClass;
+		uint32 UsedBlocks;
+		uint32 TotalBlocks;
+
+		// os allocation the slab lives in, larger than the slab if the os didn't align it
+		void* Allocation;
+		SIZE_T AllocationSize;
+	};
+
+	static const uint32 SlabHeaderSize;
+
+	static inline uint32 GetSizeClass(size_t Size)
+	{
+		return (uint32)((Size + Granularity - 1) / Granularity) - 1;
+	}
+
+	static inline uint32 GetBlockSize(uint32 SizeClass)
+	{
+		return (SizeClass + 1) * Granularity;
+	}
+
+	static inline FSlab* GetSlab(void* Ptr)
+	{
+		return (FSlab*)((UPTRINT)Ptr & ~((UPTRINT)SlabSize - 1));
+	}
+
+	// realloc of a large block lua thinks is small, see KeptLargeBlocks
+	void* ReallocKept(void* Ptr, size_t KeptSize, size_t NewSize);
+
+	void* Malloc(size_t Size);
+	void Free(void* Ptr, size_t Size);
+
+	void* MallocSmall(uint32 SizeClass);
+	void FreeSmall(void* Ptr, uint32 SizeClass);
+
+	FSlab* NewSlab(uint32 SizeClass);
+	static void FreeSlab(FSlab* Slab);
+	void LinkSlab(FSlab* Slab);
+	void UnlinkSlab(FSlab* Slab);
+
+	void UpdateHighWater();
+
+protected:
+	// slabs that still have free blocks, per size class
+	FSlab* AvailableSlabs[NumSizeClasses];
+
+	// large blocks kept after a shrink to a small size failed, with the size counted in LargeBytes
+	TMap<void*, size_t> KeptLargeBlocks;
+
+	FLuaAllocatorStats Stats;
+};
@@ -0,0 +1,341 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/IntegerSequence.h"
+#include "Templates/Models.h"
+#include "Templates/Tuple.h"
+#include "UObject/Class.h"
+
+#include "lua.hpp"
+#include "LuaBindingRegistry.h"
+#include "LuaUObject.h"
+#include "LuaUStruct.h"
+
+/**
+ * Hand-written bindings for C++ APIs that aren't UFUNCTIONs or UPROPERTYs. Argument and return types are deduced
+ * at compile time and converted with lua_to* and lua_push* directly, no reflection involved.
+ *
+ * BLUELUA_BINDINGS(MyGame)
+ * {
+ *     BLUELUA_BIND_METHOD(AActor, GetActorLocation);
+ *     BLUELUA_BIND_STATIC(UMyLibrary, Distance);
+ *     FLuaBinder<FMyStruct>().Field(TEXT("X"), &FMyStruct::X).ReadOnlyField(TEXT("Id"), &FMyStruct::Id);
+ * }
+ *
+ * Members are found by name on the object, struct or class proxy before reflected members, super classes included.
+ * Non-const reference arguments are returned after the return value like reflected out params.
+ */
+
+struct CLuaStaticStructProvider
+{
+	template<typename T>
+	auto Requires(UScriptStruct*& StructRef) -> decltype(StructRef = T::StaticStruct());
+};
+
+template<typename T, bool bHasStaticStruct = TModels<CLuaStaticStructProvider, T>::Value>
+struct TLuaStruct
+{
+	static UScriptStruct* Get() { return T::StaticStruct(); }
+};
+
+template<typename T>
+struct TLuaStruct<T, false>
+{
+	// noexport core types, e.g. FVector
+	static UScriptStruct* Get() { return TBaseStructure<T>::Get(); }
+};
+
+struct FLuaValueByCopy
+{
+	enum { bByReference = false };
+};
+
+// values without a specialization are treated as USTRUCTs
+template<typename T, typename Enable = void>
+struct TLuaValue
+{
+	enum { bByReference = true };
+
+	static T Fetch(lua_State* L, int32 Index) { return FLuaBindingRegistry::FetchStruct<T>(L, Index, TLuaStruct<T>::Get()); }
+	static int Push(lua_State* L, const T& Value) { return FLuaUStruct::Push(L, TLuaStruct<T>::Get(), (void*)&Value, true); }
+	static int PushReference(lua_State* L, T* Value) { return FLuaUStruct::Push(L, TLuaStruct<T>::Get(), Value, false); }
+};
+
+template<>
+struct TLuaValue<bool> : FLuaValueByCopy
+{
+	static bool Fetch(lua_State* L, int32 Index) { return lua_toboolean(L, Index) != 0; }
+	static int Push(lua_State* L, bool Value) { lua_pushboolean(L, Value); return 1; }
+};
+
+template<typename T>
+struct TLuaValue<T, typename TEnableIf<TIsIntegral<T>::Value>::Type> : FLuaValueByCopy
+{
+	static T Fetch(lua_State* L, int32 Index) { return (T)lua_tointeger(L, Index); }
+	static int Push(lua_State* L, T Value) { lua_pushinteger(L, (lua_Integer)Value); return 1; }
+};
+
+template<typename T>
+struct TLuaValue<T, typename TEnableIf<TIsFloatingPoint<T>::Value>::Type> : FLuaValueByCopy
+{
+	static T Fetch(lua_State* L, int32 Index) { return (T)lua_tonumber(L, Index); }
+	static int Push(lua_State* L, T Value) { lua_pushnumber(L, (lua_Number)Value); return 1; }
+};
+
+template<typename T>
+struct TLuaValue<T, typename TEnableIf<TIsEnum<T>::Value>::Type> : FLuaValueByCopy
+{
+	static T Fetch(lua_State* L, int32 Index) { return (T)lua_tointeger(L, Index); }
+	static int Push(lua_State* L, T Value) { lua_pushinteger(L, (lua_Integer)Value); return 1; }
+};
+
+template<typename T>
+struct TLuaValue<TEnumAsByte<T>> : FLuaValueByCopy
+{
+	static TEnumAsByte<T> Fetch(lua_State* L, int32 Index) { return (T)lua_tointeger(L, Index); }
+	static int Push(lua_State* L, TEnumAsByte<T> Value) { lua_pushinteger(L, (lua_Integer)Value.GetValue()); return 1; }
+};
+
+template<>
+struct TLuaValue<FString> : FLuaValueByCopy
+{
+	static FString Fetch(lua_State* L, int32 Index) { return UTF8_TO_TCHAR(lua_tostring(L, Index)); }
+	static int Push(lua_State* L, const FString& Value) { lua_pushstring(L, TCHAR_TO_UTF8(*Value)); return 1; }
+};
+
+template<>
+struct TLuaValue<FText> : FLuaValueByCopy
+{
+	static FText Fetch(lua_State* L, int32 Index) { return FText::FromString(UTF8_TO_TCHAR(lua_tostring(L, Index))); }
+	static int Push(lua_State* L, const FText& Value) { lua_pushstring(L, TCHAR_TO_UTF8(*Value.ToString())); return 1; }
+};
+
+template<>
+struct TLuaValue<FName> : FLuaValueByCopy
+{
+	static FName Fetch(lua_State* L, int32 Index) { return UTF8_TO_TCHAR(lua_tostring(L, Index)); }
+	static int Push(lua_State* L, const FName& Value) { lua_pushstring(L, TCHAR_TO_UTF8(*Value.ToString())); return 1; }
+};
+
+template<typename T>
+struct TLuaValue<T*, typename TEnableIf<TIsDerivedFrom<typename TRemoveCV<T>::Type, UObject>::IsDerived>::Type> : FLuaValueByCopy
+{
+	static T* Fetch(lua_State* L, int32 Index) { return Cast<typename TRemoveCV<T>::Type>(FLuaUObject::Fetch(L, Index)); }
+	static int Push(lua_State* L, T* Value) { return FLuaUObject::Push(L, (UObject*)Value); }
+};
+
+template<typename T>
+using TLuaArgValue = TLuaValue<typename TDecay<T>::Type>;
+
+// non-const reference arguments are pushed back after the call
+template<typename ArgType>
+struct TLuaOutArg
+{
+	template<typename ValueType>
+	static int Push(lua_State* L, const ValueType& Value) { return 0; }
+};
+
+template<typename ArgType>
+struct TLuaOutArg<ArgType&>
+{
+	template<typename ValueType>
+	static int Push(lua_State* L, const ValueType& Value) { return TLuaArgValue<ArgType>::Push(L, Value); }
+};
+
+template<typename ArgType>
+struct TLuaOutArg<const ArgType&>
+{
+	template<typename ValueType>
+	static int Push(lua_State* L, const ValueType& Value) { return 0; }
+};
+
+template<typename RetType>
+struct TLuaReturn
+{
+	template<typename CallType>
+	static int Call(lua_State* L, CallType&& Callable) { return TLuaArgValue<RetType>::Push(L, Callable()); }
+};
+
+template<>
+struct TLuaReturn<void>
+{
+	template<typename CallType>
+	static int Call(lua_State* L, CallType&& Callable) { Callable(); return 0; }
+};
+
+// self at index 1, an object or a struct proxy
+template<typename ClassType, bool bIsObject = TIsDerivedFrom<ClassType, UObject>::IsDerived>
+struct TLuaSelf
+{
+	static ClassType* Fetch(lua_State* L) { return Cast<ClassType>(FLuaUObject::Fetch(L, 1)); }
+	static UStruct* GetStruct() { return ClassType::StaticClass(); }
+};
+
+template<typename ClassType>
+struct TLuaSelf<ClassType, false>
+{
+	static ClassType* Fetch(lua_State* L)
+	{
+		FLuaUStruct* LuaUStruct = FLuaUStruct::ToLuaUStruct(L, 1);
+		UScriptStruct* Struct = LuaUStruct ? LuaUStruct->GetSource() : nullptr;
+		return Struct && Struct->IsChildOf(TLuaStruct<ClassType>::Get()) ? (ClassType*)LuaUStruct->GetScriptBuffer() : nullptr;
+	}
+
+	static UStruct* GetStruct() { return TLuaStruct<ClassType>::Get(); }
+};
+
+template<typename... ArgTypes>
+struct TLuaInvoker
+{
+	typedef TTuple<typename TDecay<ArgTypes>::Type...> FArgs;
+
+	template<typename RetType, typename CallType, uint32... Indices>
+	static int Invoke(lua_State* L, CallType&& Callable, TIntegerSequence<uint32, Indices...>)
+	{
+		// arguments start at 2, after self or the class
+		FArgs Args(TLuaArgValue<ArgTypes>::Fetch(L, Indices + 2)...);
+
+		int ReturnNum = TLuaReturn<RetType>::Call(L, [&]() -> RetType { return Callable(Args.template Get<Indices>()...); });
+
+		const int OutNums[] = { 0, TLuaOutArg<ArgTypes>::Push(L, Args.template Get<Indices>())... };
+		for (int OutNum : OutNums)
+		{
+			ReturnNum += OutNum;
+		}
+
+		return ReturnNum;
+	}
+};
+
+template<typename FunctionType, FunctionType Function>
+struct TLuaMethod;
+
+template<typename ClassType, typename RetType, typename... ArgTypes, RetType(ClassType::*Function)(ArgTypes...)>
+struct TLuaMethod<RetType(ClassType::*)(ArgTypes...), Function>
+{
+	static int Call(lua_State* L)
+	{
+		ClassType* Self = TLuaSelf<ClassType>::Fetch(L);
+		if (!Self)
+		{
+			return FLuaBindingRegistry::InvalidSelfError(L, TLuaSelf<ClassType>::GetStruct());
+		}
+
+		return TLuaInvoker<ArgTypes...>::template Invoke<RetType>(L,
+			[Self](typename TDecay<ArgTypes>::Type&... Args) -> RetType { return (Self->*Function)(Args...); },
+			TMakeIntegerSequence<uint32, sizeof...(ArgTypes)>());
+	}
+};
+
+template<typename ClassType, typename RetType, typename... ArgTypes, RetType(ClassType::*Function)(ArgTypes...) const>
+struct TLuaMethod<RetType(ClassType::*)(ArgTypes...) const, Function>
+{
+	static int Call(lua_State* L)
+	{
+		const ClassType* Self = TLuaSelf<ClassType>::Fetch(L);
+		if (!Self)
+		{
+			return FLuaBindingRegistry::InvalidSelfError(L, TLuaSelf<ClassType>::GetStruct());
+		}
+
+		return TLuaInvoker<ArgTypes...>::template Invoke<RetType>(L,
+			[Self](typename TDecay<ArgTypes>::Type&... Args) -> RetType { return (Self->*Function)(Args...); },
+			TMakeIntegerSequence<uint32, sizeof...(ArgTypes)>());
+	}
+};
+
+// static member or free function, index 1 is the class proxy
+template<typename RetType, typename... ArgTypes, RetType(*Function)(ArgTypes...)>
+struct TLuaMethod<RetType(*)(ArgTypes...), Function>
+{
+	static int Call(lua_State* L)
+	{
+		return TLuaInvoker<ArgTypes...>::template Invoke<RetType>(L,
+			[](typename TDecay<ArgTypes>::Type&... Args) -> RetType { return Function(Args...); },
+			TMakeIntegerSequence<uint32, sizeof...(ArgTypes)>());
+	}
+};
+
+template<typename FieldType, bool bByReference = TLuaValue<FieldType>::bByReference>
+struct TLuaField
+{
+	static int Get(lua_State* L, void* Address) { return TLuaValue<FieldType>::Push(L, *(FieldType*)Address); }
+	static void Set(lua_State* L, void* Address, int32 Index) { *(FieldType*)Address = TLuaValue<FieldType>::Fetch(L, Index); }
+};
+
+template<typename FieldType>
+struct TLuaField<FieldType, true>
+{
+	// struct fields are pushed by reference like reflected struct properties
+	static int Get(lua_State* L, void* Address) { return TLuaValue<FieldType>::PushReference(L, (FieldType*)Address); }
+	static void Set(lua_State* L, void* Address, int32 Index) { FLuaUStruct::Fetch(L, Index, TLuaStruct<FieldType>::Get(), (uint8*)Address); }
+};
+
+template<typename ClassType>
+class FLuaBinder
+{
+public:
+	FLuaBinder()
+		: Struct(TLuaSelf<ClassType>::GetStruct())
+	{
+
+	}
+
+	template<typename FunctionType, FunctionType Function>
+	FLuaBinder& Method(const TCHAR* Name)
+	{
+		FLuaBindingMember Member;
+		Member.Function = &TLuaMethod<FunctionType, Function>::Call;
+		FLuaBindingRegistry::RegisterMember(Struct, Name, Member);
+
+		return *this;
+	}
+
+	template<typename FieldType>
+	FLuaBinder& Field(const TCHAR* Name, FieldType ClassType::*FieldPointer)
+	{
+		FLuaBindingMember Member;
+		Member.Offset = GetOffset(FieldPointer);
+		Member.Getter = &TLuaField<FieldType>::Get;
+		Member.Setter = &TLuaField<FieldType>::Set;
+		FLuaBindingRegistry::RegisterMember(Struct, Name, Member);
+
+		return *this;
+	}
+
+	template<typename FieldType>
+	FLuaBinder& ReadOnlyField(const TCHAR* Name, FieldType ClassType::*FieldPointer)
+	{
+		FLuaBindingMember Member;
+		Member.Offset = GetOffset(FieldPointer);
+		Member.Getter = &TLuaField<typename TRemoveCV<FieldType>::Type>::Get;
+		FLuaBindingRegistry::RegisterMember(Struct, Name, Member);
+
+		return *this;
+	}
+
+protected:
+	template<typename FieldType>
+	static int32 GetOffset(FieldType ClassType::*FieldPointer)
+	{
+		return (int32)((UPTRINT)&(((ClassType*)nullptr)->*FieldPointer));
+	}
+
+protected:
+	UStruct* Struct;
+};
+
+// body of a function registering bindings when UObject classes are ready
+#define BLUELUA_BINDINGS(Name) \
+	static void RegisterLuaBindings_##Name(); \
+	static FLuaBindingAutoRegister LuaBindingAutoRegister_##Name(&RegisterLuaBindings_##Name); \
+	static void RegisterLuaBindings_##Name()
+
+#define BLUELUA_BIND_METHOD(ClassName, MethodName) \
+	FLuaBinder<ClassName>().Method<decltype(&ClassName::MethodName), &ClassName::MethodName>(TEXT(#MethodName))
+
+#define BLUELUA_BIND_STATIC(ClassName, FunctionName) \
+	FLuaBinder<ClassName>().Method<decltype(&ClassName::FunctionName), &ClassName::FunctionName>(TEXT(#FunctionName))
+
+#define BLUELUA_BIND_FIELD(ClassName, FieldName) \
+	FLuaBinder<ClassName>().Field(TEXT(#FieldName), &ClassName::FieldName)
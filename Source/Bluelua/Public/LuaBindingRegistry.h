@@ -0,0 +1,106 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/TypeCompatibleBytes.h"
+#include "UObject/Class.h"
+
+#include "LuaBridgeStats.h"
+#include "LuaSampleProfiler.h"
+#include "LuaTrace.h"
+#include "LuaUStruct.h"
+
+struct lua_State;
+
+typedef int(*FLuaBindingFunction)(lua_State* L);
+typedef int(*FLuaBindingGetter)(lua_State* L, void* Address);
+typedef void(*FLuaBindingSetter)(lua_State* L, void* Address, int32 Index);
+
+// hand-written member of a class or struct proxy, see FLuaBinder
+struct FLuaBindingMember
+{
+	// method or static function, called with self at index 1
+	FLuaBindingFunction Function = nullptr;
+
+	// field at Offset of the object or struct buffer, Setter is nullptr if read only
+	int32 Offset = INDEX_NONE;
+	FLuaBindingGetter Getter = nullptr;
+	FLuaBindingSetter Setter = nullptr;
+};
+
+// Direct native glue for UFunctions, generated by the BlueluaBindings commandlet from an allow-list.
+// Lua index finds the glue before the reflection path, functions without glue still go through ProcessEvent.
+// Also holds hand-written methods and fields registered with FLuaBinder, looked up by name before reflected members.
+class BLUELUA_API FLuaBindingRegistry
+{
+public:
+	typedef void(*FRegisterFunction)();
+
+	// safe at static init, RegisterFunction runs on first lookup when all UClasses are loaded
+	static void AddRegisterFunction(FRegisterFunction RegisterFunction);
+
+	static void Register(UFunction* Function, FLuaBindingFunction Binding);
+	static void Unregister(UFunction* Function);
+
+	// returns nullptr if the function has no glue or static bindings are disabled
+	static FLuaBindingFunction Find(UFunction* Function);
+
+	// push glue of Function as a closure with Function as upvalue, returns false if there is none
+	static bool PushBinding(lua_State* L, UFunction* Function);
+
+	static void RegisterMember(UStruct* Struct, FName Name, const FLuaBindingMember& Member);
+
+	// find a hand-written member of Struct or its super structs
+	static bool FindMember(UStruct* Struct, FName Name, FLuaBindingMember& OutMember);
+
+	// push the member Name of the object or struct at Container if there is one, returns the number of pushed values or -1 if not found
+	static int32 PushMember(lua_State* L, UStruct* Struct, FName Name, void* Container);
+
+	// write the value at Index to the field Name, returns false if not found
+	static bool SetMember(lua_State* L, UStruct* Struct, FName Name, void* Container, int32 Index);
+
+	// raise the error of a method called without a valid Struct self at index 1, named as lua called it
+	static int InvalidSelfError(lua_State* L, UStruct* Struct);
+
+	// generated glue uses it to read struct arguments, the value is zero or default constructed if Index isn't a struct
+	template<typename T>
+	static T FetchStruct(lua_State* L, int32 Index, UScriptStruct* Struct)
+	{
+		TTypeCompatibleBytes<T> Storage;
+		Struct->InitializeStruct(&Storage);
+		FLuaUStruct::Fetch(L, Index, Struct, (uint8*)&Storage);
+
+		T Value = MoveTemp(*Storage.GetTypedPtr());
+		Struct->DestroyStruct(&Storage);
+
+		return Value;
+	}
+
+protected:
+	static void RegisterPending();
+	static void OnPostGarbageCollect();
+};
+
+// the same profiling and stats scopes as a reflected UFunction call
+struct FLuaBindingScope
+{
+	FLuaBindingScope(lua_State* L, UFunction* Function)
+		: ProfileScope(L, Function)
+		, TraceScope(Function)
+		, StatsScope(Function)
+	{
+
+	}
+
+private:
+	FLuaSampleProfiler::FNativeScope ProfileScope;
+	FLuaTrace::FScope TraceScope;
+	FLuaBridgeStats::FCallScope StatsScope;
+};
+
+struct FLuaBindingAutoRegister
+{
+	explicit FLuaBindingAutoRegister(FLuaBindingRegistry::FRegisterFunction RegisterFunction)
+	{
+		FLuaBindingRegistry::AddRegisterFunction(RegisterFunction);
+	}
+};
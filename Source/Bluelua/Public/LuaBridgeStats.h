@@ -0,0 +1,99 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/UnrealType.h"
+
+struct BLUELUA_API FLuaBridgeCounters
+{
+	int64 Calls = 0;
+	uint64 Cycles = 0;
+	int64 Pushes = 0;
+	int64 Fetches = 0;
+	// copied for structs, strings and containers
+	int64 Bytes = 0;
+	// userdata proxies created for objects, structs and delegates
+	int64 Proxies = 0;
+
+	FLuaBridgeCounters& operator+=(const FLuaBridgeCounters& Other);
+};
+
+enum class ELuaBridgeStatsSort : uint8
+{
+	Cycles,
+	Calls,
+	Pushes,
+	Fetches,
+	Bytes,
+	Proxies,
+};
+
+// Per UFunction and per property marshalling counters of the lua bridge, kept per frame for the last frames.
+// Counting is off until started, a disabled check is one bool read in the hot paths.
+class BLUELUA_API FLuaBridgeStats
+{
+public:
+	static inline bool IsEnabled()
+	{
+		return bEnabled;
+	}
+
+	static void Start();
+	static void Stop();
+	static void Reset();
+
+	static void RecordCall(const UFunction* Function, uint64 Cycles);
+	static void RecordPush(const UProperty* Property, const void* Value, int64 Proxies);
+	static void RecordFetch(const UProperty* Property, const void* Value);
+
+	static inline void OnProxyCreated()
+	{
+		++NumProxies;
+	}
+
+	static inline int64 GetNumProxies()
+	{
+		return NumProxies;
+	}
+
+	static void Dump(FOutputDevice& Ar, int32 TopN, int32 NumFrames, ELuaBridgeStatsSort Sort);
+
+	// times a UFunction call from lua including its marshalling
+	struct BLUELUA_API FCallScope
+	{
+		explicit FCallScope(const UFunction* InFunction);
+		~FCallScope();
+
+	private:
+		const UFunction* Function;
+		uint64 StartCycles;
+	};
+
+	// container elements and struct fields are marshalled inside their outer property, only the outermost one is recorded
+	struct BLUELUA_API FMarshalScope
+	{
+		FMarshalScope();
+		~FMarshalScope();
+
+		bool IsOutermost() const
+		{
+			return bOutermost;
+		}
+
+	private:
+		bool bOutermost;
+	};
+
+protected:
+	static FLuaBridgeCounters& GetCounters(const UFunction* Function);
+	static FLuaBridgeCounters& GetCounters(const UProperty* Property);
+	static FLuaBridgeCounters& GetCounters(const UStruct* Owner, const void* Field, TFunctionRef<FString()> GetName);
+	static void AdvanceFrame();
+	static int64 GetCopiedBytes(const UProperty* Property, const void* Value);
+
+protected:
+	static bool bEnabled;
+	static int64 NumProxies;
+
+	static int32 MarshalDepth;
+	static uint64 MarshalFrame;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "HAL/CriticalSection.h"
+#include "HAL/ThreadSafeCounter.h"
+
+struct lua_State;
+
+struct BLUELUA_API FLuaPreloadResult
+{
+	int32 CompiledChunks = 0;
+	int32 FailedChunks = 0;
+	double Seconds = 0.0;
+};
+
+struct FLuaCompiledChunk
+{
+	FString FilePath;
+	FString ChunkName;
+	TArray<uint8> Bytecode;
+};
+
+class BLUELUA_API FLuaChunkCache : public TSharedFromThis<FLuaChunkCache, ESPMode::ThreadSafe>
+{
+public:
+	// Compile modules to bytecode on task graph workers, each worker uses its own throwaway lua_State
+	TFuture<FLuaPreloadResult> Preload(const TArray<FString>& ModuleNames);
+
+	// Remove a precompiled chunk from cache, returns false if the module is not preloaded yet
+	bool Take(const FString& ModuleName, FLuaCompiledChunk& OutChunk);
+
+	bool IsPreloading() const;
+	void Reset();
+
+	static bool ResolveModulePath(const FString& ModuleName, FString& OutFilePath);
+	static FString MakeChunkName(const FString& FilePath);
+	static bool Compile(lua_State* L, const TArray<uint8>& Source, const FString& ChunkName, TArray<uint8>& OutBytecode);
+
+protected:
+	static int WriteBytecode(lua_State* L, const void* Data, size_t Size, void* UserData);
+
+protected:
+	mutable FCriticalSection ChunksLock;
+	TMap<FString, FLuaCompiledChunk> Chunks;
+
+	FThreadSafeCounter PendingPreloads;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/SoftObjectPath.h"
+
+struct lua_State;
+struct FStreamableHandle;
+struct FStreamableManager;
+
+// Runs lua functions as pooled coroutines that can wait for time, frames, delegates and async loads.
+// Waiting coroutines are resumed in one pass per tick.
+class BLUELUA_API FLuaCoroutineScheduler
+{
+public:
+	FLuaCoroutineScheduler();
+	~FLuaCoroutineScheduler();
+
+	void Init(lua_State* InL);
+	void Shutdown();
+
+	void Tick(float DeltaTime);
+
+	// run function with NumArgs arguments on top of FromL as a coroutine, returns false if it failed before the first wait
+	bool Spawn(lua_State* FromL, int32 NumArgs);
+
+	// true if L is a coroutine owned by this scheduler, only those can wait
+	bool IsSchedulerThread(lua_State* L) const;
+
+	int32 GetNumWaiting() const;
+
+	// lua events and delegate callbacks without results run through Spawn
+	static bool ShouldSpawnEvents();
+
+	static int LuaStartCoroutine(lua_State* L);
+	static int LuaWaitSeconds(lua_State* L);
+	static int LuaWaitFrames(lua_State* L);
+	static int LuaWaitDelegate(lua_State* L);
+	static int LuaWaitLoadObject(lua_State* L);
+
+protected:
+	struct FCoroutine
+	{
+		lua_State* Thread;
+		int ThreadRef;
+		bool bWaiting;
+		// woken before it yielded, e.g. a load that completed synchronously
+		bool bWoken;
+		// bumped by every wait, wakes of older waits are dropped
+		uint32 WaitSerial;
+		// binding created by WaitDelegate, released when the coroutine ends
+		int BindingRef;
+	};
+
+	struct FTimedWait
+	{
+		double WakeTime;
+		int32 Id;
+		uint32 Serial;
+
+		bool operator<(const FTimedWait& Other) const
+		{
+			return WakeTime < Other.WakeTime;
+		}
+	};
+
+	struct FFrameWait
+	{
+		uint64 WakeFrame;
+		int32 Id;
+		uint32 Serial;
+
+		bool operator<(const FFrameWait& Other) const
+		{
+			return WakeFrame < Other.WakeFrame;
+		}
+	};
+
+	struct FReadyCoroutine
+	{
+		int32 Id;
+		// registry ref of a table with values returned by the wait, or LUA_NOREF
+		int ArgsRef;
+	};
+
+	static FLuaCoroutineScheduler* Get(lua_State* L);
+
+	// mark the running coroutine as waiting, returns its id and the serial of the wait
+	int32 BeginWait(lua_State* L, uint32& OutSerial);
+	void Wake(int32 Id, uint32 Serial, int ArgsRef);
+	bool Resume(int32 Id, int32 NumArgs, lua_State* FromL);
+	void ReleaseThread(const FCoroutine& Coroutine, bool bReusable);
+	void ReleaseWaitBinding(FCoroutine& Coroutine);
+
+	void OnObjectLoaded(int32 Id, uint32 Serial, FSoftObjectPath ObjectPath);
+
+	static int OnDelegateFired(lua_State* L);
+
+protected:
+	lua_State* L;
+
+	int32 LastId;
+	uint64 FrameCounter;
+	double CurrentTime;
+
+	TMap<int32, FCoroutine> Coroutines;
+	TMap<lua_State*, int32> ThreadIds;
+
+	// finished coroutines kept for reuse
+	TArray<FCoroutine> IdleThreads;
+
+	TArray<FTimedWait> TimedWaits;
+	TArray<FFrameWait> FrameWaits;
+	TArray<FReadyCoroutine> ReadyCoroutines;
+	TArray<FReadyCoroutine> ResumingCoroutines;
+
+	TUniquePtr<FStreamableManager> StreamableManager;
+	TMap<int32, TSharedPtr<FStreamableHandle>> LoadHandles;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "UObject/WeakObjectPtr.h"
+
+#include "LuaUDelegate.h"
+
+#include "LuaDelegateDispatcher.generated.h"
+
+class FLuaState;
+struct lua_State;
+
+// One dispatcher per lua state, every lua function bound to a UE delegate is a slot in its binding table.
+// Slot N is exposed as function LuaBinding_N, firing a delegate resolves the slot from the function name number.
+UCLASS()
+class BLUELUA_API ULuaDelegateDispatcher : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void ProcessEvent(UFunction* Function, void* Parameters) override;
+	virtual void BeginDestroy() override;
+
+	void BindLuaState(TSharedPtr<FLuaState> InLuaState);
+	void Shutdown();
+
+	// bind function at FunctionIndex, and self at SelfIndex if not 0, returns slot
+	int32 CreateBinding(lua_State* L, UObject* Owner, int32 FunctionIndex, int32 SelfIndex);
+	// unbinds the slot from every delegate it was added to
+	bool ReleaseBinding(int32 Slot);
+	void ReleaseBindingsByOwner(UObject* Owner);
+	void ReleaseBindingsBySource(const void* Source);
+	// release bindings whose owner is garbage collected
+	void ReleaseStaleBindings();
+
+	// remember the delegate at Source the slot is added to, so release can unbind it
+	void TrackBoundDelegate(int32 Slot, const void* Source, UObject* SourceOwner, UFunction* Function, FUnbindDelegateFuncPtr Unbind);
+
+	bool IsBindingValid(int32 Slot) const;
+	uint32 GetBindingSerial(int32 Slot) const;
+	int32 GetNumBindings() const;
+	// live and released slots, released ones are reused so this stays at the peak of live bindings
+	int32 GetNumSlots() const;
+
+	// listeners of one multicast delegate share a group binding, parameters are pushed once per broadcast
+	int32 FindOrCreateGroup(const void* Source, UObject* SourceOwner, UFunction* SignatureFunction);
+	void AddToGroup(int32 GroupSlot, int32 Slot);
+	// a group without listeners is unbound and released, returns true if so
+	bool RemoveFromGroup(int32 GroupSlot, int32 Slot);
+	int32 GetGroupSlot(int32 Slot) const;
+
+	// no return value and no out params
+	static bool CanFanOut(UFunction* SignatureFunction);
+
+	// fill OutDelegate with the binding, Source is the delegate it is added to,
+	// without Source the copy can't be unbound on release and only the slot reuse delay keeps it from firing a reused slot
+	bool MakeDelegate(int32 Slot, UFunction* SignatureFunction, const void* Source, FScriptDelegate& OutDelegate);
+
+	static int PushBinding(lua_State* L, int32 Slot);
+	// true if value at Index is a binding, OutSlot is INDEX_NONE if it's released
+	static bool FetchBinding(lua_State* L, int32 Index, int32& OutSlot);
+
+	// binding or ULuaFunctionDelegate at Index to script delegate
+	static bool FetchDelegate(lua_State* L, int32 Index, UFunction* SignatureFunction, const void* Source, FScriptDelegate& OutDelegate);
+
+	// CreateFunctionDelegate(Owner, [Self,] Function) -> Binding
+	static int CreateFunctionDelegate(lua_State* L);
+
+	static int32 GetBindingSlot(FName FunctionName);
+	static FName GetBindingFunctionName(int32 Slot);
+
+	static const FName BindingFunctionName;
+
+protected:
+	struct FBoundDelegate
+	{
+		const void* Source = nullptr;
+		// Source memory is only touched while its owner is alive
+		TWeakObjectPtr<UObject> SourceOwner;
+		UFunction* Function = nullptr;
+		FUnbindDelegateFuncPtr Unbind = nullptr;
+	};
+
+	struct FBinding
+	{
+		int FunctionRef = -2;
+		int SelfRef = -2;
+		UFunction* SignatureFunction = nullptr;
+		TWeakObjectPtr<UObject> Owner;
+		const UObject* OwnerKey = nullptr;
+		const void* Source = nullptr;
+		uint32 Serial = 0;
+		bool bInUse = false;
+
+		// group bindings call their listeners, listeners keep their group
+		bool bGroup = false;
+		int32 GroupSlot = INDEX_NONE;
+		TArray<int32> Listeners;
+
+		TArray<FBoundDelegate> BoundDelegates;
+	};
+
+	int32 AllocateSlot();
+	void CallBinding(int32 Slot, void* Parameters);
+
+	static int BindingToString(lua_State* L);
+	static int LuaReleaseBinding(lua_State* L);
+
+	static const char* BINDING_METATABLE;
+
+protected:
+	TWeakPtr<FLuaState> LuaState;
+
+	TArray<FBinding> Bindings;
+	int32 NumBindings = 0;
+
+	// released slots are reused first in first out
+	TQueue<int32> FreeSlots;
+	int32 NumFreeSlots = 0;
+
+	TMultiMap<const UObject*, int32> OwnerBindings;
+
+	// multicast delegate -> group slot
+	TMap<const void*, int32> SourceGroups;
+
+	// numbered thunk functions shared by all dispatchers
+	static TArray<UFunction*> BindingFunctions;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+
+struct BLUELUA_API FLuaErrorSite
+{
+	// chunk:line of the innermost lua frame
+	FString Location;
+	FString LastMessage;
+
+	int32 TotalCount = 0;
+	int32 SuppressedCount = 0;
+
+	double WindowStartTime = 0.0;
+};
+
+// Groups lua runtime errors by call site so an error raised every frame by many objects
+// logs its traceback once per window, repeats are only counted and summarized in Tick.
+class BLUELUA_API FLuaErrorThrottle
+{
+public:
+	FLuaErrorThrottle();
+
+	// count an error raised in Thread, returns true if its traceback should be logged
+	bool Report(lua_State* Thread, const char* Message);
+
+	// log suppressed counts of the last window
+	void Tick(float DeltaTime);
+
+	int32 GetTotalCount() const;
+	const TMap<uint32, FLuaErrorSite>& GetSites() const;
+	void Reset();
+
+	// GetErrorCounts() returns { ["chunk:line"] = count }, total
+	static int LuaGetErrorCounts(lua_State* L);
+
+protected:
+	void WriteSummary(double Now);
+
+protected:
+	TMap<uint32, FLuaErrorSite> Sites;
+
+	int32 TotalCount;
+	int32 PendingSuppressedCount;
+
+	double LastSummaryTime;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+
+struct BLUELUA_API FLuaGCStats
+{
+	int64 Steps = 0;
+	int64 Cycles = 0;
+	int64 FullCollects = 0;
+	int64 CeilingRestarts = 0;
+	double LastSliceMs = 0.0;
+	double MaxSliceMs = 0.0;
+	double LastFullCollectMs = 0.0;
+	double MaxFullCollectMs = 0.0;
+};
+
+class BLUELUA_API FLuaGCScheduler
+{
+public:
+	FLuaGCScheduler();
+
+	// stop lua's automatic collector and drive it from Tick instead
+	void Init(lua_State* InL);
+
+	// run incremental steps within the frame budget
+	void Tick(float DeltaTime);
+
+	// called when UE runs lua, hands collection back to lua's collector if the heap outgrew the ceiling and nothing ticks
+	void CheckHeapCeiling();
+
+	void FullCollect(const TCHAR* Reason);
+
+	bool IsScheduling() const;
+	const FLuaGCStats& GetStats() const;
+
+	// false hands collection back to lua's collector for good, whatever bluelua.GC.Scheduler says
+	void SetSchedulingAllowed(bool bInSchedulingAllowed);
+
+protected:
+	void SetScheduling(bool bInScheduling);
+	void ScheduleNextCycle();
+	double GetSliceBudgetMs(float DeltaTime) const;
+
+protected:
+	lua_State* L;
+
+	bool bScheduling;
+	bool bSchedulingAllowed;
+	bool bCycleRunning;
+	// lua's automatic collector runs until the next tick
+	bool bCollectorRestarted;
+
+	double LastTickTime;
+
+	// heap size in KB at which the next cycle starts
+	int32 NextCycleKB;
+
+	FLuaGCStats Stats;
+};
@@ -26,11 +26,15 @@ public:
 
 	static void CleanAllLuaImplementableObject(FLuaState* InLuaState = nullptr);
 
+	// reload changed lua file in every lua state, bound objects keep their module table and state
+	static void HotReloadLuaFile(const FString& FilePath);
+
 	static void ProcessBPFunctionOverride(UObject* Context, struct FFrame& Stack, void* const Z_Param__Result);
 
 protected:
 	virtual bool OnInitLuaBinding();
 	virtual void OnReleaseLuaBinding();
+	virtual bool OnReloadLuaBinding();
 	virtual bool OnProcessLuaOverrideEvent(UFunction* Function, void* Parameters);
 
 	template<typename Super>
@@ -75,7 +79,6 @@ protected:
 	static void AddToLuaObjectList(FLuaState* InLuaState, ILuaImplementableInterface* Object);
 	static void RemoveFromLuaObjectList(FLuaState* InLuaState, ILuaImplementableInterface* Object);
 
-	static int FillBPFunctionOverrideOutProperty(struct lua_State* L);
 	bool CallBPFunctionOverride(UFunction* Function, FFrame& Stack, void* const Z_Param__Result);
 
 protected:
@@ -83,6 +86,7 @@ protected:
 	int ModuleReferanceIndex = -2;
 
 	TSet<FString> OverridedBPFunctionList;
+	FString BoundLuaFilePath;
 
 	static TMap<FLuaState*, TSet<ILuaImplementableInterface*>> LuaImplementableObjects;
 };
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+class FLuaState;
+
+enum class ELuaLogLevel : uint8
+{
+	Error,
+	Warning,
+	Display,
+	Log,
+	Verbose,
+};
+
+// Log pipeline behind lua print and the Log table.
+// Messages are filtered by level before formatting, formatted on the calling thread without heap allocations
+// and pushed into a lock-free ring buffer, a background writer drains it into LogBluelua.
+// Messages too long for the ring buffer, like tracebacks, are written synchronously.
+// Worker states can log too, the ring buffer accepts messages from any thread.
+class BLUELUA_API FLuaLog
+{
+public:
+	// register print and the Log table, Owner supplies the PIE prefix and can be null
+	static void Register(lua_State* L, FLuaState* Owner);
+
+	static bool IsEnabled(ELuaLogLevel Level);
+
+	// Message is utf8 text, with bJsonFields it is a preformatted json key/value list from Log.Event,
+	// its first PrefixLength bytes are the PIE prefix, written before "Lua log:"
+	static void Write(ELuaLogLevel Level, const ANSICHAR* Category, const ANSICHAR* Message, int32 Length, bool bJsonFields = false, int32 PrefixLength = 0);
+
+	// write all pending messages on the calling thread
+	static void Flush();
+
+	// flush and stop the writer thread, later messages are written synchronously
+	static void Shutdown();
+
+protected:
+	static int LuaWrite(lua_State* L);
+	static int LuaEvent(lua_State* L);
+	static int LuaCategory(lua_State* L);
+
+	static void PushLogTable(lua_State* L, int32 OwnerIndex, const char* Category);
+	static void StartWriter();
+};
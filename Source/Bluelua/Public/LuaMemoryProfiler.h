@@ -0,0 +1,90 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+
+enum class ELuaMemoryType : uint8
+{
+	String,
+	Table,
+	Function,
+	Userdata,
+	Thread,
+	Proto,
+	// table parts, stacks, upvalues, proto code and other internal buffers
+	Other,
+	Num,
+};
+
+struct BLUELUA_API FLuaMemoryUsage
+{
+	int64 LiveBytes = 0;
+	int64 LiveCount = 0;
+	int64 TotalCount = 0;
+};
+
+struct BLUELUA_API FLuaModuleMemoryUsage
+{
+	FString ModuleName;
+	FLuaMemoryUsage Usage;
+};
+
+class BLUELUA_API FLuaMemoryProfiler
+{
+public:
+	explicit FLuaMemoryProfiler(lua_State* InL);
+	~FLuaMemoryProfiler();
+
+	void Start();
+	void Stop();
+	void Reset();
+
+	inline bool IsRunning() const
+	{
+		return bRunning;
+	}
+
+	// called by lua alloc after the allocator succeeded
+	void OnRealloc(void* Ptr, size_t OldSize, void* NewPtr, size_t NewSize);
+
+	const FLuaMemoryUsage& GetTypeUsage(ELuaMemoryType Type) const;
+
+	// modules sorted by live bytes, biggest first
+	void GetModuleUsages(TArray<FLuaModuleMemoryUsage>& OutUsages) const;
+
+	void Dump(FOutputDevice& Ar, int32 MaxModules = 20) const;
+
+	static const TCHAR* GetTypeName(ELuaMemoryType Type);
+
+protected:
+	struct FRecord
+	{
+		SIZE_T Size;
+		ELuaMemoryType Type;
+		int32 ModuleIndex;
+	};
+
+	static ELuaMemoryType GetMemoryType(size_t LuaTypeTag);
+
+	int32 GetCurrentModuleIndex();
+	int32 FindOrAddModule(const char* Source);
+
+	void AddUsage(const FRecord& Record, int64 Bytes, int64 Count);
+	static void AddStats(ELuaMemoryType Type, int64 Bytes);
+	void ClearStats();
+
+protected:
+	lua_State* L;
+
+	bool bRunning;
+
+	TMap<void*, FRecord> Records;
+
+	FLuaMemoryUsage TypeUsages[(int32)ELuaMemoryType::Num];
+
+	// chunk source crc -> index into ModuleNames and ModuleUsages
+	TMap<uint32, int32> ModuleIndices;
+	TArray<FString> ModuleNames;
+	TArray<FLuaMemoryUsage> ModuleUsages;
+};
@@ -17,6 +17,8 @@ public:
 	static FetchPropertyFunction GetFetcher(FFieldClass* Class);
 
 	static int PushProperty(lua_State* L, UProperty* Property, void* Params, UObject* Object = nullptr, bool bCopyValue = true);
+	// struct parameters are pushed as views valid within the current FLuaUStruct::FBorrowScope, others as PushProperty
+	static int PushBorrowedProperty(lua_State* L, UProperty* Property, void* Params);
 	static int PushStructProperty(lua_State* L, UProperty* Property, void* Params, UObject* Object, bool bCopyValue = true);
 	static int PushEnumProperty(lua_State* L, UProperty* Property, void* Params, UObject* Object, bool);
 	static int PushClassProperty(lua_State* L, UProperty* Property, void* Params, UObject* Object, bool);
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_Debug;
+struct lua_State;
+class UFunction;
+
+enum class ELuaProfileFormat : uint8
+{
+	// "frame;frame;frame microseconds" per line, for flamegraph.pl and most flame graph viewers
+	Collapsed,
+	// sampled profile of https://www.speedscope.app
+	Speedscope,
+};
+
+// Samples lua call stacks from a count hook, gated by time so the sample rate doesn't depend on the instructions rate.
+// Lua stacks are merged with the native bridge frames active on the same lua thread,
+// which are UE functions calling into lua and UFunctions called from lua.
+class BLUELUA_API FLuaSampleProfiler
+{
+public:
+	explicit FLuaSampleProfiler(lua_State* InL);
+	~FLuaSampleProfiler();
+
+	void Start();
+	void Stop();
+	void Reset();
+
+	inline bool IsRunning() const
+	{
+		return bRunning;
+	}
+
+	int64 GetNumSamples() const;
+
+	// export to Saved/Profiling, FileName is generated if empty, returns the file path or empty if failed
+	FString Export(ELuaProfileFormat Format, const FString& FileName = FString()) const;
+
+	void PushNativeFrame(lua_State* InL, UFunction* Function);
+	void PopNativeFrame();
+
+	// keeps a native frame on the running profiler of InL's state while in scope
+	struct BLUELUA_API FNativeScope
+	{
+		FNativeScope(lua_State* InL, UFunction* Function);
+		~FNativeScope();
+
+	private:
+		FLuaSampleProfiler* Profiler;
+	};
+
+protected:
+	struct FFrame
+	{
+		FString Name;
+		FString File;
+		int32 Line;
+	};
+
+	// interned, the strings of a collected chunk can be reused by another one
+	struct FLuaFrameKey
+	{
+		FName Source;
+		FName Name;
+		int32 Line;
+
+		bool operator==(const FLuaFrameKey& Other) const
+		{
+			return Source == Other.Source && Name == Other.Name && Line == Other.Line;
+		}
+
+		friend uint32 GetTypeHash(const FLuaFrameKey& Key)
+		{
+			return HashCombine(HashCombine(::GetTypeHash(Key.Source), ::GetTypeHash(Key.Name)), ::GetTypeHash(Key.Line));
+		}
+	};
+
+	struct FNativeFrame
+	{
+		lua_State* L;
+		// number of lua levels on L when the frame is pushed
+		int32 LuaDepth;
+		FName Name;
+	};
+
+	// call tree, samples of a stack are counted on its leaf node
+	struct FStackNode
+	{
+		int32 Parent;
+		int32 FrameIndex;
+		int64 Samples;
+		// measured time since the previous sample, summed over the samples
+		uint64 Cycles;
+		TMap<int32, int32> Children;
+	};
+
+	static void Hook(lua_State* InL, lua_Debug* Ar);
+	static int32 GetStackDepth(lua_State* InL);
+
+	void Sample(lua_State* InL, uint64 ElapsedCycles);
+
+	int32 FindOrAddLuaFrame(lua_State* InL, lua_Debug& Ar);
+	int32 FindOrAddNativeFrame(FName Name);
+	int32 FindOrAddChild(int32 NodeIndex, int32 FrameIndex);
+
+	void GetStackFrames(int32 NodeIndex, TArray<int32>& OutFrames) const;
+	int64 GetWeightUs(int32 NodeIndex) const;
+	void BuildCollapsed(FString& Out) const;
+	void BuildSpeedscope(FString& Out) const;
+
+protected:
+	lua_State* L;
+
+	bool bRunning;
+
+	uint64 SamplePeriodCycles;
+	uint64 NextSampleCycles;
+	uint64 LastSampleCycles;
+	int64 NumSamples;
+
+	// hook of L before the profiler started, restored when stopped
+	void (*PreviousHook)(lua_State*, lua_Debug*);
+	int PreviousHookMask;
+	int PreviousHookCount;
+
+	TArray<FFrame> Frames;
+	TMap<FLuaFrameKey, int32> LuaFrameIndices;
+	TMap<FName, int32> NativeFrameIndices;
+
+	TArray<FStackNode> StackNodes;
+
+	TArray<FNativeFrame> NativeFrames;
+};
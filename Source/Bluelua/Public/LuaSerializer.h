@@ -0,0 +1,62 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+
+// Binary encoder/decoder for lua values.
+// Supports nil, boolean, integer, number, string, nested tables with shared references and cycles,
+// and UStruct userdata through tagged property serialization. Metatables are not kept.
+class BLUELUA_API FLuaSerializer
+{
+public:
+	explicit FLuaSerializer(bool bInAllowStructs = true);
+
+	// encode Count values starting at FirstIndex into OutBuffer
+	bool Serialize(lua_State* L, int32 FirstIndex, int32 Count, TArray<uint8>& OutBuffer);
+
+	// encode into the scratch buffer, result is valid until next call
+	bool Serialize(lua_State* L, int32 FirstIndex, int32 Count);
+	const TArray<uint8>& GetScratchBuffer() const;
+
+	// push decoded values to stack, returns number of values pushed or INDEX_NONE on error
+	int32 Deserialize(lua_State* L, const uint8* Data, int32 Size);
+	int32 Deserialize(lua_State* L, const TArray<uint8>& Buffer);
+
+	const FString& GetError() const;
+
+	// Serialize(...) -> string
+	static int LuaSerialize(lua_State* L);
+	// Deserialize(string) -> ...
+	static int LuaDeserialize(lua_State* L);
+
+protected:
+	bool WriteValue(lua_State* L, int32 Index, int32 Depth, TArray<uint8>& Buffer);
+	bool WriteTable(lua_State* L, int32 Index, int32 Depth, TArray<uint8>& Buffer);
+	bool WriteStruct(lua_State* L, int32 Index, TArray<uint8>& Buffer);
+
+	bool ReadValue(lua_State* L, int32 RefsIndex, int32 Depth);
+	bool ReadTable(lua_State* L, int32 RefsIndex, int32 Depth);
+	bool ReadStruct(lua_State* L);
+
+	static void WriteVarUInt(TArray<uint8>& Buffer, uint64 Value);
+	bool ReadVarUInt(uint64& OutValue);
+	bool ReadBytes(void* Dest, int32 Size);
+
+	bool SetError(const FString& InError);
+
+protected:
+	bool bAllowStructs;
+
+	TArray<uint8> ScratchBuffer;
+
+	// table pointer -> reference id, reused between calls
+	TMap<const void*, int32> TableRefs;
+
+	const uint8* ReadData;
+	int32 ReadSize;
+	int32 ReadOffset;
+	int32 NumReadTables;
+
+	FString Error;
+};
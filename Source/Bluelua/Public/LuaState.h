@@ -1,25 +1,80 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/Future.h"
 #include "UObject/GCObject.h"
 #include "UObject/WeakObjectPtr.h"
 #include "UObject/WeakObjectPtrTemplates.h"
 
+#include "LuaAllocator.h"
+#include "LuaCoroutineScheduler.h"
+#include "LuaErrorThrottle.h"
+#include "LuaGCScheduler.h"
+#include "LuaSerializer.h"
+#include "LuaTimerWheel.h"
+#include "LuaWorkerPool.h"
+
 struct lua_State;
+struct FLuaPreloadResult;
+class FLuaChunkCache;
+class FLuaMemoryProfiler;
+class FLuaSampleProfiler;
+class ULuaDelegateDispatcher;
+
+// where results of a lua call are written back, lives on the caller's C stack
+struct FLuaOutParams
+{
+	// written in order from the out list if set, otherwise return value then non-const out params of Function
+	struct FOutParmRec* OutParamsList = nullptr;
+	UFunction* Function = nullptr;
+	void* Parameters = nullptr;
+	class UProperty* ReturnValue = nullptr;
+	int32 OutParamsCount = 0;
+};
+
+struct FLuaFunctionRef
+{
+	int FunctionRef;
+	// LUA_NOREF if the function is called without self
+	int SelfRef;
+};
+
+// which libraries a state opens on creation, the others are opened on first access
+enum class ELuaStateProfile : uint8
+{
+	// every library, luasocket and LuaPanda outside shipping builds
+	Game,
+	// like Game without LuaPanda
+	Server,
+	// pure data jobs, no os, debug, file loading or luasocket
+	Worker,
+	// untrusted scripts, like Worker without native modules, bytecode, project modules or object loading,
+	// require only finds package.preload entries, delegates, worker jobs and serialization are Game and Server only
+	Sandbox,
+};
 
 class BLUELUA_API FLuaState : public FGCObject, public TSharedFromThis<FLuaState>
 {
 public:
-	FLuaState();
+	explicit FLuaState(ELuaStateProfile InProfile = ELuaStateProfile::Game);
 	virtual ~FLuaState();
 
 	lua_State* GetState() const;
+	ELuaStateProfile GetProfile() const;
 
 	bool DoBuffer(const uint8* Buffer, uint32 BufferSize, const char* Name = nullptr);
 	bool DoString(const FString& String);
 	bool DoFile(const FString& FilePath);
 	bool CallLuaFunction(UFunction* SignatureFunction, void* Parameters, bool bWithSelf = true);
 	bool CallLuaFunction(int32 InParamsCount, int32 OutParamsCount, bool bWithSelf = true);
+	// stack = [Function, Params...], calls it and writes results back in the same protected call
+	bool CallLuaFunction(int32 InParamsCount, const FLuaOutParams& OutParams);
+	// push parameters once and call every function with them, a failing function doesn't stop the others
+	void CallLuaFunctions(UFunction* SignatureFunction, void* Parameters, TArrayView<const FLuaFunctionRef> Functions);
+	TFuture<FLuaPreloadResult> PreloadModules(const TArray<FString>& ModuleNames);
+	bool ReloadFile(const FString& FilePath);
+	bool ReloadModule(const FString& ModuleName);
+	bool IsModuleFile(const FString& FilePath) const;
 	bool GetFromCache(void* InObject);
 	bool AddToCache(void* InObject);
 
@@ -28,9 +83,40 @@ public:
 	void RemoveReferenceByOwner(UObject* Owner);
 	void GetObjectsByOwner(UObject* Owner, TSet<UObject*>& Objects);
 
+	const FLuaAllocatorStats& GetAllocatorStats() const;
+	int64 TrimMemory();
+
+	void StartMemoryProfiler();
+	void StopMemoryProfiler();
+	FLuaMemoryProfiler* GetMemoryProfiler() const;
+
+	void StartSampleProfiler();
+	void StopSampleProfiler();
+	FLuaSampleProfiler* GetSampleProfiler() const;
+
+	FLuaGCScheduler& GetGCScheduler();
+
+	FLuaCoroutineScheduler& GetCoroutineScheduler();
+
+	FLuaTimerWheel& GetTimerWheel();
+
+	FLuaErrorThrottle& GetErrorThrottle();
+
+	// created on first use, shared by all lua delegate bindings of this state
+	ULuaDelegateDispatcher* GetDelegateDispatcher();
+
+	// encode Count values from FirstIndex, see FLuaSerializer
+	bool Serialize(int32 FirstIndex, int32 Count, TArray<uint8>& OutBuffer);
+	// push decoded values to stack, returns number of values or INDEX_NONE on error
+	int32 Deserialize(const TArray<uint8>& Buffer);
+	FLuaSerializer& GetSerializer();
+
 	void SetOwnerGameInstane(class UGameInstance* InOwnerGameInstane);
 	class UGameInstance* GetOwnerGameInstance();
 
+	// "Client 1: " or "Server: " in PIE, empty otherwise
+	const ANSICHAR* GetLogPrefix() const;
+
 	// Begin FGCObject interface
 	virtual void AddReferencedObjects(FReferenceCollector& Collector) override;
 	virtual FString GetReferencerName() const override;
@@ -38,31 +124,91 @@ public:
 
 	inline static FLuaState* GetStateWrapper(lua_State* InL);
 
+	// open the standard libraries of Profile, lazy ones are opened when their global or require first asks for them
+	static void OpenLibraries(lua_State* L, ELuaStateProfile Profile);
+
+	static FString MakeRelativePathToContent(const FString& InPath);
+	static FString NormalizeFilePath(const FString& InPath);
+
+	// copy functions from source table into target table recursively, other values in target are kept
+	static void PatchTable(lua_State* L, int32 TargetIndex, int32 SourceIndex);
+
 protected:
 	static int LuaError(lua_State* L);
 	static int LuaPanic(lua_State* L);
-	static int LuaPrint(lua_State* L);
 	static int LuaSearcher(lua_State* L);
+	static int LuaOpenLazyLibrary(lua_State* L);
+	static int LuaSetMetatable(lua_State* L);
+	static int LuaSandboxLoad(lua_State* L);
 	static void* LuaAlloc(void* UserData, void* Ptr, size_t OldSize, size_t NewSize);
 
 	static int LuaLoadClass(lua_State* L);
 	static int LuaLoadStruct(lua_State* L);
 	static int GetEnumValue(lua_State* L);
+	static int LuaPreloadModules(lua_State* L);
+	static int LuaRunWorkerJob(lua_State* L);
 
-	static int FillOutProperty(lua_State* L);
+	static int CallAndFillOutParams(lua_State* L);
+
+	bool Tick(float DeltaTime);
+	void DispatchWorkerResults();
+	void UpdateLogPrefix();
 
 	void OnPostGarbageCollect();
+	void OnPostLoadMap(class UWorld* World);
+	void OnMemoryTrim();
 
-	static FString MakeRelativePathToContent(const FString& InPath);
+	static void PatchTableRecursive(lua_State* L, int32 TargetIndex, int32 SourceIndex, int32 VisitedIndex);
+	// share upvalues of the old function with the new one by name
+	static void JoinUpvalues(lua_State* L, int32 NewFunctionIndex, int32 OldFunctionIndex);
 
 protected:
 	lua_State* L;
 
+	ELuaStateProfile Profile;
+
 	int CacheObjectRefIndex;
 
 	TMap<UObject*, TWeakObjectPtr<UObject>> ReferencedObjectsWithOwner;
 
 	FDelegateHandle PostGarbageCollectDelegate;
+	FDelegateHandle MemoryTrimDelegate;
+	FDelegateHandle PostLoadMapDelegate;
+	FDelegateHandle TickerHandle;
+
+	FLuaAllocator Allocator;
+
+	TUniquePtr<FLuaMemoryProfiler> MemoryProfiler;
+
+	TUniquePtr<FLuaSampleProfiler> SampleProfiler;
+
+	FLuaGCScheduler GCScheduler;
+
+	FLuaCoroutineScheduler CoroutineScheduler;
+
+	FLuaTimerWheel TimerWheel;
+
+	FLuaErrorThrottle ErrorThrottle;
+
+	ULuaDelegateDispatcher* DelegateDispatcher;
+
+	FLuaSerializer Serializer;
 
 	TWeakObjectPtr<class UGameInstance> OwnerGameInstane;
+
+	// utf8 with terminator, cached per tick instead of looked up by every print
+	TArray<ANSICHAR> LogPrefix;
+
+	TSharedPtr<FLuaChunkCache, ESPMode::ThreadSafe> ChunkCache;
+
+	// required module name -> normalized file path, used by hot reload
+	TMap<FString, FString> LoadedModuleFiles;
+
+	struct FPendingWorkerJob
+	{
+		TFuture<FLuaWorkerResult> Result;
+		int CallbackRef;
+	};
+
+	TArray<FPendingWorkerJob> PendingWorkerJobs;
 };
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct lua_State;
+
+// Hierarchical timing wheel for lua timers.
+// Timers only hold registry refs to lua functions, insert and cancel are O(1),
+// expired timers are fired in one batched pass per tick.
+class BLUELUA_API FLuaTimerWheel
+{
+public:
+	FLuaTimerWheel();
+	~FLuaTimerWheel();
+
+	void Init(lua_State* InL);
+	void Shutdown();
+
+	void Tick(float DeltaTime);
+
+	// call function at FunctionIndex of InL after Delay seconds, then every Interval seconds if Interval > 0
+	int64 SetTimer(lua_State* InL, int32 FunctionIndex, float Delay, float Interval = 0.f);
+	bool ClearTimer(int64 Handle);
+	bool IsTimerActive(int64 Handle) const;
+
+	int32 GetNumTimers() const;
+
+	// SetTimer(Func, DelaySeconds) -> Handle
+	static int LuaSetTimer(lua_State* L);
+	// SetInterval(Func, IntervalSeconds[, FirstDelaySeconds]) -> Handle
+	static int LuaSetInterval(lua_State* L);
+	// ClearTimer(Handle) -> bool
+	static int LuaClearTimer(lua_State* L);
+
+protected:
+	enum
+	{
+		RootBits = 8,
+		LevelBits = 6,
+		NumLevels = 4,
+		RootSlots = 1 << RootBits,
+		LevelSlots = 1 << LevelBits,
+		NumSlots = RootSlots + LevelSlots * (NumLevels - 1),
+	};
+
+	struct FTimerNode
+	{
+		int32 Prev;
+		int32 Next;
+		// wheel slot the node is linked in, INDEX_NONE when not linked
+		int32 Slot;
+		uint32 Generation;
+		uint64 ExpireTick;
+		uint32 IntervalTicks;
+		int FunctionRef;
+	};
+
+	int32 AllocNode();
+	void FreeNode(int32 NodeIndex);
+
+	void Schedule(int32 NodeIndex);
+	void Link(int32 NodeIndex, int32 Slot);
+	void Unlink(int32 NodeIndex);
+	void Cascade(int32 Level, int32 Index);
+	void Expire(int32 Slot);
+	void FireExpired();
+
+	uint64 SecondsToTicks(float Seconds) const;
+
+	int64 MakeHandle(int32 NodeIndex) const;
+	int32 FindNode(int64 Handle) const;
+
+	static int TimerTraceback(lua_State* L);
+
+protected:
+	lua_State* L;
+
+	double TickSeconds;
+	double Accumulator;
+
+	// next tick to process
+	uint64 NextTick;
+
+	int32 Heads[NumSlots];
+
+	TArray<FTimerNode> Nodes;
+	int32 FreeHead;
+	int32 NumTimers;
+
+	// handles expired in this tick, reused between ticks
+	TArray<int64> ExpiredTimers;
+};
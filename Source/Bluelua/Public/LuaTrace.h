@@ -0,0 +1,58 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Runtime/Launch/Resources/Version.h"
+
+#if ENGINE_MINOR_VERSION >= 26
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Trace/Trace.h"
+#endif // ENGINE_MINOR_VERSION >= 26
+
+#if ENGINE_MINOR_VERSION >= 26 && CPUPROFILERTRACE_ENABLED
+#define BLUELUA_TRACE_ENABLED 1
+#else
+#define BLUELUA_TRACE_ENABLED 0
+#endif
+
+#if BLUELUA_TRACE_ENABLED
+UE_TRACE_CHANNEL_EXTERN(BlueluaChannel, BLUELUA_API);
+#endif // BLUELUA_TRACE_ENABLED
+
+struct lua_Debug;
+struct lua_State;
+class UFunction;
+
+// CPU timing events of lua calls and bridge crossings, shown in Unreal Insights with -trace=cpu,bluelua.
+// Event names are interned on first use, tracing a known function doesn't allocate.
+class BLUELUA_API FLuaTrace
+{
+public:
+	static bool IsEnabled();
+
+	// install the lua call hook while lua to lua calls are traced, only call it outside of lua
+	static void UpdateLuaCallHook(lua_State* L);
+
+	struct BLUELUA_API FScope
+	{
+		// UE function called from lua or a delegate firing into lua
+		explicit FScope(const UFunction* Function);
+		// lua function at FunctionIndex called for SignatureFunction
+		FScope(lua_State* L, int32 FunctionIndex, const UFunction* SignatureFunction);
+		~FScope();
+
+	private:
+		void Begin(uint32 EventId);
+
+		bool bActive;
+		int32 SavedLuaCallDepth;
+	};
+
+protected:
+	static uint32 GetEventId(const UFunction* Function);
+	static uint32 GetEventId(const lua_Debug& Ar, const UFunction* SignatureFunction);
+
+	static void LuaCallHook(lua_State* L, lua_Debug* Ar);
+
+	// lua events left open by errors, which skip return hooks
+	static void EndLuaEvents(int32 ToDepth);
+};
@@ -1,13 +1,15 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "UObject/WeakObjectPtr.h"
 
 #include "LuaObjectBase.h"
 
-class ULuaFunctionDelegate;
 class FLuaUDelegate;
 
 typedef FLuaUDelegate*(*FCreateDelegateFuncPtr)(lua_State* L, void* InSource, UFunction* InFunction);
+// remove Delegate from the delegate at Source, used after the lua proxy is gone
+typedef void(*FUnbindDelegateFuncPtr)(void* Source, UFunction* Function, const FScriptDelegate& Delegate);
 
 class BLUELUA_API FLuaUDelegate : public FLuaObjectBase
 {
@@ -15,7 +17,7 @@ public:
 	FLuaUDelegate(void* InSource, UFunction* InFunction);
 	virtual ~FLuaUDelegate();
 
-	static int Push(lua_State* L, void* InSource, UFunction* InFunction, FCreateDelegateFuncPtr CreateDelegateFuncPtr, void* InBuffer = nullptr);
+	static int Push(lua_State* L, void* InSource, UFunction* InFunction, FCreateDelegateFuncPtr CreateDelegateFuncPtr, void* InBuffer = nullptr, UObject* InOwner = nullptr);
 	static bool Fetch(lua_State* L, int32 Index, UFunction* InFunction, FScriptDelegate* InScriptDelegate);
 
 protected:
@@ -27,13 +29,21 @@ protected:
 
 	static const char* UDELEGATE_METATABLE;
 
-	virtual void OnAdd(ULuaFunctionDelegate* LuaFunctionDelegate) = 0;
-	virtual void OnRemove(ULuaFunctionDelegate* LuaFunctionDelegate) = 0;
+	virtual void OnAdd(const FScriptDelegate& Delegate) = 0;
+	virtual void OnRemove(const FScriptDelegate& Delegate) = 0;
 	virtual void OnClear() = 0;
 	virtual TArray<UObject*> OnGetAllObjects() const = 0;
 	virtual FString OnGetName() = 0;
+	virtual FUnbindDelegateFuncPtr GetUnbindFunc() const = 0;
+
+	// delegates which can be bound once and fan out to all lua listeners
+	virtual bool SupportsFanOut() const { return false; }
+	virtual bool OnContains(const FScriptDelegate& Delegate) const { return false; }
 
 protected:
 	void* Source;
 	UFunction* Function;
+
+	// object the delegate memory belongs to, null if unknown
+	TWeakObjectPtr<UObject> Owner;
 };
@@ -11,15 +11,35 @@ public:
 	~FLuaUStruct();
 
 	int32 GetStructureSize() const;
+	UScriptStruct* GetSource() const;
+	uint8* GetScriptBuffer() const;
 
 	static int Push(lua_State* L, UScriptStruct* InSource, void* InBuffer = nullptr, bool InbCopyValue = true);
+	// push a read-only view of InBuffer without copying, it raises an error when accessed after the enclosing FBorrowScope ends
+	static int PushBorrowed(lua_State* L, UScriptStruct* InSource, void* InBuffer);
 	static bool Fetch(lua_State* L, int32 Index, UScriptStruct* OutStruct, uint8* OutBuffer);
 
+	// returns nullptr if value at Index is not a struct
+	static FLuaUStruct* ToLuaUStruct(lua_State* L, int32 Index);
+
+	// struct views borrowed while it's alive are invalidated when it ends, does nothing off the game thread
+	struct BLUELUA_API FBorrowScope
+	{
+		FBorrowScope();
+		~FBorrowScope();
+
+	private:
+		int32 FirstBorrowed;
+	};
+
 protected:
 	static int Index(lua_State* L);
 	static int NewIndex(lua_State* L);
 	static int GC(lua_State* L);
 	static int ToString(lua_State* L);
+	static int Copy(lua_State* L);
+
+	static FLuaUStruct* CheckLuaUStruct(lua_State* L, int32 Index);
 
 	static class UProperty* FindStructPropertyByName(UScriptStruct* Source, FName Name);
 
@@ -27,6 +47,7 @@ protected:
 	TWeakObjectPtr<UScriptStruct> Source;
 	uint8* ScriptBuffer;
 	bool bCopyValue;
+	bool bBorrowed;
 
 	static const char* USTRUCT_METATABLE;
 };
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "HAL/CriticalSection.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter.h"
+
+struct lua_State;
+struct lua_Debug;
+
+struct BLUELUA_API FLuaWorkerResult
+{
+	bool bSuccess = false;
+	FString Error;
+
+	// return values of the job function, encoded by FLuaSerializer
+	TArray<uint8> Payload;
+};
+
+struct FLuaWorkerJob
+{
+	FString ModuleName;
+	FString FunctionName;
+
+	// arguments of the job function, encoded by FLuaSerializer
+	TArray<uint8> Arguments;
+
+	TPromise<FLuaWorkerResult> Promise;
+};
+
+// Isolated lua states on task graph threads for pure data jobs.
+// Worker states have no UObject access and can only require modules allowed by
+// bluelua.Worker.AllowedModules or AddAllowedModules, never by scripts.
+class BLUELUA_API FLuaWorkerPool : public TSharedFromThis<FLuaWorkerPool, ESPMode::ThreadSafe>
+{
+public:
+	FLuaWorkerPool();
+	~FLuaWorkerPool();
+
+	// run ModuleName.FunctionName(Arguments...) on a worker state
+	TFuture<FLuaWorkerResult> Submit(const FString& ModuleName, const FString& FunctionName, TArray<uint8>&& Arguments);
+
+	// module names or wildcards like "ai.scoring.*" that worker states may require
+	void AddAllowedModules(const TArray<FString>& ModuleNames);
+	bool IsModuleAllowed(const FString& ModuleName) const;
+
+	// wait for running jobs and close all worker states, pending jobs fail
+	void Shutdown();
+
+protected:
+	// reparse bluelua.Worker.AllowedModules if it changed, game thread only
+	void RefreshConfiguredModules();
+
+	void TryDispatch();
+	void RunWorker(lua_State* WorkerL);
+	void RunJob(lua_State* WorkerL, FLuaWorkerJob& Job);
+
+	lua_State* CreateWorkerState();
+
+	static int WorkerSearcher(lua_State* L);
+	static int WorkerTraceback(lua_State* L);
+	// count hook, stops a job on shutdown or when it runs out of its time budget
+	static void WorkerHook(lua_State* L, lua_Debug* Ar);
+
+protected:
+	mutable FCriticalSection JobsLock;
+	TArray<TSharedPtr<FLuaWorkerJob, ESPMode::ThreadSafe>> PendingJobs;
+	TArray<lua_State*> IdleStates;
+	int32 NumStates;
+	// also read without the lock by the hook of running jobs
+	FThreadSafeBool bShuttingDown;
+
+	FThreadSafeCounter RunningWorkers;
+
+	mutable FCriticalSection AllowedModulesLock;
+	TArray<FString> AllowedModules;
+	TArray<FString> ConfiguredModules;
+	FString ConfiguredModulesValue;
+};
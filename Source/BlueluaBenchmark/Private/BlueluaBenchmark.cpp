@@ -0,0 +1,281 @@
+// Copyright 1998-2018 Epic Games, Inc. All Rights Reserved.
+
+#include "BlueluaBenchmark.h"
+
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+#include "lua.hpp"
+#include "LuaStackGuard.h"
+#include "LuaState.h"
+#include "LuaUObject.h"
+
+#define LOCTEXT_NAMESPACE "FBlueluaBenchmarkModule"
+
+DEFINE_LOG_CATEGORY(LogBlueluaBenchmark);
+
+static TAutoConsoleVariable<int32> CVarLuaBenchmarkIterations(
+	TEXT("bluelua.Benchmark.Iterations"),
+	100000,
+	TEXT("Iterations of each lua bridge benchmark, a tenth of it is run before as warm-up."));
+
+static FString EscapeCsv(const FString& Value)
+{
+	return FString::Printf(TEXT("\"%s\""), *Value.Replace(TEXT("\""), TEXT("\"\"")));
+}
+
+FLuaBenchmark::FLuaBenchmark(TSharedPtr<FLuaState> InLuaState)
+	: LuaState(InLuaState)
+	, EmptyLoopSeconds(0.0)
+{
+
+}
+
+bool FLuaBenchmark::RunLua(const FString& Group, const FString& Name, const FString& Setup, const FString& Body, int64 Iterations/* = 0*/)
+{
+	if (!LuaState.IsValid())
+	{
+		return false;
+	}
+
+	if (Iterations <= 0)
+	{
+		Iterations = GetDefaultIterations();
+	}
+
+	lua_State* L = LuaState->GetState();
+	FLuaStackGuard Gurad(L);
+
+	// Target and N are locals of the chunk so the loop body doesn't pay for global lookups
+	const FString Chunk = FString::Printf(TEXT("return function(Target, N)\n%s\nfor i = 1, N do\n%s\nend\nend"), *Setup, *Body);
+	const FTCHARToUTF8 ChunkUTF8(*Chunk);
+	if (luaL_loadbuffer(L, ChunkUTF8.Get(), ChunkUTF8.Length(), TCHAR_TO_UTF8(*FString::Printf(TEXT("=Benchmark[%s]"), *Name)))
+		|| lua_pcall(L, 0, 1, 0))
+	{
+		UE_LOG(LogBlueluaBenchmark, Error, TEXT("Benchmark[%s] failed! Compile error: %s"), *Name, UTF8_TO_TCHAR(lua_tostring(L, -1)));
+		return false;
+	}
+
+	const int32 FunctionIndex = lua_gettop(L);
+
+	if (EmptyLoopSeconds <= 0.0)
+	{
+		luaL_loadstring(L, "return function(Target, N) for i = 1, N do end end");
+		lua_call(L, 0, 1);
+
+		uint64 EmptyAllocations = 0;
+		const int64 EmptyIterations = FMath::Max<int64>(GetDefaultIterations(), 1);
+		MeasureLuaLoop(lua_gettop(L), EmptyIterations / 10, EmptyAllocations);
+		EmptyLoopSeconds = MeasureLuaLoop(lua_gettop(L), EmptyIterations, EmptyAllocations) / EmptyIterations;
+		lua_pop(L, 1);
+	}
+
+	uint64 Allocations = 0;
+	if (MeasureLuaLoop(FunctionIndex, FMath::Max<int64>(Iterations / 10, 1), Allocations) < 0.0)
+	{
+		return false;
+	}
+
+	const double Seconds = MeasureLuaLoop(FunctionIndex, Iterations, Allocations);
+	if (Seconds < 0.0)
+	{
+		return false;
+	}
+
+	AddResult(Group, Name, Iterations, FMath::Max(Seconds - EmptyLoopSeconds * Iterations, 0.0), Allocations);
+
+	return true;
+}
+
+bool FLuaBenchmark::Prepare(const FString& Code)
+{
+	if (!LuaState.IsValid())
+	{
+		return false;
+	}
+
+	lua_State* L = LuaState->GetState();
+	FLuaStackGuard Gurad(L);
+
+	const FString Chunk = FString::Printf(TEXT("return function(Target)\n%s\nend"), *Code);
+	const FTCHARToUTF8 ChunkUTF8(*Chunk);
+	if (luaL_loadbuffer(L, ChunkUTF8.Get(), ChunkUTF8.Length(), "=BenchmarkPrepare") || lua_pcall(L, 0, 1, 0))
+	{
+		UE_LOG(LogBlueluaBenchmark, Error, TEXT("Benchmark prepare failed! Compile error: %s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+		return false;
+	}
+
+	if (Target.IsValid())
+	{
+		FLuaUObject::Push(L, Target.Get());
+	}
+	else
+	{
+		lua_pushnil(L);
+	}
+
+	if (lua_pcall(L, 1, 0, 0))
+	{
+		UE_LOG(LogBlueluaBenchmark, Error, TEXT("Benchmark prepare failed! %s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+		return false;
+	}
+
+	return true;
+}
+
+bool FLuaBenchmark::RunNative(const FString& Group, const FString& Name, TFunctionRef<void(int64)> Body, int64 Iterations/* = 0*/)
+{
+	if (Iterations <= 0)
+	{
+		Iterations = GetDefaultIterations();
+	}
+
+	Body(FMath::Max<int64>(Iterations / 10, 1));
+
+	if (LuaState.IsValid())
+	{
+		lua_gc(LuaState->GetState(), LUA_GCCOLLECT, 0);
+	}
+
+	const uint64 StartAllocations = GetAllocationCount();
+	const double StartSeconds = FPlatformTime::Seconds();
+
+	Body(Iterations);
+
+	const double Seconds = FPlatformTime::Seconds() - StartSeconds;
+	AddResult(Group, Name, Iterations, Seconds, GetAllocationCount() - StartAllocations);
+
+	return true;
+}
+
+void FLuaBenchmark::SetNativeBaseline(TFunctionRef<void(int64)> Body)
+{
+	if (Results.Num() == 0)
+	{
+		return;
+	}
+
+	FLuaBenchmarkResult& Result = Results.Last();
+
+	Body(FMath::Max<int64>(Result.Iterations / 10, 1));
+
+	const double StartSeconds = FPlatformTime::Seconds();
+	Body(Result.Iterations);
+	Result.NativeSeconds = FPlatformTime::Seconds() - StartSeconds;
+}
+
+void FLuaBenchmark::SetTarget(UObject* InTarget)
+{
+	Target = InTarget;
+}
+
+const TArray<FLuaBenchmarkResult>& FLuaBenchmark::GetResults() const
+{
+	return Results;
+}
+
+FString FLuaBenchmark::Export(const FString& BaseName) const
+{
+	const FString BasePath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmark"), BaseName);
+
+	// same columns as Benchmark.xlsx, followed by the per operation costs
+	FString Csv = TEXT("Group,Function Signature,Iterations,Blueprint(s),Lua(s),ns/op,allocs/op\n");
+	FString Json = TEXT("[\n");
+
+	for (int32 Index = 0; Index < Results.Num(); ++Index)
+	{
+		const FLuaBenchmarkResult& Result = Results[Index];
+
+		Csv += FString::Printf(TEXT("%s,%s,%lld,%.6f,%.6f,%.2f,%.3f\n"), *EscapeCsv(Result.Group), *EscapeCsv(Result.Name),
+			Result.Iterations, Result.NativeSeconds, Result.LuaSeconds, Result.NanosecondsPerOp, Result.AllocationsPerOp);
+
+		Json += FString::Printf(TEXT("\t{\"group\": \"%s\", \"name\": \"%s\", \"iterations\": %lld, \"blueprintSeconds\": %.6f, \"luaSeconds\": %.6f, \"nsPerOp\": %.2f, \"allocsPerOp\": %.3f}%s\n"),
+			*Result.Group.ReplaceCharWithEscapedChar(), *Result.Name.ReplaceCharWithEscapedChar(),
+			Result.Iterations, Result.NativeSeconds, Result.LuaSeconds, Result.NanosecondsPerOp, Result.AllocationsPerOp,
+			Index + 1 < Results.Num() ? TEXT(",") : TEXT(""));
+	}
+
+	Json += TEXT("]\n");
+
+	if (!FFileHelper::SaveStringToFile(Csv, *(BasePath + TEXT(".csv")), FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM)
+		|| !FFileHelper::SaveStringToFile(Json, *(BasePath + TEXT(".json")), FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM))
+	{
+		UE_LOG(LogBlueluaBenchmark, Error, TEXT("Export benchmark results failed! Can't write file[%s]!"), *BasePath);
+		return FString();
+	}
+
+	return FPaths::ConvertRelativePathToFull(BasePath + TEXT(".csv"));
+}
+
+int64 FLuaBenchmark::GetDefaultIterations()
+{
+	return FMath::Max(CVarLuaBenchmarkIterations.GetValueOnGameThread(), 1);
+}
+
+double FLuaBenchmark::MeasureLuaLoop(int32 FunctionIndex, int64 Iterations, uint64& OutAllocations)
+{
+	lua_State* L = LuaState->GetState();
+
+	// start every measurement from a collected heap so earlier garbage isn't paid here
+	lua_gc(L, LUA_GCCOLLECT, 0);
+
+	lua_pushvalue(L, FunctionIndex);
+	if (Target.IsValid())
+	{
+		FLuaUObject::Push(L, Target.Get());
+	}
+	else
+	{
+		lua_pushnil(L);
+	}
+	lua_pushinteger(L, Iterations);
+
+	const uint64 StartAllocations = GetAllocationCount();
+	const double StartSeconds = FPlatformTime::Seconds();
+
+	if (lua_pcall(L, 2, 0, 0))
+	{
+		UE_LOG(LogBlueluaBenchmark, Error, TEXT("Benchmark loop failed! %s"), UTF8_TO_TCHAR(lua_tostring(L, -1)));
+		lua_pop(L, 1);
+		return -1.0;
+	}
+
+	const double Seconds = FPlatformTime::Seconds() - StartSeconds;
+	OutAllocations = GetAllocationCount() - StartAllocations;
+
+	return Seconds;
+}
+
+void FLuaBenchmark::AddResult(const FString& Group, const FString& Name, int64 Iterations, double Seconds, uint64 Allocations)
+{
+	FLuaBenchmarkResult& Result = Results.AddDefaulted_GetRef();
+	Result.Group = Group;
+	Result.Name = Name;
+	Result.Iterations = Iterations;
+	Result.LuaSeconds = Seconds;
+	Result.NanosecondsPerOp = Iterations > 0 ? Seconds * 1e9 / Iterations : 0.0;
+	Result.AllocationsPerOp = Iterations > 0 ? (double)Allocations / Iterations : 0.0;
+
+	UE_LOG(LogBlueluaBenchmark, Display, TEXT("%-12s %-64s %10.2f ns/op %8.3f allocs/op"), *Group, *Name, Result.NanosecondsPerOp, Result.AllocationsPerOp);
+}
+
+uint64 FLuaBenchmark::GetAllocationCount() const
+{
+	return LuaState.IsValid() ? LuaState->GetAllocatorStats().AllocationCount : 0;
+}
+
+void FBlueluaBenchmarkModule::StartupModule()
+{
+
+}
+
+void FBlueluaBenchmarkModule::ShutdownModule()
+{
+
+}
+
+#undef LOCTEXT_NAMESPACE
+
+IMPLEMENT_MODULE(FBlueluaBenchmarkModule, BlueluaBenchmark)
@@ -0,0 +1,100 @@
+#include "BlueluaBenchmarkTarget.h"
+
+#include "LuaState.h"
+
+void UBlueluaBenchmarkTarget::Func0()
+{
+	++CallCount;
+}
+
+int32 UBlueluaBenchmarkTarget::Func1(int32 A)
+{
+	++CallCount;
+	return A;
+}
+
+int32 UBlueluaBenchmarkTarget::Func4(int32 A, int32 B, int32 C, int32 D)
+{
+	++CallCount;
+	return A + B + C + D;
+}
+
+int32 UBlueluaBenchmarkTarget::Func8(int32 A, int32 B, int32 C, int32 D, int32 E, int32 F, int32 G, int32 H)
+{
+	++CallCount;
+	return A + B + C + D + E + F + G + H;
+}
+
+FString UBlueluaBenchmarkTarget::FuncString(const FString& A)
+{
+	++CallCount;
+	return A;
+}
+
+FVector UBlueluaBenchmarkTarget::FuncVector(const FVector& A)
+{
+	++CallCount;
+	return A;
+}
+
+FBlueluaBenchmarkStruct UBlueluaBenchmarkTarget::FuncStruct(const FBlueluaBenchmarkStruct& A)
+{
+	++CallCount;
+	return A;
+}
+
+void UBlueluaBenchmarkTarget::ResizeContainers(int32 Num)
+{
+	IntArray.Reset(Num);
+	IntMap.Reset();
+	IntSet.Reset();
+
+	for (int32 Index = 0; Index < Num; ++Index)
+	{
+		IntArray.Add(Index);
+		IntMap.Add(Index, Index);
+		IntSet.Add(Index);
+	}
+}
+
+void UBlueluaBenchmarkTarget::OnBenchmarkDelegate(int32 Value)
+{
+	++CallCount;
+}
+
+bool UBlueluaBenchmarkTarget::BindLua(TSharedPtr<FLuaState> InLuaState, const FString& InLuaFilePath)
+{
+	OnReleaseLuaBinding();
+
+	BenchmarkLuaState = InLuaState;
+	LuaFilePath = InLuaFilePath;
+
+	return LuaFilePath.IsEmpty() || OnInitLuaBinding();
+}
+
+void UBlueluaBenchmarkTarget::BeginDestroy()
+{
+	Super::BeginDestroy();
+
+	OnReleaseLuaBinding();
+}
+
+void UBlueluaBenchmarkTarget::ProcessEvent(UFunction* Function, void* Parameters)
+{
+	LuaProcessEvent<Super>(Function, Parameters);
+}
+
+FString UBlueluaBenchmarkTarget::OnInitBindingLuaPath_Implementation()
+{
+	return LuaFilePath;
+}
+
+bool UBlueluaBenchmarkTarget::ShouldEnableLuaBinding_Implementation()
+{
+	return !LuaFilePath.IsEmpty();
+}
+
+TSharedPtr<FLuaState> UBlueluaBenchmarkTarget::OnInitLuaState()
+{
+	return BenchmarkLuaState;
+}
@@ -0,0 +1,403 @@
+#include "BlueluaBenchmark.h"
+
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/Package.h"
+#include "UObject/UnrealType.h"
+
+#include "BlueluaBenchmarkTarget.h"
+#include "BlueluaScenario.h"
+#include "LuaDelegateDispatcher.h"
+#include "LuaState.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+static const uint32 BenchmarkTestFlags = EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext
+	| EAutomationTestFlags::ServerContext | EAutomationTestFlags::PerfFilter;
+
+static const int32 ContainerSizes[] = { 1, 16, 256 };
+
+// fresh lua state and target per run, so results don't depend on earlier runs
+struct FLuaBenchmarkContext
+{
+	FLuaBenchmarkContext()
+		: LuaState(MakeShared<FLuaState>())
+		, Benchmark(LuaState)
+	{
+		// nothing ticks the state between iterations, a scheduled collector would never run and the heap only grows
+		LuaState->GetGCScheduler().SetSchedulingAllowed(false);
+
+		Target = NewObject<UBlueluaBenchmarkTarget>(GetTransientPackage());
+		Target->AddToRoot();
+
+		// unbound twin of Target, its ProcessEvent doesn't reach lua
+		NativeTarget = NewObject<UBlueluaBenchmarkTarget>(GetTransientPackage());
+		NativeTarget->AddToRoot();
+
+		Benchmark.SetTarget(Target);
+	}
+
+	~FLuaBenchmarkContext()
+	{
+		Target->BindLua(nullptr, FString());
+		Target->RemoveFromRoot();
+		NativeTarget->RemoveFromRoot();
+	}
+
+	TSharedPtr<FLuaState> LuaState;
+	FLuaBenchmark Benchmark;
+	UBlueluaBenchmarkTarget* Target;
+	UBlueluaBenchmarkTarget* NativeTarget;
+};
+
+// call a UFunction through ProcessEvent like blueprint does
+static void CallFunctionNative(UObject* Object, const TCHAR* FunctionName, int64 Iterations)
+{
+	UFunction* Function = Object->FindFunctionChecked(FName(FunctionName));
+
+	uint8* Parms = (uint8*)FMemory_Alloca(Function->ParmsSize);
+	FMemory::Memzero(Parms, Function->ParmsSize);
+
+	for (TFieldIterator<UProperty> ParamIter(Function); ParamIter && (ParamIter->PropertyFlags & CPF_Parm); ++ParamIter)
+	{
+		ParamIter->InitializeValue_InContainer(Parms);
+	}
+
+	for (int64 Index = 0; Index < Iterations; ++Index)
+	{
+		Object->ProcessEvent(Function, Parms);
+	}
+
+	for (TFieldIterator<UProperty> ParamIter(Function); ParamIter && (ParamIter->PropertyFlags & CPF_Parm); ++ParamIter)
+	{
+		ParamIter->DestroyValue_InContainer(Parms);
+	}
+}
+
+static void RunCallFunctionBenchmarks(FLuaBenchmarkContext& Context)
+{
+	struct FCallCase
+	{
+		const TCHAR* Name;
+		const TCHAR* FunctionName;
+		const TCHAR* Setup;
+		const TCHAR* Body;
+	};
+
+	static const FCallCase Cases[] =
+	{
+		{ TEXT("void Func()"), TEXT("Func0"), TEXT(""), TEXT("Target:Func0()") },
+		{ TEXT("int32 Func(int32)"), TEXT("Func1"), TEXT(""), TEXT("Target:Func1(i)") },
+		{ TEXT("int32 Func(int32, int32, int32, int32)"), TEXT("Func4"), TEXT(""), TEXT("Target:Func4(i, 1, 2, 3)") },
+		{ TEXT("int32 Func(int32 x 8)"), TEXT("Func8"), TEXT(""), TEXT("Target:Func8(i, 1, 2, 3, 4, 5, 6, 7)") },
+		{ TEXT("FString Func(FString)"), TEXT("FuncString"), TEXT("local S = 'Bluelua benchmark'"), TEXT("Target:FuncString(S)") },
+		{ TEXT("FVector Func(FVector)"), TEXT("FuncVector"), TEXT("local V = Target.VectorValue"), TEXT("Target:FuncVector(V)") },
+	};
+
+	for (const FCallCase& Case : Cases)
+	{
+		if (Context.Benchmark.RunLua(TEXT("CallFunction"), Case.Name, Case.Setup, Case.Body))
+		{
+			Context.Benchmark.SetNativeBaseline([&Context, &Case](int64 Iterations) { CallFunctionNative(Context.NativeTarget, Case.FunctionName, Iterations); });
+		}
+	}
+}
+
+static void RunPropertyBenchmarks(FLuaBenchmarkContext& Context)
+{
+	struct FPropertyCase
+	{
+		const TCHAR* Name;
+		const TCHAR* Value;
+	};
+
+	static const FPropertyCase Cases[] =
+	{
+		{ TEXT("BoolValue"), TEXT("true") },
+		{ TEXT("IntValue"), TEXT("i") },
+		{ TEXT("Int64Value"), TEXT("i") },
+		{ TEXT("FloatValue"), TEXT("0.5") },
+		{ TEXT("NameValue"), TEXT("'Bluelua'") },
+		{ TEXT("StringValue"), TEXT("'Bluelua benchmark'") },
+		{ TEXT("TextValue"), TEXT("'Bluelua benchmark'") },
+		{ TEXT("VectorValue"), TEXT("V") },
+		{ TEXT("ObjectValue"), TEXT("Target") },
+	};
+
+	for (const FPropertyCase& Case : Cases)
+	{
+		const FString Property = FString::Printf(TEXT("Target.%s"), Case.Name);
+
+		Context.Benchmark.RunLua(TEXT("Property"), FString::Printf(TEXT("get %s"), Case.Name), TEXT(""),
+			FString::Printf(TEXT("local Value = %s"), *Property));
+		Context.Benchmark.RunLua(TEXT("Property"), FString::Printf(TEXT("set %s"), Case.Name), TEXT("local V = Target.VectorValue"),
+			FString::Printf(TEXT("%s = %s"), *Property, Case.Value));
+	}
+}
+
+static void RunStructBenchmarks(FLuaBenchmarkContext& Context)
+{
+	FLuaBenchmark& Benchmark = Context.Benchmark;
+
+	Benchmark.RunLua(TEXT("Struct"), TEXT("push FBlueluaBenchmarkStruct"), TEXT(""), TEXT("local S = Target.StructValue"));
+	Benchmark.RunLua(TEXT("Struct"), TEXT("fetch FBlueluaBenchmarkStruct"), TEXT("local S = Target.StructValue"), TEXT("Target.StructValue = S"));
+	Benchmark.RunLua(TEXT("Struct"), TEXT("get FBlueluaBenchmarkStruct.IntValue"), TEXT("local S = Target.StructValue"), TEXT("local Value = S.IntValue"));
+	Benchmark.RunLua(TEXT("Struct"), TEXT("set FBlueluaBenchmarkStruct.IntValue"), TEXT("local S = Target.StructValue"), TEXT("S.IntValue = i"));
+
+	if (Benchmark.RunLua(TEXT("Struct"), TEXT("FBlueluaBenchmarkStruct Func(FBlueluaBenchmarkStruct)"), TEXT("local S = Target.StructValue"), TEXT("Target:FuncStruct(S)")))
+	{
+		Benchmark.SetNativeBaseline([&Context](int64 Iterations) { CallFunctionNative(Context.NativeTarget, TEXT("FuncStruct"), Iterations); });
+	}
+}
+
+static void RunContainerBenchmarks(FLuaBenchmarkContext& Context)
+{
+	static const TCHAR* Containers[] = { TEXT("IntArray"), TEXT("IntMap"), TEXT("IntSet") };
+
+	for (const int32 Size : ContainerSizes)
+	{
+		// keep the run time of big containers close to the small ones
+		const int64 Iterations = FMath::Max<int64>(FLuaBenchmark::GetDefaultIterations() / Size, 1);
+		const FString Setup = FString::Printf(TEXT("Target:ResizeContainers(%d) local T = {} for k = 1, %d do T[k] = k end"), Size, Size);
+
+		for (const TCHAR* Container : Containers)
+		{
+			Context.Benchmark.RunLua(TEXT("Container"), FString::Printf(TEXT("push %s[%d]"), Container, Size), Setup,
+				FString::Printf(TEXT("local Value = Target.%s"), Container), Iterations);
+			Context.Benchmark.RunLua(TEXT("Container"), FString::Printf(TEXT("fetch %s[%d]"), Container, Size), Setup,
+				FString::Printf(TEXT("Target.%s = T"), Container), Iterations);
+		}
+	}
+}
+
+static void RunDelegateBenchmarks(FLuaBenchmarkContext& Context)
+{
+	FLuaBenchmark& Benchmark = Context.Benchmark;
+	UBlueluaBenchmarkTarget* Target = Context.Target;
+	UBlueluaBenchmarkTarget* NativeTarget = Context.NativeTarget;
+
+	NativeTarget->OnBenchmark.AddDynamic(NativeTarget, &UBlueluaBenchmarkTarget::OnBenchmarkDelegate);
+
+	static const int32 ListenerCounts[] = { 1, 8 };
+	int32 BoundListeners = 0;
+
+	for (const int32 ListenerCount : ListenerCounts)
+	{
+		for (; BoundListeners < ListenerCount; ++BoundListeners)
+		{
+			Benchmark.Prepare(TEXT("Target.OnBenchmark:Add(CreateFunctionDelegate(Target, function(Value) end))"));
+		}
+
+		if (Benchmark.RunNative(TEXT("Delegate"), FString::Printf(TEXT("Broadcast(int32) to %d lua listener(s)"), ListenerCount),
+			[Target](int64 Iterations) { for (int64 Index = 0; Index < Iterations; ++Index) { Target->OnBenchmark.Broadcast((int32)Index); } }))
+		{
+			Benchmark.SetNativeBaseline([NativeTarget](int64 Iterations) { for (int64 Index = 0; Index < Iterations; ++Index) { NativeTarget->OnBenchmark.Broadcast((int32)Index); } });
+		}
+	}
+
+	Benchmark.Prepare(TEXT("Target.OnBenchmark:Clear()"));
+	NativeTarget->OnBenchmark.Clear();
+}
+
+static void RunOverrideBenchmarks(FLuaBenchmarkContext& Context)
+{
+	FLuaBenchmark& Benchmark = Context.Benchmark;
+	UBlueluaBenchmarkTarget* Target = Context.Target;
+	UBlueluaBenchmarkTarget* NativeTarget = Context.NativeTarget;
+
+	const FString LuaFilePath = FPaths::ConvertRelativePathToFull(FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmark"), TEXT("BenchmarkOverride.lua")));
+	const FString LuaModule = TEXT("local m = {}\nfunction m:ReceiveBenchmarkEvent(Value)\nend\nreturn m\n");
+
+	if (!FFileHelper::SaveStringToFile(LuaModule, *LuaFilePath) || !Target->BindLua(Context.LuaState, LuaFilePath))
+	{
+		UE_LOG(LogBlueluaBenchmark, Error, TEXT("Override benchmark failed! Can't bind lua file[%s]!"), *LuaFilePath);
+		return;
+	}
+
+	if (Benchmark.RunNative(TEXT("Override"), TEXT("void Event(int32) overridden by lua, called from C++"),
+		[Target](int64 Iterations) { for (int64 Index = 0; Index < Iterations; ++Index) { Target->ReceiveBenchmarkEvent((int32)Index); } }))
+	{
+		Benchmark.SetNativeBaseline([NativeTarget](int64 Iterations) { for (int64 Index = 0; Index < Iterations; ++Index) { NativeTarget->ReceiveBenchmarkEvent((int32)Index); } });
+	}
+
+	Benchmark.RunLua(TEXT("Override"), TEXT("void Event(int32) overridden by lua, called from lua"), TEXT(""), TEXT("Target:ReceiveBenchmarkEvent(i)"));
+
+	Target->BindLua(nullptr, FString());
+	IFileManager::Get().Delete(*LuaFilePath);
+}
+
+static void RunRequireBenchmarks(FLuaBenchmarkContext& Context)
+{
+	// require only searches the content directory, the module is removed afterwards
+	const FString ModuleDir = FPaths::Combine(FPaths::ProjectContentDir(), TEXT("BlueluaBenchmark"));
+	const FString ModuleFilePath = FPaths::Combine(ModuleDir, TEXT("BenchmarkModule.lua"));
+
+	FString LuaModule = TEXT("local m = {}\n");
+	for (int32 Index = 0; Index < 64; ++Index)
+	{
+		LuaModule += FString::Printf(TEXT("function m.Func%d(a, b) return a + b + %d end\n"), Index, Index);
+	}
+	LuaModule += TEXT("return m\n");
+
+	if (!FFileHelper::SaveStringToFile(LuaModule, *ModuleFilePath))
+	{
+		UE_LOG(LogBlueluaBenchmark, Error, TEXT("Require benchmark failed! Can't write file[%s]!"), *ModuleFilePath);
+		return;
+	}
+
+	// loading from disk is much slower than the bridge crossings, keep the run short
+	const int64 ColdIterations = FMath::Max<int64>(FLuaBenchmark::GetDefaultIterations() / 100, 1);
+
+	Context.Benchmark.RunLua(TEXT("Require"), TEXT("require cached module"), TEXT("require('BlueluaBenchmark.BenchmarkModule')"),
+		TEXT("local m = require('BlueluaBenchmark.BenchmarkModule')"));
+	Context.Benchmark.RunLua(TEXT("Require"), TEXT("require module from file"), TEXT(""),
+		TEXT("package.loaded['BlueluaBenchmark.BenchmarkModule'] = nil local m = require('BlueluaBenchmark.BenchmarkModule')"), ColdIterations);
+
+	IFileManager::Get().DeleteDirectory(*ModuleDir, false, true);
+}
+
+typedef void(*FLuaBenchmarkGroupFunction)(FLuaBenchmarkContext&);
+
+struct FLuaBenchmarkGroup
+{
+	const TCHAR* Name;
+	FLuaBenchmarkGroupFunction Function;
+};
+
+static const FLuaBenchmarkGroup BenchmarkGroups[] =
+{
+	{ TEXT("CallFunction"), &RunCallFunctionBenchmarks },
+	{ TEXT("Property"), &RunPropertyBenchmarks },
+	{ TEXT("Struct"), &RunStructBenchmarks },
+	{ TEXT("Container"), &RunContainerBenchmarks },
+	{ TEXT("Delegate"), &RunDelegateBenchmarks },
+	{ TEXT("Override"), &RunOverrideBenchmarks },
+	{ TEXT("Require"), &RunRequireBenchmarks },
+};
+
+// run groups matching GroupName, all if empty, and export to Saved/Benchmark
+static bool RunBenchmarkGroups(const FString& GroupName, FString& OutFilePath)
+{
+	FLuaBenchmarkContext Context;
+
+	for (const FLuaBenchmarkGroup& Group : BenchmarkGroups)
+	{
+		if (GroupName.IsEmpty() || GroupName.Equals(Group.Name, ESearchCase::IgnoreCase))
+		{
+			Group.Function(Context);
+		}
+	}
+
+	if (Context.Benchmark.GetResults().Num() == 0)
+	{
+		return false;
+	}
+
+	const FString BaseName = FString::Printf(TEXT("Bluelua-%s-%s"), GroupName.IsEmpty() ? TEXT("All") : *GroupName, *FDateTime::Now().ToString());
+	OutFilePath = Context.Benchmark.Export(BaseName);
+
+	return !OutFilePath.IsEmpty();
+}
+
+#define IMPLEMENT_BLUELUA_BENCHMARK_TEST(GroupName) \
+	IMPLEMENT_SIMPLE_AUTOMATION_TEST(FBlueluaBenchmark##GroupName##Test, "Bluelua.Benchmark." #GroupName, BenchmarkTestFlags) \
+	bool FBlueluaBenchmark##GroupName##Test::RunTest(const FString& Parameters) \
+	{ \
+		FString FilePath; \
+		const bool bSucceeded = RunBenchmarkGroups(TEXT(#GroupName), FilePath); \
+		TestTrue(TEXT("Benchmark results exported"), bSucceeded); \
+		AddInfo(FilePath); \
+		return bSucceeded; \
+	}
+
+IMPLEMENT_BLUELUA_BENCHMARK_TEST(CallFunction)
+IMPLEMENT_BLUELUA_BENCHMARK_TEST(Property)
+IMPLEMENT_BLUELUA_BENCHMARK_TEST(Struct)
+IMPLEMENT_BLUELUA_BENCHMARK_TEST(Container)
+IMPLEMENT_BLUELUA_BENCHMARK_TEST(Delegate)
+IMPLEMENT_BLUELUA_BENCHMARK_TEST(Override)
+IMPLEMENT_BLUELUA_BENCHMARK_TEST(Require)
+
+#undef IMPLEMENT_BLUELUA_BENCHMARK_TEST
+
+// bindings added to a delegate and bindings passed as a delegate param must both give their slot back on release
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FBlueluaDelegateSlotReuseTest, "Bluelua.Delegate.SlotReuse", EAutomationTestFlags::EditorContext
+	| EAutomationTestFlags::ClientContext | EAutomationTestFlags::ServerContext | EAutomationTestFlags::EngineFilter)
+bool FBlueluaDelegateSlotReuseTest::RunTest(const FString& Parameters)
+{
+	FLuaBenchmarkContext Context;
+
+	ULuaDelegateDispatcher* Dispatcher = Context.LuaState->GetDelegateDispatcher();
+	if (!Dispatcher)
+	{
+		AddError(TEXT("Lua state has no delegate dispatcher!"));
+		return false;
+	}
+
+	// released slots wait in the reuse queue, loop past it before measuring
+	const int32 Iterations = IConsoleManager::Get().FindConsoleVariable(TEXT("bluelua.Delegate.SlotReuseDelay"))->GetInt() + 256;
+	const FString Code = FString::Printf(TEXT(
+		"local BlueluaLibrary = LoadClass('BlueluaLibrary')\n"
+		"for i = 1, %d do\n"
+		"	local Binding = CreateFunctionDelegate(Target, function(Value) end)\n"
+		"	Target.OnBenchmark:Add(Binding)\n"
+		"	BlueluaLibrary:BindAction(nil, 'Bluelua', 0, false, false, Binding)\n"
+		"	Binding:Release()\n"
+		"end"), Iterations);
+
+	if (!TestTrue(TEXT("Warm up loop runs"), Context.Benchmark.Prepare(Code)))
+	{
+		return false;
+	}
+
+	const int32 NumSlots = Dispatcher->GetNumSlots();
+
+	TestTrue(TEXT("Loop runs"), Context.Benchmark.Prepare(Code));
+	TestEqual(TEXT("Slot count stays flat"), Dispatcher->GetNumSlots(), NumSlots);
+	TestEqual(TEXT("No binding is left"), Dispatcher->GetNumBindings(), 0);
+
+	return true;
+}
+
+// sizes come from the bluelua.Scenario.* cvars or the command line, e.g. -Actors=2000 -Widgets=300
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FBlueluaScenarioTest, "Bluelua.Scenario", BenchmarkTestFlags)
+bool FBlueluaScenarioTest::RunTest(const FString& Parameters)
+{
+	FLuaScenarioReport Report;
+	FLuaScenario Scenario(FLuaScenarioSettings::FromCommandLine(FCommandLine::Get()));
+	if (!Scenario.Run(Report))
+	{
+		AddError(TEXT("Lua scenario failed!"));
+		return false;
+	}
+
+	const FString FilePath = FLuaScenario::Export(Report);
+	TestFalse(TEXT("Scenario report exported"), FilePath.IsEmpty());
+	AddInfo(FilePath);
+
+	return !FilePath.IsEmpty();
+}
+
+static void LuaBenchmarkCommand(const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+{
+	FString FilePath;
+	if (RunBenchmarkGroups(Args.Num() > 0 ? Args[0] : FString(), FilePath))
+	{
+		Ar.Logf(TEXT("Lua benchmark results exported to %s"), *FilePath);
+	}
+	else
+	{
+		Ar.Log(TEXT("Usage: bluelua.Benchmark [CallFunction|Property|Struct|Container|Delegate|Override|Require]"));
+	}
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice LuaBenchmarkConsoleCommand(
+	TEXT("bluelua.Benchmark"),
+	TEXT("Run lua bridge benchmarks and export csv and json to Saved/Benchmark. Usage: bluelua.Benchmark [CallFunction|Property|Struct|Container|Delegate|Override|Require]"),
+	FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic(&LuaBenchmarkCommand));
+
+#endif // WITH_DEV_AUTOMATION_TESTS
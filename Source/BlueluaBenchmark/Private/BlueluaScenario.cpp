@@ -0,0 +1,470 @@
+#include "BlueluaScenario.h"
+
+#include "Blueprint/UserWidget.h"
+#include "Containers/Ticker.h"
+#include "Engine/Engine.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/OutputDevice.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+#include "UObject/UObjectGlobals.h"
+
+#include "Bluelua.h"
+#include "BlueluaBenchmark.h"
+#include "BlueluaBenchmarkTarget.h"
+#include "BlueluaScenarioActor.h"
+#include "BlueluaScenarioWidget.h"
+#include "LuaState.h"
+
+static TAutoConsoleVariable<int32> CVarLuaScenarioActors(
+	TEXT("bluelua.Scenario.Actors"),
+	2000,
+	TEXT("Number of lua bound actors spawned by the lua scenario harness."));
+
+static TAutoConsoleVariable<int32> CVarLuaScenarioWidgets(
+	TEXT("bluelua.Scenario.Widgets"),
+	300,
+	TEXT("Number of lua bound widgets created by the lua scenario harness."));
+
+static TAutoConsoleVariable<int32> CVarLuaScenarioFrames(
+	TEXT("bluelua.Scenario.Frames"),
+	300,
+	TEXT("Number of frames ticked by the lua scenario harness."));
+
+static TAutoConsoleVariable<int32> CVarLuaScenarioEvents(
+	TEXT("bluelua.Scenario.EventsPerFrame"),
+	16,
+	TEXT("Broadcasts per frame of the delegate every scenario actor listens to."));
+
+// moves every tick and counts events of the shared hub
+static const TCHAR* ScenarioActorLua = TEXT(R"(local m = {}
+local Super = Super
+local Listener = nil
+
+function m:ReceiveBeginPlay()
+	Listener = CreateFunctionDelegate(Super, function(Value)
+		Super.EventCount = Super.EventCount + 1
+	end)
+	Super.Hub.OnBenchmark:Add(Listener)
+end
+
+function m:ReceiveEndPlay(EndPlayReason)
+	Super.Hub.OnBenchmark:Remove(Listener)
+end
+
+function m:ReceiveTick(DeltaSeconds)
+	Super.Distance = Super.Distance + Super.Speed * DeltaSeconds
+end
+
+return m
+)");
+
+// restarts a latent delay whenever the previous one fired, DelayBinding releases the binding it is given when it's done
+static const TCHAR* ScenarioWidgetLua = TEXT(R"(local m = {}
+local Super = Super
+local BlueluaLibrary = LoadClass("BlueluaLibrary")
+local bWaiting = false
+
+local function OnDelay()
+	bWaiting = false
+	Super.FiredCount = Super.FiredCount + 1
+end
+
+function m:Tick(MyGeometry, InDeltaTime)
+	if bWaiting then
+		return
+	end
+
+	bWaiting = true
+	BlueluaLibrary:DelayBinding(Super, 0.1, CreateFunctionDelegate(Super, OnDelay))
+end
+
+return m
+)");
+
+static void LuaScenarioCommand(const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+{
+	FLuaScenarioReport Report;
+	FLuaScenario Scenario(FLuaScenarioSettings::FromCommandLine(*FString::Join(Args, TEXT(" "))));
+	if (!Scenario.Run(Report))
+	{
+		Ar.Log(TEXT("Lua scenario failed! See log for details."));
+		return;
+	}
+
+	Ar.Logf(TEXT("Lua scenario report exported to %s"), *FLuaScenario::Export(Report));
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice LuaScenarioConsoleCommand(
+	TEXT("bluelua.Scenario"),
+	TEXT("Run the lua scenario harness in a transient world and export a json report to Saved/Benchmark. Usage: bluelua.Scenario [-Actors=N] [-Widgets=M] [-Frames=F] [-Events=E]"),
+	FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic(&LuaScenarioCommand));
+
+static double GetPercentile(const TArray<float>& SortedValues, float Percentile)
+{
+	if (SortedValues.Num() == 0)
+	{
+		return 0.0;
+	}
+
+	return SortedValues[FMath::Clamp(FMath::FloorToInt(SortedValues.Num() * Percentile), 0, SortedValues.Num() - 1)];
+}
+
+static FString FloatArrayToJson(const TArray<float>& Values)
+{
+	TArray<FString> Strings;
+	Strings.Reserve(Values.Num());
+	for (const float Value : Values)
+	{
+		Strings.Add(FString::Printf(TEXT("%.3f"), Value));
+	}
+
+	return FString::Printf(TEXT("[%s]"), *FString::Join(Strings, TEXT(", ")));
+}
+
+FLuaScenarioSettings FLuaScenarioSettings::FromCommandLine(const TCHAR* CommandLine)
+{
+	FLuaScenarioSettings Settings;
+	Settings.NumActors = CVarLuaScenarioActors.GetValueOnGameThread();
+	Settings.NumWidgets = CVarLuaScenarioWidgets.GetValueOnGameThread();
+	Settings.NumFrames = CVarLuaScenarioFrames.GetValueOnGameThread();
+	Settings.EventsPerFrame = CVarLuaScenarioEvents.GetValueOnGameThread();
+
+	if (CommandLine)
+	{
+		FParse::Value(CommandLine, TEXT("Actors="), Settings.NumActors);
+		FParse::Value(CommandLine, TEXT("Widgets="), Settings.NumWidgets);
+		FParse::Value(CommandLine, TEXT("Frames="), Settings.NumFrames);
+		FParse::Value(CommandLine, TEXT("Events="), Settings.EventsPerFrame);
+		FParse::Value(CommandLine, TEXT("DeltaTime="), Settings.DeltaTime);
+		FParse::Value(CommandLine, TEXT("ActorLua="), Settings.ActorLuaFile);
+		FParse::Value(CommandLine, TEXT("WidgetLua="), Settings.WidgetLuaFile);
+	}
+
+	Settings.NumActors = FMath::Max(Settings.NumActors, 0);
+	Settings.NumWidgets = FMath::Max(Settings.NumWidgets, 0);
+	Settings.NumFrames = FMath::Max(Settings.NumFrames, 1);
+	Settings.EventsPerFrame = FMath::Max(Settings.EventsPerFrame, 0);
+
+	return Settings;
+}
+
+FString FLuaScenarioReport::ToJson() const
+{
+	FString Json = TEXT("{\n");
+	Json += FString::Printf(TEXT("\t\"settings\": {\"actors\": %d, \"widgets\": %d, \"frames\": %d, \"eventsPerFrame\": %d, \"deltaTime\": %.4f},\n"),
+		Settings.NumActors, Settings.NumWidgets, Settings.NumFrames, Settings.EventsPerFrame, Settings.DeltaTime);
+	Json += FString::Printf(TEXT("\t\"spawnActorsMs\": %.3f,\n\t\"createWidgetsMs\": %.3f,\n\t\"despawnMs\": %.3f,\n"), SpawnActorsMs, CreateWidgetsMs, DespawnMs);
+	Json += FString::Printf(TEXT("\t\"frameMs\": {\"average\": %.3f, \"median\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n"),
+		AverageFrameMs, MedianFrameMs, P95FrameMs, P99FrameMs, MaxFrameMs);
+	Json += FString::Printf(TEXT("\t\"luaHeapBytes\": {\"beforeSpawn\": %llu, \"afterSpawn\": %llu, \"peak\": %llu, \"afterDespawn\": %llu},\n"),
+		HeapBeforeSpawn, HeapAfterSpawn, HeapPeak, HeapAfterDespawn);
+	Json += FString::Printf(TEXT("\t\"gc\": {\"steps\": %lld, \"fullCollects\": %lld, \"totalPauseMs\": %.3f, \"maxPauseMs\": %.3f},\n"),
+		GCSteps, GCFullCollects, TotalGCPauseMs, MaxGCPauseMs);
+	Json += FString::Printf(TEXT("\t\"frames\": %s,\n"), *FloatArrayToJson(FrameMs));
+	Json += FString::Printf(TEXT("\t\"gcPauses\": %s\n"), *FloatArrayToJson(GCPauseMs));
+	Json += TEXT("}\n");
+
+	return Json;
+}
+
+FLuaScenario::FLuaScenario(const FLuaScenarioSettings& InSettings)
+	: Settings(InSettings)
+	, GameInstance(nullptr)
+	, World(nullptr)
+	, Hub(nullptr)
+{
+
+}
+
+FLuaScenario::~FLuaScenario()
+{
+	DespawnAll();
+	DestroyWorld();
+}
+
+bool FLuaScenario::Run(FLuaScenarioReport& OutReport)
+{
+	OutReport = FLuaScenarioReport();
+	OutReport.Settings = Settings;
+
+	if (!PrepareLuaFiles() || !CreateWorld())
+	{
+		DestroyWorld();
+		return false;
+	}
+
+	TSharedPtr<FLuaState> LuaState = FBlueluaModule::Get().GetDefaultLuaState();
+	FLuaGCScheduler& GCScheduler = LuaState->GetGCScheduler();
+
+	// start from a collected heap so earlier garbage isn't counted
+	GCScheduler.FullCollect(TEXT("ScenarioStart"));
+	const FLuaGCStats GCStatsBefore = GCScheduler.GetStats();
+
+	OutReport.HeapBeforeSpawn = LuaState->GetAllocatorStats().GetBytesInUse();
+
+	double StartSeconds = FPlatformTime::Seconds();
+	SpawnActors();
+	OutReport.SpawnActorsMs = (FPlatformTime::Seconds() - StartSeconds) * 1000.0;
+
+	StartSeconds = FPlatformTime::Seconds();
+	CreateWidgets();
+	OutReport.CreateWidgetsMs = (FPlatformTime::Seconds() - StartSeconds) * 1000.0;
+
+	OutReport.HeapAfterSpawn = LuaState->GetAllocatorStats().GetBytesInUse();
+	OutReport.HeapPeak = OutReport.HeapAfterSpawn;
+
+	OutReport.FrameMs.Reserve(Settings.NumFrames);
+	for (int32 Frame = 0; Frame < Settings.NumFrames; ++Frame)
+	{
+		const int64 StepsBefore = GCScheduler.GetStats().Steps;
+		const int64 FullCollectsBefore = GCScheduler.GetStats().FullCollects;
+
+		StartSeconds = FPlatformTime::Seconds();
+		TickFrame();
+		OutReport.FrameMs.Add((float)((FPlatformTime::Seconds() - StartSeconds) * 1000.0));
+
+		// the scheduler runs at most one slice per tick
+		const FLuaGCStats& GCStats = GCScheduler.GetStats();
+		if (GCStats.FullCollects != FullCollectsBefore)
+		{
+			OutReport.GCPauseMs.Add((float)GCStats.LastFullCollectMs);
+		}
+		else if (GCStats.Steps != StepsBefore)
+		{
+			OutReport.GCPauseMs.Add((float)GCStats.LastSliceMs);
+		}
+
+		OutReport.HeapPeak = FMath::Max(OutReport.HeapPeak, LuaState->GetAllocatorStats().GetBytesInUse());
+	}
+
+	StartSeconds = FPlatformTime::Seconds();
+	DespawnAll();
+	OutReport.DespawnMs = (FPlatformTime::Seconds() - StartSeconds) * 1000.0;
+
+	// what is left after a full collect of both heaps is leaked by the scenario
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	GCScheduler.FullCollect(TEXT("ScenarioEnd"));
+	OutReport.HeapAfterDespawn = LuaState->GetAllocatorStats().GetBytesInUse();
+
+	const FLuaGCStats& GCStatsAfter = GCScheduler.GetStats();
+	OutReport.GCSteps = GCStatsAfter.Steps - GCStatsBefore.Steps;
+	OutReport.GCFullCollects = GCStatsAfter.FullCollects - GCStatsBefore.FullCollects;
+
+	for (const float PauseMs : OutReport.GCPauseMs)
+	{
+		OutReport.TotalGCPauseMs += PauseMs;
+		OutReport.MaxGCPauseMs = FMath::Max<double>(OutReport.MaxGCPauseMs, PauseMs);
+	}
+
+	TArray<float> SortedFrameMs = OutReport.FrameMs;
+	SortedFrameMs.Sort();
+
+	double TotalFrameMs = 0.0;
+	for (const float FrameMs : SortedFrameMs)
+	{
+		TotalFrameMs += FrameMs;
+	}
+
+	OutReport.AverageFrameMs = TotalFrameMs / FMath::Max(SortedFrameMs.Num(), 1);
+	OutReport.MedianFrameMs = GetPercentile(SortedFrameMs, 0.5f);
+	OutReport.P95FrameMs = GetPercentile(SortedFrameMs, 0.95f);
+	OutReport.P99FrameMs = GetPercentile(SortedFrameMs, 0.99f);
+	OutReport.MaxFrameMs = SortedFrameMs.Num() > 0 ? SortedFrameMs.Last() : 0.0;
+
+	DestroyWorld();
+
+	UE_LOG(LogBlueluaBenchmark, Display, TEXT("Lua scenario %d actors %d widgets: spawn %.2fms, widgets %.2fms, frame avg %.3fms p95 %.3fms max %.3fms, lua heap peak %lluKB, gc max pause %.3fms."),
+		Settings.NumActors, Settings.NumWidgets, OutReport.SpawnActorsMs, OutReport.CreateWidgetsMs,
+		OutReport.AverageFrameMs, OutReport.P95FrameMs, OutReport.MaxFrameMs, OutReport.HeapPeak / 1024, OutReport.MaxGCPauseMs);
+
+	return true;
+}
+
+FString FLuaScenario::Export(const FLuaScenarioReport& Report, const FString& FileName/* = FString()*/)
+{
+	FString FilePath = FileName;
+	if (FilePath.IsEmpty())
+	{
+		FilePath = FString::Printf(TEXT("Scenario-%s.json"), *FDateTime::Now().ToString());
+	}
+
+	if (FPaths::IsRelative(FilePath))
+	{
+		FilePath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmark"), FilePath);
+	}
+
+	if (!FFileHelper::SaveStringToFile(Report.ToJson(), *FilePath, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM))
+	{
+		UE_LOG(LogBlueluaBenchmark, Error, TEXT("Export lua scenario report failed! Can't write file[%s]!"), *FilePath);
+		return FString();
+	}
+
+	return FPaths::ConvertRelativePathToFull(FilePath);
+}
+
+bool FLuaScenario::CreateWorld()
+{
+	if (!GEngine)
+	{
+		return false;
+	}
+
+	// a standalone game instance owns an empty game world, no map or viewport is needed
+	GameInstance = NewObject<UGameInstance>(GEngine);
+	GameInstance->AddToRoot();
+	GameInstance->InitializeStandalone();
+
+	World = GameInstance->GetWorld();
+	if (!World)
+	{
+		UE_LOG(LogBlueluaBenchmark, Error, TEXT("Lua scenario failed! Can't create game world!"));
+		return false;
+	}
+
+	const FURL URL;
+	World->SetGameMode(URL);
+	World->InitializeActorsForPlay(URL);
+	World->BeginPlay();
+
+	Hub = NewObject<UBlueluaBenchmarkTarget>(World);
+	Hub->AddToRoot();
+
+	return true;
+}
+
+void FLuaScenario::DestroyWorld()
+{
+	if (Hub)
+	{
+		Hub->RemoveFromRoot();
+		Hub = nullptr;
+	}
+
+	if (GameInstance)
+	{
+		GameInstance->Shutdown();
+
+		if (World)
+		{
+			World->DestroyWorld(false);
+			GEngine->DestroyWorldContext(World);
+			World = nullptr;
+		}
+
+		GameInstance->RemoveFromRoot();
+		GameInstance = nullptr;
+	}
+
+	for (const FString& GeneratedFile : GeneratedFiles)
+	{
+		IFileManager::Get().Delete(*GeneratedFile);
+	}
+	GeneratedFiles.Empty();
+}
+
+bool FLuaScenario::PrepareLuaFiles()
+{
+	auto PrepareLuaFile = [this](const FString& LuaFile, const TCHAR* BuiltinName, const TCHAR* BuiltinLua, FString& OutLuaPath)
+	{
+		if (!LuaFile.IsEmpty())
+		{
+			OutLuaPath = LuaFile;
+			return true;
+		}
+
+		OutLuaPath = FPaths::ConvertRelativePathToFull(FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmark"), BuiltinName));
+		if (!FFileHelper::SaveStringToFile(BuiltinLua, *OutLuaPath))
+		{
+			UE_LOG(LogBlueluaBenchmark, Error, TEXT("Lua scenario failed! Can't write file[%s]!"), *OutLuaPath);
+			return false;
+		}
+
+		GeneratedFiles.Add(OutLuaPath);
+		return true;
+	};
+
+	return PrepareLuaFile(Settings.ActorLuaFile, TEXT("ScenarioActor.lua"), ScenarioActorLua, ActorLuaPath)
+		&& PrepareLuaFile(Settings.WidgetLuaFile, TEXT("ScenarioWidget.lua"), ScenarioWidgetLua, WidgetLuaPath);
+}
+
+void FLuaScenario::SpawnActors()
+{
+	Actors.Reserve(Settings.NumActors);
+
+	for (int32 Index = 0; Index < Settings.NumActors; ++Index)
+	{
+		const FTransform Transform(FVector(100.f * (Index % 100), 100.f * (Index / 100), 0.f));
+
+		// Hub and lua file must be set before BeginPlay binds lua
+		ABlueluaScenarioActor* Actor = World->SpawnActorDeferred<ABlueluaScenarioActor>(ABlueluaScenarioActor::StaticClass(), Transform);
+		if (Actor)
+		{
+			Actor->Hub = Hub;
+			Actor->SetLuaFilePath(ActorLuaPath);
+			Actor->FinishSpawning(Transform);
+			Actors.Add(Actor);
+		}
+	}
+}
+
+void FLuaScenario::CreateWidgets()
+{
+	Widgets.Reserve(Settings.NumWidgets);
+
+	for (int32 Index = 0; Index < Settings.NumWidgets; ++Index)
+	{
+		UBlueluaScenarioWidget* Widget = CreateWidget<UBlueluaScenarioWidget>(World, UBlueluaScenarioWidget::StaticClass());
+		if (Widget)
+		{
+			// not in the viewport, nothing else keeps it alive
+			Widget->AddToRoot();
+			Widget->SetLuaFilePath(WidgetLuaPath);
+			Widget->ScenarioConstruct();
+			Widgets.Add(Widget);
+		}
+	}
+}
+
+void FLuaScenario::DespawnAll()
+{
+	for (ABlueluaScenarioActor* Actor : Actors)
+	{
+		if (Actor && !Actor->IsPendingKill())
+		{
+			Actor->Destroy();
+		}
+	}
+	Actors.Empty();
+
+	for (UBlueluaScenarioWidget* Widget : Widgets)
+	{
+		Widget->ScenarioDestruct();
+		Widget->RemoveFromRoot();
+	}
+	Widgets.Empty();
+}
+
+void FLuaScenario::TickFrame()
+{
+	// also processes latent actions of the widgets
+	World->Tick(LEVELTICK_All, Settings.DeltaTime);
+
+	for (UBlueluaScenarioWidget* Widget : Widgets)
+	{
+		Widget->ScenarioTick(Settings.DeltaTime);
+	}
+
+	for (int32 Index = 0; Index < Settings.EventsPerFrame; ++Index)
+	{
+		Hub->OnBenchmark.Broadcast(Index);
+	}
+
+	// lua state ticks timers, coroutines and gc from the core ticker
+	FTicker::GetCoreTicker().Tick(Settings.DeltaTime);
+}
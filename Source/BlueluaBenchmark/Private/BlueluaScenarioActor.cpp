@@ -0,0 +1,29 @@
+#include "BlueluaScenarioActor.h"
+
+#include "Misc/Paths.h"
+
+#include "BlueluaBenchmarkTarget.h"
+
+ABlueluaScenarioActor::ABlueluaScenarioActor()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	Speed = 1.f;
+}
+
+void ABlueluaScenarioActor::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	// AActor only calls ReceiveTick for blueprint classes
+	ReceiveTick(DeltaSeconds);
+}
+
+void ABlueluaScenarioActor::SetLuaFilePath(const FString& InLuaFilePath)
+{
+	LuaFilePath = InLuaFilePath;
+}
+
+FString ABlueluaScenarioActor::OnInitBindingLuaPath_Implementation()
+{
+	return FPaths::IsRelative(LuaFilePath) ? Super::OnInitBindingLuaPath_Implementation() : LuaFilePath;
+}
@@ -0,0 +1,38 @@
+#include "BlueluaScenarioCommandlet.h"
+
+#include "Misc/Parse.h"
+
+#include "BlueluaBenchmark.h"
+#include "BlueluaScenario.h"
+
+UBlueluaScenarioCommandlet::UBlueluaScenarioCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UBlueluaScenarioCommandlet::Main(const FString& Params)
+{
+	FLuaScenarioReport Report;
+	FLuaScenario Scenario(FLuaScenarioSettings::FromCommandLine(*Params));
+	if (!Scenario.Run(Report))
+	{
+		UE_LOG(LogBlueluaBenchmark, Error, TEXT("Lua scenario commandlet failed!"));
+		return 1;
+	}
+
+	FString OutputFile;
+	FParse::Value(*Params, TEXT("Output="), OutputFile);
+
+	const FString FilePath = FLuaScenario::Export(Report, OutputFile);
+	if (FilePath.IsEmpty())
+	{
+		return 1;
+	}
+
+	UE_LOG(LogBlueluaBenchmark, Display, TEXT("Lua scenario report exported to %s"), *FilePath);
+
+	return 0;
+}
@@ -0,0 +1,33 @@
+#include "BlueluaScenarioWidget.h"
+
+#include "Misc/Paths.h"
+
+void UBlueluaScenarioWidget::SetLuaFilePath(const FString& InLuaFilePath)
+{
+	LuaFilePath = InLuaFilePath;
+}
+
+void UBlueluaScenarioWidget::ScenarioConstruct()
+{
+	Initialize();
+	NativeConstruct();
+}
+
+void UBlueluaScenarioWidget::ScenarioDestruct()
+{
+	NativeDestruct();
+}
+
+void UBlueluaScenarioWidget::ScenarioTick(float DeltaTime)
+{
+	Tick(GetCachedGeometry(), DeltaTime);
+
+	// latent actions with this widget as world context are processed by the world tick,
+	// with the pass for objects nothing else ticks, so no class flags are touched here
+	TickActions(DeltaTime);
+}
+
+FString UBlueluaScenarioWidget::OnInitBindingLuaPath_Implementation()
+{
+	return FPaths::IsRelative(LuaFilePath) ? Super::OnInitBindingLuaPath_Implementation() : LuaFilePath;
+}
@@ -0,0 +1,79 @@
+// Copyright 1998-2018 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Modules/ModuleManager.h"
+#include "Templates/Function.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogBlueluaBenchmark, Log, All);
+
+class FLuaState;
+
+struct BLUELUABENCHMARK_API FLuaBenchmarkResult
+{
+	FString Group;
+	// "Function Signature" column of Benchmark.xlsx
+	FString Name;
+	int64 Iterations = 0;
+	// "Blueprint(s)" column, same operation from C++ through ProcessEvent, 0 if not measured
+	double NativeSeconds = 0.0;
+	// "Lua(s)" column, empty loop overhead excluded
+	double LuaSeconds = 0.0;
+	double NanosecondsPerOp = 0.0;
+	// lua heap allocations, the bridge allocates through the lua allocator for proxies and tables
+	double AllocationsPerOp = 0.0;
+};
+
+// Runs one operation many times after a warm-up and collects the cost per operation.
+class BLUELUABENCHMARK_API FLuaBenchmark
+{
+public:
+	explicit FLuaBenchmark(TSharedPtr<FLuaState> InLuaState);
+
+	// run Body Iterations times in a lua loop, Setup runs once before the loop, Body sees Target and i
+	bool RunLua(const FString& Group, const FString& Name, const FString& Setup, const FString& Body, int64 Iterations = 0);
+
+	// run Code once with Target, e.g. to bind lua listeners before RunNative
+	bool Prepare(const FString& Code);
+
+	// run Body(Iterations) from C++, e.g. firing a delegate bound to lua
+	bool RunNative(const FString& Group, const FString& Name, TFunctionRef<void(int64)> Body, int64 Iterations = 0);
+
+	// measure the same operation from C++ as baseline of the last result
+	void SetNativeBaseline(TFunctionRef<void(int64)> Body);
+
+	// value of Target seen by lua code
+	void SetTarget(UObject* InTarget);
+
+	const TArray<FLuaBenchmarkResult>& GetResults() const;
+
+	// write csv and json to Saved/Benchmark, returns the csv path or empty if failed
+	FString Export(const FString& BaseName) const;
+
+	static int64 GetDefaultIterations();
+
+protected:
+	double MeasureLuaLoop(int32 FunctionIndex, int64 Iterations, uint64& OutAllocations);
+	void AddResult(const FString& Group, const FString& Name, int64 Iterations, double Seconds, uint64 Allocations);
+
+	uint64 GetAllocationCount() const;
+
+protected:
+	TSharedPtr<FLuaState> LuaState;
+
+	TWeakObjectPtr<UObject> Target;
+
+	// seconds per iteration of an empty lua loop
+	double EmptyLoopSeconds;
+
+	TArray<FLuaBenchmarkResult> Results;
+};
+
+class FBlueluaBenchmarkModule : public IModuleInterface
+{
+public:
+	/** IModuleInterface implementation */
+	virtual void StartupModule() override;
+	virtual void ShutdownModule() override;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "LuaImplementableInterface.h"
+#include "BlueluaBenchmarkTarget.generated.h"
+
+class FLuaState;
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FBlueluaBenchmarkDelegate, int32, Value);
+
+USTRUCT(BlueprintType)
+struct FBlueluaBenchmarkStruct
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 IntValue = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	float FloatValue = 0.f;
+
+	UPROPERTY(BlueprintReadWrite)
+	FVector VectorValue = FVector::ZeroVector;
+
+	UPROPERTY(BlueprintReadWrite)
+	FString StringValue;
+};
+
+// Object the benchmarks call into, every member is a bridge crossing measured by FLuaBenchmark.
+UCLASS()
+class BLUELUABENCHMARK_API UBlueluaBenchmarkTarget : public UObject, public ILuaImplementableInterface
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintCallable)
+	void Func0();
+
+	UFUNCTION(BlueprintCallable)
+	int32 Func1(int32 A);
+
+	UFUNCTION(BlueprintCallable)
+	int32 Func4(int32 A, int32 B, int32 C, int32 D);
+
+	UFUNCTION(BlueprintCallable)
+	int32 Func8(int32 A, int32 B, int32 C, int32 D, int32 E, int32 F, int32 G, int32 H);
+
+	UFUNCTION(BlueprintCallable)
+	FString FuncString(const FString& A);
+
+	UFUNCTION(BlueprintCallable)
+	FVector FuncVector(const FVector& A);
+
+	UFUNCTION(BlueprintCallable)
+	FBlueluaBenchmarkStruct FuncStruct(const FBlueluaBenchmarkStruct& A);
+
+	// fill containers with Num elements
+	UFUNCTION(BlueprintCallable)
+	void ResizeContainers(int32 Num);
+
+	UFUNCTION()
+	void OnBenchmarkDelegate(int32 Value);
+
+	// overridden by the benchmark lua module when bound
+	UFUNCTION(BlueprintCallable, BlueprintImplementableEvent)
+	void ReceiveBenchmarkEvent(int32 Value);
+
+	// bind to lua file in InLuaState, an empty path releases the binding
+	bool BindLua(TSharedPtr<FLuaState> InLuaState, const FString& InLuaFilePath);
+
+	virtual void BeginDestroy() override;
+	virtual void ProcessEvent(UFunction* Function, void* Parameters) override;
+
+protected:
+	virtual FString OnInitBindingLuaPath_Implementation() override;
+	virtual bool ShouldEnableLuaBinding_Implementation() override;
+	virtual TSharedPtr<FLuaState> OnInitLuaState() override;
+
+public:
+	UPROPERTY(BlueprintReadWrite)
+	bool BoolValue;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 IntValue;
+
+	UPROPERTY(BlueprintReadWrite)
+	int64 Int64Value;
+
+	UPROPERTY(BlueprintReadWrite)
+	float FloatValue;
+
+	UPROPERTY(BlueprintReadWrite)
+	FName NameValue;
+
+	UPROPERTY(BlueprintReadWrite)
+	FString StringValue;
+
+	UPROPERTY(BlueprintReadWrite)
+	FText TextValue;
+
+	UPROPERTY(BlueprintReadWrite)
+	FVector VectorValue;
+
+	UPROPERTY(BlueprintReadWrite)
+	UObject* ObjectValue;
+
+	UPROPERTY(BlueprintReadWrite)
+	FBlueluaBenchmarkStruct StructValue;
+
+	UPROPERTY(BlueprintReadWrite)
+	TArray<int32> IntArray;
+
+	UPROPERTY(BlueprintReadWrite)
+	TMap<int32, int32> IntMap;
+
+	UPROPERTY(BlueprintReadWrite)
+	TSet<int32> IntSet;
+
+	UPROPERTY(BlueprintAssignable)
+	FBlueluaBenchmarkDelegate OnBenchmark;
+
+	int64 CallCount;
+
+protected:
+	TSharedPtr<FLuaState> BenchmarkLuaState;
+	FString LuaFilePath;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ABlueluaScenarioActor;
+class UBlueluaBenchmarkTarget;
+class UBlueluaScenarioWidget;
+class UGameInstance;
+class UWorld;
+
+struct BLUELUABENCHMARK_API FLuaScenarioSettings
+{
+	int32 NumActors = 2000;
+	int32 NumWidgets = 300;
+	int32 NumFrames = 300;
+	// broadcasts of the shared event delegate per frame, every actor listens to it
+	int32 EventsPerFrame = 16;
+	float DeltaTime = 1.f / 30.f;
+
+	// lua files relative to Content, the built-in scripts are used if empty
+	FString ActorLuaFile;
+	FString WidgetLuaFile;
+
+	// read -Actors= -Widgets= -Frames= -Events= -ActorLua= -WidgetLua= from a command line, unset values keep the cvar defaults
+	static FLuaScenarioSettings FromCommandLine(const TCHAR* CommandLine);
+};
+
+struct BLUELUABENCHMARK_API FLuaScenarioReport
+{
+	FLuaScenarioSettings Settings;
+
+	double SpawnActorsMs = 0.0;
+	double CreateWidgetsMs = 0.0;
+	double DespawnMs = 0.0;
+
+	double AverageFrameMs = 0.0;
+	double MedianFrameMs = 0.0;
+	double P95FrameMs = 0.0;
+	double P99FrameMs = 0.0;
+	double MaxFrameMs = 0.0;
+
+	// lua heap bytes in use
+	uint64 HeapBeforeSpawn = 0;
+	uint64 HeapAfterSpawn = 0;
+	uint64 HeapPeak = 0;
+	uint64 HeapAfterDespawn = 0;
+
+	int64 GCSteps = 0;
+	int64 GCFullCollects = 0;
+	double TotalGCPauseMs = 0.0;
+	double MaxGCPauseMs = 0.0;
+
+	TArray<float> FrameMs;
+	TArray<float> GCPauseMs;
+
+	FString ToJson() const;
+};
+
+// Spawns lua bound actors and widgets in a transient game world, ticks it for a number of frames
+// and measures what a player would see at that scale. Runs without rendering, e.g. with -nullrhi.
+class BLUELUABENCHMARK_API FLuaScenario
+{
+public:
+	explicit FLuaScenario(const FLuaScenarioSettings& InSettings);
+	~FLuaScenario();
+
+	bool Run(FLuaScenarioReport& OutReport);
+
+	// write report json to Saved/Benchmark, returns the file path or empty if failed
+	static FString Export(const FLuaScenarioReport& Report, const FString& FileName = FString());
+
+protected:
+	bool CreateWorld();
+	void DestroyWorld();
+	bool PrepareLuaFiles();
+	void SpawnActors();
+	void CreateWidgets();
+	void DespawnAll();
+	void TickFrame();
+
+protected:
+	FLuaScenarioSettings Settings;
+
+	UGameInstance* GameInstance;
+	UWorld* World;
+
+	UBlueluaBenchmarkTarget* Hub;
+	TArray<ABlueluaScenarioActor*> Actors;
+	TArray<UBlueluaScenarioWidget*> Widgets;
+
+	FString ActorLuaPath;
+	FString WidgetLuaPath;
+	TArray<FString> GeneratedFiles;
+};
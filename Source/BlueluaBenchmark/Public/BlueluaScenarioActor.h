@@ -0,0 +1,39 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LuaImplementableActor.h"
+#include "BlueluaScenarioActor.generated.h"
+
+class UBlueluaBenchmarkTarget;
+
+// Lua bound actor of the scenario harness, ticks through the lua ReceiveTick override.
+UCLASS()
+class BLUELUABENCHMARK_API ABlueluaScenarioActor : public ALuaImplementableActor
+{
+	GENERATED_BODY()
+
+public:
+	ABlueluaScenarioActor();
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	// absolute paths are used as is, others are relative to Content
+	void SetLuaFilePath(const FString& InLuaFilePath);
+
+protected:
+	virtual FString OnInitBindingLuaPath_Implementation() override;
+
+public:
+	// shared event source of the delegate flows
+	UPROPERTY(BlueprintReadOnly)
+	UBlueluaBenchmarkTarget* Hub;
+
+	UPROPERTY(BlueprintReadWrite)
+	float Speed;
+
+	UPROPERTY(BlueprintReadWrite)
+	float Distance;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 EventCount;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "BlueluaScenarioCommandlet.generated.h"
+
+/**
+ * Run the lua scenario harness headless and write its json report.
+ * Usage: -run=BlueluaScenario -nullrhi [-Actors=2000] [-Widgets=300] [-Frames=300] [-Events=16] [-ActorLua=] [-WidgetLua=] [-Output=]
+ */
+UCLASS()
+class UBlueluaScenarioCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UBlueluaScenarioCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LuaImplementableWidget.h"
+#include "BlueluaScenarioWidget.generated.h"
+
+// Lua bound widget of the scenario harness, constructed and ticked without slate so it runs headless.
+UCLASS()
+class BLUELUABENCHMARK_API UBlueluaScenarioWidget : public ULuaImplementableWidget
+{
+	GENERATED_BODY()
+
+public:
+	// absolute paths are used as is, others are relative to Content
+	void SetLuaFilePath(const FString& InLuaFilePath);
+
+	void ScenarioConstruct();
+	void ScenarioDestruct();
+
+	// lua Tick event and actions, what slate would tick for a visible widget, latent actions are ticked by the world
+	void ScenarioTick(float DeltaTime);
+
+protected:
+	virtual FString OnInitBindingLuaPath_Implementation() override;
+
+public:
+	UPROPERTY(BlueprintReadWrite)
+	int32 FiredCount;
+};
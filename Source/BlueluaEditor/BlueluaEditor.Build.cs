@@ -38,6 +38,8 @@ public class BlueluaEditor : ModuleRules
 				"Engine",
 				"UMG",
 				"UnrealEd",
+				"DirectoryWatcher",
+				"Projects",
 				// ... add private dependencies that you statically link with here ...	
 				"Bluelua",
 			}
@@ -0,0 +1,534 @@
+#include "BlueluaBindingsCommandlet.h"
+
+#include "Interfaces/IPluginManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+#include "UObject/UnrealType.h"
+
+#include "Bluelua.h"
+
+enum class ELuaBindingParamType
+{
+	Unsupported,
+	Bool,
+	Integer,
+	Number,
+	String,
+	Text,
+	Name,
+	Enum,
+	Object,
+	Struct,
+};
+
+static ELuaBindingParamType GetParamType(UProperty* Property)
+{
+	if (UBoolProperty* BoolProperty = Cast<UBoolProperty>(Property))
+	{
+		return BoolProperty->IsNativeBool() ? ELuaBindingParamType::Bool : ELuaBindingParamType::Unsupported;
+	}
+	else if (Cast<UEnumProperty>(Property))
+	{
+		return ELuaBindingParamType::Enum;
+	}
+	else if (UByteProperty* ByteProperty = Cast<UByteProperty>(Property))
+	{
+		return ByteProperty->Enum ? ELuaBindingParamType::Enum : ELuaBindingParamType::Integer;
+	}
+	else if (UNumericProperty* NumericProperty = Cast<UNumericProperty>(Property))
+	{
+		return NumericProperty->IsFloatingPoint() ? ELuaBindingParamType::Number : ELuaBindingParamType::Integer;
+	}
+	else if (Cast<UStrProperty>(Property))
+	{
+		return ELuaBindingParamType::String;
+	}
+	else if (Cast<UTextProperty>(Property))
+	{
+		return ELuaBindingParamType::Text;
+	}
+	else if (Cast<UNameProperty>(Property))
+	{
+		return ELuaBindingParamType::Name;
+	}
+	else if (Cast<UClassProperty>(Property))
+	{
+		// TSubclassOf needs the class check of the reflection path
+		return ELuaBindingParamType::Unsupported;
+	}
+	else if (Cast<UObjectProperty>(Property))
+	{
+		return ELuaBindingParamType::Object;
+	}
+	else if (Cast<UStructProperty>(Property))
+	{
+		return ELuaBindingParamType::Struct;
+	}
+
+	return ELuaBindingParamType::Unsupported;
+}
+
+static bool IsCoreUObjectType(UField* Type)
+{
+	return Type->GetOutermost()->GetName() == TEXT("/Script/CoreUObject");
+}
+
+static FString GetModuleName(UField* Type)
+{
+	return FPackageName::GetShortName(Type->GetOutermost()->GetName());
+}
+
+// header to include for a class or struct, empty if it comes with CoreMinimal, returns false if the header isn't public
+static bool GetTypeInclude(UField* Type, FString& OutInclude)
+{
+	OutInclude.Empty();
+
+	if (IsCoreUObjectType(Type))
+	{
+		return true;
+	}
+
+	if (Cast<UClass>(Type))
+	{
+		OutInclude = Type->GetMetaData(TEXT("IncludePath"));
+		return !OutInclude.IsEmpty();
+	}
+
+	FString ModuleRelativePath = Type->GetMetaData(TEXT("ModuleRelativePath"));
+	if (ModuleRelativePath.EndsWith(TEXT("NoExportTypes.h")))
+	{
+		return false;
+	}
+
+	if (ModuleRelativePath.RemoveFromStart(TEXT("Public/")) || ModuleRelativePath.RemoveFromStart(TEXT("Classes/")))
+	{
+		OutInclude = ModuleRelativePath;
+		return true;
+	}
+
+	return false;
+}
+
+static FString GetClassCPPName(UClass* Class)
+{
+	return FString(Class->GetPrefixCPP()) + Class->GetName();
+}
+
+static bool IsOutParam(UProperty* Property)
+{
+	// same as FLuaObjectBase::CallFunction, const refs aren't pushed back
+	return Property->HasAnyPropertyFlags(CPF_OutParm) && !Property->HasAnyPropertyFlags(CPF_ConstParm);
+}
+
+static FString GetFetchCode(UProperty* Property, ELuaBindingParamType ParamType, int32 Index)
+{
+	const FString CPPType = Property->GetCPPType();
+
+	switch (ParamType)
+	{
+	case ELuaBindingParamType::Bool:
+		return FString::Printf(TEXT("(lua_toboolean(L, %d) != 0)"), Index);
+	case ELuaBindingParamType::Integer:
+		return FString::Printf(TEXT("(%s)lua_tointeger(L, %d)"), *CPPType, Index);
+	case ELuaBindingParamType::Number:
+		return FString::Printf(TEXT("(%s)lua_tonumber(L, %d)"), *CPPType, Index);
+	case ELuaBindingParamType::String:
+	case ELuaBindingParamType::Name:
+		return FString::Printf(TEXT("%s(UTF8_TO_TCHAR(lua_tostring(L, %d)))"), *CPPType, Index);
+	case ELuaBindingParamType::Text:
+		return FString::Printf(TEXT("FText::FromString(UTF8_TO_TCHAR(lua_tostring(L, %d)))"), Index);
+	case ELuaBindingParamType::Enum:
+		return FString::Printf(TEXT("(%s)(int32)lua_tointeger(L, %d)"), *CPPType, Index);
+	case ELuaBindingParamType::Object:
+		return FString::Printf(TEXT("Cast<%s>(FLuaUObject::Fetch(L, %d))"), *GetClassCPPName(Cast<UObjectProperty>(Property)->PropertyClass), Index);
+	case ELuaBindingParamType::Struct:
+		return FString::Printf(TEXT("FLuaBindingRegistry::FetchStruct<%s>(L, %d, Struct_%s)"), *CPPType, Index, *Property->GetName());
+	default:
+		return FString();
+	}
+}
+
+static FString GetPushCode(UProperty* Property, ELuaBindingParamType ParamType, const FString& Value)
+{
+	switch (ParamType)
+	{
+	case ELuaBindingParamType::Bool:
+		return FString::Printf(TEXT("lua_pushboolean(L, %s);"), *Value);
+	case ELuaBindingParamType::Integer:
+		return FString::Printf(TEXT("lua_pushinteger(L, (lua_Integer)%s);"), *Value);
+	case ELuaBindingParamType::Number:
+		return FString::Printf(TEXT("lua_pushnumber(L, (lua_Number)%s);"), *Value);
+	case ELuaBindingParamType::String:
+		return FString::Printf(TEXT("lua_pushstring(L, TCHAR_TO_UTF8(*%s));"), *Value);
+	case ELuaBindingParamType::Text:
+	case ELuaBindingParamType::Name:
+		return FString::Printf(TEXT("lua_pushstring(L, TCHAR_TO_UTF8(*%s.ToString()));"), *Value);
+	case ELuaBindingParamType::Enum:
+		return FString::Printf(TEXT("lua_pushinteger(L, (lua_Integer)%s%s);"), Cast<UByteProperty>(Property) ? TEXT("(uint8)") : TEXT(""), *Value);
+	case ELuaBindingParamType::Object:
+		return FString::Printf(TEXT("FLuaUObject::Push(L, (UObject*)%s);"), *Value);
+	case ELuaBindingParamType::Struct:
+		return FString::Printf(TEXT("FLuaUStruct::Push(L, Struct_%s, (void*)&%s, true);"), *Property->GetName(), *Value);
+	default:
+		return FString();
+	}
+}
+
+UBlueluaBindingsCommandlet::UBlueluaBindingsCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UBlueluaBindingsCommandlet::Main(const FString& Params)
+{
+	FString AllowListFile = FPaths::ProjectConfigDir() / TEXT("BlueluaBindings.txt");
+	FParse::Value(*Params, TEXT("AllowList="), AllowListFile);
+
+	FString OutputFile;
+	if (!FParse::Value(*Params, TEXT("Output="), OutputFile))
+	{
+		TSharedPtr<IPlugin> Plugin = IPluginManager::Get().FindPlugin(TEXT("Bluelua"));
+		if (!Plugin.IsValid())
+		{
+			UE_LOG(LogBluelua, Error, TEXT("Generate lua bindings failed! Bluelua plugin not found, specify -Output="));
+			return 1;
+		}
+
+		OutputFile = Plugin->GetBaseDir() / TEXT("Source/Bluelua/Private/Generated/LuaGeneratedBindings.cpp");
+	}
+
+	FString Name = TEXT("Generated");
+	FParse::Value(*Params, TEXT("Name="), Name);
+	for (int32 Index = 0; Index < Name.Len(); ++Index)
+	{
+		if (!FChar::IsAlnum(Name[Index]) && Name[Index] != TEXT('_'))
+		{
+			Name[Index] = TEXT('_');
+		}
+	}
+
+	TArray<UFunction*> Functions;
+	if (!ParseAllowList(AllowListFile, Functions))
+	{
+		return 1;
+	}
+
+	const FString Content = GenerateFile(Functions, AllowListFile, Name);
+
+	FString OldContent;
+	if (FFileHelper::LoadFileToString(OldContent, *OutputFile) && OldContent == Content)
+	{
+		UE_LOG(LogBluelua, Display, TEXT("Lua bindings in %s are up to date."), *OutputFile);
+		return 0;
+	}
+
+	if (!FFileHelper::SaveStringToFile(Content, *OutputFile))
+	{
+		UE_LOG(LogBluelua, Error, TEXT("Generate lua bindings failed! Can't write to %s"), *OutputFile);
+		return 1;
+	}
+
+	UE_LOG(LogBluelua, Display, TEXT("Generated %d lua binding(s) to %s"), Functions.Num(), *OutputFile);
+
+	return 0;
+}
+
+bool UBlueluaBindingsCommandlet::ParseAllowList(const FString& AllowListFile, TArray<UFunction*>& OutFunctions) const
+{
+	TArray<FString> Lines;
+	if (!FFileHelper::LoadFileToStringArray(Lines, *AllowListFile))
+	{
+		UE_LOG(LogBluelua, Error, TEXT("Generate lua bindings failed! Can't read allow-list %s"), *AllowListFile);
+		return false;
+	}
+
+	for (FString Line : Lines)
+	{
+		int32 CommentIndex = INDEX_NONE;
+		if (Line.FindChar(TEXT('#'), CommentIndex))
+		{
+			Line.LeftInline(CommentIndex);
+		}
+
+		Line.TrimStartAndEndInline();
+		if (Line.IsEmpty())
+		{
+			continue;
+		}
+
+		FString ClassName;
+		FString FunctionName;
+		if (!Line.Split(TEXT("."), &ClassName, &FunctionName, ESearchCase::CaseSensitive, ESearchDir::FromEnd))
+		{
+			UE_LOG(LogBluelua, Warning, TEXT("Skip allow-list entry[%s], expect ClassName.FunctionName!"), *Line);
+			continue;
+		}
+
+		UClass* Class = FindObject<UClass>(ANY_PACKAGE, *ClassName);
+		if (!Class && ClassName.Len() > 1)
+		{
+			// accept the C++ name with prefix too
+			Class = FindObject<UClass>(ANY_PACKAGE, *ClassName.RightChop(1));
+		}
+
+		if (!Class)
+		{
+			UE_LOG(LogBluelua, Warning, TEXT("Skip allow-list entry[%s], class not found!"), *Line);
+			continue;
+		}
+
+		FString Reason;
+		if (FunctionName == TEXT("*"))
+		{
+			for (TFieldIterator<UFunction> It(Class, EFieldIteratorFlags::ExcludeSuper); It; ++It)
+			{
+				if (CanGenerate(*It, Reason))
+				{
+					OutFunctions.AddUnique(*It);
+				}
+				else
+				{
+					UE_LOG(LogBluelua, Verbose, TEXT("Skip %s.%s, %s"), *Class->GetName(), *It->GetName(), *Reason);
+				}
+			}
+
+			continue;
+		}
+
+		UFunction* Function = Class->FindFunctionByName(*FunctionName);
+		if (!Function)
+		{
+			UE_LOG(LogBluelua, Warning, TEXT("Skip allow-list entry[%s], function not found!"), *Line);
+		}
+		else if (!CanGenerate(Function, Reason))
+		{
+			UE_LOG(LogBluelua, Warning, TEXT("Skip allow-list entry[%s], %s"), *Line, *Reason);
+		}
+		else
+		{
+			OutFunctions.AddUnique(Function);
+		}
+	}
+
+	return true;
+}
+
+bool UBlueluaBindingsCommandlet::CanGenerate(UFunction* Function, FString& OutReason) const
+{
+	UClass* Class = Function->GetOwnerClass();
+	FString Include;
+
+	if (!Function->HasAnyFunctionFlags(FUNC_Native))
+	{
+		OutReason = TEXT("not a native function.");
+	}
+	else if (Function->HasAnyFunctionFlags(FUNC_Event))
+	{
+		// lua and blueprint can override it, keep the reflection path
+		OutReason = TEXT("overridable event.");
+	}
+	else if (Function->HasAnyFunctionFlags(FUNC_Net))
+	{
+		OutReason = TEXT("network function.");
+	}
+	else if (!Function->HasAnyFunctionFlags(FUNC_Public))
+	{
+		OutReason = TEXT("not public.");
+	}
+	else if (Function->HasAnyFunctionFlags(FUNC_EditorOnly))
+	{
+		OutReason = TEXT("editor only.");
+	}
+	else if (Function->HasMetaData(TEXT("CustomThunk")) || Function->HasMetaData(TEXT("Latent")) || Function->HasMetaData(TEXT("DeprecatedFunction")))
+	{
+		OutReason = TEXT("custom thunk, latent or deprecated function.");
+	}
+	else if (!Class || Class->HasAnyClassFlags(CLASS_Interface))
+	{
+		OutReason = TEXT("interface function.");
+	}
+	else if (!GetTypeInclude(Class, Include))
+	{
+		OutReason = TEXT("class header is not public.");
+	}
+
+	if (!OutReason.IsEmpty())
+	{
+		return false;
+	}
+
+	for (TFieldIterator<UProperty> It(Function); It && It->HasAnyPropertyFlags(CPF_Parm); ++It)
+	{
+		UProperty* Property = *It;
+		const ELuaBindingParamType ParamType = GetParamType(Property);
+
+		if (ParamType == ELuaBindingParamType::Unsupported || Property->ArrayDim > 1)
+		{
+			OutReason = FString::Printf(TEXT("parameter[%s] type %s is not supported."), *Property->GetName(), *Property->GetCPPType());
+		}
+		else if (ParamType == ELuaBindingParamType::Enum && Cast<UByteProperty>(Property) && IsOutParam(Property))
+		{
+			// may be declared as the raw enum or TEnumAsByte, can't tell which one to bind the reference to
+			OutReason = FString::Printf(TEXT("parameter[%s] is a byte enum reference."), *Property->GetName());
+		}
+		else if (ParamType == ELuaBindingParamType::Object && !GetTypeInclude(Cast<UObjectProperty>(Property)->PropertyClass, Include))
+		{
+			OutReason = FString::Printf(TEXT("parameter[%s] class header is not public."), *Property->GetName());
+		}
+		else if (ParamType == ELuaBindingParamType::Struct && !GetTypeInclude(Cast<UStructProperty>(Property)->Struct, Include))
+		{
+			OutReason = FString::Printf(TEXT("parameter[%s] struct header is not public."), *Property->GetName());
+		}
+
+		if (!OutReason.IsEmpty())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+FString UBlueluaBindingsCommandlet::GenerateBinding(UFunction* Function, TSet<FString>& OutIncludes, TSet<FString>& OutModules) const
+{
+	UClass* Class = Function->GetOwnerClass();
+	const FString ClassCPPName = GetClassCPPName(Class);
+	const bool bIsStatic = Function->HasAnyFunctionFlags(FUNC_Static);
+
+	FString Include;
+	if (GetTypeInclude(Class, Include) && !Include.IsEmpty())
+	{
+		OutIncludes.Add(Include);
+	}
+	OutModules.Add(GetModuleName(Class));
+
+	FString Code;
+	Code += FString::Printf(TEXT("// %s::%s\n"), *ClassCPPName, *Function->GetName());
+	Code += FString::Printf(TEXT("static int LuaBinding_%s_%s(lua_State* L)\n{\n"), *ClassCPPName, *Function->GetName());
+	Code += TEXT("\tUFunction* Function = (UFunction*)lua_touserdata(L, lua_upvalueindex(1));\n");
+
+	if (!bIsStatic)
+	{
+		Code += FString::Printf(TEXT("\t%s* Self = Cast<%s>(FLuaUObject::Fetch(L, 1));\n"), *ClassCPPName, *ClassCPPName);
+		Code += FString::Printf(TEXT("\tif (!Self)\n\t{\n\t\treturn luaL_error(L, \"Call function[%s] failed! Param 1 must be a %s, call it with ':' on a valid object!\");\n\t}\n"),
+			*Function->GetName(), *ClassCPPName);
+	}
+
+	Code += TEXT("\n\tFLuaBindingScope Scope(L, Function);\n\n");
+
+	FString Arguments;
+	FString PushCode;
+	UProperty* ReturnProperty = nullptr;
+	int32 ParamIndex = 2;
+	int32 ReturnCount = 0;
+
+	for (TFieldIterator<UProperty> It(Function); It && It->HasAnyPropertyFlags(CPF_Parm); ++It)
+	{
+		UProperty* Property = *It;
+		const ELuaBindingParamType ParamType = GetParamType(Property);
+
+		UField* Type = nullptr;
+		if (ParamType == ELuaBindingParamType::Object)
+		{
+			Type = Cast<UObjectProperty>(Property)->PropertyClass;
+		}
+		else if (ParamType == ELuaBindingParamType::Struct)
+		{
+			UScriptStruct* Struct = Cast<UStructProperty>(Property)->Struct;
+			Code += FString::Printf(TEXT("\tstatic UScriptStruct* Struct_%s = FindObjectChecked<UScriptStruct>(nullptr, TEXT(\"%s\"));\n"), *Property->GetName(), *Struct->GetPathName());
+			Type = Struct;
+		}
+
+		if (Type)
+		{
+			if (GetTypeInclude(Type, Include) && !Include.IsEmpty())
+			{
+				OutIncludes.Add(Include);
+			}
+			OutModules.Add(GetModuleName(Type));
+		}
+
+		if (Property->HasAnyPropertyFlags(CPF_ReturnParm))
+		{
+			ReturnProperty = Property;
+			continue;
+		}
+
+		const FString LocalName = TEXT("Param_") + Property->GetName();
+		Code += FString::Printf(TEXT("\t%s %s = %s;\n"), *Property->GetCPPType(), *LocalName, *GetFetchCode(Property, ParamType, ParamIndex++));
+
+		Arguments += Arguments.IsEmpty() ? LocalName : TEXT(", ") + LocalName;
+
+		if (IsOutParam(Property))
+		{
+			PushCode += TEXT("\t") + GetPushCode(Property, ParamType, LocalName) + TEXT("\n");
+			++ReturnCount;
+		}
+	}
+
+	const FString Call = FString::Printf(TEXT("%s%s(%s)"), bIsStatic ? *(ClassCPPName + TEXT("::")) : TEXT("Self->"), *Function->GetName(), *Arguments);
+
+	Code += TEXT("\n");
+	if (ReturnProperty)
+	{
+		Code += FString::Printf(TEXT("\tconst auto ReturnValue = %s;\n\n"), *Call);
+		Code += TEXT("\t") + GetPushCode(ReturnProperty, GetParamType(ReturnProperty), TEXT("ReturnValue")) + TEXT("\n");
+		++ReturnCount;
+	}
+	else
+	{
+		Code += FString::Printf(TEXT("\t%s;\n\n"), *Call);
+	}
+
+	Code += PushCode;
+	Code += FString::Printf(TEXT("\n\treturn %d;\n}\n"), ReturnCount);
+
+	return Code;
+}
+
+FString UBlueluaBindingsCommandlet::GenerateFile(const TArray<UFunction*>& Functions, const FString& AllowListFile, const FString& Name) const
+{
+	TSet<FString> Includes;
+	TSet<FString> Modules;
+
+	FString Bindings;
+	FString Registers;
+	for (UFunction* Function : Functions)
+	{
+		const FString ClassCPPName = GetClassCPPName(Function->GetOwnerClass());
+
+		Bindings += GenerateBinding(Function, Includes, Modules) + TEXT("\n");
+		Registers += FString::Printf(TEXT("\tFLuaBindingRegistry::Register(%s::StaticClass()->FindFunctionByName(TEXT(\"%s\")), &LuaBinding_%s_%s);\n"),
+			*ClassCPPName, *Function->GetName(), *ClassCPPName, *Function->GetName());
+	}
+
+	Includes.Sort([](const FString& A, const FString& B) { return A < B; });
+	Modules.Sort([](const FString& A, const FString& B) { return A < B; });
+
+	FString Content;
+	Content += FString::Printf(TEXT("// Generated by the BlueluaBindings commandlet from %s, do not edit.\n"), *FPaths::GetCleanFilename(AllowListFile));
+	Content += FString::Printf(TEXT("// Modules used by the bindings, Bluelua.Build.cs must depend on them: %s\n\n"), *FString::Join(Modules.Array(), TEXT(", ")));
+
+	Content += TEXT("#include \"LuaBindingRegistry.h\"\n\n");
+	for (const FString& IncludePath : Includes)
+	{
+		Content += FString::Printf(TEXT("#include \"%s\"\n"), *IncludePath);
+	}
+	if (Includes.Num() > 0)
+	{
+		Content += TEXT("\n");
+	}
+	Content += TEXT("#include \"lua.hpp\"\n#include \"LuaUObject.h\"\n#include \"LuaUStruct.h\"\n\n");
+
+	Content += Bindings;
+
+	Content += FString::Printf(TEXT("static void RegisterLuaBindings_%s()\n{\n%s}\n\n"), *Name, *Registers);
+	Content += FString::Printf(TEXT("static FLuaBindingAutoRegister LuaBindingAutoRegister_%s(&RegisterLuaBindings_%s);\n"), *Name, *Name);
+
+	return Content;
+}
@@ -1,20 +1,42 @@
 // Copyright 1998-2018 Epic Games, Inc. All Rights Reserved.
 
 #include "BlueluaEditor.h"
+#include "DirectoryWatcherModule.h"
 #include "Editor.h"
+#include "HAL/IConsoleManager.h"
+#include "IDirectoryWatcher.h"
+#include "Misc/Paths.h"
 
 #include "Bluelua.h"
 #include "LuaImplementableInterface.h"
 
 #define LOCTEXT_NAMESPACE "FBlueluaEditorModule"
 
+static TAutoConsoleVariable<int32> CVarLuaHotReload(
+	TEXT("bluelua.HotReload"),
+	1,
+	TEXT("Reload changed lua files in running lua states without tearing them down."));
+
 void FBlueluaEditorModule::StartupModule()
 {
 	FEditorDelegates::EndPIE.AddRaw(this, &FBlueluaEditorModule::OnEndPIE);
+
+	FDirectoryWatcherModule& DirectoryWatcherModule = FModuleManager::LoadModuleChecked<FDirectoryWatcherModule>(TEXT("DirectoryWatcher"));
+	if (IDirectoryWatcher* DirectoryWatcher = DirectoryWatcherModule.Get())
+	{
+		WatchingDirectory = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir());
+		DirectoryWatcher->RegisterDirectoryChangedCallback_Handle(WatchingDirectory,
+			IDirectoryWatcher::FDirectoryChanged::CreateRaw(this, &FBlueluaEditorModule::OnLuaFilesChanged), LuaFilesChangedHandle);
+	}
 }
 
 void FBlueluaEditorModule::ShutdownModule()
 {
+	FDirectoryWatcherModule* DirectoryWatcherModule = FModuleManager::GetModulePtr<FDirectoryWatcherModule>(TEXT("DirectoryWatcher"));
+	if (DirectoryWatcherModule && DirectoryWatcherModule->Get() && LuaFilesChangedHandle.IsValid())
+	{
+		DirectoryWatcherModule->Get()->UnregisterDirectoryChangedCallback_Handle(WatchingDirectory, LuaFilesChangedHandle);
+	}
 }
 
 void FBlueluaEditorModule::OnEndPIE(bool bIsSimulating)
@@ -24,6 +46,28 @@ void FBlueluaEditorModule::OnEndPIE(bool bIsSimulating)
 	FBlueluaModule::Get().ResetDefaultLuaState();
 }
 
+void FBlueluaEditorModule::OnLuaFilesChanged(const TArray<FFileChangeData>& FileChanges)
+{
+	if (CVarLuaHotReload.GetValueOnGameThread() == 0)
+	{
+		return;
+	}
+
+	TSet<FString> ChangedFiles;
+	for (const FFileChangeData& FileChange : FileChanges)
+	{
+		if (FileChange.Action != FFileChangeData::FCA_Removed && FPaths::GetExtension(FileChange.Filename).Equals(TEXT("lua")))
+		{
+			ChangedFiles.Emplace(FileChange.Filename);
+		}
+	}
+
+	for (const FString& ChangedFile : ChangedFiles)
+	{
+		ILuaImplementableInterface::HotReloadLuaFile(ChangedFile);
+	}
+}
+
 #undef LOCTEXT_NAMESPACE
 	
 IMPLEMENT_MODULE(FBlueluaEditorModule, BlueluaEditor)
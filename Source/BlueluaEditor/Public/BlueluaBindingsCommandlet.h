@@ -0,0 +1,30 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "BlueluaBindingsCommandlet.generated.h"
+
+/**
+ * Generate direct native lua glue for the UFunctions in an allow-list, see FLuaBindingRegistry.
+ * Allow-list lines are ClassName.FunctionName or ClassName.* for every function declared by the class, # starts a comment.
+ * Usage: -run=BlueluaBindings [-AllowList=Config/BlueluaBindings.txt] [-Output=Plugins/Bluelua/Source/Bluelua/Private/Generated/LuaGeneratedBindings.cpp] [-Name=Generated]
+ */
+UCLASS()
+class UBlueluaBindingsCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UBlueluaBindingsCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+protected:
+	bool ParseAllowList(const FString& AllowListFile, TArray<UFunction*>& OutFunctions) const;
+
+	// returns false with the reason if the function can't be called from generated code
+	bool CanGenerate(UFunction* Function, FString& OutReason) const;
+
+	FString GenerateBinding(UFunction* Function, TSet<FString>& OutIncludes, TSet<FString>& OutModules) const;
+	FString GenerateFile(const TArray<UFunction*>& Functions, const FString& AllowListFile, const FString& Name) const;
+};
@@ -14,4 +14,9 @@ public:
 
 protected:
 	void OnEndPIE(bool bIsSimulating);
+	void OnLuaFilesChanged(const TArray<struct FFileChangeData>& FileChanges);
+
+protected:
+	FString WatchingDirectory;
+	FDelegateHandle LuaFilesChangedHandle;
 };